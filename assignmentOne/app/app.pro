@@ -0,0 +1,31 @@
+TARGET = assignmentOne
+
+include(../core.pri)
+
+SOURCES += \
+    ../main.cpp \
+    ../startupprobe.cpp
+
+HEADERS += \
+    ../startupprobe.h
+
+win32 {
+    CONFIG(debug, debug|release): APP_BINARY = $$OUT_PWD/debug/$${TARGET}.exe
+    else: APP_BINARY = $$OUT_PWD/release/$${TARGET}.exe
+} else: macx {
+    APP_BINARY = $$OUT_PWD/$${TARGET}.app/Contents/MacOS/$$TARGET
+} else {
+    APP_BINARY = $$OUT_PWD/$$TARGET
+}
+
+# "make startupbench" starts the app on the offscreen platform and fails if
+# the first frame takes longer than STARTUP_BUDGET_MS to paint.
+STARTUP_BUDGET_MS = 300
+startupbench.commands = $$shell_quote($$shell_path($$APP_BINARY)) --startup-bench $$STARTUP_BUDGET_MS
+startupbench.depends = first
+QMAKE_EXTRA_TARGETS += startupbench
+
+# Default rules for deployment.
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
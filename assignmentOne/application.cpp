@@ -0,0 +1,37 @@
+#include "application.h"
+
+#include "eventprofiler.h"
+#include "trace.h"
+
+#include <QEvent>
+#include <QWidget>
+
+#include <chrono>
+
+Application::Application(int &argc, char **argv)
+    : QApplication(argc, argv)
+{
+}
+
+bool Application::notify(QObject *receiver, QEvent *event)
+{
+    TraceScope paintScope(event->type() == QEvent::Paint ? "QEvent::Paint" : nullptr);
+    if (!EventProfiler::isEnabled())
+        return QApplication::notify(receiver, event);
+
+    // The event may be deleted during delivery; read the type up front. A
+    // window's UpdateRequest paints every dirty widget in it and flushes
+    // the result, so that is one frame; the paint events it sends each
+    // widget are only counted as dispatch.
+    const int type = event->type();
+    const bool frame = type == QEvent::UpdateRequest && receiver->isWidgetType()
+            && static_cast<QWidget *>(receiver)->isWindow();
+    const auto start = std::chrono::steady_clock::now();
+    const bool result = QApplication::notify(receiver, event);
+    const quint64 nsecs = quint64(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                          std::chrono::steady_clock::now() - start).count());
+    EventProfiler::recordEvent(type, nsecs);
+    if (frame)
+        EventProfiler::recordPaint(nsecs);
+    return result;
+}
@@ -0,0 +1,17 @@
+#ifndef APPLICATION_H
+#define APPLICATION_H
+
+#include <QApplication>
+
+// QApplication that times every event it delivers for EventProfiler.
+class Application : public QApplication
+{
+    Q_OBJECT
+
+public:
+    Application(int &argc, char **argv);
+
+    bool notify(QObject *receiver, QEvent *event) override;
+};
+
+#endif // APPLICATION_H
@@ -0,0 +1,394 @@
+#include "batch.h"
+
+#include "columncache.h"
+#include "columnstats.h"
+#include "columnstore.h"
+#include "csvsource.h"
+#include "mappedtextfile.h"
+#include "sortfilterproxy.h"
+#include "taskengine.h"
+#include "trace.h"
+
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+
+#include <cmath>
+#include <functional>
+#include <vector>
+
+namespace {
+
+// Each file already uses every core while it is parsed, filtered and
+// reduced; a second one in flight fills the gaps between those steps.
+const int FilesInFlight = 2;
+
+// The given rows of another source, in order.
+class RowSubset : public DataSource
+{
+public:
+    RowSubset(const QSharedPointer<DataSource> &source, const QSharedPointer<const std::vector<quint32>> &rows)
+        : m_source(source)
+        , m_rows(rows)
+    {
+    }
+
+    qint64 rowCount() const override { return qint64(m_rows->size()); }
+    int columnCount() const override { return m_source->columnCount(); }
+    QString columnName(int column) const override { return m_source->columnName(column); }
+
+    QString cellText(qint64 row, int column) const override
+    {
+        return m_source->cellText((*m_rows)[size_t(row)], column);
+    }
+
+    const char *rowData(qint64 row, qint64 *length) const override
+    {
+        return m_source->rowData((*m_rows)[size_t(row)], length);
+    }
+
+    QSharedPointer<DataSource> clone() const override
+    {
+        return QSharedPointer<DataSource>(new RowSubset(m_source->clone(), m_rows));
+    }
+
+private:
+    QSharedPointer<DataSource> m_source;
+    QSharedPointer<const std::vector<quint32>> m_rows;
+};
+
+struct FileResult
+{
+    QString fileName;
+    QString errorString;
+    // Rows in the file, and how many passed the filter.
+    qint64 rows = 0;
+    qint64 matched = 0;
+    double seconds = 0;
+    // Held only until the statistics are done.
+    QSharedPointer<ColumnStore> store;
+    int groupColumn = -1;
+    int valueColumn = -1;
+    QStringList columnNames;
+    QVector<ColumnStore::Type> columnTypes;
+    QVector<ColumnSummary> summaries;
+    QVector<GroupSummary> groups;
+};
+
+int findColumn(const QStringList &columnNames, const QString &name)
+{
+    for (int column = 0; column < columnNames.size(); ++column) {
+        if (columnNames.at(column).compare(name, Qt::CaseInsensitive) == 0)
+            return column;
+    }
+    return -1;
+}
+
+// Everything up to the statistics, on a worker thread: the same loading as
+// MainWindow::openFile() and the same filter as SortFilterProxy, then the
+// surviving rows parsed into columns.
+void loadFile(FileResult &result, const BatchOptions &options, TaskContext &context)
+{
+    TRACE_SCOPE("Batch::loadFile");
+    QSharedPointer<DataSource> source = ColumnCache::load(result.fileName, ColumnCache::cacheFileName(result.fileName),
+                                                          nullptr, &context);
+    if (!source) {
+        if (context.isCanceled())
+            return;
+        QSharedPointer<MappedTextFile> file(new MappedTextFile);
+        if (!file->open(result.fileName, &result.errorString, &context))
+            return;
+        source.reset(new CsvSource(file));
+    }
+    result.rows = source->rowCount();
+
+    for (int column = 0; column < source->columnCount(); ++column)
+        result.columnNames.append(source->columnName(column));
+    if (!options.groupBy.isEmpty()) {
+        result.groupColumn = findColumn(result.columnNames, options.groupBy);
+        if (result.groupColumn < 0) {
+            result.errorString = QStringLiteral("Unknown column: %1").arg(options.groupBy);
+            return;
+        }
+    }
+    if (!options.aggregate.isEmpty()) {
+        result.valueColumn = findColumn(result.columnNames, options.aggregate);
+        if (result.valueColumn < 0) {
+            result.errorString = QStringLiteral("Unknown column: %1").arg(options.aggregate);
+            return;
+        }
+    }
+    QVector<SortFilterProxy::Clause> clauses;
+    if (!SortFilterProxy::parseFilter(options.filter, result.columnNames, &clauses, &result.errorString))
+        return;
+
+    if (!clauses.isEmpty()) {
+        const QSharedPointer<const std::vector<quint32>> rows(
+                    new std::vector<quint32>(SortFilterProxy::filterRows(*source, clauses, context)));
+        source.reset(new RowSubset(source, rows));
+    }
+    if (context.isCanceled())
+        return;
+
+    // A cached store is already in columns; only filtered rows need parsing.
+    result.store = qSharedPointerDynamicCast<ColumnStore>(source);
+    if (!result.store)
+        result.store = ColumnStore::build(*source, &context);
+    if (!result.store)
+        return;
+    result.matched = result.store->rowCount();
+    for (int column = 0; column < result.store->columnCount(); ++column)
+        result.columnTypes.append(result.store->columnType(column));
+    if (result.valueColumn >= 0 && result.columnTypes.at(result.valueColumn) == ColumnStore::StringColumn) {
+        result.errorString = QStringLiteral("Column %1 is not numeric").arg(options.aggregate);
+        result.store.reset();
+    }
+}
+
+QString typeName(ColumnStore::Type type)
+{
+    switch (type) {
+    case ColumnStore::Int64Column: return QStringLiteral("int64");
+    case ColumnStore::DoubleColumn: return QStringLiteral("double");
+    case ColumnStore::StringColumn: return QStringLiteral("string");
+    }
+    return QString();
+}
+
+QByteArray csvField(const QString &text)
+{
+    QByteArray field = text.toUtf8();
+    if (field.contains(',') || field.contains('"') || field.contains('\n') || field.contains('\r'))
+        field = '"' + field.replace('"', "\"\"") + '"';
+    return field;
+}
+
+// Empty for the infinities and NaNs of empty Moments.
+QByteArray csvNumber(double value)
+{
+    return std::isfinite(value) ? QByteArray::number(value, 'g', 10) : QByteArray();
+}
+
+QJsonValue jsonNumber(double value)
+{
+    return std::isfinite(value) ? QJsonValue(value) : QJsonValue();
+}
+
+QByteArray toCsv(const QVector<QSharedPointer<FileResult>> &results, bool grouped)
+{
+    QByteArray csv(grouped ? "file,group,rows,count,min,max,mean,stddev,sum\n"
+                           : "file,column,type,rows,nulls,count,min,max,mean,stddev,p50,p90,p99,distinct,most_frequent\n");
+    for (const QSharedPointer<FileResult> &result : results) {
+        if (!result->errorString.isEmpty())
+            continue;
+        const QByteArray file = csvField(result->fileName);
+        if (grouped) {
+            const bool values = result->valueColumn >= 0;
+            for (const GroupSummary &group : qAsConst(result->groups)) {
+                const Moments &m = group.values;
+                csv += file + ',' + csvField(group.key) + ',' + QByteArray::number(group.rows) + ',';
+                if (values) {
+                    csv += QByteArray::number(m.count) + ',' + csvNumber(m.min) + ',' + csvNumber(m.max) + ','
+                            + (m.count ? csvNumber(m.mean) : QByteArray()) + ','
+                            + (m.count ? csvNumber(m.standardDeviation()) : QByteArray()) + ','
+                            + csvNumber(m.sum());
+                } else {
+                    csv += ",,,,,";
+                }
+                csv += '\n';
+            }
+            continue;
+        }
+        for (int column = 0; column < result->summaries.size(); ++column) {
+            const ColumnSummary &s = result->summaries.at(column);
+            const ColumnStore::Type type = result->columnTypes.at(column);
+            csv += file + ',' + csvField(result->columnNames.at(column)) + ',' + typeName(type).toUtf8() + ','
+                    + QByteArray::number(s.rows) + ',' + QByteArray::number(s.nulls) + ',';
+            if (type == ColumnStore::StringColumn) {
+                csv += QByteArray::number(s.rows - s.nulls) + ",,,,,,,," + QByteArray::number(s.distinct) + ','
+                        + csvField(s.mostFrequent);
+            } else {
+                const Moments &m = s.moments;
+                csv += QByteArray::number(m.count) + ',' + csvNumber(m.min) + ',' + csvNumber(m.max) + ','
+                        + (m.count ? csvNumber(m.mean) : QByteArray()) + ','
+                        + (m.count ? csvNumber(m.standardDeviation()) : QByteArray()) + ','
+                        + csvNumber(s.quantiles.quantile(0.5)) + ',' + csvNumber(s.quantiles.quantile(0.9)) + ','
+                        + csvNumber(s.quantiles.quantile(0.99)) + ",,";
+            }
+            csv += '\n';
+        }
+    }
+    return csv;
+}
+
+QJsonObject toJson(const Moments &m)
+{
+    return QJsonObject {
+        { QStringLiteral("count"), m.count },
+        { QStringLiteral("min"), jsonNumber(m.min) },
+        { QStringLiteral("max"), jsonNumber(m.max) },
+        { QStringLiteral("mean"), m.count ? jsonNumber(m.mean) : QJsonValue() },
+        { QStringLiteral("stddev"), m.count ? jsonNumber(m.standardDeviation()) : QJsonValue() },
+        { QStringLiteral("sum"), jsonNumber(m.sum()) },
+    };
+}
+
+QByteArray toJson(const QVector<QSharedPointer<FileResult>> &results)
+{
+    QJsonArray files;
+    for (const QSharedPointer<FileResult> &result : results) {
+        QJsonObject file {
+            { QStringLiteral("file"), result->fileName },
+        };
+        if (!result->errorString.isEmpty()) {
+            file.insert(QStringLiteral("error"), result->errorString);
+            files.append(file);
+            continue;
+        }
+        file.insert(QStringLiteral("rows"), result->rows);
+        file.insert(QStringLiteral("matched"), result->matched);
+        file.insert(QStringLiteral("seconds"), result->seconds);
+
+        if (result->groupColumn >= 0) {
+            QJsonArray groups;
+            for (const GroupSummary &group : qAsConst(result->groups)) {
+                QJsonObject object {
+                    { QStringLiteral("key"), group.key },
+                    { QStringLiteral("rows"), group.rows },
+                };
+                if (result->valueColumn >= 0)
+                    object.insert(QStringLiteral("values"), toJson(group.values));
+                groups.append(object);
+            }
+            file.insert(QStringLiteral("groupBy"), result->columnNames.at(result->groupColumn));
+            if (result->valueColumn >= 0)
+                file.insert(QStringLiteral("aggregate"), result->columnNames.at(result->valueColumn));
+            file.insert(QStringLiteral("groups"), groups);
+        } else {
+            QJsonArray columns;
+            for (int column = 0; column < result->summaries.size(); ++column) {
+                const ColumnSummary &s = result->summaries.at(column);
+                const ColumnStore::Type type = result->columnTypes.at(column);
+                QJsonObject object {
+                    { QStringLiteral("name"), result->columnNames.at(column) },
+                    { QStringLiteral("type"), typeName(type) },
+                    { QStringLiteral("rows"), s.rows },
+                    { QStringLiteral("nulls"), s.nulls },
+                };
+                if (type == ColumnStore::StringColumn) {
+                    object.insert(QStringLiteral("distinct"), s.distinct);
+                    object.insert(QStringLiteral("mostFrequent"), s.mostFrequent);
+                    object.insert(QStringLiteral("mostFrequentCount"), s.mostFrequentCount);
+                } else {
+                    object.insert(QStringLiteral("values"), toJson(s.moments));
+                    object.insert(QStringLiteral("p50"), jsonNumber(s.quantiles.quantile(0.5)));
+                    object.insert(QStringLiteral("p90"), jsonNumber(s.quantiles.quantile(0.9)));
+                    object.insert(QStringLiteral("p99"), jsonNumber(s.quantiles.quantile(0.99)));
+                }
+                columns.append(object);
+            }
+            file.insert(QStringLiteral("columns"), columns);
+        }
+        files.append(file);
+    }
+    return QJsonDocument(QJsonObject { { QStringLiteral("files"), files } }).toJson();
+}
+
+}
+
+int runBatch(const BatchOptions &options)
+{
+    QTextStream err(stderr);
+    const QString format = options.format.isEmpty() ? QStringLiteral("csv") : options.format;
+    if (format != QLatin1String("csv") && format != QLatin1String("json")) {
+        err << "unknown batch format: " << format << Qt::endl;
+        return 1;
+    }
+    if (options.files.isEmpty()) {
+        err << "no files given" << Qt::endl;
+        return 1;
+    }
+    if (!options.aggregate.isEmpty() && options.groupBy.isEmpty()) {
+        err << "--aggregate needs --group-by" << Qt::endl;
+        return 1;
+    }
+    // Checked before any work, so a typo does not cost a night's run.
+    QFile out;
+    if (options.outputFile.isEmpty()) {
+        out.open(stdout, QIODevice::WriteOnly);
+    } else {
+        out.setFileName(options.outputFile);
+        if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            err << "could not write " << options.outputFile << ": " << out.errorString() << Qt::endl;
+            return 1;
+        }
+    }
+
+    TaskEngine tasks;
+    QEventLoop loop;
+    QVector<QSharedPointer<FileResult>> results;
+    int running = 0;
+    std::function<void()> startFiles;
+
+    const auto fileDone = [&](const QSharedPointer<FileResult> &result, const QElapsedTimer &timer) {
+        result->seconds = timer.nsecsElapsed() / 1e9;
+        result->store.reset();
+        if (result->errorString.isEmpty()) {
+            err << result->fileName << ": " << result->matched << " of " << result->rows << " rows in "
+                << QString::number(result->seconds, 'f', 3) << " s" << Qt::endl;
+        } else {
+            err << result->fileName << ": " << result->errorString << Qt::endl;
+        }
+        --running;
+        startFiles();
+    };
+
+    startFiles = [&] {
+        while (running < FilesInFlight && results.size() < options.files.size()) {
+            const QSharedPointer<FileResult> result(new FileResult);
+            result->fileName = options.files.at(results.size());
+            results.append(result);
+            ++running;
+
+            QElapsedTimer timer;
+            timer.start();
+            Task *task = tasks.start(QStringLiteral("Loading %1").arg(result->fileName), Task::NormalPriority,
+                                     [result, &options](TaskContext &context) {
+                loadFile(*result, options, context);
+            });
+            QObject::connect(task, &Task::finished, &loop, [&, result, timer] {
+                if (!result->store) {
+                    if (result->errorString.isEmpty())
+                        result->errorString = QStringLiteral("Canceled");
+                    fileDone(result, timer);
+                    return;
+                }
+                ColumnStatistics *statistics = new ColumnStatistics(&tasks);
+                QObject::connect(statistics, &ColumnStatistics::finished, &loop, [&, result, timer, statistics] {
+                    result->summaries = statistics->summaries();
+                    result->groups = statistics->groups();
+                    statistics->deleteLater();
+                    fileDone(result, timer);
+                });
+                statistics->start(result->store, result->groupColumn, result->valueColumn);
+            });
+        }
+        if (running == 0)
+            loop.quit();
+    };
+
+    startFiles();
+    loop.exec();
+
+    out.write(format == QLatin1String("csv") ? toCsv(results, !options.groupBy.isEmpty()) : toJson(results));
+    out.close();
+    for (const QSharedPointer<FileResult> &result : qAsConst(results)) {
+        if (!result->errorString.isEmpty())
+            return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,29 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <QStringList>
+
+struct BatchOptions
+{
+    QStringList files;
+    // A SortFilterProxy filter expression; empty keeps every row.
+    QString filter;
+    // Column whose values form the groups, and the numeric column
+    // aggregated per group. Without groupBy every column is summarized.
+    QString groupBy;
+    QString aggregate;
+    // "csv" (the default) or "json".
+    QString format;
+    // Results go here; stdout when empty.
+    QString outputFile;
+};
+
+// Headless analysis behind --batch, for servers: every file is loaded
+// (from its column cache when one is current), filtered and aggregated by
+// the same code the window uses, without creating any widgets. A few files
+// are processed at a time and every step fans out over all cores. Results
+// are written in the order the files were given; progress and errors go to
+// stderr. Returns non-zero if any file failed.
+int runBatch(const BatchOptions &options);
+
+#endif // BATCH_H
@@ -0,0 +1,491 @@
+#include "columncache.h"
+
+#include "columnstore.h"
+#include "taskengine.h"
+#include "trace.h"
+
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QThread>
+
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+namespace {
+
+const char Magic[8] = { 'P', 'N', 'C', 'O', 'L', 'S', '\r', '\n' };
+// Blocks that shrink less than this stay uncompressed; reading them back
+// is then a plain copy.
+const double MaxCompressedRatio = 0.875;
+const int CompressionLevel = 1;
+
+struct Header
+{
+    char magic[8];
+    quint32 version;
+    quint32 columnCount;
+    qint64 rows;
+    qint64 blockRows;
+    qint64 sourceSize;
+    qint64 sourceModified;
+    // Of the fields above; they size the arrays before any block is read.
+    quint32 checksum;
+    quint32 reserved;
+};
+
+struct BlockHeader
+{
+    quint32 rawSize;
+    quint32 storedSize;
+    quint32 checksum;
+    quint32 flags;
+};
+
+enum BlockFlag { CompressedBlock = 1 };
+
+QString tr(const char *text)
+{
+    return QCoreApplication::translate("ColumnCache", text);
+}
+
+quint32 crc32(const char *data, qint64 size)
+{
+    static const std::vector<quint32> table = [] {
+        std::vector<quint32> t(256);
+        for (quint32 i = 0; i < 256; ++i) {
+            quint32 c = i;
+            for (int k = 0; k < 8; ++k)
+                c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+    quint32 crc = 0xffffffffu;
+    for (qint64 i = 0; i < size; ++i)
+        crc = table[(crc ^ quint8(data[i])) & 0xff] ^ (crc >> 8);
+    return crc ^ 0xffffffffu;
+}
+
+quint32 headerChecksum(const Header &header)
+{
+    return crc32(reinterpret_cast<const char *>(&header), qint64(offsetof(Header, checksum)));
+}
+
+qint64 padded(qint64 size)
+{
+    return (size + 7) & ~qint64(7);
+}
+
+qint64 modifiedMs(const QFileInfo &info)
+{
+    return info.lastModified().toMSecsSinceEpoch();
+}
+
+// A block about to be written; data stays valid until it is.
+struct PendingBlock
+{
+    const char *data;
+    qint64 size;
+};
+
+struct PackedBlock
+{
+    BlockHeader header;
+    QByteArray compressed;
+};
+
+PackedBlock pack(const PendingBlock &block)
+{
+    PackedBlock packed;
+    packed.header.rawSize = quint32(block.size);
+    packed.header.flags = 0;
+    const QByteArray compressed = qCompress(reinterpret_cast<const uchar *>(block.data), block.size, CompressionLevel);
+    if (compressed.size() < block.size * MaxCompressedRatio) {
+        packed.compressed = compressed;
+        packed.header.flags = CompressedBlock;
+        packed.header.storedSize = quint32(compressed.size());
+        packed.header.checksum = crc32(compressed.constData(), compressed.size());
+    } else {
+        packed.header.storedSize = quint32(block.size);
+        packed.header.checksum = crc32(block.data, block.size);
+    }
+    return packed;
+}
+
+// A block found in a mapped cache and where its bytes belong. Name and
+// dictionary blocks are decoded into the column; the others are copied
+// to destination.
+struct FoundBlock
+{
+    enum Kind { Meta, Dictionary, Array };
+
+    Kind kind;
+    int column;
+    const BlockHeader *header;
+    const char *stored;
+    char *destination;
+    qint64 expectedSize;
+};
+
+// Checks and unpacks one block into out, which must hold expectedSize
+// bytes; -1 for expectedSize takes the block's own size into *buffer.
+bool unpack(const FoundBlock &block, char *out, QByteArray *buffer)
+{
+    const BlockHeader &header = *block.header;
+    if (crc32(block.stored, header.storedSize) != header.checksum)
+        return false;
+    if (block.expectedSize >= 0 && header.rawSize != quint64(block.expectedSize))
+        return false;
+    if (!out) {
+        buffer->resize(header.rawSize);
+        out = buffer->data();
+    }
+    if (header.flags & CompressedBlock) {
+        const QByteArray raw = qUncompress(reinterpret_cast<const uchar *>(block.stored), header.storedSize);
+        if (raw.size() != qint64(header.rawSize))
+            return false;
+        std::memcpy(out, raw.constData(), size_t(raw.size()));
+    } else {
+        if (header.storedSize != header.rawSize)
+            return false;
+        std::memcpy(out, block.stored, header.rawSize);
+    }
+    return true;
+}
+
+bool decodeDictionary(const QByteArray &bytes, QVector<QString> *dictionary)
+{
+    const char *p = bytes.constData();
+    const char *end = p + bytes.size();
+    quint32 count = 0;
+    if (end - p < qint64(sizeof(count)))
+        return false;
+    std::memcpy(&count, p, sizeof(count));
+    p += sizeof(count);
+    dictionary->reserve(int(qMin<quint64>(count, quint64(bytes.size()) / sizeof(quint32))));
+    for (quint32 i = 0; i < count; ++i) {
+        quint32 length = 0;
+        if (end - p < qint64(sizeof(length)))
+            return false;
+        std::memcpy(&length, p, sizeof(length));
+        p += sizeof(length);
+        if (end - p < qint64(length))
+            return false;
+        dictionary->append(QString::fromUtf8(p, int(length)));
+        p += length;
+    }
+    return p == end;
+}
+
+QByteArray encodeDictionary(const QVector<QString> &dictionary)
+{
+    QByteArray bytes;
+    const quint32 count = quint32(dictionary.size());
+    bytes.append(reinterpret_cast<const char *>(&count), sizeof(count));
+    for (const QString &text : dictionary) {
+        const QByteArray utf8 = text.toUtf8();
+        const quint32 length = quint32(utf8.size());
+        bytes.append(reinterpret_cast<const char *>(&length), sizeof(length));
+        bytes.append(utf8);
+    }
+    return bytes;
+}
+
+}
+
+QString ColumnCache::cacheFileName(const QString &sourceFile)
+{
+    const QString path = QFileInfo(sourceFile).canonicalFilePath();
+    const QByteArray key = QCryptographicHash::hash(path.toUtf8(), QCryptographicHash::Sha1).toHex();
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation)
+            + QStringLiteral("/columns/") + QString::fromLatin1(key) + QStringLiteral(".cols");
+}
+
+bool ColumnCache::save(const ColumnStore &store, const QString &sourceFile, const QString &cacheFile,
+                       QString *errorString, TaskContext *context)
+{
+    TRACE_SCOPE("ColumnCache::save");
+    const auto fail = [errorString](const QString &message) {
+        if (errorString)
+            *errorString = message;
+        return false;
+    };
+    const QFileInfo source(sourceFile);
+    if (!source.exists())
+        return fail(tr("%1 does not exist").arg(sourceFile));
+
+    const ColumnStore::Data &data = *store.m_data;
+    Header header;
+    std::memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = Version;
+    header.columnCount = quint32(data.columns.size());
+    header.rows = data.rows;
+    header.blockRows = BlockRows;
+    header.sourceSize = source.size();
+    header.sourceModified = modifiedMs(source);
+    header.reserved = 0;
+    header.checksum = headerChecksum(header);
+
+    // Everything after the header, in file order.
+    std::vector<QByteArray> owned;
+    owned.reserve(2 * data.columns.size());
+    std::vector<PendingBlock> blocks;
+    const qint64 blocksPerArray = (data.rows + BlockRows - 1) / BlockRows;
+    const qint64 validityWords = (data.rows + 63) / 64;
+    for (const ColumnStore::Column &column : data.columns) {
+        const quint32 type = column.type;
+        owned.push_back(QByteArray(reinterpret_cast<const char *>(&type), sizeof(type)) + column.name.toUtf8());
+        blocks.push_back({ owned.back().constData(), owned.back().size() });
+        if (column.type == ColumnStore::StringColumn) {
+            owned.push_back(encodeDictionary(column.dictionary));
+            if (owned.back().size() > std::numeric_limits<quint32>::max())
+                return fail(tr("The dictionary of %1 is too large to cache").arg(column.name));
+            blocks.push_back({ owned.back().constData(), owned.back().size() });
+        }
+        for (qint64 b = 0; b < blocksPerArray; ++b) {
+            const qint64 first = b * (BlockRows / 64);
+            blocks.push_back({ reinterpret_cast<const char *>(column.validity.data() + first),
+                               qint64(sizeof(quint64)) * (qMin(validityWords, first + BlockRows / 64) - first) });
+        }
+        const char *values = nullptr;
+        qint64 valueSize = 0;
+        switch (column.type) {
+        case ColumnStore::Int64Column:
+            values = reinterpret_cast<const char *>(column.ints.data());
+            valueSize = sizeof(qint64);
+            break;
+        case ColumnStore::DoubleColumn:
+            values = reinterpret_cast<const char *>(column.doubles.data());
+            valueSize = sizeof(double);
+            break;
+        case ColumnStore::StringColumn:
+            values = reinterpret_cast<const char *>(column.codes.data());
+            valueSize = sizeof(quint32);
+            break;
+        }
+        for (qint64 b = 0; b < blocksPerArray; ++b) {
+            const qint64 first = b * BlockRows;
+            blocks.push_back({ values + first * valueSize, valueSize * (qMin(data.rows, first + BlockRows) - first) });
+        }
+    }
+
+    QDir().mkpath(QFileInfo(cacheFile).absolutePath());
+    QSaveFile file(cacheFile);
+    if (!file.open(QIODevice::WriteOnly))
+        return fail(file.errorString());
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    if (context) {
+        qint64 total = 0;
+        for (const PendingBlock &block : blocks)
+            total += block.size;
+        context->setProgressRange(total);
+        context->setProgress(0);
+    }
+
+    // Compressed in batches on all cores, so only a batch is held at once.
+    const int batch = 2 * qMax(1, QThread::idealThreadCount());
+    std::vector<PackedBlock> packed(size_t(batch));
+    const char padding[8] = {};
+    for (size_t first = 0; first < blocks.size(); first += size_t(batch)) {
+        const qint64 count = qMin<qint64>(batch, qint64(blocks.size() - first));
+        TaskEngine::parallelFor(count, 1, [&blocks, &packed, first, context](qint64 begin, qint64 end) {
+            for (qint64 i = begin; i < end; ++i) {
+                packed[size_t(i)] = pack(blocks[first + size_t(i)]);
+                if (context)
+                    context->addProgress(blocks[first + size_t(i)].size);
+            }
+        }, context);
+        if (context && context->isCanceled()) {
+            file.cancelWriting();
+            return fail(tr("Canceled"));
+        }
+        for (qint64 i = 0; i < count; ++i) {
+            const PackedBlock &block = packed[size_t(i)];
+            file.write(reinterpret_cast<const char *>(&block.header), sizeof(block.header));
+            if (block.header.flags & CompressedBlock)
+                file.write(block.compressed);
+            else
+                file.write(blocks[first + size_t(i)].data, block.header.rawSize);
+            file.write(padding, padded(block.header.storedSize) - block.header.storedSize);
+        }
+    }
+    if (!file.commit())
+        return fail(file.errorString());
+    return true;
+}
+
+QSharedPointer<ColumnStore> ColumnCache::load(const QString &sourceFile, const QString &cacheFile,
+                                              QString *reason, TaskContext *context)
+{
+    TRACE_SCOPE("ColumnCache::load");
+    const auto fail = [reason](const QString &message) {
+        if (reason)
+            *reason = message;
+        return QSharedPointer<ColumnStore>();
+    };
+    QFile file(cacheFile);
+    if (!file.exists())
+        return fail(tr("no cache"));
+    if (!file.open(QIODevice::ReadOnly))
+        return fail(file.errorString());
+    const qint64 size = file.size();
+    if (size < qint64(sizeof(Header)))
+        return fail(tr("cache truncated"));
+    const char *base = reinterpret_cast<const char *>(file.map(0, size));
+    if (!base)
+        return fail(file.errorString());
+
+    // Closing unmaps; the next save writes a fresh cache.
+    const auto damaged = [&file, &fail] {
+        file.close();
+        file.remove();
+        return fail(tr("cache damaged"));
+    };
+
+    Header header;
+    std::memcpy(&header, base, sizeof(header));
+    if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0 || header.version != Version
+            || header.blockRows != BlockRows)
+        return fail(tr("cache from another version"));
+    if (header.checksum != headerChecksum(header) || header.rows < 0)
+        return damaged();
+    // Every column takes a meta block and a validity and a value block per
+    // BlockRows rows, each at least a block header; a header asking for
+    // more than the file can hold would only make the arrays fail to fit.
+    const qint64 available = (size - qint64(sizeof(Header))) / qint64(sizeof(BlockHeader));
+    if (header.rows / BlockRows > available)
+        return damaged();
+    const qint64 blocksPerColumn = 1 + 2 * ((header.rows + BlockRows - 1) / BlockRows);
+    if (header.columnCount > 0 && blocksPerColumn > available / qint64(header.columnCount))
+        return damaged();
+    const QFileInfo source(sourceFile);
+    if (header.sourceSize != source.size() || header.sourceModified != modifiedMs(source))
+        return fail(tr("file changed since it was cached"));
+
+    // Locate every block first; all of them are unpacked in parallel.
+    const QSharedPointer<ColumnStore::Data> data(new ColumnStore::Data);
+    data->rows = header.rows;
+    data->columns.resize(header.columnCount);
+    const qint64 blocksPerArray = (data->rows + BlockRows - 1) / BlockRows;
+    const qint64 validityWords = (data->rows + 63) / 64;
+    std::vector<FoundBlock> found;
+    qint64 position = sizeof(Header);
+    const auto next = [&](FoundBlock::Kind kind, int column, char *destination, qint64 expectedSize) {
+        if (size - position < qint64(sizeof(BlockHeader)))
+            return false;
+        const BlockHeader *block = reinterpret_cast<const BlockHeader *>(base + position);
+        const qint64 stored = position + qint64(sizeof(BlockHeader));
+        if (size - stored < qint64(block->storedSize))
+            return false;
+        found.push_back({ kind, column, block, base + stored, destination, expectedSize });
+        position = stored + padded(block->storedSize);
+        return true;
+    };
+
+    for (quint32 c = 0; c < header.columnCount; ++c) {
+        if (!next(FoundBlock::Meta, int(c), nullptr, -1))
+            return damaged();
+        // The type decides what follows, so this block is read right away.
+        QByteArray meta;
+        quint32 type = 0;
+        if (!unpack(found.back(), nullptr, &meta) || meta.size() < qint64(sizeof(type)))
+            return damaged();
+        found.pop_back();
+        std::memcpy(&type, meta.constData(), sizeof(type));
+        if (type > ColumnStore::StringColumn)
+            return damaged();
+
+        ColumnStore::Column &column = data->columns[c];
+        column.type = ColumnStore::Type(type);
+        column.name = QString::fromUtf8(meta.constData() + sizeof(type), int(meta.size() - qint64(sizeof(type))));
+        column.validity.resize(size_t(validityWords));
+        char *values = nullptr;
+        qint64 valueSize = 0;
+        switch (column.type) {
+        case ColumnStore::Int64Column:
+            column.ints.resize(size_t(data->rows));
+            values = reinterpret_cast<char *>(column.ints.data());
+            valueSize = sizeof(qint64);
+            break;
+        case ColumnStore::DoubleColumn:
+            column.doubles.resize(size_t(data->rows));
+            values = reinterpret_cast<char *>(column.doubles.data());
+            valueSize = sizeof(double);
+            break;
+        case ColumnStore::StringColumn:
+            column.codes.resize(size_t(data->rows));
+            values = reinterpret_cast<char *>(column.codes.data());
+            valueSize = sizeof(quint32);
+            if (!next(FoundBlock::Dictionary, int(c), nullptr, -1))
+                return damaged();
+            break;
+        }
+        for (qint64 b = 0; b < blocksPerArray; ++b) {
+            const qint64 first = b * (BlockRows / 64);
+            const qint64 words = qMin(validityWords, first + BlockRows / 64) - first;
+            if (!next(FoundBlock::Array, int(c), reinterpret_cast<char *>(column.validity.data() + first),
+                      words * qint64(sizeof(quint64))))
+                return damaged();
+        }
+        for (qint64 b = 0; b < blocksPerArray; ++b) {
+            const qint64 first = b * BlockRows;
+            if (!next(FoundBlock::Array, int(c), values + first * valueSize,
+                      valueSize * (qMin(data->rows, first + BlockRows) - first)))
+                return damaged();
+        }
+    }
+
+    if (context) {
+        context->setProgressRange(qint64(found.size()));
+        context->setProgress(0);
+    }
+    std::atomic<bool> ok { true };
+    TaskEngine::parallelFor(qint64(found.size()), 1, [&found, &data, &ok, context](qint64 begin, qint64 end) {
+        for (qint64 i = begin; i < end && ok.load(std::memory_order_relaxed); ++i) {
+            const FoundBlock &block = found[size_t(i)];
+            if (block.kind == FoundBlock::Dictionary) {
+                QByteArray bytes;
+                if (!unpack(block, nullptr, &bytes)
+                        || !decodeDictionary(bytes, &data->columns[size_t(block.column)].dictionary))
+                    ok = false;
+            } else if (!unpack(block, block.destination, nullptr)) {
+                ok = false;
+            }
+            if (context)
+                context->addProgress(1);
+        }
+    }, context);
+    if (context && context->isCanceled())
+        return fail(tr("Canceled"));
+    if (!ok)
+        return damaged();
+
+    // Codes must index their dictionary; anything else means the file
+    // was not written by save().
+    for (const ColumnStore::Column &column : data->columns) {
+        if (column.type != ColumnStore::StringColumn)
+            continue;
+        const quint32 limit = quint32(column.dictionary.size());
+        TaskEngine::parallelFor(data->rows, BlockRows, [&column, &ok, limit](qint64 begin, qint64 end) {
+            for (qint64 row = begin; row < end; ++row) {
+                if (column.codes[size_t(row)] >= limit && (column.validity[size_t(row / 64)] >> (row % 64) & 1)) {
+                    ok = false;
+                    return;
+                }
+            }
+        });
+    }
+    if (!ok)
+        return damaged();
+    return QSharedPointer<ColumnStore>(new ColumnStore(data));
+}
@@ -0,0 +1,40 @@
+#ifndef COLUMNCACHE_H
+#define COLUMNCACHE_H
+
+#include <QSharedPointer>
+#include <QString>
+
+class ColumnStore;
+class TaskContext;
+
+// A ColumnStore saved to disk: one binary file per source file in the
+// user's cache directory, tied to the source's size and modification
+// time. Each column's arrays are stored in blocks of BlockRows rows; every
+// block has a CRC-32 and is zlib-compressed when that saves enough.
+// Loading maps the file and unpacks all blocks in parallel, which is much
+// faster than parsing the text again.
+//
+// Layout, native byte order: a header with its own CRC-32, then per column
+// a block with its type and UTF-8 name, for text a dictionary block, then
+// its validity blocks and its value blocks. Each block is a small header followed by
+// the stored bytes, padded to 8 bytes.
+class ColumnCache
+{
+public:
+    static const quint32 Version = 2;
+    static const qint64 BlockRows = 1 << 20;
+
+    // Where the cache for sourceFile lives.
+    static QString cacheFileName(const QString &sourceFile);
+
+    // Writes store, parsed from sourceFile, to cacheFile. The file is
+    // replaced atomically, so a reader never sees it half written.
+    static bool save(const ColumnStore &store, const QString &sourceFile, const QString &cacheFile,
+                     QString *errorString = nullptr, TaskContext *context = nullptr);
+    // Null if cacheFile is missing, older than sourceFile or damaged; reason
+    // then says which. A damaged cache is removed.
+    static QSharedPointer<ColumnStore> load(const QString &sourceFile, const QString &cacheFile,
+                                            QString *reason = nullptr, TaskContext *context = nullptr);
+};
+
+#endif // COLUMNCACHE_H
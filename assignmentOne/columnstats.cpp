@@ -0,0 +1,525 @@
+#include "columnstats.h"
+
+#include "columnstore.h"
+#include "taskengine.h"
+#include "trace.h"
+
+#include <QLocale>
+#include <QMutex>
+#include <QtAlgorithms>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <type_traits>
+#include <unordered_map>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#  include <emmintrin.h>
+#  define COLUMNSTATS_SSE2
+#endif
+
+namespace {
+
+// Tables do not need to refresh faster than this to look live.
+const int PollIntervalMs = 100;
+const double Gamma = (1 + QuantileSketch::RelativeAccuracy) / (1 - QuantileSketch::RelativeAccuracy);
+const double SmallestMagnitude = 1e-12;
+// Finite doubles stay within about 36000 buckets of gamma for 1%; the
+// bound only keeps a stray magnitude from asking for gigabytes of them.
+const int MaxBucket = 1 << 16;
+
+struct Group
+{
+    qint64 rows = 0;
+    Moments values;
+};
+
+inline void addValue(Moments *moments, double value)
+{
+    // Welford's update.
+    ++moments->count;
+    const double delta = value - moments->mean;
+    moments->mean += delta / moments->count;
+    moments->m2 += delta * (value - moments->mean);
+    moments->min = qMin(moments->min, value);
+    moments->max = qMax(moments->max, value);
+}
+
+inline quint64 validBits(const quint64 *validity, qint64 word, qint64 end)
+{
+    const qint64 rowsLeft = end - word * 64;
+    return rowsLeft >= 64 ? validity[word] : validity[word] & ((quint64(1) << rowsLeft) - 1);
+}
+
+inline int lowestBit(quint64 v)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(v);
+#else
+    int n = 0;
+    while (!(v & 1u)) {
+        v >>= 1;
+        ++n;
+    }
+    return n;
+#endif
+}
+
+// Moments and quantiles of the valid values in [begin, end); begin is a
+// multiple of 64. Two passes over the chunk, which is still in cache for
+// the second: sum and extremes first, then squared deviations from the
+// chunk mean, which is more accurate than a running update.
+template <typename T>
+void reduceChunk(const T *values, const quint64 *validity, qint64 begin, qint64 end,
+                 Moments *moments, QuantileSketch *sketch)
+{
+    double sum = 0;
+    double min = std::numeric_limits<double>::infinity();
+    double max = -std::numeric_limits<double>::infinity();
+    qint64 count = 0;
+    for (qint64 word = begin / 64; word * 64 < end; ++word) {
+        quint64 bits = validBits(validity, word, end);
+        const qint64 base = word * 64;
+#ifdef COLUMNSTATS_SSE2
+        if (std::is_same<T, double>::value && bits == ~quint64(0)) {
+            const double *v = reinterpret_cast<const double *>(values + base);
+            __m128d sums = _mm_setzero_pd();
+            __m128d mins = _mm_set1_pd(min);
+            __m128d maxs = _mm_set1_pd(max);
+            for (int i = 0; i < 64; i += 2) {
+                const __m128d x = _mm_loadu_pd(v + i);
+                sums = _mm_add_pd(sums, x);
+                mins = _mm_min_pd(mins, x);
+                maxs = _mm_max_pd(maxs, x);
+            }
+            double lanes[2];
+            _mm_storeu_pd(lanes, sums);
+            sum += lanes[0] + lanes[1];
+            _mm_storeu_pd(lanes, mins);
+            min = qMin(lanes[0], lanes[1]);
+            _mm_storeu_pd(lanes, maxs);
+            max = qMax(lanes[0], lanes[1]);
+            count += 64;
+            continue;
+        }
+#endif
+        while (bits) {
+            const double x = double(values[base + lowestBit(bits)]);
+            sum += x;
+            min = qMin(min, x);
+            max = qMax(max, x);
+            ++count;
+            bits &= bits - 1;
+        }
+    }
+    if (count == 0)
+        return;
+
+    const double mean = sum / count;
+    double m2 = 0;
+    for (qint64 word = begin / 64; word * 64 < end; ++word) {
+        quint64 bits = validBits(validity, word, end);
+        const qint64 base = word * 64;
+#ifdef COLUMNSTATS_SSE2
+        if (std::is_same<T, double>::value && bits == ~quint64(0)) {
+            const double *v = reinterpret_cast<const double *>(values + base);
+            const __m128d means = _mm_set1_pd(mean);
+            __m128d squares = _mm_setzero_pd();
+            for (int i = 0; i < 64; i += 2) {
+                const __m128d d = _mm_sub_pd(_mm_loadu_pd(v + i), means);
+                squares = _mm_add_pd(squares, _mm_mul_pd(d, d));
+                sketch->add(v[i]);
+                sketch->add(v[i + 1]);
+            }
+            double lanes[2];
+            _mm_storeu_pd(lanes, squares);
+            m2 += lanes[0] + lanes[1];
+            continue;
+        }
+#endif
+        while (bits) {
+            const double x = double(values[base + lowestBit(bits)]);
+            m2 += (x - mean) * (x - mean);
+            sketch->add(x);
+            bits &= bits - 1;
+        }
+    }
+
+    Moments chunk;
+    chunk.count = count;
+    chunk.mean = mean;
+    chunk.m2 = m2;
+    chunk.min = min;
+    chunk.max = max;
+    moments->merge(chunk);
+}
+
+qint64 keyOf(const ColumnStore &store, int column, qint64 row)
+{
+    switch (store.columnType(column)) {
+    case ColumnStore::Int64Column:
+        return store.int64Values(column)[row];
+    case ColumnStore::DoubleColumn: {
+        // Grouped by exact value; -0.0 joins 0.0.
+        const double value = store.doubleValues(column)[row] + 0.0;
+        qint64 bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+    case ColumnStore::StringColumn:
+        return store.stringCodes(column)[row];
+    }
+    return 0;
+}
+
+QString keyText(const ColumnStore &store, int column, qint64 key)
+{
+    switch (store.columnType(column)) {
+    case ColumnStore::Int64Column:
+        return QString::number(key);
+    case ColumnStore::DoubleColumn: {
+        double value;
+        std::memcpy(&value, &key, sizeof(value));
+        return QString::number(value, 'g', QLocale::FloatingPointShortest);
+    }
+    case ColumnStore::StringColumn:
+        return store.dictionary(column).at(int(key));
+    }
+    return QString();
+}
+
+double valueAt(const ColumnStore &store, int column, qint64 row)
+{
+    return store.columnType(column) == ColumnStore::Int64Column ? double(store.int64Values(column)[row])
+                                                                : store.doubleValues(column)[row];
+}
+
+}
+
+void Moments::merge(const Moments &other)
+{
+    if (other.count == 0)
+        return;
+    if (count == 0) {
+        *this = other;
+        return;
+    }
+    const qint64 total = count + other.count;
+    const double delta = other.mean - mean;
+    mean += delta * other.count / total;
+    m2 += other.m2 + delta * delta * (double(count) * other.count / total);
+    count = total;
+    min = qMin(min, other.min);
+    max = qMax(max, other.max);
+}
+
+double Moments::standardDeviation() const
+{
+    return count > 1 ? std::sqrt(m2 / (count - 1)) : 0.0;
+}
+
+void QuantileSketch::Buckets::add(int index, qint64 count)
+{
+    if (counts.empty()) {
+        offset = index;
+        counts.assign(1, count);
+        return;
+    }
+    if (index < offset) {
+        counts.insert(counts.begin(), size_t(offset - index), 0);
+        offset = index;
+    } else if (index - offset >= int(counts.size())) {
+        counts.resize(size_t(index - offset + 1), 0);
+    }
+    counts[size_t(index - offset)] += count;
+}
+
+int QuantileSketch::bucketOf(double magnitude)
+{
+    static const double logGamma = std::log(Gamma);
+    const double bucket = std::ceil(std::log(magnitude) / logGamma);
+    return bucket > MaxBucket ? MaxBucket : bucket < -MaxBucket ? -MaxBucket : int(bucket);
+}
+
+double QuantileSketch::valueOf(int bucket)
+{
+    // Bucket i holds (gamma^(i-1), gamma^i]; this point is within the
+    // relative accuracy of both ends.
+    return 2 * std::pow(Gamma, bucket) / (Gamma + 1);
+}
+
+void QuantileSketch::add(double value)
+{
+    // Infinities have no bucket; like NaN they are left out of the ranks.
+    if (!std::isfinite(value))
+        return;
+    ++m_count;
+    if (value > SmallestMagnitude)
+        m_positive.add(bucketOf(value), 1);
+    else if (value < -SmallestMagnitude)
+        m_negative.add(bucketOf(-value), 1);
+    else
+        ++m_zeros;
+}
+
+void QuantileSketch::merge(const QuantileSketch &other)
+{
+    for (size_t i = 0; i < other.m_positive.counts.size(); ++i) {
+        if (other.m_positive.counts[i])
+            m_positive.add(other.m_positive.offset + int(i), other.m_positive.counts[i]);
+    }
+    for (size_t i = 0; i < other.m_negative.counts.size(); ++i) {
+        if (other.m_negative.counts[i])
+            m_negative.add(other.m_negative.offset + int(i), other.m_negative.counts[i]);
+    }
+    m_zeros += other.m_zeros;
+    m_count += other.m_count;
+}
+
+double QuantileSketch::quantile(double q) const
+{
+    if (m_count == 0)
+        return std::numeric_limits<double>::quiet_NaN();
+    const qint64 rank = qint64(qBound(0.0, q, 1.0) * (m_count - 1));
+    qint64 seen = 0;
+    // Most negative values sit in the highest negative buckets.
+    for (size_t i = m_negative.counts.size(); i-- > 0;) {
+        seen += m_negative.counts[i];
+        if (seen > rank)
+            return -valueOf(m_negative.offset + int(i));
+    }
+    seen += m_zeros;
+    if (seen > rank)
+        return 0.0;
+    for (size_t i = 0; i < m_positive.counts.size(); ++i) {
+        seen += m_positive.counts[i];
+        if (seen > rank)
+            return valueOf(m_positive.offset + int(i));
+    }
+    return valueOf(m_positive.offset + int(m_positive.counts.size()) - 1);
+}
+
+struct ColumnStatistics::Results
+{
+    QSharedPointer<ColumnStore> store;
+    int groupColumn = -1;
+    int valueColumn = -1;
+    qint64 total = 0;
+    std::atomic<qint64> scanned { 0 };
+
+    mutable QMutex mutex;
+    QVector<ColumnSummary> summaries;
+    // Occurrences of each dictionary code, for text columns small enough.
+    std::vector<std::vector<qint64>> stringCounts;
+    std::unordered_map<qint64, Group> groups;
+    Group nullGroup;
+};
+
+ColumnStatistics::ColumnStatistics(TaskEngine *tasks, QObject *parent)
+    : QObject(parent)
+    , m_tasks(tasks)
+{
+    m_pollTimer.setInterval(PollIntervalMs);
+    connect(&m_pollTimer, &QTimer::timeout, this, &ColumnStatistics::resultsChanged);
+}
+
+ColumnStatistics::~ColumnStatistics()
+{
+    cancel();
+}
+
+void ColumnStatistics::start(const QSharedPointer<ColumnStore> &store, int groupColumn, int valueColumn)
+{
+    cancel();
+    m_results.reset(new Results);
+    if (!store) {
+        emit resultsChanged();
+        emit finished();
+        return;
+    }
+
+    const QSharedPointer<Results> results = m_results;
+    results->store = store;
+    results->total = store->rowCount();
+    const int columns = store->columnCount();
+    results->groupColumn = groupColumn >= 0 && groupColumn < columns ? groupColumn : -1;
+    results->valueColumn = results->groupColumn >= 0 && valueColumn >= 0 && valueColumn < columns
+            && store->columnType(valueColumn) != ColumnStore::StringColumn ? valueColumn : -1;
+    results->summaries.resize(columns);
+    results->stringCounts.resize(size_t(columns));
+    for (int c = 0; c < columns; ++c) {
+        if (store->columnType(c) != ColumnStore::StringColumn)
+            continue;
+        results->summaries[c].distinct = store->dictionary(c).size();
+        if (store->dictionary(c).size() <= MaxCountedStrings)
+            results->stringCounts[size_t(c)].assign(size_t(store->dictionary(c).size()), 0);
+    }
+
+    Task *task = m_tasks->start(tr("Computing statistics"), Task::NormalPriority, [results](TaskContext &context) {
+        context.setProgressRange(results->total);
+        TaskEngine::parallelFor(results->total, ChunkRows, [&results, &context](qint64 begin, qint64 end) {
+            TRACE_SCOPE("ColumnStatistics::reduceChunk");
+            const ColumnStore &store = *results->store;
+            const int columns = store.columnCount();
+            QVector<ColumnSummary> summaries(columns);
+            std::vector<std::vector<qint64>> stringCounts(size_t(columns));
+            for (int c = 0; c < columns; ++c) {
+                ColumnSummary &summary = summaries[c];
+                const quint64 *validity = store.validity(c);
+                qint64 valid = 0;
+                switch (store.columnType(c)) {
+                case ColumnStore::Int64Column:
+                    reduceChunk(store.int64Values(c), validity, begin, end, &summary.moments, &summary.quantiles);
+                    valid = summary.moments.count;
+                    break;
+                case ColumnStore::DoubleColumn:
+                    reduceChunk(store.doubleValues(c), validity, begin, end, &summary.moments, &summary.quantiles);
+                    valid = summary.moments.count;
+                    break;
+                case ColumnStore::StringColumn: {
+                    std::vector<qint64> &counts = stringCounts[size_t(c)];
+                    const bool counted = !results->stringCounts[size_t(c)].empty();
+                    if (counted)
+                        counts.assign(results->stringCounts[size_t(c)].size(), 0);
+                    const quint32 *codes = store.stringCodes(c);
+                    for (qint64 word = begin / 64; word * 64 < end; ++word) {
+                        quint64 bits = validBits(validity, word, end);
+                        valid += qPopulationCount(bits);
+                        while (counted && bits) {
+                            ++counts[codes[word * 64 + lowestBit(bits)]];
+                            bits &= bits - 1;
+                        }
+                    }
+                    break;
+                }
+                }
+                summary.rows = end - begin;
+                summary.nulls = summary.rows - valid;
+            }
+
+            std::unordered_map<qint64, Group> groups;
+            Group nullGroup;
+            if (results->groupColumn >= 0) {
+                const int key = results->groupColumn;
+                const int value = results->valueColumn;
+                for (qint64 row = begin; row < end; ++row) {
+                    Group &group = store.isNull(row, key) ? nullGroup : groups[keyOf(store, key, row)];
+                    ++group.rows;
+                    if (value >= 0 && !store.isNull(row, value))
+                        addValue(&group.values, valueAt(store, value, row));
+                }
+            }
+
+            {
+                QMutexLocker locker(&results->mutex);
+                for (int c = 0; c < columns; ++c) {
+                    ColumnSummary &summary = results->summaries[c];
+                    summary.rows += summaries[c].rows;
+                    summary.nulls += summaries[c].nulls;
+                    summary.moments.merge(summaries[c].moments);
+                    summary.quantiles.merge(summaries[c].quantiles);
+                    std::vector<qint64> &counts = results->stringCounts[size_t(c)];
+                    const std::vector<qint64> &chunkCounts = stringCounts[size_t(c)];
+                    for (size_t i = 0; i < chunkCounts.size(); ++i)
+                        counts[i] += chunkCounts[i];
+                }
+                for (const auto &entry : groups) {
+                    auto it = results->groups.find(entry.first);
+                    if (it == results->groups.end()) {
+                        if (results->groups.size() >= size_t(MaxGroups))
+                            continue;
+                        it = results->groups.emplace(entry.first, Group()).first;
+                    }
+                    it->second.rows += entry.second.rows;
+                    it->second.values.merge(entry.second.values);
+                }
+                results->nullGroup.rows += nullGroup.rows;
+                results->nullGroup.values.merge(nullGroup.values);
+            }
+            results->scanned.fetch_add(end - begin, std::memory_order_relaxed);
+            context.addProgress(end - begin);
+        }, &context);
+    });
+    m_task = task;
+    connect(task, &Task::finished, this, [this, task] {
+        if (task != m_task)
+            return;
+        m_pollTimer.stop();
+        emit resultsChanged();
+        emit finished();
+    });
+    m_pollTimer.start();
+}
+
+void ColumnStatistics::cancel()
+{
+    if (m_task) {
+        m_task->cancel();
+        m_task = nullptr;
+    }
+    m_pollTimer.stop();
+}
+
+bool ColumnStatistics::isRunning() const
+{
+    return !m_task.isNull();
+}
+
+qint64 ColumnStatistics::scannedRows() const
+{
+    return m_results ? m_results->scanned.load(std::memory_order_relaxed) : 0;
+}
+
+qint64 ColumnStatistics::totalRows() const
+{
+    return m_results ? m_results->total : 0;
+}
+
+QVector<ColumnSummary> ColumnStatistics::summaries() const
+{
+    if (!m_results)
+        return QVector<ColumnSummary>();
+    QMutexLocker locker(&m_results->mutex);
+    QVector<ColumnSummary> summaries = m_results->summaries;
+    for (int c = 0; c < summaries.size(); ++c) {
+        const std::vector<qint64> &counts = m_results->stringCounts[size_t(c)];
+        const auto top = std::max_element(counts.begin(), counts.end());
+        if (top != counts.end() && *top > 0) {
+            summaries[c].mostFrequent = m_results->store->dictionary(c).at(int(top - counts.begin()));
+            summaries[c].mostFrequentCount = *top;
+        }
+    }
+    return summaries;
+}
+
+QVector<GroupSummary> ColumnStatistics::groups() const
+{
+    QVector<GroupSummary> groups;
+    if (!m_results || m_results->groupColumn < 0)
+        return groups;
+    QMutexLocker locker(&m_results->mutex);
+    const ColumnStore &store = *m_results->store;
+    groups.reserve(int(m_results->groups.size()) + 1);
+    for (const auto &entry : m_results->groups) {
+        GroupSummary group;
+        group.key = keyText(store, m_results->groupColumn, entry.first);
+        group.rows = entry.second.rows;
+        group.values = entry.second.values;
+        groups.append(group);
+    }
+    if (m_results->nullGroup.rows > 0) {
+        GroupSummary group;
+        group.key = tr("(empty)");
+        group.rows = m_results->nullGroup.rows;
+        group.values = m_results->nullGroup.values;
+        groups.append(group);
+    }
+    locker.unlock();
+
+    std::sort(groups.begin(), groups.end(), [](const GroupSummary &a, const GroupSummary &b) {
+        return a.rows != b.rows ? a.rows > b.rows : a.key < b.key;
+    });
+    return groups;
+}
@@ -0,0 +1,136 @@
+#ifndef COLUMNSTATS_H
+#define COLUMNSTATS_H
+
+#include <QObject>
+#include <QPointer>
+#include <QSharedPointer>
+#include <QTimer>
+
+#include <limits>
+#include <vector>
+
+class ColumnStore;
+class Task;
+class TaskEngine;
+
+// Count, extremes, mean and variance of a set of values. Partial results
+// from separate chunks merge exactly (Chan et al.), in any order.
+struct Moments
+{
+    qint64 count = 0;
+    double mean = 0;
+    double m2 = 0;
+    double min = std::numeric_limits<double>::infinity();
+    double max = -std::numeric_limits<double>::infinity();
+
+    void merge(const Moments &other);
+    double sum() const { return mean * count; }
+    double standardDeviation() const;
+};
+
+// Mergeable quantile estimate with bounded relative error: values fall
+// into logarithmically sized buckets, so any quantile is reported within
+// RelativeAccuracy of a value that really is at that rank. NaN and
+// infinities are not added.
+class QuantileSketch
+{
+public:
+    static constexpr double RelativeAccuracy = 0.01;
+
+    void add(double value);
+    void merge(const QuantileSketch &other);
+    qint64 count() const { return m_count; }
+    // NaN when empty.
+    double quantile(double q) const;
+
+private:
+    struct Buckets
+    {
+        int offset = 0;
+        std::vector<qint64> counts;
+
+        void add(int index, qint64 count);
+    };
+
+    static int bucketOf(double magnitude);
+    static double valueOf(int bucket);
+
+    Buckets m_positive;
+    Buckets m_negative;
+    qint64 m_zeros = 0;
+    qint64 m_count = 0;
+};
+
+struct ColumnSummary
+{
+    // Rows merged so far, and how many of them are empty.
+    qint64 rows = 0;
+    qint64 nulls = 0;
+    // Numeric columns; count is the number of non-null cells.
+    Moments moments;
+    QuantileSketch quantiles;
+    // Text columns.
+    qint64 distinct = 0;
+    QString mostFrequent;
+    qint64 mostFrequentCount = 0;
+};
+
+struct GroupSummary
+{
+    QString key;
+    qint64 rows = 0;
+    // Over the non-null values of the aggregated column.
+    Moments values;
+};
+
+// Summary statistics of every column of a ColumnStore and, optionally, an
+// aggregation of one column grouped by the values of another. Row chunks
+// are reduced on every core, with SSE2 over fully valid runs of doubles;
+// partial results are merged as chunks finish and can be read at any time,
+// so a view can show them filling in.
+class ColumnStatistics : public QObject
+{
+    Q_OBJECT
+
+public:
+    static const int ChunkRows = 1 << 16;
+    // Beyond this many distinct strings the most frequent one is not
+    // tracked, since every chunk would need a counter per string.
+    static const int MaxCountedStrings = 1 << 16;
+    // Grouping by a mostly unique column would only rebuild the column;
+    // keys first seen after this many are left out.
+    static const int MaxGroups = 100000;
+
+    explicit ColumnStatistics(TaskEngine *tasks, QObject *parent = nullptr);
+    ~ColumnStatistics() override;
+
+    // Cancels any running computation. groupColumn -1 skips grouping;
+    // valueColumn -1 only counts the rows of each group.
+    void start(const QSharedPointer<ColumnStore> &store, int groupColumn = -1, int valueColumn = -1);
+    void cancel();
+
+    bool isRunning() const;
+    qint64 scannedRows() const;
+    qint64 totalRows() const;
+
+    // Results merged so far.
+    QVector<ColumnSummary> summaries() const;
+    // Sorted by descending row count; rows with an empty key form a group
+    // of their own.
+    QVector<GroupSummary> groups() const;
+
+signals:
+    // Sent a few times a second while computing, and once more at the end.
+    void resultsChanged();
+    void finished();
+
+private:
+    struct Results;
+
+    TaskEngine *m_tasks;
+    QPointer<Task> m_task;
+    QSharedPointer<Results> m_results;
+    QTimer m_pollTimer;
+};
+
+#endif // COLUMNSTATS_H
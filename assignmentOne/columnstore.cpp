@@ -0,0 +1,287 @@
+#include "columnstore.h"
+
+#include "taskengine.h"
+#include "trace.h"
+
+#include <QHash>
+#include <QLocale>
+
+#include <atomic>
+#include <memory>
+
+namespace {
+
+// A multiple of 64, so chunks never share a validity word.
+const qint64 ChunkRows = 1 << 16;
+const int TypeSampleRows = 1000;
+
+// Distinct strings of one column within one chunk.
+struct LocalDictionary
+{
+    QHash<QString, quint32> index;
+    QVector<QString> strings;
+
+    quint32 code(const QString &text)
+    {
+        const auto it = index.constFind(text);
+        if (it != index.constEnd())
+            return it.value();
+        const quint32 code = quint32(strings.size());
+        index.insert(text, code);
+        strings.append(text);
+        return code;
+    }
+};
+
+// A cell is only held as a number if cellText() gives its text back, so
+// "00123", "+5", "1.50" or "1e3" stay text.
+qint64 parseInt64(const QString &cell, bool *ok)
+{
+    const qint64 value = cell.toLongLong(ok);
+    *ok = *ok && QString::number(value) == cell;
+    return value;
+}
+
+double parseDouble(const QString &cell, bool *ok)
+{
+    const double value = cell.toDouble(ok);
+    *ok = *ok && QString::number(value, 'g', QLocale::FloatingPointShortest) == cell;
+    return value;
+}
+
+ColumnStore::Type typeOf(const QString &cell)
+{
+    bool ok = false;
+    parseInt64(cell, &ok);
+    if (ok)
+        return ColumnStore::Int64Column;
+    parseDouble(cell, &ok);
+    return ok ? ColumnStore::DoubleColumn : ColumnStore::StringColumn;
+}
+
+}
+
+ColumnStore::ColumnStore(const QSharedPointer<const Data> &data)
+    : m_data(data)
+{
+}
+
+QSharedPointer<ColumnStore> ColumnStore::build(const DataSource &source, TaskContext *context)
+{
+    TRACE_SCOPE("ColumnStore::build");
+    const QSharedPointer<Data> data(new Data);
+    const qint64 rows = source.rowCount();
+    const int columnCount = source.columnCount();
+    data->rows = rows;
+    data->columns.resize(size_t(columnCount));
+
+    // Narrowest type that fits every non-empty cell of a sample.
+    {
+        const QSharedPointer<DataSource> reader = source.clone();
+        for (int c = 0; c < columnCount; ++c) {
+            Column &column = data->columns[size_t(c)];
+            column.name = source.columnName(c);
+            for (qint64 row = 0; row < qMin<qint64>(rows, TypeSampleRows); ++row) {
+                const QString cell = reader->cellText(row, c);
+                if (!cell.isEmpty())
+                    column.type = qMax(column.type, typeOf(cell));
+            }
+        }
+    }
+
+    const qint64 chunks = (rows + ChunkRows - 1) / ChunkRows;
+    std::vector<std::vector<LocalDictionary>> chunkDictionaries(size_t(chunks));
+    QVector<int> pending;
+    for (int c = 0; c < columnCount; ++c)
+        pending.append(c);
+
+    // Parse the pending columns; any column that met a cell its type cannot
+    // hold is widened and parsed again. At most two extra passes.
+    while (!pending.isEmpty()) {
+        if (context) {
+            context->setProgressRange(rows);
+            context->setProgress(0);
+        }
+        std::unique_ptr<std::atomic<int>[]> widest(new std::atomic<int>[size_t(columnCount)]);
+        for (int c : qAsConst(pending)) {
+            Column &column = data->columns[size_t(c)];
+            widest[size_t(c)] = column.type;
+            column.validity.assign(size_t((rows + 63) / 64), 0);
+            column.ints.clear();
+            column.doubles.clear();
+            column.codes.clear();
+            switch (column.type) {
+            case Int64Column: column.ints.resize(size_t(rows)); break;
+            case DoubleColumn: column.doubles.resize(size_t(rows)); break;
+            case StringColumn: column.codes.resize(size_t(rows)); break;
+            }
+        }
+
+        TaskEngine::parallelFor(rows, ChunkRows, [&](qint64 begin, qint64 end) {
+            const QSharedPointer<DataSource> reader = source.clone();
+            std::vector<LocalDictionary> &dictionaries = chunkDictionaries[size_t(begin / ChunkRows)];
+            dictionaries.resize(size_t(columnCount));
+            for (qint64 row = begin; row < end; ++row) {
+                for (int c : qAsConst(pending)) {
+                    Column &column = data->columns[size_t(c)];
+                    const QString cell = reader->cellText(row, c);
+                    if (cell.isEmpty())
+                        continue;
+                    column.validity[size_t(row / 64)] |= quint64(1) << (row % 64);
+                    bool ok = true;
+                    switch (column.type) {
+                    case Int64Column:
+                        column.ints[size_t(row)] = parseInt64(cell, &ok);
+                        break;
+                    case DoubleColumn:
+                        column.doubles[size_t(row)] = parseDouble(cell, &ok);
+                        break;
+                    case StringColumn:
+                        column.codes[size_t(row)] = dictionaries[size_t(c)].code(cell);
+                        break;
+                    }
+                    if (!ok) {
+                        const int type = typeOf(cell);
+                        int seen = widest[size_t(c)].load(std::memory_order_relaxed);
+                        while (type > seen && !widest[size_t(c)].compare_exchange_weak(seen, type)) {
+                        }
+                    }
+                }
+            }
+            if (context)
+                context->addProgress(end - begin);
+        }, context);
+        if (context && context->isCanceled())
+            return QSharedPointer<ColumnStore>();
+
+        QVector<int> widened;
+        for (int c : qAsConst(pending)) {
+            Column &column = data->columns[size_t(c)];
+            if (widest[size_t(c)] > column.type) {
+                column.type = Type(widest[size_t(c)].load());
+                widened.append(c);
+            }
+        }
+        pending = widened;
+    }
+
+    // Merge the per-chunk dictionaries, then rewrite each chunk's codes.
+    for (int c = 0; c < columnCount; ++c) {
+        Column &column = data->columns[size_t(c)];
+        if (column.type != StringColumn)
+            continue;
+        TRACE_SCOPE("ColumnStore::mergeDictionary");
+        LocalDictionary merged;
+        std::vector<std::vector<quint32>> remap(size_t(chunks));
+        for (qint64 chunk = 0; chunk < chunks; ++chunk) {
+            const std::vector<LocalDictionary> &dictionaries = chunkDictionaries[size_t(chunk)];
+            if (dictionaries.empty())
+                continue;
+            const QVector<QString> &strings = dictionaries[size_t(c)].strings;
+            remap[size_t(chunk)].reserve(size_t(strings.size()));
+            for (const QString &text : strings)
+                remap[size_t(chunk)].push_back(merged.code(text));
+        }
+        TaskEngine::parallelFor(rows, ChunkRows, [&column, &remap](qint64 begin, qint64 end) {
+            const std::vector<quint32> &map = remap[size_t(begin / ChunkRows)];
+            for (qint64 row = begin; row < end; ++row) {
+                if (column.validity[size_t(row / 64)] >> (row % 64) & 1)
+                    column.codes[size_t(row)] = map[column.codes[size_t(row)]];
+            }
+        }, context);
+        column.dictionary = merged.strings;
+    }
+    if (context && context->isCanceled())
+        return QSharedPointer<ColumnStore>();
+
+    return QSharedPointer<ColumnStore>(new ColumnStore(data));
+}
+
+qint64 ColumnStore::rowCount() const
+{
+    return m_data->rows;
+}
+
+int ColumnStore::columnCount() const
+{
+    return int(m_data->columns.size());
+}
+
+QString ColumnStore::columnName(int column) const
+{
+    return column >= 0 && column < columnCount() ? m_data->columns[size_t(column)].name : QString();
+}
+
+QString ColumnStore::cellText(qint64 row, int column) const
+{
+    if (column < 0 || column >= columnCount() || isNull(row, column))
+        return QString();
+    const Column &c = m_data->columns[size_t(column)];
+    switch (c.type) {
+    case Int64Column:
+        return QString::number(c.ints[size_t(row)]);
+    case DoubleColumn:
+        return QString::number(c.doubles[size_t(row)], 'g', QLocale::FloatingPointShortest);
+    case StringColumn:
+        return c.dictionary.at(int(c.codes[size_t(row)]));
+    }
+    return QString();
+}
+
+QSharedPointer<DataSource> ColumnStore::clone() const
+{
+    return QSharedPointer<DataSource>(new ColumnStore(m_data));
+}
+
+ColumnStore::Type ColumnStore::columnType(int column) const
+{
+    return m_data->columns[size_t(column)].type;
+}
+
+bool ColumnStore::isNull(qint64 row, int column) const
+{
+    return !(m_data->columns[size_t(column)].validity[size_t(row / 64)] >> (row % 64) & 1);
+}
+
+const quint64 *ColumnStore::validity(int column) const
+{
+    return m_data->columns[size_t(column)].validity.data();
+}
+
+const qint64 *ColumnStore::int64Values(int column) const
+{
+    const Column &c = m_data->columns[size_t(column)];
+    return c.type == Int64Column ? c.ints.data() : nullptr;
+}
+
+const double *ColumnStore::doubleValues(int column) const
+{
+    const Column &c = m_data->columns[size_t(column)];
+    return c.type == DoubleColumn ? c.doubles.data() : nullptr;
+}
+
+const quint32 *ColumnStore::stringCodes(int column) const
+{
+    const Column &c = m_data->columns[size_t(column)];
+    return c.type == StringColumn ? c.codes.data() : nullptr;
+}
+
+const QVector<QString> &ColumnStore::dictionary(int column) const
+{
+    return m_data->columns[size_t(column)].dictionary;
+}
+
+qint64 ColumnStore::memoryUsage() const
+{
+    qint64 bytes = 0;
+    for (const Column &c : m_data->columns) {
+        bytes += qint64(c.validity.capacity() * sizeof(quint64));
+        bytes += qint64(c.ints.capacity() * sizeof(qint64));
+        bytes += qint64(c.doubles.capacity() * sizeof(double));
+        bytes += qint64(c.codes.capacity() * sizeof(quint32));
+        bytes += qint64(c.dictionary.capacity() * sizeof(QString));
+        for (const QString &text : c.dictionary)
+            bytes += qint64(text.capacity() + 1) * qint64(sizeof(QChar)) + 16;
+    }
+    return bytes;
+}
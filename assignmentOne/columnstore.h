@@ -0,0 +1,73 @@
+#ifndef COLUMNSTORE_H
+#define COLUMNSTORE_H
+
+#include "datasource.h"
+#include "memorytracker.h"
+
+#include <QVector>
+
+#include <vector>
+
+class TaskContext;
+
+// A table parsed into memory column by column: contiguous int64 or double
+// arrays, or uint32 codes into a per-column dictionary for text, plus one
+// validity bit per cell. Scans, aggregations and sorts over one column
+// touch only that column's array. Built once from another DataSource and
+// immutable afterwards, so any number of threads may read it; clone() is
+// free.
+class ColumnStore : public DataSource
+{
+public:
+    enum Type { Int64Column, DoubleColumn, StringColumn };
+
+    // Parses every cell of source on all cores. Column types come from a
+    // sample and are widened (int64 -> double -> string) if a later cell
+    // does not fit; a cell only fits a numeric type if it reads back as the
+    // same text. Empty cells are null. Returns null if canceled.
+    static QSharedPointer<ColumnStore> build(const DataSource &source, TaskContext *context = nullptr);
+
+    qint64 rowCount() const override;
+    int columnCount() const override;
+    QString columnName(int column) const override;
+    QString cellText(qint64 row, int column) const override;
+    QSharedPointer<DataSource> clone() const override;
+
+    Type columnType(int column) const;
+    bool isNull(qint64 row, int column) const;
+    // Bit row % 64 of word row / 64 is set when the cell has a value.
+    const quint64 *validity(int column) const;
+    // The array matching columnType(), null for the other two.
+    const qint64 *int64Values(int column) const;
+    const double *doubleValues(int column) const;
+    const quint32 *stringCodes(int column) const;
+    const QVector<QString> &dictionary(int column) const;
+
+    // Bytes held by the column arrays and dictionaries.
+    qint64 memoryUsage() const;
+
+private:
+    friend class ColumnCache;
+
+    struct Column
+    {
+        QString name;
+        Type type = Int64Column;
+        TrackedVector<quint64, MemoryTracker::Columns> validity;
+        TrackedVector<qint64, MemoryTracker::Columns> ints;
+        TrackedVector<double, MemoryTracker::Columns> doubles;
+        TrackedVector<quint32, MemoryTracker::Columns> codes;
+        QVector<QString> dictionary;
+    };
+    struct Data
+    {
+        qint64 rows = 0;
+        std::vector<Column> columns;
+    };
+
+    explicit ColumnStore(const QSharedPointer<const Data> &data);
+
+    QSharedPointer<const Data> m_data;
+};
+
+#endif // COLUMNSTORE_H
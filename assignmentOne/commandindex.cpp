@@ -0,0 +1,267 @@
+#include "commandindex.h"
+
+#include "taskengine.h"
+
+#include <QHash>
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+namespace {
+
+// Bounds the work of a one- or two-letter query that starts many words.
+const int MaxPrefixHits = 20000;
+// Candidates given the full score, ranked by trigram hits first.
+const int RefineFactor = 8;
+const int MaxQueryTrigrams = 100;
+const quint8 PrefixHit = 0x80;
+const quint8 TrigramHits = 0x7f;
+
+quint64 trigramKey(const QChar *c)
+{
+    return (quint64(c[0].unicode()) << 32) | (quint64(c[1].unicode()) << 16) | c[2].unicode();
+}
+
+QVector<quint64> trigramsOf(const QString &folded)
+{
+    QVector<quint64> keys;
+    for (int i = 0; i + 3 <= folded.size(); ++i)
+        keys.append(trigramKey(folded.constData() + i));
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    return keys;
+}
+
+// The first letter of each word, for texts of more than one word.
+QString initialsOf(const QString &folded)
+{
+    QString initials;
+    bool wordStart = true;
+    for (const QChar c : folded) {
+        if (c == QLatin1Char(' ')) {
+            wordStart = true;
+        } else if (wordStart) {
+            initials += c;
+            wordStart = false;
+        }
+    }
+    return initials.size() > 1 ? initials : QString();
+}
+
+double scoreOf(const QString &text, const QString &initials, const QString &query, double trigramRatio)
+{
+    double score;
+    const int at = text.indexOf(query);
+    if (at >= 0) {
+        score = 100;
+        if (at == 0)
+            score += 40;
+        else if (text.at(at - 1) == QLatin1Char(' '))
+            score += 25;
+        score -= qMin(at, 50) * 0.2;
+    } else if (!initials.isEmpty() && initials.startsWith(query)) {
+        score = 90;
+    } else {
+        score = 60 * trigramRatio;
+    }
+    // Of equal matches, the shorter text is closer to what was typed.
+    return score - qMin(text.size(), 200) * 0.05;
+}
+
+bool betterMatch(const CommandIndex::Match &a, const CommandIndex::Match &b)
+{
+    if (a.score != b.score)
+        return a.score > b.score;
+    return a.candidate.text.size() < b.candidate.text.size();
+}
+
+}
+
+class CommandIndex::Segment
+{
+public:
+    static const quint32 InitialsOffset = std::numeric_limits<quint32>::max();
+
+    // A word of a folded text, or its initials.
+    struct WordRef
+    {
+        quint32 candidate;
+        quint32 offset;
+        quint32 length;
+    };
+
+    QStringView word(const WordRef &ref) const
+    {
+        if (ref.offset == InitialsOffset)
+            return QStringView(initials[ref.candidate]);
+        return QStringView(folded[ref.candidate]).mid(ref.offset, ref.length);
+    }
+
+    void collect(const QString &query, const QVector<quint64> &queryTrigrams, int maxMatches,
+                 QVector<Match> *matches) const;
+
+    QVector<Candidate> candidates;
+    std::vector<QString> folded;
+    std::vector<QString> initials;
+    QHash<quint64, std::vector<quint32>> trigrams;
+    std::vector<WordRef> words;
+};
+
+void CommandIndex::Segment::collect(const QString &query, const QVector<quint64> &queryTrigrams, int maxMatches,
+                                    QVector<Match> *matches) const
+{
+    std::vector<quint8> hits(size_t(candidates.size()), 0);
+    std::vector<quint32> found;
+
+    const int space = query.indexOf(QLatin1Char(' '));
+    const QStringView firstWord = QStringView(query).left(space < 0 ? query.size() : space);
+    auto it = std::lower_bound(words.begin(), words.end(), firstWord, [this](const WordRef &ref, QStringView w) {
+        return word(ref) < w;
+    });
+    for (int count = 0; it != words.end() && count < MaxPrefixHits && word(*it).startsWith(firstWord); ++it, ++count) {
+        quint8 &h = hits[it->candidate];
+        if (h == 0)
+            found.push_back(it->candidate);
+        h |= PrefixHit;
+    }
+
+    for (const quint64 key : queryTrigrams) {
+        const auto list = trigrams.constFind(key);
+        if (list == trigrams.constEnd())
+            continue;
+        for (const quint32 id : *list) {
+            quint8 &h = hits[id];
+            if (h == 0)
+                found.push_back(id);
+            if ((h & TrigramHits) < TrigramHits)
+                ++h;
+        }
+    }
+
+    // A third of the query's trigrams may be missing.
+    const int total = queryTrigrams.size();
+    const int needed = total > 0 ? qMax(1, total - total / 3) : std::numeric_limits<int>::max();
+    std::vector<std::pair<double, quint32>> survivors;
+    for (const quint32 id : found) {
+        const quint8 h = hits[id];
+        if ((h & PrefixHit) || (h & TrigramHits) >= needed)
+            survivors.emplace_back(((h & PrefixHit) ? 1.0 : 0.0) + (total ? double(h & TrigramHits) / total : 0.0), id);
+    }
+    const size_t refined = qMin(survivors.size(), size_t(maxMatches) * RefineFactor);
+    std::nth_element(survivors.begin(), survivors.begin() + refined, survivors.end(),
+                     [](const std::pair<double, quint32> &a, const std::pair<double, quint32> &b) {
+        return a.first > b.first;
+    });
+    for (size_t i = 0; i < refined; ++i) {
+        const quint32 id = survivors[i].second;
+        const double ratio = total ? double(hits[id] & TrigramHits) / total : 0.0;
+        matches->append({ candidates.at(int(id)), scoreOf(folded[id], initials[id], query, ratio) });
+    }
+}
+
+QSharedPointer<const CommandIndex::Segment> CommandIndex::buildSegment(const QVector<Candidate> &candidates,
+                                                                        TaskContext *context)
+{
+    QSharedPointer<Segment> segment(new Segment);
+    segment->candidates = candidates;
+    const int count = candidates.size();
+    segment->folded.reserve(size_t(count));
+    segment->initials.reserve(size_t(count));
+    if (context)
+        context->setProgressRange(count);
+
+    for (int i = 0; i < count; ++i) {
+        if (context && i % 4096 == 0) {
+            if (context->isCanceled())
+                return QSharedPointer<const Segment>();
+            context->setProgress(i);
+        }
+        const QString folded = fold(candidates.at(i).text);
+        for (int start = 0; start < folded.size();) {
+            int end = folded.indexOf(QLatin1Char(' '), start);
+            if (end < 0)
+                end = folded.size();
+            segment->words.push_back({ quint32(i), quint32(start), quint32(end - start) });
+            start = end + 1;
+        }
+        const QString initials = initialsOf(folded);
+        if (!initials.isEmpty())
+            segment->words.push_back({ quint32(i), Segment::InitialsOffset, quint32(initials.size()) });
+        for (int c = 0; c + 3 <= folded.size(); ++c) {
+            std::vector<quint32> &list = segment->trigrams[trigramKey(folded.constData() + c)];
+            if (list.empty() || list.back() != quint32(i))
+                list.push_back(quint32(i));
+        }
+        segment->folded.push_back(folded);
+        segment->initials.push_back(initials);
+    }
+
+    const Segment *s = segment.data();
+    std::sort(segment->words.begin(), segment->words.end(), [s](const Segment::WordRef &a, const Segment::WordRef &b) {
+        return s->word(a) < s->word(b);
+    });
+    return segment;
+}
+
+void CommandIndex::setSegment(const QString &group, const QSharedPointer<const Segment> &segment)
+{
+    m_segments.insert(group, segment);
+}
+
+void CommandIndex::removeSegment(const QString &group)
+{
+    m_segments.remove(group);
+}
+
+int CommandIndex::candidateCount() const
+{
+    int count = 0;
+    for (const QSharedPointer<const Segment> &segment : m_segments)
+        count += segment->candidates.size();
+    return count;
+}
+
+QVector<CommandIndex::Match> CommandIndex::match(const QString &query, int maxMatches) const
+{
+    QVector<Match> matches;
+    const QString folded = fold(query);
+    if (folded.isEmpty()) {
+        for (const QSharedPointer<const Segment> &segment : m_segments) {
+            for (const Candidate &candidate : segment->candidates) {
+                if (matches.size() == maxMatches)
+                    return matches;
+                matches.append({ candidate, 0 });
+            }
+        }
+        return matches;
+    }
+
+    QVector<quint64> trigrams = trigramsOf(folded);
+    if (trigrams.size() > MaxQueryTrigrams)
+        trigrams.resize(MaxQueryTrigrams);
+    for (const QSharedPointer<const Segment> &segment : m_segments)
+        segment->collect(folded, trigrams, maxMatches, &matches);
+    const int kept = qMin(matches.size(), maxMatches);
+    std::partial_sort(matches.begin(), matches.begin() + kept, matches.end(), betterMatch);
+    matches.resize(kept);
+    return matches;
+}
+
+QString CommandIndex::fold(const QString &text)
+{
+    QString folded;
+    folded.reserve(text.size());
+    bool separated = false;
+    for (const QChar c : text.toCaseFolded()) {
+        if (!c.isLetterOrNumber()) {
+            separated = true;
+            continue;
+        }
+        if (separated && !folded.isEmpty())
+            folded += QLatin1Char(' ');
+        folded += c;
+        separated = false;
+    }
+    return folded;
+}
@@ -0,0 +1,66 @@
+#ifndef COMMANDINDEX_H
+#define COMMANDINDEX_H
+
+#include <QMap>
+#include <QSharedPointer>
+#include <QString>
+#include <QVector>
+
+class TaskContext;
+
+// Fuzzy search over named things the user can jump to. Candidates come in
+// groups (the menu actions, the columns, ...) and each group is indexed
+// on its own, so a change to one is re-indexed without the others. An
+// index holds the trigrams of every candidate and a sorted list of its
+// words and initials; a query only scores the candidates sharing most of
+// its trigrams or starting a word with it, not every candidate.
+//
+// Candidates match when at most a third of the query's trigrams are
+// missing from them, so small typos still find them, or when the query
+// starts one of their words or their initials ("lim" for "Load Into
+// Memory").
+class CommandIndex
+{
+public:
+    enum Kind { Action, OpenDocument, Column, RecentFile };
+
+    struct Candidate
+    {
+        QString text;
+        // Shown next to the text; not searched.
+        QString detail;
+        int kind = Action;
+        // Meaning depends on kind, e.g. the column number.
+        int id = 0;
+    };
+
+    struct Match
+    {
+        Candidate candidate;
+        double score = 0;
+    };
+
+    // Immutable once built; can be built on any thread and shared.
+    class Segment;
+
+    static const int MaxMatches = 50;
+
+    static QSharedPointer<const Segment> buildSegment(const QVector<Candidate> &candidates,
+                                                      TaskContext *context = nullptr);
+
+    void setSegment(const QString &group, const QSharedPointer<const Segment> &segment);
+    void removeSegment(const QString &group);
+    int candidateCount() const;
+
+    // Best first. An empty query lists the first candidates of each group.
+    QVector<Match> match(const QString &query, int maxMatches = MaxMatches) const;
+
+    // Lower case, with runs of anything but letters and digits turned into
+    // one space; both candidates and queries are compared in this form.
+    static QString fold(const QString &text);
+
+private:
+    QMap<QString, QSharedPointer<const Segment>> m_segments;
+};
+
+#endif // COMMANDINDEX_H
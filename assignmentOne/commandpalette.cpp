@@ -0,0 +1,124 @@
+#include "commandpalette.h"
+
+#include "taskengine.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QKeyEvent>
+#include <QLabel>
+#include <QLineEdit>
+#include <QListWidget>
+#include <QLocale>
+#include <QVBoxLayout>
+
+CommandPalette::CommandPalette(TaskEngine *tasks, QWidget *parent)
+    : QFrame(parent, Qt::Popup)
+    , m_tasks(tasks)
+    , m_edit(new QLineEdit(this))
+    , m_list(new QListWidget(this))
+    , m_status(new QLabel(this))
+{
+    setFrameStyle(QFrame::StyledPanel | QFrame::Raised);
+    m_edit->setPlaceholderText(tr("Type a command, column, window or recent file"));
+    m_edit->installEventFilter(this);
+    m_list->setUniformItemSizes(true);
+    m_list->setFocusPolicy(Qt::NoFocus);
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->setContentsMargins(4, 4, 4, 4);
+    layout->addWidget(m_edit);
+    layout->addWidget(m_list, 1);
+    layout->addWidget(m_status);
+
+    connect(m_edit, &QLineEdit::textChanged, this, &CommandPalette::updateMatches);
+    connect(m_edit, &QLineEdit::returnPressed, this, [this] { activateRow(m_list->currentRow()); });
+    connect(m_list, &QListWidget::itemActivated, this, [this](QListWidgetItem *item) {
+        activateRow(m_list->row(item));
+    });
+}
+
+void CommandPalette::setCandidates(const QString &group, const QVector<CommandIndex::Candidate> &candidates)
+{
+    if (Task *previous = m_builds.value(group))
+        previous->cancel();
+    const QSharedPointer<QSharedPointer<const CommandIndex::Segment>> result(
+                new QSharedPointer<const CommandIndex::Segment>);
+    Task *task = m_tasks->start(tr("Indexing commands"), Task::LowPriority,
+                                [candidates, result](TaskContext &context) {
+        *result = CommandIndex::buildSegment(candidates, &context);
+    });
+    m_builds.insert(group, task);
+    connect(task, &Task::finished, this, [this, task, group, result] {
+        // A newer build of the group replaces this one.
+        if (task->isCanceled() || !*result || m_builds.value(group) != task)
+            return;
+        m_builds.remove(group);
+        m_index.setSegment(group, *result);
+        if (isVisible())
+            updateMatches();
+    });
+}
+
+const CommandIndex &CommandPalette::index() const
+{
+    return m_index;
+}
+
+void CommandPalette::popup()
+{
+    QWidget *window = parentWidget() ? parentWidget()->window() : nullptr;
+    if (window) {
+        const int width = qBound(300, window->width() / 2, 700);
+        resize(width, qMin(400, window->height() - 40));
+        move(window->mapToGlobal(QPoint((window->width() - width) / 2, 40)));
+    }
+    m_edit->clear();
+    updateMatches();
+    show();
+    m_edit->setFocus();
+}
+
+bool CommandPalette::eventFilter(QObject *watched, QEvent *event)
+{
+    // The field keeps the focus; the arrow keys move through the list.
+    if (watched == m_edit && event->type() == QEvent::KeyPress) {
+        const int key = static_cast<QKeyEvent *>(event)->key();
+        if (key == Qt::Key_Down || key == Qt::Key_Up || key == Qt::Key_PageDown || key == Qt::Key_PageUp) {
+            QCoreApplication::sendEvent(m_list, event);
+            return true;
+        }
+        if (key == Qt::Key_Escape) {
+            hide();
+            return true;
+        }
+    }
+    return QFrame::eventFilter(watched, event);
+}
+
+void CommandPalette::updateMatches()
+{
+    QElapsedTimer timer;
+    timer.start();
+    m_matches = m_index.match(m_edit->text());
+    const double ms = timer.nsecsElapsed() / 1e6;
+
+    m_list->clear();
+    for (const CommandIndex::Match &match : qAsConst(m_matches)) {
+        const CommandIndex::Candidate &candidate = match.candidate;
+        m_list->addItem(candidate.detail.isEmpty() ? candidate.text
+                                                   : tr("%1   (%2)").arg(candidate.text, candidate.detail));
+    }
+    m_list->setCurrentRow(0);
+    m_status->setText(tr("%1 of %2 in %3 ms").arg(QLocale().toString(m_matches.size()),
+                                                   QLocale().toString(m_index.candidateCount()),
+                                                   QString::number(ms, 'f', 2)));
+}
+
+void CommandPalette::activateRow(int row)
+{
+    if (row < 0 || row >= m_matches.size())
+        return;
+    const CommandIndex::Candidate candidate = m_matches.at(row).candidate;
+    hide();
+    emit activated(candidate);
+}
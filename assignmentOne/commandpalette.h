@@ -0,0 +1,51 @@
+#ifndef COMMANDPALETTE_H
+#define COMMANDPALETTE_H
+
+#include "commandindex.h"
+
+#include <QFrame>
+#include <QHash>
+#include <QPointer>
+
+class QLabel;
+class QLineEdit;
+class QListWidget;
+class Task;
+class TaskEngine;
+
+// Popup with a search field over a CommandIndex. Groups of candidates are
+// indexed on the task engine as they are handed in; until a group's new
+// index is ready, its previous one keeps answering. Every keystroke runs
+// one query against the indexes, on the GUI thread.
+class CommandPalette : public QFrame
+{
+    Q_OBJECT
+
+public:
+    explicit CommandPalette(TaskEngine *tasks, QWidget *parent = nullptr);
+
+    void setCandidates(const QString &group, const QVector<CommandIndex::Candidate> &candidates);
+    const CommandIndex &index() const;
+    // Shows the palette at the top of its parent with an empty query.
+    void popup();
+
+signals:
+    void activated(const CommandIndex::Candidate &candidate);
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) override;
+
+private:
+    void updateMatches();
+    void activateRow(int row);
+
+    TaskEngine *m_tasks;
+    CommandIndex m_index;
+    QHash<QString, QPointer<Task>> m_builds;
+    QLineEdit *m_edit;
+    QListWidget *m_list;
+    QLabel *m_status;
+    QVector<CommandIndex::Match> m_matches;
+};
+
+#endif // COMMANDPALETTE_H
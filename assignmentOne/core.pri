@@ -0,0 +1,23 @@
+# Included by everything that links the core library.
+QT       += core gui concurrent network widgets
+
+CONFIG += c++17
+
+INCLUDEPATH += $$PWD
+DEPENDPATH += $$PWD
+
+win32:CONFIG(release, debug|release): CORE_DIR = $$top_builddir/core/release
+else:win32:CONFIG(debug, debug|release): CORE_DIR = $$top_builddir/core/debug
+else: CORE_DIR = $$top_builddir/core
+
+LIBS += -L$$CORE_DIR -lcore
+
+win32-g++: PRE_TARGETDEPS += $$CORE_DIR/libcore.a
+else:win32:!win32-g++: PRE_TARGETDEPS += $$CORE_DIR/core.lib
+else: PRE_TARGETDEPS += $$CORE_DIR/libcore.a
+
+# See core.pro.
+packagesExist(libjpeg) {
+    CONFIG += link_pkgconfig
+    PKGCONFIG += libjpeg
+}
@@ -0,0 +1,108 @@
+# Everything but main(), as a static library the application and the tests
+# link against.
+TEMPLATE = lib
+TARGET = core
+CONFIG += staticlib
+
+QT       += core gui concurrent network widgets
+
+CONFIG += c++17
+
+# You can make your code fail to compile if it uses deprecated APIs.
+# In order to do so, uncomment the following line.
+#DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
+
+SOURCES += \
+    ../application.cpp \
+    ../batch.cpp \
+    ../columncache.cpp \
+    ../columnstats.cpp \
+    ../columnstore.cpp \
+    ../commandindex.cpp \
+    ../commandpalette.cpp \
+    ../csvsource.cpp \
+    ../datatableview.cpp \
+    ../document.cpp \
+    ../documentcache.cpp \
+    ../editedsource.cpp \
+    ../edithistory.cpp \
+    ../eventprofiler.cpp \
+    ../filefollower.cpp \
+    ../findbar.cpp \
+    ../imagepyramid.cpp \
+    ../imageviewer.cpp \
+    ../ingest.cpp \
+    ../lazytablemodel.cpp \
+    ../lineindex.cpp \
+    ../mainwindow.cpp \
+    ../mappedtextfile.cpp \
+    ../memorydialog.cpp \
+    ../memorytracker.cpp \
+    ../minmaxpyramid.cpp \
+    ../modelupdatescheduler.cpp \
+    ../plotwidget.cpp \
+    ../rowsearch.cpp \
+    ../sortfilterproxy.cpp \
+    ../statisticspanel.cpp \
+    ../streamsource.cpp \
+    ../syntheticsource.cpp \
+    ../taskengine.cpp \
+    ../thumbnailmodel.cpp \
+    ../thumbnailview.cpp \
+    ../tiledcanvas.cpp \
+    ../trace.cpp
+
+HEADERS += \
+    ../application.h \
+    ../batch.h \
+    ../columncache.h \
+    ../columnstats.h \
+    ../columnstore.h \
+    ../commandindex.h \
+    ../commandpalette.h \
+    ../csvsource.h \
+    ../datasource.h \
+    ../datatableview.h \
+    ../document.h \
+    ../documentcache.h \
+    ../editedsource.h \
+    ../edithistory.h \
+    ../eventprofiler.h \
+    ../filefollower.h \
+    ../findbar.h \
+    ../imagepyramid.h \
+    ../imageviewer.h \
+    ../ingest.h \
+    ../lazytablemodel.h \
+    ../lineindex.h \
+    ../mainwindow.h \
+    ../mappedtextfile.h \
+    ../memorydialog.h \
+    ../memorytracker.h \
+    ../minmaxpyramid.h \
+    ../modelupdatescheduler.h \
+    ../plotwidget.h \
+    ../rowsearch.h \
+    ../sortfilterproxy.h \
+    ../spscring.h \
+    ../statisticspanel.h \
+    ../streamsource.h \
+    ../syntheticsource.h \
+    ../taskengine.h \
+    ../thumbnailmodel.h \
+    ../thumbnailview.h \
+    ../tiledcanvas.h \
+    ../trace.h
+
+FORMS += \
+    ../mainwindow.ui
+
+INCLUDEPATH += ..
+
+# Large JPEGs are decoded in strips straight through libjpeg when it is
+# found; otherwise through QImageReader clips.
+packagesExist(libjpeg) {
+    CONFIG += link_pkgconfig
+    PKGCONFIG += libjpeg
+    DEFINES += HAVE_LIBJPEG
+}
@@ -0,0 +1,159 @@
+#include "csvsource.h"
+
+#include "mappedtextfile.h"
+
+#include <cstring>
+
+CsvSource::CsvSource(const QSharedPointer<MappedTextFile> &file)
+    : m_file(file)
+{
+    if (m_file->lineCount() == 0)
+        return;
+
+    qint64 length = 0;
+    const char *header = m_file->line(0, &length);
+    m_delimiter = detectDelimiter(header, length);
+    if (m_delimiter == '\0') {
+        m_columnNames.append(QStringLiteral("Line"));
+        return;
+    }
+
+    FieldSpans fields;
+    splitFields(header, length, m_delimiter, &fields);
+    for (int i = 0; i < fields.size(); ++i) {
+        const QString name = fieldText(header, fields.at(i)).trimmed();
+        m_columnNames.append(name.isEmpty() ? QStringLiteral("Column %1").arg(i + 1) : name);
+    }
+    m_firstDataLine = 1;
+}
+
+QSharedPointer<MappedTextFile> CsvSource::file() const
+{
+    return m_file;
+}
+
+char CsvSource::delimiter() const
+{
+    return m_delimiter;
+}
+
+qint64 CsvSource::rowCount() const
+{
+    return qMax<qint64>(0, m_file->lineCount() - m_firstDataLine);
+}
+
+int CsvSource::columnCount() const
+{
+    return m_columnNames.size();
+}
+
+QString CsvSource::columnName(int column) const
+{
+    return m_columnNames.value(column);
+}
+
+QString CsvSource::cellText(qint64 row, int column) const
+{
+    const char *line = nullptr;
+    const FieldSpans &fields = fieldsOf(row, &line);
+    if (column >= fields.size())
+        return QString();
+    return fieldText(line, fields.at(column));
+}
+
+const char *CsvSource::rowData(qint64 row, qint64 *length) const
+{
+    return m_file->line(row + m_firstDataLine, length);
+}
+
+QSharedPointer<DataSource> CsvSource::clone() const
+{
+    return QSharedPointer<DataSource>(new CsvSource(m_file));
+}
+
+char CsvSource::detectDelimiter(const char *line, qint64 length)
+{
+    static const char Candidates[] = { ',', '\t', ';', '|' };
+    int counts[sizeof(Candidates)] = {};
+    bool quoted = false;
+    for (qint64 i = 0; i < length; ++i) {
+        if (line[i] == '"')
+            quoted = !quoted;
+        else if (!quoted) {
+            for (size_t c = 0; c < sizeof(Candidates); ++c)
+                counts[c] += line[i] == Candidates[c];
+        }
+    }
+
+    char best = '\0';
+    int bestCount = 0;
+    for (size_t c = 0; c < sizeof(Candidates); ++c) {
+        if (counts[c] > bestCount) {
+            best = Candidates[c];
+            bestCount = counts[c];
+        }
+    }
+    return best;
+}
+
+void CsvSource::splitFields(const char *line, qint64 length, char delimiter, FieldSpans *fields)
+{
+    fields->clear();
+    if (delimiter == '\0') {
+        const FieldSpan whole = { 0, length, false };
+        fields->append(whole);
+        return;
+    }
+
+    qint64 pos = 0;
+    for (;;) {
+        if (pos < length && line[pos] == '"') {
+            // Quoted field: runs to the closing quote, "" is an escaped quote.
+            qint64 end = pos + 1;
+            while (end < length) {
+                if (line[end] == '"') {
+                    if (end + 1 < length && line[end + 1] == '"') {
+                        end += 2;
+                        continue;
+                    }
+                    break;
+                }
+                ++end;
+            }
+            const FieldSpan field = { pos + 1, end - pos - 1, true };
+            fields->append(field);
+            pos = end + 1;
+            while (pos < length && line[pos] != delimiter)
+                ++pos;
+        } else {
+            const void *hit = std::memchr(line + pos, delimiter, size_t(length - pos));
+            const qint64 end = hit ? static_cast<const char *>(hit) - line : length;
+            const FieldSpan field = { pos, end - pos, false };
+            fields->append(field);
+            pos = end;
+        }
+        if (pos >= length)
+            break;
+        ++pos; // skip the delimiter
+    }
+}
+
+QString CsvSource::fieldText(const char *line, const FieldSpan &field)
+{
+    QString text = QString::fromUtf8(line + field.begin, int(field.length));
+    if (field.quoted)
+        text.replace(QLatin1String("\"\""), QLatin1String("\""));
+    return text;
+}
+
+const CsvSource::FieldSpans &CsvSource::fieldsOf(qint64 row, const char **line) const
+{
+    if (row != m_cachedRow) {
+        qint64 length = 0;
+        m_cachedLine = m_file->line(row + m_firstDataLine, &length);
+        splitFields(m_cachedLine, length, m_delimiter, &m_cachedFields);
+        m_cachedRow = row;
+    }
+    *line = m_cachedLine;
+    return m_cachedFields;
+}
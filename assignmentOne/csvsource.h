@@ -0,0 +1,57 @@
+#ifndef CSVSOURCE_H
+#define CSVSOURCE_H
+
+#include "datasource.h"
+
+#include <QSharedPointer>
+#include <QStringList>
+#include <QVarLengthArray>
+
+class MappedTextFile;
+
+// Delimited text (CSV, TSV, ...) or plain log lines over a MappedTextFile.
+// Fields are located and decoded only when a cell is requested; the most
+// recently split line is remembered since views read row by row.
+// Not thread-safe: use one instance per thread.
+class CsvSource : public DataSource
+{
+public:
+    struct FieldSpan
+    {
+        qint64 begin;
+        qint64 length;
+        bool quoted;
+    };
+    typedef QVarLengthArray<FieldSpan, 32> FieldSpans;
+
+    explicit CsvSource(const QSharedPointer<MappedTextFile> &file);
+
+    QSharedPointer<MappedTextFile> file() const;
+    // '\0' when the file is treated as one unsplit "Line" column.
+    char delimiter() const;
+
+    qint64 rowCount() const override;
+    int columnCount() const override;
+    QString columnName(int column) const override;
+    QString cellText(qint64 row, int column) const override;
+    const char *rowData(qint64 row, qint64 *length) const override;
+    QSharedPointer<DataSource> clone() const override;
+
+    static char detectDelimiter(const char *line, qint64 length);
+    static void splitFields(const char *line, qint64 length, char delimiter, FieldSpans *fields);
+    static QString fieldText(const char *line, const FieldSpan &field);
+
+private:
+    const FieldSpans &fieldsOf(qint64 row, const char **line) const;
+
+    QSharedPointer<MappedTextFile> m_file;
+    char m_delimiter = '\0';
+    qint64 m_firstDataLine = 0;
+    QStringList m_columnNames;
+
+    mutable qint64 m_cachedRow = -1;
+    mutable const char *m_cachedLine = nullptr;
+    mutable FieldSpans m_cachedFields;
+};
+
+#endif // CSVSOURCE_H
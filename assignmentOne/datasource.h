@@ -0,0 +1,37 @@
+#ifndef DATASOURCE_H
+#define DATASOURCE_H
+
+#include <QSharedPointer>
+#include <QString>
+
+// Read-only tabular data that views pull from on demand. Implementations
+// must be cheap to query row by row; nothing is expected to be held in
+// QStrings ahead of time. A source is used from one thread at a time;
+// workers read through their own clone().
+class DataSource
+{
+public:
+    virtual ~DataSource() = default;
+
+    // Number of rows that can be read right now. May grow over time for
+    // sources that are still loading or streaming.
+    virtual qint64 rowCount() const = 0;
+    virtual int columnCount() const = 0;
+    virtual QString columnName(int column) const = 0;
+    virtual QString cellText(qint64 row, int column) const = 0;
+
+    // The row's bytes as stored (UTF-8, fields still delimited), or null
+    // when the source has no such representation. Lets searches reject
+    // rows without decoding any cells. Valid until the next call.
+    virtual const char *rowData(qint64 row, qint64 *length) const
+    {
+        Q_UNUSED(row);
+        *length = 0;
+        return nullptr;
+    }
+
+    // An independent reader over the same data.
+    virtual QSharedPointer<DataSource> clone() const = 0;
+};
+
+#endif // DATASOURCE_H
@@ -0,0 +1,22 @@
+#ifndef DATATABLEVIEW_H
+#define DATATABLEVIEW_H
+
+#include <QTableView>
+
+// QTableView configured for very large models: fixed, uniform row heights
+// and no per-row measuring, so layout cost does not grow with row count.
+class DataTableView : public QTableView
+{
+    Q_OBJECT
+
+public:
+    explicit DataTableView(QWidget *parent = nullptr);
+
+protected:
+    void changeEvent(QEvent *event) override;
+
+private:
+    void updateRowHeight();
+};
+
+#endif // DATATABLEVIEW_H
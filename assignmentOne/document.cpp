@@ -0,0 +1,129 @@
+#include "document.h"
+
+#include "columnstore.h"
+#include "editedsource.h"
+#include "edithistory.h"
+
+Document::Document(QObject *parent)
+    : QObject(parent)
+    , m_history(new EditHistory)
+{
+}
+
+Document::~Document() = default;
+
+QSharedPointer<DataSource> Document::source() const
+{
+    return m_edited ? m_edited : m_source;
+}
+
+QString Document::title() const
+{
+    return m_title;
+}
+
+QString Document::fileName() const
+{
+    return m_fileName;
+}
+
+QSharedPointer<ColumnStore> Document::columnStore() const
+{
+    return m_edited ? QSharedPointer<ColumnStore>() : m_source.dynamicCast<ColumnStore>();
+}
+
+void Document::setSource(const QSharedPointer<DataSource> &source, const QString &title,
+                         const QString &fileName)
+{
+    m_source = source;
+    m_edited.reset();
+    m_title = title;
+    m_fileName = fileName;
+    m_history->clear();
+    emit sourceChanged();
+    emit historyChanged();
+}
+
+void Document::assign(const Document &other)
+{
+    m_source = other.m_source;
+    // The edits are copied, not the EditedSource, so the two stay apart.
+    m_edited.reset(other.m_edited ? new EditedSource(m_source, other.m_edited->edits()) : nullptr);
+    m_title = other.m_title;
+    m_fileName = other.m_fileName;
+    m_history->clear();
+    emit sourceChanged();
+    emit historyChanged();
+}
+
+bool Document::isModified() const
+{
+    return m_edited && !m_edited->edits().isEmpty();
+}
+
+QSharedPointer<DataSource> Document::originalSource() const
+{
+    return m_source;
+}
+
+bool Document::setCellText(qint64 row, int column, const QString &text)
+{
+    if (!m_source || row < 0 || row >= m_source->rowCount() || column < 0 || column >= m_source->columnCount())
+        return false;
+    ensureEdited();
+    m_history->record(m_edited->edits(), column, row, row, text, true);
+    m_edited->edits().set(row, column, text);
+    emit cellsChanged(row, row, column, column);
+    emit historyChanged();
+    return true;
+}
+
+bool Document::fillCells(int column, qint64 firstRow, qint64 lastRow, const QString &text)
+{
+    if (!m_source || column < 0 || column >= m_source->columnCount())
+        return false;
+    firstRow = qMax<qint64>(firstRow, 0);
+    lastRow = qMin(lastRow, m_source->rowCount() - 1);
+    if (firstRow > lastRow)
+        return false;
+    ensureEdited();
+    m_history->record(m_edited->edits(), column, firstRow, lastRow, text, false);
+    m_edited->edits().setRange(firstRow, lastRow, column, text);
+    emit cellsChanged(firstRow, lastRow, column, column);
+    emit historyChanged();
+    return true;
+}
+
+EditHistory *Document::history() const
+{
+    return m_history.data();
+}
+
+bool Document::undo()
+{
+    EditHistory::Bounds changed;
+    if (!m_edited || !m_history->undo(m_edited->edits(), &changed))
+        return false;
+    emit cellsChanged(changed.firstRow, changed.lastRow, changed.firstColumn, changed.lastColumn);
+    emit historyChanged();
+    return true;
+}
+
+bool Document::redo()
+{
+    EditHistory::Bounds changed;
+    if (!m_edited || !m_history->redo(m_edited->edits(), &changed))
+        return false;
+    emit cellsChanged(changed.firstRow, changed.lastRow, changed.firstColumn, changed.lastColumn);
+    emit historyChanged();
+    return true;
+}
+
+void Document::ensureEdited()
+{
+    if (m_edited)
+        return;
+    m_edited.reset(new EditedSource(m_source));
+    if (m_source.dynamicCast<ColumnStore>())
+        emit columnStoreChanged();
+}
@@ -0,0 +1,76 @@
+#ifndef DOCUMENT_H
+#define DOCUMENT_H
+
+#include <QObject>
+#include <QScopedPointer>
+#include <QSharedPointer>
+
+class ColumnStore;
+class DataSource;
+class EditHistory;
+class EditedSource;
+
+// The data a window is showing. Views never own their source; they follow
+// the document, so swapping the backing store (e.g. a mapped file for its
+// in-memory columns) updates the table, the plot and searches together.
+//
+// Documents have value semantics over shared data: several may show the
+// same source, and a document's edits stay its own. The first edit wraps
+// the source in an EditedSource; later ones change that in place, copying
+// only the chunk of the column they touch. Each document keeps its own
+// undo history, which starts over when the source is replaced.
+class Document : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit Document(QObject *parent = nullptr);
+    ~Document() override;
+
+    QSharedPointer<DataSource> source() const;
+    QString title() const;
+    // The file the data was read from, if any.
+    QString fileName() const;
+    // The source when it is held in memory as columns, otherwise null.
+    // Also null once edited, as the columns no longer match the data.
+    QSharedPointer<ColumnStore> columnStore() const;
+
+    void setSource(const QSharedPointer<DataSource> &source, const QString &title,
+                   const QString &fileName = QString());
+    // Shows the same data as other, edits included; edits made afterwards
+    // in either document do not show in the other.
+    void assign(const Document &other);
+
+    bool isModified() const;
+    // The source as it was set, without the edits.
+    QSharedPointer<DataSource> originalSource() const;
+    bool setCellText(qint64 row, int column, const QString &text);
+    // Sets rows firstRow to lastRow of column to text, as one undo step.
+    bool fillCells(int column, qint64 firstRow, qint64 lastRow, const QString &text);
+
+    EditHistory *history() const;
+    bool undo();
+    bool redo();
+
+signals:
+    void sourceChanged();
+    // columnStore() has changed without the source being replaced, e.g.
+    // the first edit of in-memory columns.
+    void columnStoreChanged();
+    // source() may be a new object afterwards, with the same rows and
+    // columns as before.
+    void cellsChanged(qint64 firstRow, qint64 lastRow, int firstColumn, int lastColumn);
+    // What can be undone or redone has changed.
+    void historyChanged();
+
+private:
+    void ensureEdited();
+
+    QSharedPointer<DataSource> m_source;
+    QSharedPointer<EditedSource> m_edited;
+    QString m_title;
+    QString m_fileName;
+    QScopedPointer<EditHistory> m_history;
+};
+
+#endif // DOCUMENT_H
@@ -0,0 +1,53 @@
+#include "documentcache.h"
+
+#include "datasource.h"
+
+#include <QDateTime>
+#include <QFileInfo>
+#include <QHash>
+
+namespace {
+
+struct Entry
+{
+    QWeakPointer<DataSource> source;
+    qint64 size;
+    QDateTime modified;
+};
+
+QHash<QString, Entry> entries;
+
+QString keyOf(const QFileInfo &info)
+{
+    const QString canonical = info.canonicalFilePath();
+    return canonical.isEmpty() ? info.absoluteFilePath() : canonical;
+}
+
+}
+
+QSharedPointer<DataSource> DocumentCache::find(const QString &fileName)
+{
+    const QFileInfo info(fileName);
+    const auto it = entries.find(keyOf(info));
+    if (it == entries.end())
+        return QSharedPointer<DataSource>();
+    const QSharedPointer<DataSource> source = it->source.toStrongRef();
+    if (!source || info.size() != it->size || info.lastModified() != it->modified) {
+        entries.erase(it);
+        return QSharedPointer<DataSource>();
+    }
+    return source;
+}
+
+void DocumentCache::insert(const QString &fileName, const QSharedPointer<DataSource> &source)
+{
+    // Entries of closed files are dropped as new ones come in.
+    for (auto it = entries.begin(); it != entries.end();) {
+        if (it->source.isNull())
+            it = entries.erase(it);
+        else
+            ++it;
+    }
+    const QFileInfo info(fileName);
+    entries.insert(keyOf(info), { source, info.size(), info.lastModified() });
+}
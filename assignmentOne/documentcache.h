@@ -0,0 +1,24 @@
+#ifndef DOCUMENTCACHE_H
+#define DOCUMENTCACHE_H
+
+#include <QSharedPointer>
+#include <QString>
+
+class DataSource;
+
+// The sources of files open in any window, so opening a file again, in
+// the same window or another one, shares the data already read instead
+// of mapping, indexing or parsing it twice. Entries are weak: the data is
+// freed once no document uses it. An entry is only handed out while the
+// file's size and modification time are what they were when it was read.
+// GUI thread only, like the documents sharing the sources.
+class DocumentCache
+{
+public:
+    // Null when the file is not open anywhere or has changed since.
+    static QSharedPointer<DataSource> find(const QString &fileName);
+    // source must hold the file's contents as they are on disk now.
+    static void insert(const QString &fileName, const QSharedPointer<DataSource> &source);
+};
+
+#endif // DOCUMENTCACHE_H
@@ -0,0 +1,226 @@
+#include "editedsource.h"
+
+CellEdits::CellEdits()
+    : d(new Data)
+{
+}
+
+bool CellEdits::find(qint64 row, int column, QString *text) const
+{
+    const Data *data = d.constData();
+    if (data->count == 0)
+        return false;
+    const auto it = data->chunks.constFind(keyOf(row, column));
+    if (it == data->chunks.constEnd())
+        return false;
+    const Chunk *chunk = it->constData();
+    const int offset = int(row % ChunkRows);
+    if (!chunk->edited.testBit(offset))
+        return false;
+    *text = chunk->values.at(offset);
+    return true;
+}
+
+bool CellEdits::isRowEdited(qint64 row, int columnCount) const
+{
+    const Data *data = d.constData();
+    if (data->count == 0)
+        return false;
+    for (int column = 0; column < columnCount; ++column) {
+        const auto it = data->chunks.constFind(keyOf(row, column));
+        if (it != data->chunks.constEnd() && it->constData()->edited.testBit(int(row % ChunkRows)))
+            return true;
+    }
+    return false;
+}
+
+void CellEdits::set(qint64 row, int column, const QString &text)
+{
+    // Non-const access detaches the table of chunks, then just this chunk.
+    QSharedDataPointer<Chunk> &chunk = d->chunks[keyOf(row, column)];
+    if (!chunk) {
+        chunk = new Chunk;
+        chunk->values.resize(ChunkRows);
+        chunk->edited.resize(ChunkRows);
+    }
+    const int offset = int(row % ChunkRows);
+    if (!chunk.constData()->edited.testBit(offset)) {
+        chunk->edited.setBit(offset);
+        ++chunk->count;
+        ++d->count;
+    }
+    chunk->values[offset] = text;
+}
+
+void CellEdits::remove(qint64 row, int column)
+{
+    const quint64 key = keyOf(row, column);
+    const auto found = d.constData()->chunks.constFind(key);
+    const int offset = int(row % ChunkRows);
+    if (found == d.constData()->chunks.constEnd() || !found->constData()->edited.testBit(offset))
+        return;
+
+    const auto it = d->chunks.find(key);
+    --d->count;
+    if (it.value().constData()->count == 1) {
+        d->chunks.erase(it);
+        return;
+    }
+    Chunk *chunk = it.value().data();
+    chunk->edited.clearBit(offset);
+    chunk->values[offset] = QString();
+    --chunk->count;
+}
+
+void CellEdits::setRange(qint64 firstRow, qint64 lastRow, int column, const QString &text)
+{
+    for (qint64 row = firstRow; row <= lastRow;) {
+        const qint64 chunkFirst = row - row % ChunkRows;
+        const int begin = int(row - chunkFirst);
+        const int end = int(qMin(lastRow, chunkFirst + ChunkRows - 1) - chunkFirst);
+        QSharedDataPointer<Chunk> &chunk = d->chunks[keyOf(row, column)];
+        if (!chunk) {
+            chunk = new Chunk;
+            chunk->values.resize(ChunkRows);
+            chunk->edited.resize(ChunkRows);
+        }
+        // Every cell shares text's characters.
+        QString *values = chunk->values.data();
+        for (int i = begin; i <= end; ++i)
+            values[i] = text;
+        chunk->edited.fill(true, begin, end + 1);
+        const int count = chunk->edited.count(true);
+        d->count += count - chunk->count;
+        chunk->count = count;
+        row = chunkFirst + end + 1;
+    }
+}
+
+void CellEdits::removeRange(qint64 firstRow, qint64 lastRow, int column)
+{
+    for (qint64 row = firstRow; row <= lastRow;) {
+        const qint64 chunkFirst = row - row % ChunkRows;
+        const int begin = int(row - chunkFirst);
+        const int end = int(qMin(lastRow, chunkFirst + ChunkRows - 1) - chunkFirst);
+        row = chunkFirst + end + 1;
+        const quint64 key = keyOf(chunkFirst, column);
+        if (!d.constData()->chunks.contains(key))
+            continue;
+
+        const auto it = d->chunks.find(key);
+        if (begin == 0 && end == ChunkRows - 1) {
+            d->count -= it.value().constData()->count;
+            d->chunks.erase(it);
+            continue;
+        }
+        Chunk *chunk = it.value().data();
+        for (int i = begin; i <= end; ++i) {
+            if (chunk->edited.testBit(i)) {
+                chunk->edited.clearBit(i);
+                chunk->values[i] = QString();
+                --chunk->count;
+                --d->count;
+            }
+        }
+        if (chunk->count == 0)
+            d->chunks.erase(it);
+    }
+}
+
+void CellEdits::forEachRun(qint64 firstRow, qint64 lastRow, int column, const RunVisitor &visit) const
+{
+    qint64 runFirst = firstRow;
+    qint64 runCount = 0;
+    bool runEdited = false;
+    QString runText;
+    const auto extend = [&](qint64 row, qint64 count, bool edited, const QString &text) {
+        if (runCount > 0 && (edited != runEdited || (edited && text != runText))) {
+            visit(runFirst, runCount, runEdited ? &runText : nullptr);
+            runCount = 0;
+        }
+        if (runCount == 0) {
+            runFirst = row;
+            runEdited = edited;
+            runText = text;
+        }
+        runCount += count;
+    };
+
+    const Data *data = d.constData();
+    for (qint64 row = firstRow; row <= lastRow;) {
+        const qint64 chunkFirst = row - row % ChunkRows;
+        const qint64 chunkLast = qMin(lastRow, chunkFirst + ChunkRows - 1);
+        const auto it = data->chunks.constFind(keyOf(row, column));
+        if (it == data->chunks.constEnd()) {
+            extend(row, chunkLast - row + 1, false, QString());
+        } else {
+            const Chunk *chunk = it->constData();
+            for (qint64 r = row; r <= chunkLast; ++r) {
+                const int offset = int(r - chunkFirst);
+                const bool edited = chunk->edited.testBit(offset);
+                extend(r, 1, edited, edited ? chunk->values.at(offset) : QString());
+            }
+        }
+        row = chunkLast + 1;
+    }
+    if (runCount > 0)
+        visit(runFirst, runCount, runEdited ? &runText : nullptr);
+}
+
+EditedSource::EditedSource(const QSharedPointer<DataSource> &base, const CellEdits &edits)
+    : m_base(base)
+    , m_edits(edits)
+{
+}
+
+QSharedPointer<DataSource> EditedSource::base() const
+{
+    return m_base;
+}
+
+const CellEdits &EditedSource::edits() const
+{
+    return m_edits;
+}
+
+CellEdits &EditedSource::edits()
+{
+    return m_edits;
+}
+
+qint64 EditedSource::rowCount() const
+{
+    return m_base->rowCount();
+}
+
+int EditedSource::columnCount() const
+{
+    return m_base->columnCount();
+}
+
+QString EditedSource::columnName(int column) const
+{
+    return m_base->columnName(column);
+}
+
+QString EditedSource::cellText(qint64 row, int column) const
+{
+    QString text;
+    if (m_edits.find(row, column, &text))
+        return text;
+    return m_base->cellText(row, column);
+}
+
+const char *EditedSource::rowData(qint64 row, qint64 *length) const
+{
+    if (m_edits.isRowEdited(row, m_base->columnCount())) {
+        *length = 0;
+        return nullptr;
+    }
+    return m_base->rowData(row, length);
+}
+
+QSharedPointer<DataSource> EditedSource::clone() const
+{
+    return QSharedPointer<DataSource>(new EditedSource(m_base->clone(), m_edits));
+}
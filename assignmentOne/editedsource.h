@@ -0,0 +1,92 @@
+#ifndef EDITEDSOURCE_H
+#define EDITEDSOURCE_H
+
+#include "datasource.h"
+
+#include <QBitArray>
+#include <QHash>
+#include <QSharedData>
+#include <QVector>
+
+#include <functional>
+
+// Cell values that replace those of a source, kept per column in chunks of
+// ChunkRows rows. Implicitly shared: a copy shares every chunk, and a
+// write copies only the one chunk it touches, so documents forked from
+// each other keep sharing all the cells neither of them changed.
+class CellEdits
+{
+public:
+    static const int ChunkRows = 4096;
+
+    CellEdits();
+
+    bool isEmpty() const { return d->count == 0; }
+    // Number of edited cells.
+    qint64 count() const { return d->count; }
+
+    // True, with the value in text, when the cell was edited.
+    bool find(qint64 row, int column, QString *text) const;
+    bool isRowEdited(qint64 row, int columnCount) const;
+
+    void set(qint64 row, int column, const QString &text);
+    // Back to the source's value.
+    void remove(qint64 row, int column);
+
+    // The same for rows firstRow to lastRow of column, a chunk at a time.
+    void setRange(qint64 firstRow, qint64 lastRow, int column, const QString &text);
+    void removeRange(qint64 firstRow, qint64 lastRow, int column);
+
+    // Calls visit for each run of consecutive rows with the same edited
+    // value, or with no edit, in which case text is null.
+    typedef std::function<void(qint64 firstRow, qint64 count, const QString *text)> RunVisitor;
+    void forEachRun(qint64 firstRow, qint64 lastRow, int column, const RunVisitor &visit) const;
+
+private:
+    struct Chunk : public QSharedData
+    {
+        QVector<QString> values;
+        QBitArray edited;
+        int count = 0;
+    };
+
+    struct Data : public QSharedData
+    {
+        QHash<quint64, QSharedDataPointer<Chunk>> chunks;
+        qint64 count = 0;
+    };
+
+    static quint64 keyOf(qint64 row, int column)
+    {
+        return (quint64(column) << 40) | quint64(row / ChunkRows);
+    }
+
+    QSharedDataPointer<Data> d;
+};
+
+// A source with some of its cells replaced. Edits go to this object only;
+// clones take a copy of the edits as they are, so workers keep reading a
+// consistent table while the GUI thread goes on editing.
+class EditedSource : public DataSource
+{
+public:
+    explicit EditedSource(const QSharedPointer<DataSource> &base, const CellEdits &edits = CellEdits());
+
+    QSharedPointer<DataSource> base() const;
+    const CellEdits &edits() const;
+    CellEdits &edits();
+
+    qint64 rowCount() const override;
+    int columnCount() const override;
+    QString columnName(int column) const override;
+    QString cellText(qint64 row, int column) const override;
+    // The stored bytes no longer describe edited rows; those have none.
+    const char *rowData(qint64 row, qint64 *length) const override;
+    QSharedPointer<DataSource> clone() const override;
+
+private:
+    QSharedPointer<DataSource> m_base;
+    CellEdits m_edits;
+};
+
+#endif // EDITEDSOURCE_H
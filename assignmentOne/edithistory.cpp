@@ -0,0 +1,249 @@
+#include "edithistory.h"
+
+#include "editedsource.h"
+
+#include <QVector>
+
+#include <cstring>
+#include <new>
+
+struct EditHistory::Record
+{
+    qint64 firstRow;
+    qint64 count;
+    qint32 column;
+    // -1 when the cells had no edit.
+    qint32 oldLength;
+    qint32 newLength;
+    // Of the record and its text, a multiple of 8.
+    qint32 bytes;
+
+    const QChar *oldText() const { return reinterpret_cast<const QChar *>(this + 1); }
+    const QChar *newText() const { return oldText() + qMax(oldLength, 0); }
+};
+
+EditHistory::EditHistory()
+{
+    m_clock.start();
+}
+
+EditHistory::~EditHistory() = default;
+
+qint64 EditHistory::capacity() const
+{
+    return m_capacity;
+}
+
+void EditHistory::setCapacity(qint64 bytes)
+{
+    m_capacity = bytes;
+    // Dropping the oldest entries past the current one would leave redo
+    // steps whose predecessors are gone.
+    if (m_bytes > m_capacity)
+        dropRedo();
+    while (m_bytes > m_capacity && m_entries.size() > 1)
+        dropOldest();
+}
+
+qint64 EditHistory::bytes() const
+{
+    return m_bytes;
+}
+
+bool EditHistory::canUndo() const
+{
+    return m_current > 0;
+}
+
+bool EditHistory::canRedo() const
+{
+    return m_current < int(m_entries.size());
+}
+
+int EditHistory::undoCount() const
+{
+    return m_current;
+}
+
+int EditHistory::redoCount() const
+{
+    return int(m_entries.size()) - m_current;
+}
+
+void EditHistory::clear()
+{
+    m_entries.clear();
+    m_firstBlock += qint64(m_blocks.size());
+    m_blocks.clear();
+    m_current = 0;
+    m_bytes = 0;
+}
+
+EditHistory::Block &EditHistory::block(qint64 id)
+{
+    return m_blocks[size_t(id - m_firstBlock)];
+}
+
+template<typename Visit>
+void EditHistory::forEachRecord(const Entry &entry, Visit visit)
+{
+    for (qint64 id = entry.firstBlock; id >= 0 && id <= entry.lastBlock; ++id) {
+        const Block &b = block(id);
+        const char *data = b.data.get() + (id == entry.firstBlock ? entry.startOffset : 0);
+        const char *end = b.data.get() + (id == entry.lastBlock ? entry.endOffset : b.used);
+        while (data < end) {
+            const Record *record = reinterpret_cast<const Record *>(data);
+            visit(*record);
+            data += record->bytes;
+        }
+    }
+}
+
+void EditHistory::record(const CellEdits &edits, int column, qint64 firstRow, qint64 lastRow, const QString &text,
+                         bool mergeable)
+{
+    dropRedo();
+    const qint64 now = m_clock.elapsed();
+    mergeable = mergeable && firstRow == lastRow;
+    bool merge = false;
+    if (mergeable && !m_entries.empty()) {
+        const Entry &top = m_entries.back();
+        merge = top.mergeable && now - top.editedAtMs < MergeIntervalMs
+                && top.bounds.firstColumn == column && top.bounds.lastColumn == column
+                && firstRow >= top.bounds.firstRow - 1 && firstRow <= top.bounds.lastRow + 1;
+    }
+    if (!merge) {
+        Entry entry;
+        entry.firstBlock = -1;
+        entry.startOffset = 0;
+        entry.lastBlock = -1;
+        entry.endOffset = 0;
+        entry.bounds.firstRow = firstRow;
+        entry.bounds.lastRow = lastRow;
+        entry.bounds.firstColumn = column;
+        entry.bounds.lastColumn = column;
+        entry.mergeable = mergeable;
+        m_entries.push_back(entry);
+        ++m_current;
+    }
+
+    edits.forEachRun(firstRow, lastRow, column, [this, column, &text](qint64 first, qint64 count, const QString *old) {
+        appendRecord(column, first, count, old, text);
+    });
+    Entry &entry = m_entries.back();
+    entry.bounds.firstRow = qMin(entry.bounds.firstRow, firstRow);
+    entry.bounds.lastRow = qMax(entry.bounds.lastRow, lastRow);
+    entry.editedAtMs = now;
+
+    while (m_bytes > m_capacity && m_entries.size() > 1)
+        dropOldest();
+}
+
+bool EditHistory::undo(CellEdits &edits, Bounds *changed)
+{
+    if (m_current == 0)
+        return false;
+    Entry &entry = m_entries[size_t(--m_current)];
+    // Later records of an entry may overwrite cells of earlier ones.
+    QVector<const Record *> records;
+    forEachRecord(entry, [&records](const Record &record) { records.append(&record); });
+    for (int i = records.size() - 1; i >= 0; --i)
+        apply(edits, *records.at(i), true);
+    *changed = entry.bounds;
+    // An edit after an undo starts a new entry.
+    if (m_current > 0)
+        m_entries[size_t(m_current - 1)].mergeable = false;
+    return true;
+}
+
+bool EditHistory::redo(CellEdits &edits, Bounds *changed)
+{
+    if (m_current == int(m_entries.size()))
+        return false;
+    Entry &entry = m_entries[size_t(m_current++)];
+    forEachRecord(entry, [&edits](const Record &record) { apply(edits, record, false); });
+    *changed = entry.bounds;
+    entry.mergeable = false;
+    return true;
+}
+
+void EditHistory::apply(CellEdits &edits, const Record &record, bool undo)
+{
+    const qint64 lastRow = record.firstRow + record.count - 1;
+    const qint32 length = undo ? record.oldLength : record.newLength;
+    if (length < 0)
+        edits.removeRange(record.firstRow, lastRow, record.column);
+    else
+        edits.setRange(record.firstRow, lastRow, record.column,
+                       QString(undo ? record.oldText() : record.newText(), length));
+}
+
+char *EditHistory::allocate(qint64 bytes)
+{
+    if (m_blocks.empty() || m_blocks.back().used + bytes > m_blocks.back().size) {
+        // A record larger than a block gets a block of its own.
+        Block block;
+        block.size = qMax<qint64>(BlockSize, bytes);
+        block.data.reset(new char[size_t(block.size)]);
+        block.allocation = MemoryAllocation(MemoryTracker::UndoHistory, block.size);
+        m_bytes += block.size;
+        m_blocks.push_back(std::move(block));
+    }
+    Block &last = m_blocks.back();
+    char *data = last.data.get() + last.used;
+    last.used += bytes;
+    return data;
+}
+
+void EditHistory::appendRecord(int column, qint64 firstRow, qint64 count, const QString *oldText,
+                               const QString &newText)
+{
+    const qint32 oldLength = oldText ? qint32(oldText->size()) : -1;
+    const qint32 newLength = qint32(newText.size());
+    const qint64 bytes = (qint64(sizeof(Record)) + (qMax(oldLength, 0) + newLength) * qint64(sizeof(QChar)) + 7)
+            & ~qint64(7);
+    char *data = allocate(bytes);
+    Record *record = new (data) Record { firstRow, count, column, oldLength, newLength, qint32(bytes) };
+    if (oldLength > 0)
+        std::memcpy(const_cast<QChar *>(record->oldText()), oldText->constData(), oldLength * sizeof(QChar));
+    if (newLength > 0)
+        std::memcpy(const_cast<QChar *>(record->newText()), newText.constData(), newLength * sizeof(QChar));
+
+    Entry &entry = m_entries.back();
+    const qint64 lastBlock = m_firstBlock + qint64(m_blocks.size()) - 1;
+    if (entry.firstBlock < 0) {
+        entry.firstBlock = lastBlock;
+        entry.startOffset = data - m_blocks.back().data.get();
+    }
+    entry.lastBlock = lastBlock;
+    entry.endOffset = m_blocks.back().used;
+}
+
+// Entries after the current one are the last ones in the arena.
+void EditHistory::dropRedo()
+{
+    while (int(m_entries.size()) > m_current) {
+        const Entry entry = m_entries.back();
+        m_entries.pop_back();
+        if (entry.firstBlock < 0)
+            continue;
+        while (m_firstBlock + qint64(m_blocks.size()) - 1 > entry.firstBlock) {
+            m_bytes -= m_blocks.back().size;
+            m_blocks.pop_back();
+        }
+        block(entry.firstBlock).used = entry.startOffset;
+    }
+}
+
+void EditHistory::dropOldest()
+{
+    m_entries.pop_front();
+    m_current = qMax(0, m_current - 1);
+    const qint64 keepFrom = m_entries.empty() ? m_firstBlock + qint64(m_blocks.size())
+                                              : m_entries.front().firstBlock;
+    while (!m_blocks.empty() && m_firstBlock < keepFrom) {
+        m_bytes -= m_blocks.front().size;
+        m_blocks.pop_front();
+        ++m_firstBlock;
+    }
+}
@@ -0,0 +1,105 @@
+#ifndef EDITHISTORY_H
+#define EDITHISTORY_H
+
+#include "memorytracker.h"
+
+#include <QElapsedTimer>
+#include <QString>
+
+#include <deque>
+#include <memory>
+
+class CellEdits;
+
+// Undo and redo for the edits of a document. An entry is a list of
+// records, each a run of rows in one column with the value they had and
+// the value they got, so filling a million cells that had not been edited
+// takes one record, not a million commands. Records are packed into
+// arena blocks of BlockSize bytes that are freed as whole blocks.
+//
+// Single-cell edits in the same column on neighbouring rows, made within
+// MergeIntervalMs of each other, merge into one entry. Past the capacity,
+// the oldest entries are forgotten; the newest one is always kept. Lowering
+// the capacity below what is held forgets what could be redone first.
+class EditHistory
+{
+public:
+    static const qint64 DefaultCapacity = qint64(64) << 20;
+    static const int BlockSize = 256 << 10;
+    static const int MergeIntervalMs = 2000;
+
+    // The cells an undo or redo changed.
+    struct Bounds
+    {
+        qint64 firstRow = 0;
+        qint64 lastRow = -1;
+        int firstColumn = 0;
+        int lastColumn = -1;
+    };
+
+    EditHistory();
+    ~EditHistory();
+
+    qint64 capacity() const;
+    void setCapacity(qint64 bytes);
+    // Arena bytes held.
+    qint64 bytes() const;
+
+    bool canUndo() const;
+    bool canRedo() const;
+    int undoCount() const;
+    int redoCount() const;
+    void clear();
+
+    // Call before setting rows firstRow to lastRow of column in edits to
+    // text. Forgets what could be redone.
+    void record(const CellEdits &edits, int column, qint64 firstRow, qint64 lastRow, const QString &text,
+                bool mergeable);
+
+    bool undo(CellEdits &edits, Bounds *changed);
+    bool redo(CellEdits &edits, Bounds *changed);
+
+private:
+    struct Record;
+
+    struct Block
+    {
+        std::unique_ptr<char[]> data;
+        qint64 size = 0;
+        qint64 used = 0;
+        MemoryAllocation allocation;
+    };
+
+    struct Entry
+    {
+        // -1 until the first record is allocated.
+        qint64 firstBlock;
+        qint64 startOffset;
+        qint64 lastBlock;
+        qint64 endOffset;
+        Bounds bounds;
+        qint64 editedAtMs;
+        bool mergeable;
+    };
+
+    static void apply(CellEdits &edits, const Record &record, bool undo);
+    char *allocate(qint64 bytes);
+    void appendRecord(int column, qint64 firstRow, qint64 count, const QString *oldText, const QString &newText);
+    void dropRedo();
+    void dropOldest();
+    Block &block(qint64 id);
+    template<typename Visit>
+    void forEachRecord(const Entry &entry, Visit visit);
+
+    std::deque<Block> m_blocks;
+    // Id of m_blocks.front(); ids keep counting up as blocks are freed.
+    qint64 m_firstBlock = 0;
+    std::deque<Entry> m_entries;
+    // Entries before it are applied; the rest can be redone.
+    int m_current = 0;
+    qint64 m_bytes = 0;
+    qint64 m_capacity = DefaultCapacity;
+    QElapsedTimer m_clock;
+};
+
+#endif // EDITHISTORY_H
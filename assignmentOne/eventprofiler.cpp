@@ -0,0 +1,289 @@
+#include "eventprofiler.h"
+
+#include <QAbstractEventDispatcher>
+#include <QEvent>
+#include <QFile>
+#include <QMetaEnum>
+#include <QMutex>
+#include <QTextStream>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+namespace {
+
+// Event types past this share the last slot (user and dynamic types).
+const int TypeSlots = 256;
+
+quint64 nowNs()
+{
+    return quint64(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// Only the owning thread writes, so plain load + store is enough; readers
+// on other threads may see a slightly stale but never torn value.
+inline void bump(std::atomic<quint64> &counter, quint64 delta)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
+inline void raise(std::atomic<quint64> &counter, quint64 value)
+{
+    if (value > counter.load(std::memory_order_relaxed))
+        counter.store(value, std::memory_order_relaxed);
+}
+
+struct Histogram
+{
+    std::atomic<quint64> buckets[LatencyStats::BucketCount] = {};
+    std::atomic<quint64> count { 0 };
+    std::atomic<quint64> totalNs { 0 };
+    std::atomic<quint64> maxNs { 0 };
+
+    void record(quint64 nsecs)
+    {
+        bump(buckets[LatencyStats::bucketFor(nsecs)], 1);
+        bump(count, 1);
+        bump(totalNs, nsecs);
+        raise(maxNs, nsecs);
+    }
+};
+
+struct TypeCounters
+{
+    std::atomic<quint64> count { 0 };
+    std::atomic<quint64> totalNs { 0 };
+    std::atomic<quint64> maxNs { 0 };
+};
+
+struct ThreadBuffer
+{
+    Histogram categories[EventProfiler::CategoryCount];
+    TypeCounters types[TypeSlots];
+};
+
+// Buffers outlive their threads so nothing recorded is lost; pool threads
+// are reused, so the list stays short.
+QMutex registryMutex;
+QVector<ThreadBuffer *> registry;
+thread_local ThreadBuffer *localBuffer = nullptr;
+
+std::atomic<bool> enabled { true };
+quint64 iterationStartNs = 0;
+
+ThreadBuffer *buffer()
+{
+    if (!localBuffer) {
+        localBuffer = new ThreadBuffer;
+        QMutexLocker locker(&registryMutex);
+        registry.append(localBuffer);
+    }
+    return localBuffer;
+}
+
+QString eventTypeName(int type)
+{
+    if (type == TypeSlots - 1)
+        return QStringLiteral("Other");
+    const char *key = QMetaEnum::fromType<QEvent::Type>().valueToKey(type);
+    return key ? QString::fromLatin1(key) : QStringLiteral("Type%1").arg(type);
+}
+
+}
+
+LatencyStats::LatencyStats()
+    : m_buckets(BucketCount, 0)
+{
+}
+
+// Below 16 us buckets are 1 us wide; above, each power of two is split in 8.
+int LatencyStats::bucketFor(quint64 nsecs)
+{
+    const quint64 us = nsecs / 1000;
+    if (us < 16)
+        return int(us);
+    int exponent = 63;
+    while (!(us >> exponent))
+        --exponent;
+    const int sub = int((us >> (exponent - 3)) & 7);
+    return qMin(BucketCount - 1, 16 + (exponent - 4) * 8 + sub);
+}
+
+double LatencyStats::bucketUpperMs(int bucket)
+{
+    if (bucket < 16)
+        return (bucket + 1) / 1000.0;
+    const int exponent = 4 + (bucket - 16) / 8;
+    const int sub = (bucket - 16) % 8;
+    return double((quint64(8 + sub + 1)) << (exponent - 3)) / 1000.0;
+}
+
+double LatencyStats::quantileMs(double q) const
+{
+    if (m_count == 0)
+        return 0.0;
+    const quint64 rank = quint64(q * double(m_count - 1)) + 1;
+    quint64 seen = 0;
+    for (int i = 0; i < BucketCount; ++i) {
+        seen += m_buckets.at(i);
+        if (seen >= rank)
+            return qMin(bucketUpperMs(i), maxMs());
+    }
+    return maxMs();
+}
+
+double LatencyStats::maxMs() const
+{
+    if (m_maxNs)
+        return m_maxNs / 1e6;
+    for (int i = BucketCount - 1; i >= 0; --i) {
+        if (m_buckets.at(i))
+            return bucketUpperMs(i);
+    }
+    return 0.0;
+}
+
+quint64 LatencyStats::countAbove(double ms) const
+{
+    quint64 above = 0;
+    for (int i = bucketFor(quint64(ms * 1e6)) + 1; i < BucketCount; ++i)
+        above += m_buckets.at(i);
+    return above;
+}
+
+LatencyStats &LatencyStats::operator+=(const LatencyStats &other)
+{
+    for (int i = 0; i < BucketCount; ++i)
+        m_buckets[i] += other.m_buckets.at(i);
+    m_count += other.m_count;
+    m_totalNs += other.m_totalNs;
+    m_maxNs = qMax(m_maxNs, other.m_maxNs);
+    return *this;
+}
+
+// The exact maximum cannot be subtracted out; the interval falls back to
+// the upper bound of its highest bucket.
+LatencyStats LatencyStats::operator-(const LatencyStats &other) const
+{
+    LatencyStats result;
+    for (int i = 0; i < BucketCount; ++i)
+        result.m_buckets[i] = m_buckets.at(i) - qMin(m_buckets.at(i), other.m_buckets.at(i));
+    result.m_count = m_count - qMin(m_count, other.m_count);
+    result.m_totalNs = m_totalNs - qMin(m_totalNs, other.m_totalNs);
+    return result;
+}
+
+void EventProfiler::install()
+{
+    QAbstractEventDispatcher *dispatcher = QAbstractEventDispatcher::instance();
+    if (!dispatcher)
+        return;
+    QObject::connect(dispatcher, &QAbstractEventDispatcher::awake, [] {
+        iterationStartNs = nowNs();
+    });
+    QObject::connect(dispatcher, &QAbstractEventDispatcher::aboutToBlock, [] {
+        if (iterationStartNs && isEnabled())
+            recordLoopIteration(nowNs() - iterationStartNs);
+        iterationStartNs = 0;
+    });
+}
+
+bool EventProfiler::isEnabled()
+{
+    return enabled.load(std::memory_order_relaxed);
+}
+
+void EventProfiler::setEnabled(bool on)
+{
+    enabled.store(on, std::memory_order_relaxed);
+}
+
+void EventProfiler::recordEvent(int type, quint64 nsecs)
+{
+    ThreadBuffer *b = buffer();
+    b->categories[Dispatch].record(nsecs);
+    TypeCounters &counters = b->types[qBound(0, type, TypeSlots - 1)];
+    bump(counters.count, 1);
+    bump(counters.totalNs, nsecs);
+    raise(counters.maxNs, nsecs);
+}
+
+void EventProfiler::recordPaint(quint64 nsecs)
+{
+    buffer()->categories[Paint].record(nsecs);
+}
+
+void EventProfiler::recordLoopIteration(quint64 nsecs)
+{
+    buffer()->categories[LoopIteration].record(nsecs);
+}
+
+EventProfiler::Snapshot EventProfiler::snapshot()
+{
+    Snapshot result;
+    QVector<EventTypeStats> types(TypeSlots);
+    for (int t = 0; t < TypeSlots; ++t)
+        types[t].type = t;
+
+    QMutexLocker locker(&registryMutex);
+    for (const ThreadBuffer *b : qAsConst(registry)) {
+        for (int c = 0; c < CategoryCount; ++c) {
+            const Histogram &h = b->categories[c];
+            LatencyStats &stats = result.categories[c];
+            for (int i = 0; i < LatencyStats::BucketCount; ++i)
+                stats.m_buckets[i] += h.buckets[i].load(std::memory_order_relaxed);
+            stats.m_count += h.count.load(std::memory_order_relaxed);
+            stats.m_totalNs += h.totalNs.load(std::memory_order_relaxed);
+            stats.m_maxNs = qMax(stats.m_maxNs, h.maxNs.load(std::memory_order_relaxed));
+        }
+        for (int t = 0; t < TypeSlots; ++t) {
+            types[t].count += b->types[t].count.load(std::memory_order_relaxed);
+            types[t].totalNs += b->types[t].totalNs.load(std::memory_order_relaxed);
+            types[t].maxNs = qMax(types[t].maxNs, b->types[t].maxNs.load(std::memory_order_relaxed));
+        }
+    }
+    locker.unlock();
+
+    for (const EventTypeStats &type : qAsConst(types)) {
+        if (type.count)
+            result.eventTypes.append(type);
+    }
+    std::sort(result.eventTypes.begin(), result.eventTypes.end(),
+              [](const EventTypeStats &a, const EventTypeStats &b) { return a.totalNs > b.totalNs; });
+    return result;
+}
+
+QString EventProfiler::report(const Snapshot &snapshot)
+{
+    static const char *const CategoryNames[CategoryCount] = { "dispatch", "paint", "loop iteration" };
+
+    QString text;
+    QTextStream stream(&text);
+    stream << "category,count,total_ms,p50_ms,p99_ms,max_ms,over_16ms\n";
+    for (int c = 0; c < CategoryCount; ++c) {
+        const LatencyStats &stats = snapshot.categories[c];
+        stream << CategoryNames[c] << ',' << stats.count() << ',' << stats.totalMs() << ','
+               << stats.quantileMs(0.5) << ',' << stats.quantileMs(0.99) << ','
+               << stats.maxMs() << ',' << stats.countAbove(16.0) << '\n';
+    }
+    stream << "\nevent_type,count,total_ms,mean_us,max_ms\n";
+    for (const EventTypeStats &type : snapshot.eventTypes) {
+        stream << eventTypeName(type.type) << ',' << type.count << ',' << type.totalNs / 1e6 << ','
+               << type.totalNs / 1e3 / type.count << ',' << type.maxNs / 1e6 << '\n';
+    }
+    return text;
+}
+
+bool EventProfiler::dump(const QString &fileName, QString *errorString)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        if (errorString)
+            *errorString = file.errorString();
+        return false;
+    }
+    file.write(report(snapshot()).toUtf8());
+    return true;
+}
@@ -0,0 +1,76 @@
+#ifndef EVENTPROFILER_H
+#define EVENTPROFILER_H
+
+#include <QString>
+#include <QVector>
+
+// Latency distribution with ~12% wide log-scale buckets over microseconds.
+// A snapshot is a plain value; subtract two to get an interval.
+class LatencyStats
+{
+public:
+    static const int BucketCount = 320;
+
+    LatencyStats();
+
+    static int bucketFor(quint64 nsecs);
+    static double bucketUpperMs(int bucket);
+
+    quint64 count() const { return m_count; }
+    double totalMs() const { return m_totalNs / 1e6; }
+    double quantileMs(double q) const;
+    double maxMs() const;
+    quint64 countAbove(double ms) const;
+
+    LatencyStats &operator+=(const LatencyStats &other);
+    LatencyStats operator-(const LatencyStats &other) const;
+
+private:
+    friend class EventProfiler;
+
+    QVector<quint64> m_buckets;
+    quint64 m_count = 0;
+    quint64 m_totalNs = 0;
+    quint64 m_maxNs = 0;
+};
+
+// Records how long the GUI spends dispatching events, painting frames of
+// its windows, and in each event loop iteration. Writers only touch buffers owned by their own
+// thread, so recording takes no locks; readers merge all threads.
+class EventProfiler
+{
+public:
+    enum Category { Dispatch, Paint, LoopIteration, CategoryCount };
+
+    struct EventTypeStats
+    {
+        int type = 0;
+        quint64 count = 0;
+        quint64 totalNs = 0;
+        quint64 maxNs = 0;
+    };
+
+    struct Snapshot
+    {
+        LatencyStats categories[CategoryCount];
+        QVector<EventTypeStats> eventTypes;
+    };
+
+    // Hooks the current thread's event dispatcher to time loop iterations.
+    static void install();
+
+    // Checked by callers before taking timestamps; on by default.
+    static bool isEnabled();
+    static void setEnabled(bool enabled);
+
+    static void recordEvent(int type, quint64 nsecs);
+    // One repaint of a window, all its dirty widgets included.
+    static void recordPaint(quint64 nsecs);
+    static void recordLoopIteration(quint64 nsecs);
+
+    static Snapshot snapshot();
+    static QString report(const Snapshot &snapshot);
+    static bool dump(const QString &fileName, QString *errorString = nullptr);
+};
+
+#endif // EVENTPROFILER_H
@@ -0,0 +1,76 @@
+#include "filefollower.h"
+
+#include "mappedtextfile.h"
+#include "trace.h"
+
+FileFollower::FileFollower(QObject *parent)
+    : QObject(parent)
+{
+    m_readTimer.setSingleShot(true);
+    m_pollTimer.setInterval(PollIntervalMs);
+    connect(&m_watcher, &QFileSystemWatcher::fileChanged, this, &FileFollower::scheduleRead);
+    connect(&m_readTimer, &QTimer::timeout, this, &FileFollower::readAppended);
+    connect(&m_pollTimer, &QTimer::timeout, this, &FileFollower::scheduleRead);
+}
+
+void FileFollower::follow(const QSharedPointer<MappedTextFile> &file)
+{
+    stop();
+    m_file = file;
+    if (!m_file)
+        return;
+    m_watcher.addPath(m_file->fileName());
+    m_pollTimer.start();
+    m_sinceRead.start();
+    // Catch up with whatever was written since the file was opened.
+    readAppended();
+}
+
+void FileFollower::stop()
+{
+    if (!m_watcher.files().isEmpty())
+        m_watcher.removePaths(m_watcher.files());
+    m_readTimer.stop();
+    m_pollTimer.stop();
+    m_file.reset();
+}
+
+bool FileFollower::isFollowing() const
+{
+    return !m_file.isNull();
+}
+
+QSharedPointer<MappedTextFile> FileFollower::file() const
+{
+    return m_file;
+}
+
+void FileFollower::scheduleRead()
+{
+    if (!m_file || m_readTimer.isActive())
+        return;
+    m_readTimer.start(int(qMax<qint64>(0, MinReadIntervalMs - m_sinceRead.elapsed())));
+}
+
+void FileFollower::readAppended()
+{
+    if (!m_file)
+        return;
+    TRACE_SCOPE("FileFollower::readAppended");
+    m_sinceRead.restart();
+    bool lastLineCompleted = false;
+    QString errorString;
+    const qint64 added = m_file->readAppended(&lastLineCompleted, &errorString);
+    if (added < 0) {
+        stop();
+        emit failed(errorString);
+        return;
+    }
+    if (lastLineCompleted)
+        emit lastLineChanged();
+    if (added > 0)
+        emit linesAppended(added);
+    // Some editors and rotators replace the file, which drops the watch.
+    if (m_watcher.files().isEmpty())
+        m_watcher.addPath(m_file->fileName());
+}
@@ -0,0 +1,50 @@
+#ifndef FILEFOLLOWER_H
+#define FILEFOLLOWER_H
+
+#include <QElapsedTimer>
+#include <QFileSystemWatcher>
+#include <QObject>
+#include <QSharedPointer>
+#include <QTimer>
+
+class MappedTextFile;
+
+// Watches a MappedTextFile on disk and reads what gets appended to it.
+// Change notifications are coalesced, so a log written thousands of times
+// a second is read at most every MinReadIntervalMs; a slow poll covers
+// file systems that do not report changes.
+class FileFollower : public QObject
+{
+    Q_OBJECT
+
+public:
+    static const int MinReadIntervalMs = 50;
+    static const int PollIntervalMs = 1000;
+
+    explicit FileFollower(QObject *parent = nullptr);
+
+    void follow(const QSharedPointer<MappedTextFile> &file);
+    void stop();
+    bool isFollowing() const;
+    QSharedPointer<MappedTextFile> file() const;
+
+signals:
+    void linesAppended(qint64 count);
+    // The last line was mapped without its newline and has now been
+    // completed, so its text changed.
+    void lastLineChanged();
+    // The file shrank or could not be read; following has stopped.
+    void failed(const QString &errorString);
+
+private:
+    void scheduleRead();
+    void readAppended();
+
+    QSharedPointer<MappedTextFile> m_file;
+    QFileSystemWatcher m_watcher;
+    QTimer m_readTimer;
+    QTimer m_pollTimer;
+    QElapsedTimer m_sinceRead;
+};
+
+#endif // FILEFOLLOWER_H
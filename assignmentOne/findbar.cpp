@@ -0,0 +1,238 @@
+#include "findbar.h"
+
+#include "rowsearch.h"
+#include "sortfilterproxy.h"
+
+#include <QHBoxLayout>
+#include <QLabel>
+#include <QLineEdit>
+#include <QLocale>
+#include <QShortcut>
+#include <QToolButton>
+
+#include <limits>
+
+namespace {
+
+// Above one match per this many visible rows, a sorted view is walked
+// rather than every match looked up.
+const int DenseMatchRatio = 64;
+
+}
+
+FindBar::FindBar(TaskEngine *tasks, QWidget *parent)
+    : QWidget(parent)
+    , m_search(new RowSearch(tasks, this))
+    , m_edit(new QLineEdit(this))
+    , m_caseButton(new QToolButton(this))
+    , m_regexButton(new QToolButton(this))
+    , m_status(new QLabel(this))
+{
+    m_edit->setPlaceholderText(tr("Find"));
+    m_edit->setClearButtonEnabled(true);
+    m_caseButton->setText(QStringLiteral("Aa"));
+    m_caseButton->setToolTip(tr("Match case"));
+    m_caseButton->setCheckable(true);
+    m_caseButton->setAutoRaise(true);
+    m_regexButton->setText(QStringLiteral(".*"));
+    m_regexButton->setToolTip(tr("Regular expression"));
+    m_regexButton->setCheckable(true);
+    m_regexButton->setAutoRaise(true);
+
+    QToolButton *previousButton = new QToolButton(this);
+    previousButton->setText(tr("Previous"));
+    previousButton->setAutoRaise(true);
+    QToolButton *nextButton = new QToolButton(this);
+    nextButton->setText(tr("Next"));
+    nextButton->setAutoRaise(true);
+    QToolButton *closeButton = new QToolButton(this);
+    closeButton->setText(QString(QChar(0x00d7)));
+    closeButton->setToolTip(tr("Close"));
+    closeButton->setAutoRaise(true);
+
+    QHBoxLayout *layout = new QHBoxLayout(this);
+    layout->setContentsMargins(4, 2, 4, 2);
+    layout->addWidget(m_edit, 1);
+    layout->addWidget(m_caseButton);
+    layout->addWidget(m_regexButton);
+    layout->addWidget(m_status);
+    layout->addWidget(previousButton);
+    layout->addWidget(nextButton);
+    layout->addWidget(closeButton);
+
+    connect(m_edit, &QLineEdit::textChanged, this, &FindBar::restart);
+    connect(m_caseButton, &QToolButton::toggled, this, &FindBar::restart);
+    connect(m_regexButton, &QToolButton::toggled, this, &FindBar::restart);
+    connect(m_edit, &QLineEdit::returnPressed, this, &FindBar::findNext);
+    connect(previousButton, &QToolButton::clicked, this, &FindBar::findPrevious);
+    connect(nextButton, &QToolButton::clicked, this, &FindBar::findNext);
+    connect(closeButton, &QToolButton::clicked, this, &FindBar::dismiss);
+    new QShortcut(QKeySequence(Qt::SHIFT | Qt::Key_Return), m_edit, this, &FindBar::findPrevious,
+                  Qt::WidgetShortcut);
+    new QShortcut(QKeySequence(Qt::Key_Escape), this, this, &FindBar::dismiss, Qt::WidgetWithChildrenShortcut);
+
+    connect(m_search, &RowSearch::matchesChanged, this, [this] {
+        // Jump to the first hit as soon as there is one.
+        if (m_currentMatch < 0 && m_search->matchCount() > 0)
+            findNext();
+        updateStatus();
+    });
+}
+
+QSharedPointer<DataSource> FindBar::source() const
+{
+    return m_source;
+}
+
+void FindBar::setSource(const QSharedPointer<DataSource> &source)
+{
+    m_source = source;
+    if (isVisible())
+        restart();
+}
+
+void FindBar::setProxy(SortFilterProxy *proxy)
+{
+    m_proxy = proxy;
+}
+
+void FindBar::activate()
+{
+    show();
+    m_edit->setFocus();
+    m_edit->selectAll();
+    if (!m_search->isRunning() && m_search->query().text != m_edit->text())
+        restart();
+}
+
+void FindBar::findNext()
+{
+    activateMatch(m_proxy && m_proxy->isSorted() ? stepInProxyOrder(true) : stepInSourceOrder(true));
+}
+
+void FindBar::findPrevious()
+{
+    activateMatch(m_proxy && m_proxy->isSorted() ? stepInProxyOrder(false) : stepInSourceOrder(false));
+}
+
+void FindBar::dismiss()
+{
+    m_search->cancel();
+    hide();
+    emit dismissed();
+}
+
+void FindBar::restart()
+{
+    SearchQuery query;
+    query.text = m_edit->text();
+    query.regularExpression = m_regexButton->isChecked();
+    query.caseSensitivity = m_caseButton->isChecked() ? Qt::CaseSensitive : Qt::CaseInsensitive;
+    m_currentMatch = -1;
+    m_search->start(m_source, query);
+    updateStatus();
+}
+
+void FindBar::updateStatus()
+{
+    if (!m_search->errorString().isEmpty()) {
+        m_status->setText(tr("Invalid pattern: %1").arg(m_search->errorString()));
+        return;
+    }
+    if (m_search->query().text.isEmpty()) {
+        m_status->clear();
+        return;
+    }
+
+    const QLocale locale;
+    QString text = m_search->matchCount() == 1 ? tr("1 match")
+                                               : tr("%1 matches").arg(locale.toString(m_search->matchCount()));
+    if (m_search->isRunning() && m_search->totalRows() > 0)
+        text += tr(" (%1% searched)").arg(m_search->scannedRows() * 100 / m_search->totalRows());
+    m_status->setText(text);
+}
+
+void FindBar::activateMatch(qint64 row)
+{
+    if (row < 0)
+        return;
+    m_currentMatch = row;
+    emit matchActivated(row);
+}
+
+bool FindBar::isShown(qint64 row) const
+{
+    if (!m_proxy || !m_proxy->sourceModel())
+        return true;
+    const QAbstractItemModel *model = m_proxy->sourceModel();
+    // Rows the model has not taken in yet are shown once it does.
+    if (row >= model->rowCount())
+        return true;
+    return m_proxy->mapFromSource(model->index(int(row), 0)).isValid();
+}
+
+// A filter keeps the source order, so the matches are walked as found and
+// the hidden ones passed over; once around at most.
+qint64 FindBar::stepInSourceOrder(bool forward) const
+{
+    const qint64 restart = forward ? -1 : std::numeric_limits<qint64>::max();
+    qint64 row = m_currentMatch < 0 ? restart : m_currentMatch;
+    bool wrapped = false;
+    for (;;) {
+        row = forward ? m_search->nextMatch(row) : m_search->previousMatch(row);
+        if (row < 0) {
+            if (wrapped)
+                return -1;
+            wrapped = true;
+            row = restart;
+            continue;
+        }
+        if (isShown(row))
+            return row;
+        if (wrapped && m_currentMatch >= 0 && (forward ? row >= m_currentMatch : row <= m_currentMatch))
+            return -1;
+    }
+}
+
+// Sorted, the next match in view order can be anywhere in source order.
+// Few matches are each looked up in the proxy; when they are dense, the
+// view is walked row by row from the current one instead, which reaches
+// one after a few rows.
+qint64 FindBar::stepInProxyOrder(bool forward) const
+{
+    const int rows = m_proxy->rowCount();
+    if (rows == 0 || m_search->matchCount() == 0)
+        return -1;
+    const QAbstractItemModel *model = m_proxy->sourceModel();
+    int current = m_currentMatch >= 0 && m_currentMatch < model->rowCount()
+            ? m_proxy->mapFromSource(model->index(int(m_currentMatch), 0)).row() : -1;
+    if (current < 0)
+        current = forward ? -1 : rows;
+    // Distance from current in the direction of travel, wrapping around.
+    const auto distance = [rows, current, forward](int row) {
+        const int d = forward ? row - current : current - row;
+        return d > 0 ? d : d + rows;
+    };
+
+    if (m_search->matchCount() < rows / DenseMatchRatio) {
+        qint64 best = -1;
+        int bestDistance = std::numeric_limits<int>::max();
+        for (qint64 row = m_search->nextMatch(-1); row >= 0 && row < model->rowCount();
+             row = m_search->nextMatch(row)) {
+            const int viewRow = m_proxy->mapFromSource(model->index(int(row), 0)).row();
+            if (viewRow >= 0 && distance(viewRow) < bestDistance) {
+                best = row;
+                bestDistance = distance(viewRow);
+            }
+        }
+        return best;
+    }
+
+    for (int step = 1; step <= rows; ++step) {
+        const int viewRow = ((forward ? current + step : current - step) % rows + rows) % rows;
+        const qint64 row = m_proxy->mapToSource(m_proxy->index(viewRow, 0)).row();
+        if (row >= 0 && m_search->isMatch(row))
+            return row;
+    }
+    return -1;
+}
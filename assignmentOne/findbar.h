@@ -0,0 +1,61 @@
+#ifndef FINDBAR_H
+#define FINDBAR_H
+
+#include <QSharedPointer>
+#include <QWidget>
+
+class DataSource;
+class QLabel;
+class QLineEdit;
+class QToolButton;
+class RowSearch;
+class SortFilterProxy;
+class TaskEngine;
+
+// Incremental search strip shown under the views. Every edit cancels the
+// running RowSearch and starts a new one; the first hit is shown as soon
+// as it is found, and Next/Previous step through the matches found so far.
+// With a proxy set they step in its order and pass over the rows its
+// filter hides.
+class FindBar : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit FindBar(TaskEngine *tasks, QWidget *parent = nullptr);
+
+    QSharedPointer<DataSource> source() const;
+    void setSource(const QSharedPointer<DataSource> &source);
+    void setProxy(SortFilterProxy *proxy);
+    // Shows the bar and focuses the search field.
+    void activate();
+
+public slots:
+    void findNext();
+    void findPrevious();
+    // Stops the search and hides the bar.
+    void dismiss();
+
+signals:
+    void matchActivated(qint64 row);
+    void dismissed();
+
+private:
+    void restart();
+    void updateStatus();
+    void activateMatch(qint64 row);
+    bool isShown(qint64 row) const;
+    qint64 stepInSourceOrder(bool forward) const;
+    qint64 stepInProxyOrder(bool forward) const;
+
+    RowSearch *m_search;
+    QSharedPointer<DataSource> m_source;
+    SortFilterProxy *m_proxy = nullptr;
+    QLineEdit *m_edit;
+    QToolButton *m_caseButton;
+    QToolButton *m_regexButton;
+    QLabel *m_status;
+    qint64 m_currentMatch = -1;
+};
+
+#endif // FINDBAR_H
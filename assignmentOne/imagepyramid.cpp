@@ -0,0 +1,614 @@
+#include "imagepyramid.h"
+
+#include "taskengine.h"
+#include "trace.h"
+
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QThread>
+
+#include <cstring>
+#include <vector>
+
+#ifdef HAVE_LIBJPEG
+#include <csetjmp>
+#include <cstdio>
+extern "C" {
+#include <jpeglib.h>
+}
+#endif
+
+namespace {
+
+const char Magic[8] = { 'P', 'N', 'T', 'I', 'L', 'E', '\r', '\n' };
+const int CompressionLevel = 1;
+// About the most decoded at once when an image is read in strips; a strip
+// is at least one row of tiles.
+const qint64 StripBytes = qint64(64) << 20;
+
+struct Header
+{
+    char magic[8];
+    quint32 version;
+    quint32 tileSize;
+    quint32 format;
+    quint32 levels;
+    qint32 width;
+    qint32 height;
+    qint64 sourceSize;
+    qint64 sourceModified;
+};
+
+QString tr(const char *text)
+{
+    return QCoreApplication::translate("ImagePyramid", text);
+}
+
+qint64 modifiedMs(const QFileInfo &info)
+{
+    return info.lastModified().toMSecsSinceEpoch();
+}
+
+int tilesAcross(int pixels)
+{
+    return (pixels + ImagePyramid::TileSize - 1) / ImagePyramid::TileSize;
+}
+
+QVector<QSize> levelSizes(QSize size)
+{
+    QVector<QSize> sizes { size };
+    while (size.width() > ImagePyramid::TileSize || size.height() > ImagePyramid::TileSize) {
+        size = QSize((size.width() + 1) / 2, (size.height() + 1) / 2);
+        sizes.append(size);
+    }
+    return sizes;
+}
+
+// Mean of four pixels, channel by channel, two channels at a time.
+inline quint32 average(quint32 a, quint32 b, quint32 c, quint32 d)
+{
+    const quint32 even = (a & 0x00ff00ff) + (b & 0x00ff00ff) + (c & 0x00ff00ff) + (d & 0x00ff00ff) + 0x00020002;
+    const quint32 odd = ((a >> 8) & 0x00ff00ff) + ((b >> 8) & 0x00ff00ff) + ((c >> 8) & 0x00ff00ff)
+            + ((d >> 8) & 0x00ff00ff) + 0x00020002;
+    return ((even >> 2) & 0x00ff00ff) | (((odd >> 2) & 0x00ff00ff) << 8);
+}
+
+// Box-filtered half of a 32-bit image; an odd last row or column is
+// averaged with itself.
+QImage halve(const QImage &source, const TaskContext *context)
+{
+    QImage target((source.width() + 1) / 2, (source.height() + 1) / 2, source.format());
+    if (target.isNull())
+        return target;
+    const int lastX = source.width() - 1;
+    const int lastY = source.height() - 1;
+    const int width = target.width();
+    // Taken once: scanLine() on a non-const image checks for sharing.
+    uchar *bits = target.bits();
+    const qsizetype stride = target.bytesPerLine();
+    TaskEngine::parallelFor(target.height(), 16, [&source, bits, stride, width, lastX, lastY](qint64 begin, qint64 end) {
+        for (int y = int(begin); y < int(end); ++y) {
+            const quint32 *top = reinterpret_cast<const quint32 *>(source.constScanLine(2 * y));
+            const quint32 *bottom = reinterpret_cast<const quint32 *>(source.constScanLine(qMin(2 * y + 1, lastY)));
+            quint32 *out = reinterpret_cast<quint32 *>(bits + y * stride);
+            for (int x = 0; x < width; ++x) {
+                const int left = 2 * x;
+                const int right = qMin(left + 1, lastX);
+                out[x] = average(top[left], top[right], bottom[left], bottom[right]);
+            }
+        }
+    }, context);
+    return target;
+}
+
+// The rows of top followed by those of bottom; both are as wide and have
+// the same format.
+QImage stacked(const QImage &top, const QImage &bottom)
+{
+    QImage image(top.width(), top.height() + bottom.height(), top.format());
+    if (image.isNull())
+        return image;
+    uchar *bits = image.bits();
+    std::memcpy(bits, top.constBits(), size_t(top.sizeInBytes()));
+    std::memcpy(bits + top.sizeInBytes(), bottom.constBits(), size_t(bottom.sizeInBytes()));
+    return image;
+}
+
+#ifdef HAVE_LIBJPEG
+// A JPEG decoded top to bottom a strip at a time by one decompressor, so
+// every row is decoded once. A QImageReader clip decodes all the rows
+// above it again for every strip.
+class JpegStrips
+{
+public:
+    explicit JpegStrips(const QString &fileName)
+        : m_file(fileName)
+    {
+        if (!m_file.open(QIODevice::ReadOnly))
+            return;
+        const uchar *data = m_file.map(0, m_file.size());
+        if (!data)
+            return;
+        m_info.err = jpeg_std_error(&m_error.base);
+        m_error.base.error_exit = errorExit;
+        jpeg_create_decompress(&m_info);
+        m_created = true;
+        if (setjmp(m_error.jump))
+            return;
+        jpeg_mem_src(&m_info, const_cast<uchar *>(data), static_cast<unsigned long>(m_file.size()));
+        jpeg_read_header(&m_info, TRUE);
+        // CMYK is left to QImageReader, which knows Adobe's inverted form.
+        if (m_info.jpeg_color_space == JCS_CMYK || m_info.jpeg_color_space == JCS_YCCK)
+            return;
+        const bool gray = m_info.num_components == 1;
+        m_info.out_color_space = gray ? JCS_GRAYSCALE : JCS_RGB;
+        m_format = gray ? QImage::Format_Grayscale8 : QImage::Format_RGB888;
+        jpeg_start_decompress(&m_info);
+        m_started = true;
+    }
+
+    ~JpegStrips()
+    {
+        if (m_created)
+            jpeg_destroy_decompress(&m_info);
+    }
+
+    bool isOpen() const { return m_started; }
+    QSize size() const { return QSize(int(m_info.output_width), int(m_info.output_height)); }
+
+    // The next rows of the image.
+    QImage read(int rows, QString *errorString)
+    {
+        QImage image(size().width(), rows, m_format);
+        if (image.isNull()) {
+            if (errorString)
+                *errorString = tr("Not enough memory to decode the image");
+            return image;
+        }
+        uchar *bits = image.bits();
+        const qsizetype stride = image.bytesPerLine();
+        const JDIMENSION first = m_info.output_scanline;
+        if (setjmp(m_error.jump)) {
+            if (errorString)
+                *errorString = QString::fromLocal8Bit(m_error.message);
+            return QImage();
+        }
+        while (m_info.output_scanline < first + JDIMENSION(rows)) {
+            JSAMPROW row = bits + (m_info.output_scanline - first) * stride;
+            jpeg_read_scanlines(&m_info, &row, 1);
+        }
+        return image;
+    }
+
+private:
+    struct ErrorManager
+    {
+        jpeg_error_mgr base;
+        std::jmp_buf jump;
+        char message[JMSG_LENGTH_MAX];
+    };
+
+    static void errorExit(j_common_ptr info)
+    {
+        ErrorManager *error = reinterpret_cast<ErrorManager *>(info->err);
+        error->base.format_message(info, error->message);
+        std::longjmp(error->jump, 1);
+    }
+
+    QFile m_file;
+    jpeg_decompress_struct m_info;
+    ErrorManager m_error;
+    QImage::Format m_format = QImage::Format_RGB888;
+    bool m_created = false;
+    bool m_started = false;
+};
+#endif
+
+}
+
+ImagePyramid::ImagePyramid()
+{
+}
+
+ImagePyramid::~ImagePyramid()
+{
+    if (m_data)
+        m_file.unmap(reinterpret_cast<uchar *>(const_cast<char *>(m_data)));
+}
+
+QString ImagePyramid::pyramidFileName(const QString &imageFile)
+{
+    const QString path = QFileInfo(imageFile).canonicalFilePath();
+    const QByteArray key = QCryptographicHash::hash(path.toUtf8(), QCryptographicHash::Sha1).toHex();
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation)
+            + QStringLiteral("/images/") + QString::fromLatin1(key) + QStringLiteral(".tiles");
+}
+
+template<typename ReadStrip>
+bool ImagePyramid::write(QSize imageSize, ReadStrip readStrip, const QString &imageFile,
+                         const QString &pyramidFile, QString *errorString, TaskContext *context)
+{
+    TRACE_SCOPE("ImagePyramid::build");
+    const auto fail = [errorString](const QString &message) {
+        if (errorString)
+            *errorString = message;
+        return false;
+    };
+    const QFileInfo source(imageFile);
+    if (!source.exists())
+        return fail(tr("%1 does not exist").arg(imageFile));
+    if (imageSize.isEmpty())
+        return fail(tr("The image is empty"));
+
+    const int width = imageSize.width();
+    const int height = imageSize.height();
+    const int stripRows = int(qMax<qint64>(1, StripBytes / (qint64(width) * 4 * TileSize))) * TileSize;
+    QImage strip = readStrip(0, qMin(stripRows, height), errorString);
+    if (strip.isNull())
+        return false;
+    const QImage::Format format = strip.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied
+                                                          : QImage::Format_RGB32;
+    const QVector<QSize> sizes = levelSizes(imageSize);
+
+    Header header;
+    std::memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = Version;
+    header.tileSize = TileSize;
+    header.format = format;
+    header.levels = quint32(sizes.size());
+    header.width = width;
+    header.height = height;
+    header.sourceSize = source.size();
+    header.sourceModified = modifiedMs(source);
+
+    QDir().mkpath(QFileInfo(pyramidFile).absolutePath());
+    QSaveFile file(pyramidFile);
+    if (!file.open(QIODevice::WriteOnly))
+        return fail(file.errorString());
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    std::vector<qint64> firstTile;
+    qint64 totalTiles = 0;
+    for (const QSize &size : sizes) {
+        firstTile.push_back(totalTiles);
+        totalTiles += qint64(tilesAcross(size.width())) * tilesAcross(size.height());
+    }
+    if (context) {
+        context->setProgressRange(totalTiles);
+        context->setProgress(0);
+    }
+
+    // Tiles are written as their rows come in, so the levels interleave in
+    // the file; the index puts them in order.
+    std::vector<TileEntry> index(size_t(totalTiles), TileEntry { 0, 0, 0 });
+    qint64 position = sizeof(header);
+    // Compressed in batches on all cores, so only a batch is held at once.
+    const int batch = 4 * qMax(1, QThread::idealThreadCount());
+    std::vector<QByteArray> packed(size_t(batch));
+    const auto writeTiles = [&](int level, int firstRow, const QImage &rows) {
+        const int columns = tilesAcross(rows.width());
+        const qint64 tiles = qint64(columns) * tilesAcross(rows.height());
+        const qint64 slot = firstTile[size_t(level)] + qint64(firstRow / TileSize) * columns;
+        for (qint64 first = 0; first < tiles; first += batch) {
+            const qint64 count = qMin<qint64>(batch, tiles - first);
+            TaskEngine::parallelFor(count, 1, [&rows, &packed, first, columns, context](qint64 begin, qint64 end) {
+                for (qint64 i = begin; i < end; ++i) {
+                    const int column = int((first + i) % columns);
+                    const int row = int((first + i) / columns);
+                    // copy() packs the rows, so the tile is one run of bytes.
+                    const QImage tile = rows.copy(column * TileSize, row * TileSize,
+                                                  qMin(TileSize, rows.width() - column * TileSize),
+                                                  qMin(TileSize, rows.height() - row * TileSize));
+                    packed[size_t(i)] = qCompress(tile.constBits(), tile.sizeInBytes(), CompressionLevel);
+                    if (context)
+                        context->addProgress(1);
+                }
+            }, context);
+            if (context && context->isCanceled())
+                return false;
+            for (qint64 i = 0; i < count; ++i) {
+                const QByteArray &bytes = packed[size_t(i)];
+                index[size_t(slot + first + i)] = { position, quint32(bytes.size()), 0 };
+                file.write(bytes);
+                position += bytes.size();
+            }
+        }
+        return true;
+    };
+
+    // Whole tile rows of a level are written and halved into the next one;
+    // what is left over waits there for the rows that complete it.
+    std::vector<int> rowsDone(size_t(sizes.size()), 0);
+    std::vector<QImage> pending(size_t(sizes.size()));
+    QString error;
+    const auto feed = [&](QImage rows) {
+        for (int level = 0; level < sizes.size(); ++level) {
+            QImage &waiting = pending[size_t(level)];
+            if (!waiting.isNull()) {
+                rows = stacked(waiting, rows);
+                waiting = QImage();
+                if (rows.isNull()) {
+                    error = tr("Not enough memory to reduce the image");
+                    return false;
+                }
+            }
+            const int done = rowsDone[size_t(level)];
+            const bool last = done + rows.height() == sizes.at(level).height();
+            const int ready = last ? rows.height() : rows.height() / TileSize * TileSize;
+            if (ready < rows.height()) {
+                waiting = rows.copy(0, ready, rows.width(), rows.height() - ready);
+                rows = rows.copy(0, 0, rows.width(), ready);
+            }
+            if (ready == 0)
+                return true;
+            if (!writeTiles(level, done, rows)) {
+                error = tr("Canceled");
+                return false;
+            }
+            rowsDone[size_t(level)] = done + ready;
+            if (level + 1 < sizes.size()) {
+                rows = halve(rows, context);
+                if (rows.isNull()) {
+                    error = tr("Not enough memory to reduce the image");
+                    return false;
+                }
+            }
+        }
+        return true;
+    };
+
+    for (int y = 0;;) {
+        const int rows = qMin(stripRows, height - y);
+        if (strip.size() != QSize(width, rows)) {
+            file.cancelWriting();
+            return fail(tr("The image could not be read in strips"));
+        }
+        strip = strip.convertToFormat(format);
+        if (strip.isNull()) {
+            file.cancelWriting();
+            return fail(tr("Not enough memory to convert the image"));
+        }
+        if (!feed(std::move(strip))) {
+            file.cancelWriting();
+            return fail(error);
+        }
+        y += rows;
+        if (y == height)
+            break;
+        strip = readStrip(y, qMin(stripRows, height - y), errorString);
+        if (strip.isNull()) {
+            file.cancelWriting();
+            return false;
+        }
+    }
+
+    const char padding[8] = {};
+    const qint64 indexOffset = (position + 7) & ~qint64(7);
+    file.write(padding, indexOffset - position);
+    file.write(reinterpret_cast<const char *>(index.data()), qint64(index.size() * sizeof(TileEntry)));
+    file.write(reinterpret_cast<const char *>(&indexOffset), sizeof(indexOffset));
+    if (!file.commit())
+        return fail(file.errorString());
+    return true;
+}
+
+bool ImagePyramid::build(const QString &imageFile, const QString &pyramidFile,
+                         QString *errorString, TaskContext *context)
+{
+    TRACE_SCOPE("ImagePyramid::decode");
+    QImageReader reader(imageFile);
+    reader.setAutoTransform(true);
+    const QSize size = reader.size();
+    // Strips are rows of the image as stored, so a rotated one is read
+    // whole.
+    if (size.isValid() && reader.transformation() == QImageIOHandler::TransformationNone) {
+#ifdef HAVE_LIBJPEG
+        if (reader.format() == "jpeg") {
+            JpegStrips jpeg(imageFile);
+            if (jpeg.isOpen() && jpeg.size() == size) {
+                const auto readStrip = [&jpeg](int, int rows, QString *errorString) {
+                    return jpeg.read(rows, errorString);
+                };
+                return write(size, readStrip, imageFile, pyramidFile, errorString, context);
+            }
+        }
+#endif
+        // Every clip decodes the rows above it too, so this costs about
+        // height / stripRows / 2 full decodes; still better than running
+        // out of memory.
+        if (reader.supportsOption(QImageIOHandler::ClipRect)) {
+            const auto readStrip = [&imageFile, size](int y, int rows, QString *errorString) {
+                // A reader decodes once; every strip takes a new one.
+                QImageReader strip(imageFile);
+                strip.setAutoTransform(false);
+                strip.setClipRect(QRect(0, y, size.width(), rows));
+                const QImage image = strip.read();
+                if (image.isNull() && errorString)
+                    *errorString = strip.errorString();
+                return image;
+            };
+            return write(size, readStrip, imageFile, pyramidFile, errorString, context);
+        }
+    }
+
+    QImage image = reader.read();
+    if (image.isNull()) {
+        if (errorString)
+            *errorString = reader.errorString();
+        return false;
+    }
+    return build(std::move(image), imageFile, pyramidFile, errorString, context);
+}
+
+bool ImagePyramid::build(QImage image, const QString &imageFile, const QString &pyramidFile,
+                         QString *errorString, TaskContext *context)
+{
+    const auto readStrip = [&image](int y, int rows, QString *errorString) {
+        const QImage strip = image.copy(0, y, image.width(), rows);
+        if (strip.isNull() && errorString)
+            *errorString = tr("Not enough memory to convert the image");
+        return strip;
+    };
+    return write(image.size(), readStrip, imageFile, pyramidFile, errorString, context);
+}
+
+QSharedPointer<ImagePyramid> ImagePyramid::open(const QString &imageFile, const QString &pyramidFile, QString *reason)
+{
+    TRACE_SCOPE("ImagePyramid::open");
+    const auto fail = [reason](const QString &message) {
+        if (reason)
+            *reason = message;
+        return QSharedPointer<ImagePyramid>();
+    };
+    QSharedPointer<ImagePyramid> pyramid(new ImagePyramid);
+    QFile &file = pyramid->m_file;
+    file.setFileName(pyramidFile);
+    if (!file.exists())
+        return fail(tr("no pyramid"));
+    if (!file.open(QIODevice::ReadOnly))
+        return fail(file.errorString());
+    const qint64 size = file.size();
+    if (size < qint64(sizeof(Header) + sizeof(qint64)))
+        return fail(tr("pyramid truncated"));
+    const char *base = reinterpret_cast<const char *>(file.map(0, size));
+    if (!base)
+        return fail(file.errorString());
+    pyramid->m_data = base;
+
+    Header header;
+    std::memcpy(&header, base, sizeof(header));
+    if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0 || header.version != Version
+            || header.tileSize != quint32(TileSize))
+        return fail(tr("pyramid from another version"));
+    const QFileInfo source(imageFile);
+    if (header.sourceSize != source.size() || header.sourceModified != modifiedMs(source))
+        return fail(tr("file changed since it was tiled"));
+
+    const auto damaged = [&pyramid, &fail] {
+        const QString fileName = pyramid->m_file.fileName();
+        pyramid.reset();
+        QFile::remove(fileName);
+        return fail(tr("pyramid damaged"));
+    };
+    if (header.width <= 0 || header.height <= 0
+            || (header.format != QImage::Format_RGB32 && header.format != QImage::Format_ARGB32_Premultiplied))
+        return damaged();
+    const QVector<QSize> sizes = levelSizes(QSize(header.width, header.height));
+    if (header.levels != quint32(sizes.size()))
+        return damaged();
+
+    qint64 tiles = 0;
+    for (const QSize &levelSize : sizes) {
+        Level level;
+        level.size = levelSize;
+        level.columns = tilesAcross(levelSize.width());
+        level.rows = tilesAcross(levelSize.height());
+        level.firstTile = tiles;
+        tiles += qint64(level.columns) * level.rows;
+        pyramid->m_levels.append(level);
+    }
+
+    qint64 indexOffset = 0;
+    std::memcpy(&indexOffset, base + size - sizeof(indexOffset), sizeof(indexOffset));
+    if (indexOffset < qint64(sizeof(Header)) || indexOffset % 8 != 0
+            || indexOffset + tiles * qint64(sizeof(TileEntry)) + qint64(sizeof(indexOffset)) != size)
+        return damaged();
+    const TileEntry *entries = reinterpret_cast<const TileEntry *>(base + indexOffset);
+    for (qint64 i = 0; i < tiles; ++i) {
+        if (entries[i].offset < qint64(sizeof(Header)) || entries[i].offset + entries[i].storedSize > indexOffset)
+            return damaged();
+    }
+    pyramid->m_tiles = entries;
+    pyramid->m_format = QImage::Format(header.format);
+    pyramid->m_cache.setMaxCost(DefaultCacheBudget);
+    return pyramid;
+}
+
+QSize ImagePyramid::imageSize() const
+{
+    return m_levels.first().size;
+}
+
+int ImagePyramid::levelCount() const
+{
+    return int(m_levels.size());
+}
+
+QSize ImagePyramid::levelSize(int level) const
+{
+    return m_levels.at(level).size;
+}
+
+int ImagePyramid::columnCount(int level) const
+{
+    return m_levels.at(level).columns;
+}
+
+int ImagePyramid::rowCount(int level) const
+{
+    return m_levels.at(level).rows;
+}
+
+QImage ImagePyramid::tile(int level, int column, int row) const
+{
+    if (level < 0 || level >= m_levels.size())
+        return QImage();
+    const Level &l = m_levels.at(level);
+    if (column < 0 || row < 0 || column >= l.columns || row >= l.rows)
+        return QImage();
+    const quint64 key = (quint64(level) << 48) | (quint64(row) << 24) | quint64(column);
+    {
+        QMutexLocker locker(&m_cacheMutex);
+        if (const CachedTile *cached = m_cache.object(key))
+            return cached->image;
+    }
+
+    // Decoded outside the lock; two threads asking for the same tile at
+    // once both decode it, which is cheaper than making one wait.
+    TRACE_SCOPE("ImagePyramid::decodeTile");
+    const TileEntry &entry = m_tiles[l.firstTile + qint64(row) * l.columns + column];
+    const QSize size(qMin(TileSize, l.size.width() - column * TileSize),
+                     qMin(TileSize, l.size.height() - row * TileSize));
+    const QByteArray raw = qUncompress(reinterpret_cast<const uchar *>(m_data + entry.offset), entry.storedSize);
+    QImage image(size, m_format);
+    if (raw.size() != image.sizeInBytes())
+        return QImage();
+    std::memcpy(image.bits(), raw.constData(), size_t(raw.size()));
+
+    QMutexLocker locker(&m_cacheMutex);
+    m_cache.insert(key, new CachedTile { image, MemoryAllocation(MemoryTracker::ImageTiles, image.sizeInBytes()) },
+                   image.sizeInBytes());
+    return image;
+}
+
+void ImagePyramid::setCacheBudget(qint64 bytes)
+{
+    QMutexLocker locker(&m_cacheMutex);
+    m_cache.setMaxCost(bytes);
+}
+
+qint64 ImagePyramid::cacheBudget() const
+{
+    QMutexLocker locker(&m_cacheMutex);
+    return m_cache.maxCost();
+}
+
+qint64 ImagePyramid::cachedBytes() const
+{
+    QMutexLocker locker(&m_cacheMutex);
+    return m_cache.totalCost();
+}
+
+void ImagePyramid::trimCache(qint64 bytes)
+{
+    QMutexLocker locker(&m_cacheMutex);
+    const qint64 budget = m_cache.maxCost();
+    m_cache.setMaxCost(qMax<qint64>(0, m_cache.totalCost() - bytes));
+    m_cache.setMaxCost(budget);
+}
@@ -0,0 +1,116 @@
+#ifndef IMAGEPYRAMID_H
+#define IMAGEPYRAMID_H
+
+#include "memorytracker.h"
+
+#include <QCache>
+#include <QFile>
+#include <QImage>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QVector>
+
+class TaskContext;
+
+// A large image cut into TileSize x TileSize tiles at every halving,
+// stored in one file in the user's cache directory and tied to the
+// source's size and modification time. Tiles are zlib-compressed and
+// decoded from the mapped file on demand; decoded tiles are kept in an
+// LRU cache bounded by a byte budget, so memory use does not depend on
+// the size of the image. The cache counts as MemoryTracker::ImageTiles.
+//
+// Layout, native byte order: a header, the compressed tiles in the order
+// they were made, the tile index level by level in row-major order, and
+// the index offset.
+class ImagePyramid
+{
+public:
+    static const quint32 Version = 1;
+    static const int TileSize = 256;
+    static const qint64 DefaultCacheBudget = qint64(256) << 20;
+
+    ~ImagePyramid();
+
+    // Where the pyramid for imageFile lives.
+    static QString pyramidFileName(const QString &imageFile);
+
+    // Decodes imageFile and writes its pyramid to pyramidFile. The file is
+    // replaced atomically, so a reader never sees it half written. JPEGs
+    // are decoded a strip of rows at a time through libjpeg when it was
+    // found at build time, so only a strip of every level is held at once.
+    // Without it, formats that can decode a clip are read in strips too,
+    // but each clip decodes every row above it again, so the work grows
+    // with the square of the height. Other formats are decoded whole.
+    static bool build(const QString &imageFile, const QString &pyramidFile,
+                      QString *errorString = nullptr, TaskContext *context = nullptr);
+    // Same for an image that is already decoded; imageFile only ties the
+    // pyramid to its source.
+    static bool build(QImage image, const QString &imageFile, const QString &pyramidFile,
+                      QString *errorString = nullptr, TaskContext *context = nullptr);
+    // Null if pyramidFile is missing, older than imageFile or damaged;
+    // reason then says which. A damaged pyramid is removed.
+    static QSharedPointer<ImagePyramid> open(const QString &imageFile, const QString &pyramidFile,
+                                             QString *reason = nullptr);
+
+    QSize imageSize() const;
+    // Level 0 is the image itself; every further level halves the one
+    // before, rounding up, until the whole image fits in one tile.
+    int levelCount() const;
+    QSize levelSize(int level) const;
+    int columnCount(int level) const;
+    int rowCount(int level) const;
+
+    // Safe to call from any thread. Null outside the level, or if the
+    // tile cannot be decoded.
+    QImage tile(int level, int column, int row) const;
+
+    void setCacheBudget(qint64 bytes);
+    qint64 cacheBudget() const;
+    qint64 cachedBytes() const;
+    // Drops least recently used tiles until about bytes were freed; the
+    // budget stays as it was.
+    void trimCache(qint64 bytes);
+
+private:
+    struct TileEntry
+    {
+        qint64 offset;
+        quint32 storedSize;
+        quint32 reserved;
+    };
+
+    struct Level
+    {
+        QSize size;
+        int columns;
+        int rows;
+        qint64 firstTile;
+    };
+
+    struct CachedTile
+    {
+        QImage image;
+        MemoryAllocation allocation;
+    };
+
+    ImagePyramid();
+    Q_DISABLE_COPY(ImagePyramid)
+
+    // readStrip(y, rows, errorString) returns rows y to y + rows - 1 of the
+    // image, or a null image after setting errorString. Strips are asked
+    // for in order from the top.
+    template<typename ReadStrip>
+    static bool write(QSize imageSize, ReadStrip readStrip, const QString &imageFile, const QString &pyramidFile,
+                      QString *errorString, TaskContext *context);
+
+    QFile m_file;
+    const char *m_data = nullptr;
+    QImage::Format m_format = QImage::Format_RGB32;
+    QVector<Level> m_levels;
+    const TileEntry *m_tiles = nullptr;
+
+    mutable QMutex m_cacheMutex;
+    mutable QCache<quint64, CachedTile> m_cache;
+};
+
+#endif // IMAGEPYRAMID_H
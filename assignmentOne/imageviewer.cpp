@@ -0,0 +1,263 @@
+#include "imageviewer.h"
+
+#include "imagepyramid.h"
+#include "taskengine.h"
+#include "trace.h"
+
+#include <QFileInfo>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QWheelEvent>
+
+#include <cmath>
+
+namespace {
+
+struct OpenResult
+{
+    QSharedPointer<ImagePyramid> pyramid;
+    QString errorString;
+};
+
+}
+
+ImageViewer::ImageViewer(TaskEngine *tasks, QWidget *parent)
+    : TiledCanvas(parent)
+    , m_tasks(tasks)
+    , m_cacheBudget(ImagePyramid::DefaultCacheBudget)
+{
+    setMinimumSize(200, 120);
+    MemoryTracker::addReclaimer(this, MemoryTracker::ImageTiles, [this](qint64 bytes) {
+        if (m_pyramid)
+            m_pyramid->trimCache(bytes);
+    });
+}
+
+void ImageViewer::openImage(const QString &fileName)
+{
+    if (m_build)
+        m_build->cancel();
+    m_pyramid.reset();
+    m_title = QFileInfo(fileName).fileName();
+    invalidateAll();
+
+    const QSharedPointer<OpenResult> result(new OpenResult);
+    Task *task = m_tasks->start(tr("Tiling %1").arg(m_title), Task::HighPriority,
+                                [fileName, result](TaskContext &context) {
+        // Tiles made on an earlier run are reused as they are.
+        const QString pyramidFile = ImagePyramid::pyramidFileName(fileName);
+        result->pyramid = ImagePyramid::open(fileName, pyramidFile);
+        if (result->pyramid)
+            return;
+        if (ImagePyramid::build(fileName, pyramidFile, &result->errorString, &context))
+            result->pyramid = ImagePyramid::open(fileName, pyramidFile, &result->errorString);
+    });
+    m_build = task;
+    connect(task, &Task::finished, this, [this, task, result] {
+        if (task != m_build || task->isCanceled())
+            return;
+        m_build = nullptr;
+        if (!result->pyramid) {
+            update();
+            emit failed(result->errorString);
+            return;
+        }
+        setPyramid(result->pyramid, m_title);
+    });
+}
+
+void ImageViewer::setPyramid(const QSharedPointer<ImagePyramid> &pyramid, const QString &title)
+{
+    if (m_build) {
+        m_build->cancel();
+        m_build = nullptr;
+    }
+    m_pyramid = pyramid;
+    m_title = title;
+    m_pyramid->setCacheBudget(m_cacheBudget);
+    // Forces new tiles even if the fitted scale happens to be the old one.
+    m_scale = 0;
+    fitImage();
+    emit ready();
+}
+
+bool ImageViewer::isReady() const
+{
+    return !m_pyramid.isNull();
+}
+
+QSharedPointer<ImagePyramid> ImageViewer::pyramid() const
+{
+    return m_pyramid;
+}
+
+void ImageViewer::setCacheBudget(qint64 bytes)
+{
+    m_cacheBudget = bytes;
+    if (m_pyramid)
+        m_pyramid->setCacheBudget(bytes);
+}
+
+qint64 ImageViewer::cacheBudget() const
+{
+    return m_cacheBudget;
+}
+
+double ImageViewer::scale() const
+{
+    return m_scale;
+}
+
+void ImageViewer::setView(const QPointF &imagePoint, double scale)
+{
+    if (!m_pyramid)
+        return;
+    scale = qBound(fitScale(), scale, maximumScale());
+    if (!qFuzzyCompare(scale, m_scale)) {
+        m_scale = scale;
+        invalidateAll();
+    }
+    setWorldOrigin(clampedOrigin(QPoint(qRound(imagePoint.x() * m_scale), qRound(imagePoint.y() * m_scale))));
+    update();
+}
+
+void ImageViewer::fitImage()
+{
+    setView(QPointF(0, 0), fitScale());
+}
+
+TiledCanvas::TileRenderer ImageViewer::createRenderer() const
+{
+    if (!m_pyramid)
+        return TileRenderer();
+
+    const QSharedPointer<ImagePyramid> pyramid = m_pyramid;
+    const double scale = m_scale;
+    return [pyramid, scale](QPainter *painter, const QRect &world) {
+        // The smallest level that still has at least one pixel per world pixel.
+        int level = 0;
+        while (level + 1 < pyramid->levelCount() && scale * (1 << (level + 1)) <= 1.0)
+            ++level;
+        const double levelScale = scale * (1 << level);
+        const int tileSize = ImagePyramid::TileSize;
+        const int lastColumn = pyramid->columnCount(level) - 1;
+        const int lastRow = pyramid->rowCount(level) - 1;
+        const int firstColumn = qMax(0, int(std::floor(world.left() / levelScale / tileSize)));
+        const int firstRow = qMax(0, int(std::floor(world.top() / levelScale / tileSize)));
+        const int endColumn = qMin(lastColumn, int(std::floor((world.right() + 1) / levelScale / tileSize)));
+        const int endRow = qMin(lastRow, int(std::floor((world.bottom() + 1) / levelScale / tileSize)));
+
+        painter->setRenderHint(QPainter::SmoothPixmapTransform, levelScale < 1.0);
+        for (int row = firstRow; row <= endRow; ++row) {
+            for (int column = firstColumn; column <= endColumn; ++column) {
+                const QImage tile = pyramid->tile(level, column, row);
+                if (tile.isNull())
+                    continue;
+                // Rounded edges are shared by neighbours, so no seams show.
+                const int left = qRound(column * tileSize * levelScale);
+                const int top = qRound(row * tileSize * levelScale);
+                const int right = qRound((column * tileSize + tile.width()) * levelScale);
+                const int bottom = qRound((row * tileSize + tile.height()) * levelScale);
+                painter->drawImage(QRect(left, top, right - left, bottom - top), tile);
+            }
+        }
+    };
+}
+
+void ImageViewer::paintOverlay(QPainter *painter)
+{
+    painter->setPen(palette().color(QPalette::Text));
+    if (!m_pyramid) {
+        const QString text = m_build ? tr("Tiling %1...").arg(m_title)
+                                     : m_title.isEmpty() ? tr("No image") : tr("Could not open %1").arg(m_title);
+        painter->drawText(rect(), Qt::AlignCenter, text);
+        return;
+    }
+
+    const QSize image = m_pyramid->imageSize();
+    const QString text = tr("%1  %2 x %3  %4%").arg(m_title).arg(image.width()).arg(image.height())
+            .arg(m_scale * 100, 0, 'f', m_scale < 0.1 ? 1 : 0);
+    const QRect box = painter->fontMetrics().boundingRect(text).adjusted(-4, -2, 4, 2);
+    const QRect label(QPoint(4, height() - box.height() - 4), box.size());
+    painter->fillRect(label, palette().color(QPalette::Window));
+    painter->drawText(label, Qt::AlignCenter, text);
+}
+
+void ImageViewer::resizeEvent(QResizeEvent *event)
+{
+    TiledCanvas::resizeEvent(event);
+    if (m_pyramid)
+        setWorldOrigin(clampedOrigin(worldOrigin()));
+}
+
+void ImageViewer::wheelEvent(QWheelEvent *event)
+{
+    if (!m_pyramid)
+        return;
+    const QPointF position = event->position() - canvasRect().topLeft();
+    const QPointF anchor = (QPointF(worldOrigin()) + position) / m_scale;
+    const double scale = qBound(fitScale(), m_scale * std::pow(1.25, event->angleDelta().y() / 120.0),
+                                maximumScale());
+    setView(anchor - position / scale, scale);
+    event->accept();
+}
+
+void ImageViewer::mousePressEvent(QMouseEvent *event)
+{
+    if (event->button() != Qt::LeftButton)
+        return;
+    m_dragging = true;
+    m_dragOrigin = event->position().toPoint();
+    m_dragWorldOrigin = worldOrigin();
+    setCursor(Qt::ClosedHandCursor);
+}
+
+void ImageViewer::mouseMoveEvent(QMouseEvent *event)
+{
+    if (!m_dragging || !m_pyramid)
+        return;
+    setWorldOrigin(clampedOrigin(m_dragWorldOrigin - (event->position().toPoint() - m_dragOrigin)));
+}
+
+void ImageViewer::mouseReleaseEvent(QMouseEvent *event)
+{
+    if (event->button() == Qt::LeftButton && m_dragging) {
+        m_dragging = false;
+        unsetCursor();
+    }
+}
+
+void ImageViewer::mouseDoubleClickEvent(QMouseEvent *)
+{
+    fitImage();
+}
+
+// Whole image in view, never enlarged; also the smallest zoom.
+double ImageViewer::fitScale() const
+{
+    if (!m_pyramid)
+        return 1.0;
+    const QSize image = m_pyramid->imageSize();
+    const QRect area = canvasRect();
+    return qMin(1.0, qMin(double(qMax(1, area.width())) / image.width(),
+                          double(qMax(1, area.height())) / image.height()));
+}
+
+// World coordinates are ints; keep the zoomed-in world below 2^30.
+double ImageViewer::maximumScale() const
+{
+    const QSize image = m_pyramid->imageSize();
+    return qMin(MaximumScale, double(1 << 30) / qMax(image.width(), image.height()));
+}
+
+// Keeps the image covering the view, or centred where it is smaller.
+QPoint ImageViewer::clampedOrigin(const QPoint &origin) const
+{
+    const QSize image = m_pyramid->imageSize();
+    const QSize world(qRound(image.width() * m_scale), qRound(image.height() * m_scale));
+    const QSize view = canvasRect().size();
+    const auto clamp = [](int position, int worldSize, int viewSize) {
+        return worldSize <= viewSize ? -(viewSize - worldSize) / 2 : qBound(0, position, worldSize - viewSize);
+    };
+    return QPoint(clamp(origin.x(), world.width(), view.width()), clamp(origin.y(), world.height(), view.height()));
+}
@@ -0,0 +1,76 @@
+#ifndef IMAGEVIEWER_H
+#define IMAGEVIEWER_H
+
+#include "tiledcanvas.h"
+
+#include <QPointer>
+#include <QSharedPointer>
+
+class ImagePyramid;
+class Task;
+class TaskEngine;
+
+// Pan and zoom over images far larger than the screen or memory. The image
+// is tiled into an ImagePyramid in the background, or reopened from one;
+// tiles are then drawn off the GUI thread from the level nearest the zoom,
+// so cost depends on the widget size rather than the image. Wheel zooms
+// around the cursor, dragging pans, double-click fits the image.
+class ImageViewer : public TiledCanvas
+{
+    Q_OBJECT
+
+public:
+    static constexpr double MaximumScale = 32.0;
+
+    explicit ImageViewer(TaskEngine *tasks, QWidget *parent = nullptr);
+
+    void openImage(const QString &fileName);
+    // Shows a pyramid that is already open.
+    void setPyramid(const QSharedPointer<ImagePyramid> &pyramid, const QString &title);
+    bool isReady() const;
+    QSharedPointer<ImagePyramid> pyramid() const;
+
+    // Memory for decoded pyramid tiles.
+    void setCacheBudget(qint64 bytes);
+    qint64 cacheBudget() const;
+
+    double scale() const;
+    // Shows the image at scale with imagePoint at the top-left corner.
+    void setView(const QPointF &imagePoint, double scale);
+    void fitImage();
+
+signals:
+    void ready();
+    void failed(const QString &errorString);
+
+protected:
+    TileRenderer createRenderer() const override;
+    void paintOverlay(QPainter *painter) override;
+
+    void resizeEvent(QResizeEvent *event) override;
+    void wheelEvent(QWheelEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    void mouseReleaseEvent(QMouseEvent *event) override;
+    void mouseDoubleClickEvent(QMouseEvent *event) override;
+
+private:
+    double fitScale() const;
+    double maximumScale() const;
+    QPoint clampedOrigin(const QPoint &origin) const;
+
+    TaskEngine *m_tasks;
+    QPointer<Task> m_build;
+    QSharedPointer<ImagePyramid> m_pyramid;
+    QString m_title;
+    qint64 m_cacheBudget;
+
+    // World pixels per image pixel.
+    double m_scale = 1;
+
+    bool m_dragging = false;
+    QPoint m_dragOrigin;
+    QPoint m_dragWorldOrigin;
+};
+
+#endif // IMAGEVIEWER_H
@@ -0,0 +1,439 @@
+#include "ingest.h"
+
+#include "csvsource.h"
+#include "spscring.h"
+#include "syntheticsource.h"
+#include "trace.h"
+
+#include <QLocalServer>
+#include <QLocalSocket>
+
+#include <atomic>
+
+namespace {
+
+// Small enough that a stalled reader pushes back on the producer quickly.
+const qint64 ReadBufferBytes = 1 << 20;
+const int ReconnectIntervalMs = 250;
+const int RateIntervalMs = 500;
+
+}
+
+struct IngestClient::Shared
+{
+    SpscRing<QByteArray> ring { size_t(RingCapacity) };
+    std::atomic<qint64> received { 0 };
+    std::atomic<qint64> dropped { 0 };
+    std::atomic<qint64> backPressureEvents { 0 };
+};
+
+// Lives on IngestClient's thread and owns the socket.
+class IngestReader : public QObject
+{
+public:
+    IngestReader(IngestClient *client, const QSharedPointer<IngestClient::Shared> &shared)
+        : m_client(client)
+        , m_shared(shared)
+    {
+    }
+
+    void start(const QString &serverName);
+
+private:
+    void tryConnect();
+    void readAvailable();
+    bool readLine(QByteArray *line);
+    void parseHeader(const QByteArray &line);
+    bool parseRecord(const QByteArray &line, QByteArray *record);
+    bool pushPending();
+    void scheduleRetry();
+    void finish(const QString &errorString);
+
+    IngestClient *m_client;
+    QSharedPointer<IngestClient::Shared> m_shared;
+    QLocalSocket *m_socket = nullptr;
+    QString m_serverName;
+    bool m_connected = false;
+    bool m_closing = false;
+    bool m_finished = false;
+    bool m_retryScheduled = false;
+
+    bool m_haveHeader = false;
+    char m_delimiter = ',';
+    int m_columns = 0;
+    CsvSource::FieldSpans m_fields;
+
+    QByteArray m_pending;
+    bool m_havePending = false;
+    bool m_stalled = false;
+    QElapsedTimer m_stallClock;
+};
+
+void IngestReader::start(const QString &serverName)
+{
+    m_serverName = serverName;
+    m_socket = new QLocalSocket(this);
+    m_socket->setReadBufferSize(ReadBufferBytes);
+    connect(m_socket, &QLocalSocket::connected, this, [this] { m_connected = true; });
+    connect(m_socket, &QLocalSocket::readyRead, this, [this] { readAvailable(); });
+    connect(m_socket, &QLocalSocket::disconnected, this, [this] {
+        // Whatever is still buffered gets read before finishing.
+        m_closing = true;
+        readAvailable();
+    });
+    connect(m_socket, &QLocalSocket::errorOccurred, this, [this](QLocalSocket::LocalSocketError error) {
+        if (m_connected) {
+            if (error != QLocalSocket::PeerClosedError)
+                finish(m_socket->errorString());
+            return;
+        }
+        // No producer yet: keep waiting for one.
+        if (error == QLocalSocket::ServerNotFoundError || error == QLocalSocket::ConnectionRefusedError)
+            QTimer::singleShot(ReconnectIntervalMs, this, [this] { tryConnect(); });
+        else
+            finish(m_socket->errorString());
+    });
+    tryConnect();
+}
+
+void IngestReader::tryConnect()
+{
+    if (!m_finished)
+        m_socket->connectToServer(m_serverName, QIODevice::ReadOnly);
+}
+
+void IngestReader::readAvailable()
+{
+    TRACE_SCOPE("IngestReader::readAvailable");
+    if (m_finished)
+        return;
+
+    QByteArray line;
+    for (;;) {
+        if (m_havePending && !pushPending()) {
+            scheduleRetry();
+            return;
+        }
+        if (!readLine(&line))
+            break;
+        if (!m_haveHeader) {
+            parseHeader(line);
+            continue;
+        }
+        if (line.isEmpty())
+            continue;
+        m_shared->received.fetch_add(1, std::memory_order_relaxed);
+        if (parseRecord(line, &m_pending))
+            m_havePending = true;
+        else
+            m_shared->dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (m_closing)
+        finish(QString());
+}
+
+// A complete line without its terminator; once the peer has gone, the
+// unterminated remainder counts as a line too.
+bool IngestReader::readLine(QByteArray *line)
+{
+    if (m_socket->canReadLine())
+        *line = m_socket->readLine();
+    else if (m_closing && m_socket->bytesAvailable() > 0)
+        *line = m_socket->readAll();
+    else
+        return false;
+
+    int length = line->size();
+    while (length > 0 && ((*line)[length - 1] == '\n' || (*line)[length - 1] == '\r'))
+        --length;
+    line->truncate(length);
+    return true;
+}
+
+void IngestReader::parseHeader(const QByteArray &line)
+{
+    m_delimiter = CsvSource::detectDelimiter(line.constData(), line.size());
+    CsvSource::splitFields(line.constData(), line.size(), m_delimiter, &m_fields);
+    QStringList names;
+    for (int i = 0; i < m_fields.size(); ++i) {
+        const QString name = CsvSource::fieldText(line.constData(), m_fields.at(i)).trimmed();
+        names.append(name.isEmpty() ? QStringLiteral("Column %1").arg(i + 1) : name);
+    }
+    m_columns = names.size();
+    m_haveHeader = true;
+
+    IngestClient *client = m_client;
+    QMetaObject::invokeMethod(client, [client, names] { client->headerReceived(names); }, Qt::QueuedConnection);
+}
+
+// Unquotes the fields and joins them with StreamSource::FieldSeparator.
+bool IngestReader::parseRecord(const QByteArray &line, QByteArray *record)
+{
+    const char *data = line.constData();
+    CsvSource::splitFields(data, line.size(), m_delimiter, &m_fields);
+    if (m_fields.size() != m_columns)
+        return false;
+
+    record->clear();
+    record->reserve(line.size());
+    for (int i = 0; i < m_fields.size(); ++i) {
+        const CsvSource::FieldSpan &field = m_fields.at(i);
+        if (i > 0)
+            record->append(StreamSource::FieldSeparator);
+        if (!field.quoted) {
+            record->append(data + field.begin, int(field.length));
+            continue;
+        }
+        for (qint64 j = field.begin; j < field.begin + field.length; ++j) {
+            record->append(data[j]);
+            if (data[j] == '"')
+                ++j;
+        }
+    }
+    return true;
+}
+
+bool IngestReader::pushPending()
+{
+    if (m_shared->ring.tryPush(std::move(m_pending))) {
+        m_havePending = false;
+        m_stalled = false;
+        return true;
+    }
+
+    if (!m_stalled) {
+        m_stalled = true;
+        m_stallClock.start();
+        m_shared->backPressureEvents.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (m_stallClock.elapsed() < IngestClient::MaxStallMs)
+        return false;
+
+    // Waited long enough: shed load so the producer keeps moving.
+    m_pending.clear();
+    m_havePending = false;
+    m_shared->dropped.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void IngestReader::scheduleRetry()
+{
+    if (m_retryScheduled)
+        return;
+    m_retryScheduled = true;
+    QTimer::singleShot(1, this, [this] {
+        m_retryScheduled = false;
+        readAvailable();
+    });
+}
+
+void IngestReader::finish(const QString &errorString)
+{
+    if (m_finished)
+        return;
+    m_finished = true;
+    IngestClient *client = m_client;
+    QMetaObject::invokeMethod(client, [client, errorString] { client->readerFinished(errorString); },
+                              Qt::QueuedConnection);
+}
+
+IngestClient::IngestClient(QObject *parent)
+    : QObject(parent)
+{
+    m_thread.setObjectName(QStringLiteral("Ingest"));
+    m_drainTimer.setInterval(DrainIntervalMs);
+    connect(&m_drainTimer, &QTimer::timeout, this, &IngestClient::drain);
+    m_rateTimer.setInterval(RateIntervalMs);
+    connect(&m_rateTimer, &QTimer::timeout, this, &IngestClient::sampleRate);
+}
+
+IngestClient::~IngestClient()
+{
+    m_thread.quit();
+    m_thread.wait();
+}
+
+void IngestClient::connectToProducer(const QString &serverName)
+{
+    stop();
+    m_thread.wait();
+
+    m_shared.reset(new Shared);
+    m_serverName = serverName;
+    m_source.reset();
+    m_delivered = 0;
+    m_rateDelivered = 0;
+    m_recordsPerSecond = 0;
+    m_running = true;
+
+    m_reader = new IngestReader(this, m_shared);
+    m_reader->moveToThread(&m_thread);
+    connect(&m_thread, &QThread::finished, m_reader, &QObject::deleteLater);
+    m_thread.start();
+    IngestReader *reader = m_reader;
+    QMetaObject::invokeMethod(reader, [reader, serverName] { reader->start(serverName); }, Qt::QueuedConnection);
+
+    m_drainTimer.start();
+    m_rateClock.start();
+    m_rateTimer.start();
+}
+
+void IngestClient::stop()
+{
+    if (!m_reader)
+        return;
+    // Deleting the reader with its thread closes the socket; records
+    // already in the ring are still drained.
+    m_thread.quit();
+    m_reader = nullptr;
+    m_running = false;
+}
+
+bool IngestClient::isRunning() const
+{
+    return m_running;
+}
+
+QString IngestClient::serverName() const
+{
+    return m_serverName;
+}
+
+QSharedPointer<StreamSource> IngestClient::source() const
+{
+    return m_source;
+}
+
+IngestClient::Stats IngestClient::stats() const
+{
+    Stats stats;
+    if (!m_shared)
+        return stats;
+    stats.received = m_shared->received.load(std::memory_order_relaxed);
+    stats.delivered = m_delivered;
+    stats.dropped = m_shared->dropped.load(std::memory_order_relaxed);
+    stats.backPressureEvents = m_shared->backPressureEvents.load(std::memory_order_relaxed);
+    stats.ringFillPercent = int(m_shared->ring.size() * 100 / m_shared->ring.capacity());
+    stats.recordsPerSecond = m_recordsPerSecond;
+    return stats;
+}
+
+void IngestClient::headerReceived(const QStringList &columnNames)
+{
+    m_source.reset(new StreamSource(columnNames));
+    emit sourceReady(m_source);
+}
+
+void IngestClient::readerFinished(const QString &errorString)
+{
+    if (!m_running)
+        return;
+    m_running = false;
+    drain();
+    sampleRate();
+    emit finished(errorString);
+}
+
+// Moves records from the ring into the source for at most DrainBudgetMs,
+// so a burst never blocks the event loop for long.
+void IngestClient::drain()
+{
+    if (!m_shared)
+        return;
+    if (!m_source) {
+        if (!m_running)
+            m_drainTimer.stop();
+        return;
+    }
+
+    TRACE_SCOPE("IngestClient::drain");
+    QElapsedTimer budget;
+    budget.start();
+    qint64 count = 0;
+    QByteArray record;
+    while (m_shared->ring.tryPop(&record)) {
+        m_source->append(std::move(record));
+        // Checking the clock costs more than appending a record.
+        if (++count % 1024 == 0 && budget.elapsed() >= DrainBudgetMs)
+            break;
+    }
+    if (count > 0) {
+        m_delivered += count;
+        emit rowsAppended(count);
+    }
+    if (!m_running && m_shared->ring.size() == 0) {
+        m_drainTimer.stop();
+        m_rateTimer.stop();
+    }
+}
+
+void IngestClient::sampleRate()
+{
+    const qint64 elapsed = m_rateClock.restart();
+    if (elapsed > 0)
+        m_recordsPerSecond = (m_delivered - m_rateDelivered) * 1000.0 / elapsed;
+    m_rateDelivered = m_delivered;
+    emit statsChanged();
+}
+
+bool runIngestProducer(const QString &serverName, qint64 records, int recordsPerSecond, QString *errorString)
+{
+    const qint64 BatchBytes = 64 * 1024;
+
+    QLocalServer::removeServer(serverName);
+    QLocalServer server;
+    if (!server.listen(serverName) || !server.waitForNewConnection(-1)) {
+        if (errorString)
+            *errorString = server.errorString();
+        return false;
+    }
+    QLocalSocket *socket = server.nextPendingConnection();
+
+    const SyntheticSource rows(records);
+    QByteArray batch;
+    for (int c = 0; c < rows.columnCount(); ++c) {
+        if (c > 0)
+            batch.append(',');
+        batch.append(rows.columnName(c).toUtf8());
+    }
+    batch.append('\n');
+
+    QElapsedTimer clock;
+    clock.start();
+    for (qint64 row = 0; row < records; ++row) {
+        for (int c = 0; c < rows.columnCount(); ++c) {
+            if (c > 0)
+                batch.append(',');
+            batch.append(rows.cellText(row, c).toUtf8());
+        }
+        batch.append('\n');
+        if (batch.size() < BatchBytes && row + 1 < records)
+            continue;
+
+        socket->write(batch);
+        batch.clear();
+        // Blocks while the reader applies back-pressure.
+        while (socket->bytesToWrite() > BatchBytes) {
+            if (!socket->waitForBytesWritten(-1))
+                break;
+        }
+        if (socket->state() != QLocalSocket::ConnectedState) {
+            if (errorString)
+                *errorString = socket->errorString();
+            return false;
+        }
+        if (recordsPerSecond > 0) {
+            const qint64 due = (row + 1) * 1000 / recordsPerSecond;
+            if (due > clock.elapsed())
+                QThread::msleep(unsigned(due - clock.elapsed()));
+        }
+    }
+
+    while (socket->bytesToWrite() > 0 && socket->waitForBytesWritten(-1)) {
+    }
+    socket->disconnectFromServer();
+    if (socket->state() != QLocalSocket::UnconnectedState)
+        socket->waitForDisconnected(-1);
+    return true;
+}
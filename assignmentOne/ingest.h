@@ -0,0 +1,96 @@
+#ifndef INGEST_H
+#define INGEST_H
+
+#include "streamsource.h"
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QSharedPointer>
+#include <QStringList>
+#include <QThread>
+#include <QTimer>
+
+class IngestReader;
+
+// Live records from a local producer process. The producer serves
+// newline-separated delimited text on a QLocalServer: one header line,
+// then one record per line. A dedicated thread reads and splits the lines
+// and pushes finished records into a lock-free single-producer/single-
+// consumer ring; a GUI-thread timer drains the ring into a StreamSource
+// in batches.
+//
+// When the ring is full the reader stops reading, so the socket buffers
+// fill up and the producer blocks (back-pressure). If that lasts longer
+// than MaxStallMs, records are dropped instead so the producer is never
+// held up indefinitely by a stalled UI.
+class IngestClient : public QObject
+{
+    Q_OBJECT
+
+public:
+    static const int RingCapacity = 1 << 16;
+    static const int DrainIntervalMs = 16;
+    static const int DrainBudgetMs = 4;
+    static const int MaxStallMs = 200;
+
+    struct Stats
+    {
+        qint64 received = 0;
+        qint64 delivered = 0;
+        // Malformed records, and records discarded when back-pressure timed out.
+        qint64 dropped = 0;
+        // How often the ring filled up and reading was paused.
+        qint64 backPressureEvents = 0;
+        int ringFillPercent = 0;
+        double recordsPerSecond = 0;
+    };
+
+    explicit IngestClient(QObject *parent = nullptr);
+    ~IngestClient() override;
+
+    // Keeps retrying until a producer is listening on serverName.
+    void connectToProducer(const QString &serverName);
+    void stop();
+
+    bool isRunning() const;
+    QString serverName() const;
+    // Null until the producer's header line arrived.
+    QSharedPointer<StreamSource> source() const;
+    Stats stats() const;
+
+signals:
+    void sourceReady(const QSharedPointer<StreamSource> &source);
+    void rowsAppended(qint64 count);
+    void statsChanged();
+    void finished(const QString &errorString);
+
+private:
+    friend class IngestReader;
+    struct Shared;
+
+    void headerReceived(const QStringList &columnNames);
+    void readerFinished(const QString &errorString);
+    void drain();
+    void sampleRate();
+
+    QSharedPointer<Shared> m_shared;
+    QThread m_thread;
+    IngestReader *m_reader = nullptr;
+    QString m_serverName;
+    bool m_running = false;
+    QSharedPointer<StreamSource> m_source;
+    qint64 m_delivered = 0;
+    QTimer m_drainTimer;
+    QTimer m_rateTimer;
+    qint64 m_rateDelivered = 0;
+    QElapsedTimer m_rateClock;
+    double m_recordsPerSecond = 0;
+};
+
+// Stand-in for the production feed: listens on serverName, serves
+// SyntheticSource rows as CSV to the first client and returns when all
+// were written. recordsPerSecond 0 sends as fast as the client reads.
+bool runIngestProducer(const QString &serverName, qint64 records, int recordsPerSecond,
+                       QString *errorString = nullptr);
+
+#endif // INGEST_H
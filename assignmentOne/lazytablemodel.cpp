@@ -0,0 +1,148 @@
+#include "lazytablemodel.h"
+
+#include "trace.h"
+
+#include <limits>
+
+LazyTableModel::LazyTableModel(QObject *parent)
+    : QAbstractTableModel(parent)
+    , m_pages(MaxCachedPages)
+{
+}
+
+QSharedPointer<DataSource> LazyTableModel::source() const
+{
+    return m_source;
+}
+
+void LazyTableModel::setSource(const QSharedPointer<DataSource> &source)
+{
+    beginResetModel();
+    m_source = source;
+    m_pages.clear();
+    m_columns = m_source ? m_source->columnCount() : 0;
+    m_rows = availableRows();
+    endResetModel();
+}
+
+void LazyTableModel::setEditable(bool editable)
+{
+    m_editable = editable;
+}
+
+int LazyTableModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : m_rows;
+}
+
+int LazyTableModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : m_columns;
+}
+
+QVariant LazyTableModel::data(const QModelIndex &index, int role) const
+{
+    if ((role != Qt::DisplayRole && role != Qt::EditRole) || !index.isValid() || index.row() >= m_rows)
+        return QVariant();
+
+    const Page *page = pageFor(index.row());
+    return page->cells.at((index.row() % PageRows) * m_columns + index.column());
+}
+
+QVariant LazyTableModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (role != Qt::DisplayRole)
+        return QVariant();
+    if (orientation == Qt::Vertical)
+        return section + 1;
+    return m_source ? m_source->columnName(section) : QVariant();
+}
+
+Qt::ItemFlags LazyTableModel::flags(const QModelIndex &index) const
+{
+    const Qt::ItemFlags flags = QAbstractTableModel::flags(index);
+    return m_editable && index.isValid() ? flags | Qt::ItemIsEditable : flags;
+}
+
+bool LazyTableModel::setData(const QModelIndex &index, const QVariant &value, int role)
+{
+    if (!m_editable || role != Qt::EditRole || !index.isValid() || index.row() >= m_rows)
+        return false;
+    emit cellEdited(index.row(), index.column(), value.toString());
+    return true;
+}
+
+bool LazyTableModel::canFetchMore(const QModelIndex &parent) const
+{
+    return !parent.isValid() && m_rows < availableRows();
+}
+
+void LazyTableModel::fetchMore(const QModelIndex &parent)
+{
+    if (parent.isValid())
+        return;
+    const int count = qMin(availableRows() - m_rows, FetchBatchRows);
+    if (count <= 0)
+        return;
+
+    // The last page may have been materialized while it was still partial.
+    m_pages.remove(m_rows / PageRows);
+
+    beginInsertRows(QModelIndex(), m_rows, m_rows + count - 1);
+    m_rows += count;
+    endInsertRows();
+}
+
+int LazyTableModel::cachedPageCount() const
+{
+    return m_pages.size();
+}
+
+void LazyTableModel::sourceRowsAppended()
+{
+    while (canFetchMore(QModelIndex()))
+        fetchMore(QModelIndex());
+}
+
+void LazyTableModel::sourceCellsChanged(const QSharedPointer<DataSource> &source, int firstRow, int lastRow,
+                                        int firstColumn, int lastColumn)
+{
+    m_source = source;
+    lastRow = qMin(lastRow, m_rows - 1);
+    if (firstRow > lastRow)
+        return;
+    if (lastRow / PageRows - firstRow / PageRows >= MaxCachedPages) {
+        m_pages.clear();
+    } else {
+        for (int page = firstRow / PageRows; page <= lastRow / PageRows; ++page)
+            m_pages.remove(page);
+    }
+    emit dataChanged(index(firstRow, firstColumn), index(lastRow, lastColumn));
+}
+
+int LazyTableModel::availableRows() const
+{
+    if (!m_source)
+        return 0;
+    return int(qMin<qint64>(m_source->rowCount(), std::numeric_limits<int>::max()));
+}
+
+const LazyTableModel::Page *LazyTableModel::pageFor(int row) const
+{
+    const int pageIndex = row / PageRows;
+    if (const Page *page = m_pages.object(pageIndex))
+        return page;
+
+    TRACE_SCOPE("LazyTableModel::materializePage");
+    const int first = pageIndex * PageRows;
+    const int last = qMin(first + PageRows, m_rows);
+    Page *page = new Page;
+    page->cells.resize(PageRows * m_columns);
+    for (int r = first; r < last; ++r) {
+        QString *out = page->cells.data() + (r - first) * m_columns;
+        for (int c = 0; c < m_columns; ++c)
+            out[c] = m_source->cellText(r, c);
+    }
+    m_pages.insert(pageIndex, page);
+    return page;
+}
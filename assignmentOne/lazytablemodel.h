@@ -0,0 +1,72 @@
+#ifndef LAZYTABLEMODEL_H
+#define LAZYTABLEMODEL_H
+
+#include "datasource.h"
+
+#include <QAbstractTableModel>
+#include <QCache>
+#include <QSharedPointer>
+#include <QVector>
+
+// Table model over a DataSource that only materializes the rows a view
+// actually asks for. Cell text is produced in fixed-size pages kept in a
+// small LRU cache, so memory use does not depend on the number of rows.
+// Rows that appear in the source after setSource() are exposed through
+// canFetchMore()/fetchMore(). When editable, edits made in a view are
+// passed on through cellEdited() for the owner of the data to apply.
+class LazyTableModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    static const int PageRows = 128;
+    static const int MaxCachedPages = 32;
+    static const int FetchBatchRows = 1 << 20;
+
+    explicit LazyTableModel(QObject *parent = nullptr);
+
+    QSharedPointer<DataSource> source() const;
+    void setSource(const QSharedPointer<DataSource> &source);
+    void setEditable(bool editable);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation,
+                        int role = Qt::DisplayRole) const override;
+    Qt::ItemFlags flags(const QModelIndex &index) const override;
+    bool setData(const QModelIndex &index, const QVariant &value, int role = Qt::EditRole) override;
+
+    bool canFetchMore(const QModelIndex &parent) const override;
+    void fetchMore(const QModelIndex &parent) override;
+
+    int cachedPageCount() const;
+
+public slots:
+    // Call when the source has grown; exposes the new rows immediately.
+    void sourceRowsAppended();
+    // Call when cells of the source have changed, or with a new source of
+    // the same shape; views keep their scroll position and selection.
+    void sourceCellsChanged(const QSharedPointer<DataSource> &source, int firstRow, int lastRow,
+                            int firstColumn, int lastColumn);
+
+signals:
+    void cellEdited(int row, int column, const QString &text);
+
+private:
+    struct Page
+    {
+        QVector<QString> cells;
+    };
+
+    int availableRows() const;
+    const Page *pageFor(int row) const;
+
+    QSharedPointer<DataSource> m_source;
+    int m_rows = 0;
+    int m_columns = 0;
+    bool m_editable = false;
+    mutable QCache<int, Page> m_pages;
+};
+
+#endif // LAZYTABLEMODEL_H
@@ -0,0 +1,192 @@
+#include "lineindex.h"
+
+#include "taskengine.h"
+#include "trace.h"
+
+#include <QThread>
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#  include <emmintrin.h>
+#  define LINEINDEX_SSE2
+#endif
+
+namespace {
+
+const qint64 MinChunkBytes = 4 << 20;
+const qint64 WrapSpan = qint64(1) << 32;
+
+struct Chunk
+{
+    qint64 begin = 0;
+    qint64 end = 0;
+    qint64 firstLine = 0;
+    qint64 lines = 0;
+    // First line at or after each 4 GiB boundary that falls inside this
+    // chunk, or -1 when the next line starts in a later chunk.
+    std::vector<std::pair<qint64, qint64>> wraps;
+};
+
+inline int popcount32(quint32 v)
+{
+#if defined(__GNUC__)
+    return __builtin_popcount(v);
+#else
+    v = v - ((v >> 1) & 0x55555555u);
+    v = (v & 0x33333333u) + ((v >> 2) & 0x33333333u);
+    return int((((v + (v >> 4)) & 0x0f0f0f0fu) * 0x01010101u) >> 24);
+#endif
+}
+
+inline int lowestBit(quint32 v)
+{
+#if defined(__GNUC__)
+    return __builtin_ctz(v);
+#else
+    int n = 0;
+    while (!(v & 1u)) {
+        v >>= 1;
+        ++n;
+    }
+    return n;
+#endif
+}
+
+// Calls emit(position) for every '\n' in [begin, end), 16 bytes at a time.
+template<typename Emit>
+void forEachNewline(const char *data, qint64 begin, qint64 end, Emit emit)
+{
+    qint64 pos = begin;
+#ifdef LINEINDEX_SSE2
+    const __m128i newline = _mm_set1_epi8('\n');
+    for (; pos + 16 <= end; pos += 16) {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + pos));
+        quint32 mask = quint32(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, newline)));
+        while (mask) {
+            emit(pos + lowestBit(mask));
+            mask &= mask - 1;
+        }
+    }
+#endif
+    while (pos < end) {
+        const void *hit = std::memchr(data + pos, '\n', size_t(end - pos));
+        if (!hit)
+            break;
+        const qint64 at = static_cast<const char *>(hit) - data;
+        emit(at);
+        pos = at + 1;
+    }
+}
+
+qint64 countNewlines(const char *data, qint64 begin, qint64 end)
+{
+    qint64 count = 0;
+    qint64 pos = begin;
+#ifdef LINEINDEX_SSE2
+    const __m128i newline = _mm_set1_epi8('\n');
+    for (; pos + 16 <= end; pos += 16) {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + pos));
+        count += popcount32(quint32(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, newline))));
+    }
+#endif
+    for (; pos < end; ++pos)
+        count += data[pos] == '\n';
+    return count;
+}
+
+}
+
+bool LineIndex::build(const char *data, qint64 size, TaskContext *context)
+{
+    m_low.clear();
+    m_wraps.clear();
+    if (size <= 0)
+        return true;
+
+    // A trailing newline terminates the last line rather than starting one.
+    const qint64 scanEnd = data[size - 1] == '\n' ? size - 1 : size;
+
+    // A few chunks per core so faster workers can pick up the slack.
+    const int pieces = 4 * qMax(1, QThread::idealThreadCount());
+    const qint64 chunkBytes = qMax(MinChunkBytes, (scanEnd + pieces - 1) / pieces);
+    std::vector<Chunk> chunks;
+    for (qint64 begin = 0; begin < scanEnd || chunks.empty(); begin += chunkBytes) {
+        Chunk chunk;
+        chunk.begin = begin;
+        chunk.end = qMin(begin + chunkBytes, scanEnd);
+        chunks.push_back(chunk);
+    }
+
+    const auto forEachChunk = [&chunks, context](const std::function<void(Chunk &)> &scan) {
+        TaskEngine::parallelFor(qint64(chunks.size()), 1, [&](qint64 begin, qint64 end) {
+            for (qint64 i = begin; i < end; ++i) {
+                Chunk &chunk = chunks[size_t(i)];
+                scan(chunk);
+                if (context)
+                    context->addProgress(chunk.end - chunk.begin);
+            }
+        }, context);
+        return !(context && context->isCanceled());
+    };
+
+    const auto cleared = [this] {
+        m_low.clear();
+        m_wraps.clear();
+        return false;
+    };
+
+    // Pass 1: count lines per chunk so every chunk knows where to write.
+    if (!forEachChunk([data](Chunk &chunk) {
+            TRACE_SCOPE("LineIndex::countNewlines");
+            chunk.lines = countNewlines(data, chunk.begin, chunk.end);
+        }))
+        return cleared();
+
+    qint64 total = 1; // line 0 starts at offset 0
+    for (Chunk &chunk : chunks) {
+        chunk.firstLine = total;
+        total += chunk.lines;
+    }
+    m_low.resize(size_t(total));
+    m_low[0] = 0;
+
+    // Pass 2: write line starts in place.
+    quint32 *low = m_low.data();
+    const bool indexed = forEachChunk([data, low](Chunk &chunk) {
+        TRACE_SCOPE("LineIndex::writeOffsets");
+        qint64 line = chunk.firstLine;
+        qint64 nextWrap = (chunk.begin / WrapSpan + 1) * WrapSpan;
+        for (qint64 boundary = nextWrap; boundary < chunk.end + 1; boundary += WrapSpan)
+            chunk.wraps.emplace_back(boundary, -1);
+        size_t pendingWrap = 0;
+        forEachNewline(data, chunk.begin, chunk.end, [&](qint64 at) {
+            const qint64 start = at + 1;
+            while (pendingWrap < chunk.wraps.size() && start >= chunk.wraps[pendingWrap].first)
+                chunk.wraps[pendingWrap++].second = line;
+            low[line++] = quint32(start);
+        });
+    });
+    if (!indexed)
+        return cleared();
+
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        for (const auto &wrap : chunks[i].wraps) {
+            const qint64 nextFirst = i + 1 < chunks.size() ? chunks[i + 1].firstLine : total;
+            m_wraps.push_back(wrap.second >= 0 ? wrap.second : nextFirst);
+        }
+    }
+    return true;
+}
+
+qint64 LineIndex::lineStart(qint64 line) const
+{
+    const qint64 high = std::upper_bound(m_wraps.begin(), m_wraps.end(), line) - m_wraps.begin();
+    return (high << 32) | m_low[size_t(line)];
+}
+
+qint64 LineIndex::memoryUsage() const
+{
+    return qint64(m_low.capacity() * sizeof(quint32) + m_wraps.capacity() * sizeof(qint64));
+}
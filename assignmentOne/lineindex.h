@@ -0,0 +1,32 @@
+#ifndef LINEINDEX_H
+#define LINEINDEX_H
+
+#include "memorytracker.h"
+
+#include <QtGlobal>
+
+class TaskContext;
+
+// Start offsets of every line in a text buffer, stored as 32-bit words.
+// Offsets only ever increase, so the upper half of each offset is
+// recovered from the (tiny) list of lines where it first changes. Costs
+// four bytes per line regardless of file size.
+class LineIndex
+{
+public:
+    // Scans data for newlines using all cores and replaces the index.
+    // Each pass over the data adds its byte count to context's progress.
+    // Returns false, leaving the index empty, if context was canceled.
+    bool build(const char *data, qint64 size, TaskContext *context = nullptr);
+
+    qint64 lineCount() const { return qint64(m_low.size()); }
+    qint64 lineStart(qint64 line) const;
+    qint64 memoryUsage() const;
+
+private:
+    TrackedVector<quint32, MemoryTracker::LineIndex> m_low;
+    // m_wraps[k] is the first line whose start is at or beyond (k + 1) << 32.
+    TrackedVector<qint64, MemoryTracker::LineIndex> m_wraps;
+};
+
+#endif // LINEINDEX_H
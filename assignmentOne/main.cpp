@@ -1,11 +1,177 @@
 #include "mainwindow.h"
 
+#include "application.h"
+#include "batch.h"
+#include "eventprofiler.h"
+#include "ingest.h"
+#include "memorytracker.h"
+#include "startupprobe.h"
+#include "syntheticsource.h"
+#include "trace.h"
+
 #include <QApplication>
+#include <QCommandLineParser>
+#include <QImageReader>
+#include <QScopedPointer>
+#include <QTextStream>
+#include <QTimer>
+#include <cstring>
+
+static const int ImageAllocationLimitMb = 4096;
+
+static bool hasArgument(int argc, char *argv[], const char *name)
+{
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], name) == 0)
+            return true;
+    }
+    return false;
+}
 
 int main(int argc, char *argv[])
 {
-    QApplication a(argc, argv);
-    MainWindow w;
-    w.show();
-    return a.exec();
+    startStartupClock();
+
+    // The startup check and the producer never need a real display; the
+    // platform has to be chosen before QApplication exists.
+    if ((hasArgument(argc, argv, "--startup-bench") || hasArgument(argc, argv, "--produce"))
+            && qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+
+    // Batch runs on servers without a display, so no GUI application is
+    // created for them at all.
+    const bool batch = hasArgument(argc, argv, "--batch");
+    QScopedPointer<QCoreApplication> a(batch ? new QCoreApplication(argc, argv) : new Application(argc, argv));
+    EventProfiler::install();
+    // Where QSettings keeps the recent files.
+    QCoreApplication::setOrganizationName(QStringLiteral("Post-Narnia"));
+    // Images whose format cannot be read in strips are tiled from one full
+    // decode, which the default 256 MB limit refuses past about 8k x 8k.
+    // Set once here: readers on worker threads all consult it.
+    QImageReader::setAllocationLimit(ImageAllocationLimitMb);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption syntheticOption(QStringLiteral("synthetic"),
+                                       QStringLiteral("Show a generated table with <rows> rows."),
+                                       QStringLiteral("rows"));
+    QCommandLineOption traceOption(QStringLiteral("trace"),
+                                   QStringLiteral("Record a Chrome trace-event file to <file> on exit."),
+                                   QStringLiteral("file"));
+    QCommandLineOption startupOption(QStringLiteral("startup-bench"),
+                                     QStringLiteral("Exit after the first paint; fail if it took over <ms>."),
+                                     QStringLiteral("ms"));
+    QCommandLineOption ingestOption(QStringLiteral("ingest"),
+                                    QStringLiteral("Show records streamed by the producer listening on <name>."),
+                                    QStringLiteral("name"));
+    QCommandLineOption produceOption(QStringLiteral("produce"),
+                                     QStringLiteral("Act as a stand-in producer on <name> and exit when done."),
+                                     QStringLiteral("name"));
+    QCommandLineOption produceCountOption(QStringLiteral("produce-count"),
+                                          QStringLiteral("Records sent by --produce."),
+                                          QStringLiteral("records"), QStringLiteral("10000000"));
+    QCommandLineOption produceRateOption(QStringLiteral("produce-rate"),
+                                         QStringLiteral("Records per second sent by --produce; 0 is unlimited."),
+                                         QStringLiteral("rate"), QStringLiteral("0"));
+    QCommandLineOption imageCacheOption(QStringLiteral("image-cache"),
+                                        QStringLiteral("Memory for decoded image tiles, in MB."),
+                                        QStringLiteral("MB"), QStringLiteral("256"));
+    QCommandLineOption thumbnailCacheOption(QStringLiteral("thumbnail-cache"),
+                                            QStringLiteral("Memory for thumbnails, in MB."),
+                                            QStringLiteral("MB"), QStringLiteral("64"));
+    QCommandLineOption memoryBudgetOption(QStringLiteral("memory-budget"),
+                                          QStringLiteral("Memory in MB past which caches shrink; 0 is unlimited."),
+                                          QStringLiteral("MB"), QStringLiteral("4096"));
+    QCommandLineOption batchOption(QStringLiteral("batch"),
+                                   QStringLiteral("Analyze the files without a window and write the results."));
+    QCommandLineOption filterOption(QStringLiteral("filter"),
+                                    QStringLiteral("With --batch, keep rows matching <expression>, e.g. \"Value > 10 and Status = FAULT\"."),
+                                    QStringLiteral("expression"));
+    QCommandLineOption groupByOption(QStringLiteral("group-by"),
+                                     QStringLiteral("With --batch, report per value of <column> instead of per column."),
+                                     QStringLiteral("column"));
+    QCommandLineOption aggregateOption(QStringLiteral("aggregate"),
+                                       QStringLiteral("With --group-by, summarize the numeric <column> per group."),
+                                       QStringLiteral("column"));
+    QCommandLineOption batchFormatOption(QStringLiteral("batch-format"),
+                                         QStringLiteral("Batch result format: csv or json."),
+                                         QStringLiteral("format"), QStringLiteral("csv"));
+    QCommandLineOption batchOutputOption(QStringLiteral("batch-output"),
+                                         QStringLiteral("Write batch results to <file> instead of stdout."),
+                                         QStringLiteral("file"));
+    parser.addOption(syntheticOption);
+    parser.addOption(traceOption);
+    parser.addOption(startupOption);
+    parser.addOption(ingestOption);
+    parser.addOption(produceOption);
+    parser.addOption(produceCountOption);
+    parser.addOption(produceRateOption);
+    parser.addOption(imageCacheOption);
+    parser.addOption(thumbnailCacheOption);
+    parser.addOption(memoryBudgetOption);
+    parser.addOption(batchOption);
+    parser.addOption(filterOption);
+    parser.addOption(groupByOption);
+    parser.addOption(aggregateOption);
+    parser.addOption(batchFormatOption);
+    parser.addOption(batchOutputOption);
+    parser.addPositionalArgument(QStringLiteral("file"),
+                                 QStringLiteral("Data file or image to open, or a directory of images to browse. "
+                                                "With --batch, any number of data files."));
+    parser.process(*a);
+
+    if (parser.isSet(traceOption))
+        Trace::setEnabled(true);
+
+    int status = 0;
+    if (batch) {
+        BatchOptions options;
+        options.files = parser.positionalArguments();
+        options.filter = parser.value(filterOption);
+        options.groupBy = parser.value(groupByOption);
+        options.aggregate = parser.value(aggregateOption);
+        options.format = parser.value(batchFormatOption);
+        options.outputFile = parser.value(batchOutputOption);
+        status = runBatch(options);
+    } else if (parser.isSet(produceOption)) {
+        QString errorString;
+        if (!runIngestProducer(parser.value(produceOption), parser.value(produceCountOption).toLongLong(),
+                               parser.value(produceRateOption).toInt(), &errorString)) {
+            QTextStream(stderr) << "Producer failed: " << errorString << Qt::endl;
+            status = 1;
+        }
+    } else {
+        MemoryTracker::setBudget(qMax(0LL, parser.value(memoryBudgetOption).toLongLong()) << 20);
+        // Scoped so that background tasks are joined before the trace is written.
+        MainWindow w;
+        w.setImageCacheBudget(qMax(1LL, parser.value(imageCacheOption).toLongLong()) << 20);
+        w.setThumbnailCacheBudget(qMax(1LL, parser.value(thumbnailCacheOption).toLongLong()) << 20);
+        if (parser.isSet(startupOption))
+            measureFirstPaint(&w, parser.value(startupOption).toDouble());
+        w.show();
+
+        // Anything beyond the bare window goes through the event loop so it
+        // cannot hold up the first frame.
+        QTimer::singleShot(0, &w, [&w, &parser, &syntheticOption, &ingestOption] {
+            if (parser.isSet(ingestOption))
+                w.connectToProducer(parser.value(ingestOption));
+            if (parser.isSet(syntheticOption))
+                w.setDataSource(QSharedPointer<DataSource>(new SyntheticSource(parser.value(syntheticOption).toLongLong())));
+            if (!parser.positionalArguments().isEmpty())
+                w.openFile(parser.positionalArguments().constFirst());
+        });
+        status = a->exec();
+        // Windows opened from this one; their tasks too must be joined.
+        for (QWidget *widget : QApplication::topLevelWidgets()) {
+            if (widget != &w && qobject_cast<MainWindow *>(widget))
+                delete widget;
+        }
+    }
+
+    if (parser.isSet(traceOption)) {
+        QString errorString;
+        if (!Trace::writeChromeJson(parser.value(traceOption), &errorString))
+            QTextStream(stderr) << "Could not write trace: " << errorString << Qt::endl;
+    }
+    return status;
 }
@@ -1,11 +1,131 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 
+#include "columncache.h"
+#include "commandpalette.h"
+#include "columnstore.h"
+#include "csvsource.h"
+#include "datatableview.h"
+#include "document.h"
+#include "documentcache.h"
+#include "edithistory.h"
+#include "filefollower.h"
+#include "findbar.h"
+#include "imagepyramid.h"
+#include "imageviewer.h"
+#include "ingest.h"
+#include "lazytablemodel.h"
+#include "mappedtextfile.h"
+#include "memorydialog.h"
+#include "memorytracker.h"
+#include "modelupdatescheduler.h"
+#include "plotwidget.h"
+#include "sortfilterproxy.h"
+#include "statisticspanel.h"
+#include "taskengine.h"
+#include "thumbnailmodel.h"
+#include "thumbnailview.h"
+#include "trace.h"
+
+#include <QApplication>
+#include <QDockWidget>
+#include <QElapsedTimer>
+#include <QFileDialog>
+#include <QFileInfo>
+#include <QHeaderView>
+#include <QImageReader>
+#include <QInputDialog>
+#include <QLabel>
+#include <QLocale>
+#include <QMenu>
+#include <QMessageBox>
+#include <QProgressBar>
+#include <QScrollBar>
+#include <QSettings>
+#include <QSignalBlocker>
+#include <QToolButton>
+
+#include <limits>
+
+namespace {
+
+struct LoadResult
+{
+    QSharedPointer<ColumnStore> store;
+    // Why the column cache was not used.
+    QString cacheStatus;
+    QSharedPointer<MappedTextFile> file;
+    QString errorString;
+};
+
+// Actions of the menus, with the menus leading to them as their detail.
+void collectActions(const QList<QAction *> &actions, const QString &path, const QAction *excluded,
+                    QVector<QPointer<QAction>> *found, QVector<CommandIndex::Candidate> *candidates)
+{
+    for (QAction *action : actions) {
+        if (action->isSeparator() || action == excluded)
+            continue;
+        QString text = action->text();
+        text.remove(QLatin1Char('&'));
+        if (const QMenu *menu = action->menu()) {
+            collectActions(menu->actions(), path.isEmpty() ? text : path + QStringLiteral(" > ") + text,
+                           excluded, found, candidates);
+            continue;
+        }
+        CommandIndex::Candidate candidate;
+        candidate.text = text;
+        candidate.detail = action->shortcut().isEmpty()
+                ? path : path + QStringLiteral(", ") + action->shortcut().toString(QKeySequence::NativeText);
+        candidate.kind = CommandIndex::Action;
+        candidate.id = found->size();
+        found->append(action);
+        candidates->append(candidate);
+    }
+}
+
+}
+
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::MainWindow)
+    , m_document(new Document(this))
+    , m_model(new LazyTableModel(this))
+    , m_tasks(new TaskEngine(this))
+    , m_updates(new ModelUpdateScheduler(this))
+    , m_imageCacheBudget(ImagePyramid::DefaultCacheBudget)
+    , m_thumbnailCacheBudget(ThumbnailModel::DefaultCacheBudget)
 {
+    static int windows = 0;
+    m_serial = ++windows;
+    TRACE_SCOPE("MainWindow::MainWindow");
     ui->setupUi(this);
+    // The Data and Plot menus and the diagnostics in View are filled when
+    // one of them first opens. Their actions are on the window from the
+    // start, so the shortcuts work before that.
+    addActions({ ui->actionLatencyOverlay, ui->actionDumpLatency, ui->actionMemoryDiagnostics,
+                 ui->actionLoadIntoMemory, ui->actionStatistics, ui->actionPlotColumn, ui->actionTestSignal });
+    for (QMenu *menu : { ui->menuView, ui->menuData, ui->menuPlot })
+        connect(menu, &QMenu::aboutToShow, this, &MainWindow::fillRareMenus);
+    // Quit closes every window, not just this one. Queued, since windows
+    // opened from another delete themselves when closed.
+    connect(ui->actionQuit, &QAction::triggered, qApp, &QApplication::closeAllWindows, Qt::QueuedConnection);
+    connect(m_tasks, &TaskEngine::progressChanged, this, &MainWindow::updateTaskProgress);
+    connect(m_document, &Document::sourceChanged, this, &MainWindow::showDocument);
+    // Edits and streamed rows reach the views at most once per frame.
+    connect(m_document, &Document::cellsChanged, m_updates, &ModelUpdateScheduler::cellsChanged);
+    connect(m_updates, &ModelUpdateScheduler::cellsUpdated, this, &MainWindow::showEditedCells);
+    connect(m_updates, &ModelUpdateScheduler::rowsUpdated, m_model, &LazyTableModel::sourceRowsAppended);
+    connect(m_document, &Document::historyChanged, this, &MainWindow::updateHistoryActions);
+    updateHistoryActions();
+    m_model->setEditable(true);
+    connect(m_model, &LazyTableModel::cellEdited, this, [this](int row, int column, const QString &text) {
+        m_document->setCellText(row, column, text);
+    });
+    m_latencyTimer.setInterval(500);
+    connect(&m_latencyTimer, &QTimer::timeout, this, &MainWindow::updateLatencyOverlay);
+    m_memoryTimer.setInterval(1000);
+    connect(&m_memoryTimer, &QTimer::timeout, this, &MainWindow::updateMemoryStatus);
+    m_memoryTimer.start();
 }
 
 MainWindow::~MainWindow()
@@ -13,3 +133,842 @@ MainWindow::~MainWindow()
     delete ui;
 }
 
+void MainWindow::setDataSource(const QSharedPointer<DataSource> &source, const QString &title)
+{
+    m_document->setSource(source, title);
+}
+
+void MainWindow::openFile(const QString &fileName)
+{
+    TRACE_SCOPE("MainWindow::openFile");
+    if (QFileInfo(fileName).isDir()) {
+        browseThumbnails(fileName);
+        return;
+    }
+    if (QImageReader::supportedImageFormats().contains(QFileInfo(fileName).suffix().toLower().toLatin1())) {
+        openImage(fileName);
+        return;
+    }
+    const QString displayName = QFileInfo(fileName).fileName();
+    if (const QSharedPointer<DataSource> source = DocumentCache::find(fileName)) {
+        m_document->setSource(source, displayName, fileName);
+        addRecentFile(fileName);
+        ui->statusbar->showMessage(tr("Opened %1, already open in another window: %2 rows")
+                                   .arg(displayName, QLocale().toString(source->rowCount())));
+        return;
+    }
+    ui->statusbar->showMessage(tr("Opening %1...").arg(displayName));
+    ui->actionOpen->setEnabled(false);
+
+    QElapsedTimer timer;
+    timer.start();
+    const QSharedPointer<LoadResult> result(new LoadResult);
+    Task *task = m_tasks->start(tr("Opening %1").arg(displayName), Task::HighPriority,
+                                [fileName, result](TaskContext &context) {
+        // Columns parsed on an earlier run beat indexing the text again.
+        result->store = ColumnCache::load(fileName, ColumnCache::cacheFileName(fileName),
+                                          &result->cacheStatus, &context);
+        if (result->store || context.isCanceled())
+            return;
+        QSharedPointer<MappedTextFile> file(new MappedTextFile);
+        if (file->open(fileName, &result->errorString, &context))
+            result->file = file;
+    });
+    connect(task, &Task::finished, this, [this, task, result, timer, fileName, displayName] {
+        TRACE_SCOPE("MainWindow::showOpenedFile");
+        ui->actionOpen->setEnabled(true);
+        if (task->isCanceled()) {
+            ui->statusbar->showMessage(tr("Canceled opening %1").arg(displayName));
+            return;
+        }
+        const double seconds = qMax<qint64>(timer.nsecsElapsed(), 1) / 1e9;
+        const QLocale locale;
+        if (result->store) {
+            DocumentCache::insert(fileName, result->store);
+            m_document->setSource(result->store, displayName, fileName);
+            addRecentFile(fileName);
+            ui->statusbar->showMessage(tr("Opened %1 from the column cache: %2 rows in %3 s")
+                                       .arg(displayName,
+                                            locale.toString(result->store->rowCount()),
+                                            QString::number(seconds, 'f', 3)));
+            return;
+        }
+        if (!result->file) {
+            ui->statusbar->showMessage(tr("Could not open %1: %2").arg(displayName, result->errorString));
+            return;
+        }
+
+        const QSharedPointer<DataSource> source(new CsvSource(result->file));
+        DocumentCache::insert(fileName, source);
+        m_document->setSource(source, displayName, fileName);
+        addRecentFile(fileName);
+        ui->statusbar->showMessage(tr("Opened %1 as text (%2): %3, %4 lines in %5 s (%6/s)")
+                                   .arg(displayName, result->cacheStatus,
+                                        locale.formattedDataSize(result->file->size()),
+                                        locale.toString(result->file->lineCount()),
+                                        QString::number(seconds, 'f', 3),
+                                        locale.formattedDataSize(qint64(result->file->size() / seconds))));
+    });
+}
+
+void MainWindow::openImage(const QString &fileName)
+{
+    ImageViewer *viewer = imageViewer();
+    ui->viewTabs->setCurrentWidget(viewer);
+    ui->statusbar->showMessage(tr("Opening %1...").arg(QFileInfo(fileName).fileName()));
+    QElapsedTimer timer;
+    timer.start();
+    disconnect(viewer, &ImageViewer::ready, this, nullptr);
+    disconnect(viewer, &ImageViewer::failed, this, nullptr);
+    connect(viewer, &ImageViewer::ready, this, [this, viewer, timer, fileName] {
+        const QSize size = viewer->pyramid()->imageSize();
+        ui->statusbar->showMessage(tr("Opened %1: %2 x %3 pixels, %4 levels in %5 s")
+                                   .arg(QFileInfo(fileName).fileName())
+                                   .arg(size.width()).arg(size.height())
+                                   .arg(viewer->pyramid()->levelCount())
+                                   .arg(QString::number(timer.nsecsElapsed() / 1e9, 'f', 3)));
+    });
+    connect(viewer, &ImageViewer::failed, this, [this, fileName](const QString &errorString) {
+        ui->statusbar->showMessage(tr("Could not open %1: %2").arg(QFileInfo(fileName).fileName(), errorString));
+    });
+    viewer->openImage(fileName);
+}
+
+void MainWindow::browseThumbnails(const QString &directory)
+{
+    ThumbnailView *view = thumbnailView();
+    ui->viewTabs->setCurrentWidget(view);
+    ui->statusbar->showMessage(tr("Listing %1...").arg(directory));
+    view->thumbnailModel()->setDirectory(directory);
+}
+
+void MainWindow::setImageCacheBudget(qint64 bytes)
+{
+    m_imageCacheBudget = bytes;
+    if (m_imageViewer)
+        m_imageViewer->setCacheBudget(bytes);
+}
+
+void MainWindow::setThumbnailCacheBudget(qint64 bytes)
+{
+    m_thumbnailCacheBudget = bytes;
+    if (m_thumbnailView)
+        m_thumbnailView->thumbnailModel()->setCacheBudget(bytes);
+}
+
+void MainWindow::connectToProducer(const QString &serverName)
+{
+    if (!m_ingest) {
+        m_ingest = new IngestClient(this);
+        connect(m_ingest, &IngestClient::sourceReady, this, [this](const QSharedPointer<StreamSource> &source) {
+            setDataSource(source, m_ingest->serverName());
+        });
+        connect(m_ingest, &IngestClient::rowsAppended, m_updates, &ModelUpdateScheduler::rowsAppended);
+        connect(m_ingest, &IngestClient::statsChanged, this, &MainWindow::updateIngestStatus);
+        connect(m_ingest, &IngestClient::finished, this, [this](const QString &errorString) {
+            if (errorString.isEmpty())
+                ui->statusbar->showMessage(tr("%1 closed the stream").arg(m_ingest->serverName()));
+            else
+                ui->statusbar->showMessage(tr("Stream from %1 failed: %2").arg(m_ingest->serverName(), errorString));
+        });
+    }
+    ui->statusbar->showMessage(tr("Waiting for producer %1...").arg(serverName));
+    m_ingest->connectToProducer(serverName);
+}
+
+// The new window starts on the same data, sharing it until either edits.
+void MainWindow::on_actionNewWindow_triggered()
+{
+    MainWindow *window = new MainWindow;
+    window->setAttribute(Qt::WA_DeleteOnClose);
+    window->setImageCacheBudget(m_imageCacheBudget);
+    window->setThumbnailCacheBudget(m_thumbnailCacheBudget);
+    if (m_document->source())
+        window->m_document->assign(*m_document);
+    window->show();
+}
+
+void MainWindow::on_actionOpen_triggered()
+{
+    const QString fileName = QFileDialog::getOpenFileName(this, tr("Open Data File"), QString(),
+                                                          tr("Data files (*.csv *.tsv *.txt *.log);;All files (*)"));
+    if (!fileName.isEmpty())
+        openFile(fileName);
+}
+
+void MainWindow::on_actionFollow_toggled(bool checked)
+{
+    if (!checked) {
+        if (m_follower)
+            m_follower->stop();
+        return;
+    }
+    const QSharedPointer<CsvSource> source = m_document->source().dynamicCast<CsvSource>();
+    if (!source) {
+        // Reloading the followed file would lose the edits.
+        ui->statusbar->showMessage(m_document->isModified() ? tr("Edited data cannot be followed")
+                                   : m_document->source() ? tr("Only files opened as text can be followed")
+                                                          : tr("Nothing loaded"), 3000);
+        ui->actionFollow->setChecked(false);
+        return;
+    }
+    if (!m_follower) {
+        m_follower = new FileFollower(this);
+        connect(m_follower, &FileFollower::linesAppended, this, &MainWindow::followedLinesAppended);
+        connect(m_follower, &FileFollower::lastLineChanged, this, &MainWindow::reloadFollowedSource);
+        connect(m_follower, &FileFollower::failed, this, [this](const QString &errorString) {
+            ui->statusbar->showMessage(tr("Stopped following %1: %2").arg(m_document->title(), errorString));
+            ui->actionFollow->setChecked(false);
+        });
+    }
+    ui->statusbar->showMessage(tr("Following %1").arg(m_document->title()), 3000);
+    m_follower->follow(source->file());
+}
+
+void MainWindow::on_actionOpenImage_triggered()
+{
+    QStringList patterns;
+    for (const QByteArray &format : QImageReader::supportedImageFormats())
+        patterns.append(QStringLiteral("*.") + QString::fromLatin1(format));
+    const QString fileName = QFileDialog::getOpenFileName(this, tr("Open Image"), QString(),
+                                                          tr("Images (%1);;All files (*)").arg(patterns.join(QLatin1Char(' '))));
+    if (!fileName.isEmpty())
+        openImage(fileName);
+}
+
+void MainWindow::on_actionBrowseThumbnails_triggered()
+{
+    const QString directory = QFileDialog::getExistingDirectory(this, tr("Browse Thumbnails"));
+    if (!directory.isEmpty())
+        browseThumbnails(directory);
+}
+
+void MainWindow::on_actionConnectProducer_triggered()
+{
+    bool ok = false;
+    const QString serverName = QInputDialog::getText(this, tr("Connect to Producer"), tr("Server name:"),
+                                                     QLineEdit::Normal,
+                                                     m_ingest ? m_ingest->serverName() : QStringLiteral("post-narnia-ingest"),
+                                                     &ok);
+    if (ok && !serverName.isEmpty())
+        connectToProducer(serverName);
+}
+
+void MainWindow::on_actionFind_triggered()
+{
+    findBar()->activate();
+}
+
+void MainWindow::on_actionFindNext_triggered()
+{
+    findBar()->show();
+    m_findBar->findNext();
+}
+
+void MainWindow::on_actionFindPrevious_triggered()
+{
+    findBar()->show();
+    m_findBar->findPrevious();
+}
+
+void MainWindow::on_actionUndo_triggered()
+{
+    QElapsedTimer timer;
+    timer.start();
+    if (m_document->undo())
+        ui->statusbar->showMessage(tr("Undone in %1 ms").arg(timer.nsecsElapsed() / 1e6, 0, 'f', 1), 3000);
+}
+
+void MainWindow::on_actionRedo_triggered()
+{
+    QElapsedTimer timer;
+    timer.start();
+    if (m_document->redo())
+        ui->statusbar->showMessage(tr("Redone in %1 ms").arg(timer.nsecsElapsed() / 1e6, 0, 'f', 1), 3000);
+}
+
+void MainWindow::on_actionFillColumn_triggered()
+{
+    const QSharedPointer<DataSource> source = m_document->source();
+    const QModelIndex current = m_tableView ? m_proxy->mapToSource(m_tableView->currentIndex()) : QModelIndex();
+    if (!source || !current.isValid()) {
+        ui->statusbar->showMessage(source ? tr("Select a cell of the column to fill") : tr("Nothing loaded"), 3000);
+        return;
+    }
+    const int column = current.column();
+    bool ok = false;
+    const QString text = QInputDialog::getText(this, tr("Fill Column"),
+                                               tr("Set every row of %1 to:").arg(source->columnName(column)),
+                                               QLineEdit::Normal, current.data(Qt::EditRole).toString(), &ok);
+    if (!ok)
+        return;
+    m_document->fillCells(column, 0, source->rowCount() - 1, text);
+    ui->statusbar->showMessage(tr("Filled %1 rows of %2").arg(QLocale().toString(source->rowCount()),
+                                                             source->columnName(column)), 3000);
+}
+
+void MainWindow::on_actionCommandPalette_triggered()
+{
+    CommandPalette *palette = commandPalette();
+    // Windows and recent files change without notice; they are few. A
+    // window is named by its serial, so an older segment still indexed
+    // while this one builds raises the window it shows.
+    QVector<CommandIndex::Candidate> windows;
+    for (QWidget *widget : QApplication::topLevelWidgets()) {
+        MainWindow *window = qobject_cast<MainWindow *>(widget);
+        if (!window || !window->m_document->source())
+            continue;
+        CommandIndex::Candidate candidate;
+        candidate.text = window->windowTitle();
+        candidate.detail = window == this ? tr("This window") : tr("Window");
+        candidate.kind = CommandIndex::OpenDocument;
+        candidate.id = window->m_serial;
+        windows.append(candidate);
+    }
+    palette->setCandidates(QStringLiteral("windows"), windows);
+
+    QVector<CommandIndex::Candidate> recent;
+    for (const QString &fileName : QSettings().value(QStringLiteral("recentFiles")).toStringList()) {
+        CommandIndex::Candidate candidate;
+        candidate.text = QFileInfo(fileName).fileName();
+        candidate.detail = fileName;
+        candidate.kind = CommandIndex::RecentFile;
+        recent.append(candidate);
+    }
+    palette->setCandidates(QStringLiteral("recent"), recent);
+    palette->popup();
+}
+
+void MainWindow::activatePaletteCandidate(const CommandIndex::Candidate &candidate)
+{
+    switch (candidate.kind) {
+    case CommandIndex::Action:
+        if (QAction *action = m_paletteActions.value(candidate.id)) {
+            if (action->isEnabled())
+                action->trigger();
+        }
+        break;
+    case CommandIndex::OpenDocument:
+        for (QWidget *widget : QApplication::topLevelWidgets()) {
+            MainWindow *window = qobject_cast<MainWindow *>(widget);
+            if (window && window->m_serial == candidate.id) {
+                window->raise();
+                window->activateWindow();
+                break;
+            }
+        }
+        break;
+    case CommandIndex::Column: {
+        if (!m_document->source() || candidate.id >= m_model->columnCount())
+            break;
+        DataTableView *view = tableView();
+        ui->viewTabs->setCurrentWidget(view);
+        const QModelIndex index = m_proxy->index(qMax(0, view->currentIndex().row()), candidate.id);
+        view->setCurrentIndex(index);
+        view->scrollTo(index);
+        break;
+    }
+    case CommandIndex::RecentFile:
+        openFile(candidate.detail);
+        break;
+    }
+}
+
+void MainWindow::on_actionFilterRows_triggered()
+{
+    tableView();
+    bool ok = false;
+    const QString expression = QInputDialog::getText(this, tr("Filter Rows"),
+                                                     tr("Show rows where (e.g. Value > 10 and Status = FAULT):"),
+                                                     QLineEdit::Normal, m_proxy->filter(), &ok);
+    if (!ok)
+        return;
+    QString errorString;
+    if (!m_proxy->setFilter(expression, &errorString))
+        QMessageBox::warning(this, tr("Filter Rows"), errorString);
+}
+
+void MainWindow::on_actionLatencyOverlay_toggled(bool checked)
+{
+    latencyLabel()->setVisible(checked);
+    if (checked) {
+        m_latencyBaseline = EventProfiler::snapshot();
+        m_latencyLabel->setText(tr("Measuring..."));
+        m_latencyTimer.start();
+    } else {
+        m_latencyTimer.stop();
+    }
+}
+
+void MainWindow::on_actionDumpLatency_triggered()
+{
+    const QString fileName = QFileDialog::getSaveFileName(this, tr("Save Latency Report"),
+                                                          QStringLiteral("latency.csv"),
+                                                          tr("CSV files (*.csv)"));
+    if (fileName.isEmpty())
+        return;
+    QString errorString;
+    if (!EventProfiler::dump(fileName, &errorString))
+        QMessageBox::warning(this, tr("Save Latency Report"), errorString);
+}
+
+void MainWindow::on_actionMemoryDiagnostics_triggered()
+{
+    if (!m_memoryDialog)
+        m_memoryDialog = new MemoryDialog(this);
+    m_memoryDialog->show();
+    m_memoryDialog->raise();
+    m_memoryDialog->activateWindow();
+}
+
+void MainWindow::on_actionPlotColumn_triggered()
+{
+    const QSharedPointer<DataSource> source = m_document->source();
+    if (!source || source->columnCount() == 0) {
+        ui->statusbar->showMessage(tr("Nothing loaded to plot"), 3000);
+        return;
+    }
+    const int column = m_tableView ? qMax(0, m_tableView->currentIndex().column()) : 0;
+    const QString title = source->columnName(column);
+
+    // The workers read a snapshot; follow mode and edits keep changing the
+    // document's own source meanwhile.
+    const QSharedPointer<DataSource> snapshot = source->clone();
+    const QSharedPointer<SampleVector> samples(new SampleVector);
+    Task *task = m_tasks->start(tr("Reading %1").arg(title), Task::NormalPriority,
+                                [snapshot, column, samples](TaskContext &context) {
+        const qint64 rows = snapshot->rowCount();
+        samples->resize(size_t(rows));
+        context.setProgressRange(rows);
+        float *out = samples->data();
+        TaskEngine::parallelFor(rows, 1 << 16, [&snapshot, &context, column, out](qint64 begin, qint64 end) {
+            const QSharedPointer<DataSource> reader = snapshot->clone();
+            for (qint64 row = begin; row < end; ++row) {
+                bool ok = false;
+                const float value = reader->cellText(row, column).toFloat(&ok);
+                out[row] = ok ? value : std::numeric_limits<float>::quiet_NaN();
+            }
+            context.addProgress(end - begin);
+        }, &context);
+    });
+    connect(task, &Task::finished, this, [this, task, samples, title] {
+        if (task->isCanceled())
+            return;
+        plotWidget()->setSamples(samples, title);
+        ui->viewTabs->setCurrentWidget(m_plotWidget);
+    });
+}
+
+void MainWindow::on_actionTestSignal_triggered()
+{
+    const qint64 Samples = 100000000;
+
+    QSharedPointer<QSharedPointer<SampleVector>> result(new QSharedPointer<SampleVector>);
+    Task *task = m_tasks->start(tr("Generating test signal"), Task::NormalPriority,
+                                [result](TaskContext &context) {
+        *result = PlotWidget::generateTestSignal(Samples, &context);
+    });
+    connect(task, &Task::finished, this, [this, task, result] {
+        if (task->isCanceled())
+            return;
+        plotWidget()->setSamples(*result, tr("Test signal"));
+        ui->viewTabs->setCurrentWidget(m_plotWidget);
+    });
+}
+
+void MainWindow::on_actionLoadIntoMemory_triggered()
+{
+    const QSharedPointer<DataSource> source = m_document->source();
+    if (!source || m_document->columnStore()) {
+        ui->statusbar->showMessage(source ? tr("Already in memory") : tr("Nothing loaded"), 3000);
+        return;
+    }
+    // Edited columns belong to this document only, not to the file, and
+    // the new source starts a new undo history.
+    const bool modified = m_document->isModified();
+    const EditHistory *history = m_document->history();
+    if ((history->undoCount() > 0 || history->canRedo())
+            && QMessageBox::question(this, tr("Load into Memory"),
+                                     tr("The edits will become part of the data held in memory and can no "
+                                        "longer be undone. Load anyway?")) != QMessageBox::Yes)
+        return;
+    ui->actionLoadIntoMemory->setEnabled(false);
+
+    // Parses a snapshot; a stream keeps growing in its own source meanwhile.
+    const QSharedPointer<DataSource> snapshot = source->clone();
+    const QString title = m_document->title();
+    QSharedPointer<QSharedPointer<ColumnStore>> result(new QSharedPointer<ColumnStore>);
+    Task *task = m_tasks->start(tr("Loading %1 into memory").arg(title), Task::NormalPriority,
+                                [snapshot, result](TaskContext &context) {
+        *result = ColumnStore::build(*snapshot, &context);
+    });
+    // Edits made meanwhile are not in the snapshot and must not be lost.
+    const QSharedPointer<bool> editedMeanwhile(new bool(false));
+    connect(m_document, &Document::cellsChanged, task, [editedMeanwhile] { *editedMeanwhile = true; });
+    connect(task, &Task::finished, this, [this, task, source, result, title, modified, editedMeanwhile] {
+        ui->actionLoadIntoMemory->setEnabled(true);
+        if (task->isCanceled() || !*result || m_document->source() != source || *editedMeanwhile)
+            return;
+        const QString fileName = m_document->fileName();
+        m_document->setSource(*result, title, fileName);
+        if (!fileName.isEmpty() && !modified) {
+            DocumentCache::insert(fileName, *result);
+            saveColumnCache(*result, fileName);
+        }
+    });
+}
+
+void MainWindow::saveColumnCache(const QSharedPointer<ColumnStore> &store, const QString &fileName)
+{
+    const QString displayName = QFileInfo(fileName).fileName();
+    const QSharedPointer<QString> errorString(new QString);
+    Task *task = m_tasks->start(tr("Caching %1").arg(displayName), Task::LowPriority,
+                                [store, fileName, errorString](TaskContext &context) {
+        ColumnCache::save(*store, fileName, ColumnCache::cacheFileName(fileName), errorString.data(), &context);
+    });
+    connect(task, &Task::finished, this, [this, task, errorString, displayName] {
+        if (task->isCanceled())
+            return;
+        if (errorString->isEmpty())
+            ui->statusbar->showMessage(tr("Cached the columns of %1 for the next open").arg(displayName), 3000);
+        else
+            ui->statusbar->showMessage(tr("Could not cache %1: %2").arg(displayName, *errorString));
+    });
+}
+
+void MainWindow::on_actionStatistics_triggered()
+{
+    statisticsDock()->show();
+    m_statisticsDock->raise();
+}
+
+void MainWindow::updateTaskProgress(qint64 done, qint64 total, const QString &label)
+{
+    const bool busy = m_tasks->activeTaskCount() > 0;
+    if (!busy && !m_progressBar)
+        return;
+    ensureTaskWidgets();
+    m_progressBar->setVisible(busy);
+    m_cancelButton->setVisible(busy);
+    if (!busy)
+        return;
+
+    // QProgressBar is int based; an empty range shows a busy indicator.
+    m_progressBar->setRange(0, total > 0 ? 1000 : 0);
+    m_progressBar->setValue(total > 0 ? int(qMin(done, total) * 1000 / total) : 0);
+    m_progressBar->setFormat(label + QStringLiteral(" %p%"));
+}
+
+void MainWindow::updateLatencyOverlay()
+{
+    // Shows the interval since the last refresh, not the whole session.
+    const EventProfiler::Snapshot now = EventProfiler::snapshot();
+    const LatencyStats loop = now.categories[EventProfiler::LoopIteration]
+            - m_latencyBaseline.categories[EventProfiler::LoopIteration];
+    const LatencyStats paint = now.categories[EventProfiler::Paint]
+            - m_latencyBaseline.categories[EventProfiler::Paint];
+    m_latencyBaseline = now;
+    const ModelUpdateScheduler::Stats updates = m_updates->stats();
+
+    latencyLabel()->setText(tr("loop p50 %1 ms  p99 %2 ms  max %3 ms  stalls %4 | paint p99 %5 ms"
+                               " | model signals %6 of %7 updates")
+                            .arg(loop.quantileMs(0.5), 0, 'f', 2)
+                            .arg(loop.quantileMs(0.99), 0, 'f', 2)
+                            .arg(loop.maxMs(), 0, 'f', 1)
+                            .arg(loop.countAbove(16.0))
+                            .arg(paint.quantileMs(0.99), 0, 'f', 2)
+                            .arg(updates.emitted)
+                            .arg(updates.received));
+}
+
+void MainWindow::updateMemoryStatus()
+{
+    const MemoryTracker::Usage total = MemoryTracker::total();
+    if (!m_memoryLabel) {
+        // Nothing worth showing until something sizable was loaded.
+        if (total.live == 0)
+            return;
+        m_memoryLabel = new QLabel(this);
+        ui->statusbar->addPermanentWidget(m_memoryLabel);
+    }
+    const QLocale locale;
+    const qint64 budget = MemoryTracker::budget();
+    m_memoryLabel->setText(budget > 0 ? tr("Memory: %1 of %2").arg(locale.formattedDataSize(total.live),
+                                                                   locale.formattedDataSize(budget))
+                                      : tr("Memory: %1").arg(locale.formattedDataSize(total.live)));
+    QStringList lines;
+    for (int s = 0; s < MemoryTracker::SubsystemCount; ++s) {
+        const MemoryTracker::Subsystem subsystem = MemoryTracker::Subsystem(s);
+        const MemoryTracker::Usage usage = MemoryTracker::usage(subsystem);
+        lines.append(tr("%1: %2 (peak %3)").arg(MemoryTracker::subsystemName(subsystem),
+                                               locale.formattedDataSize(usage.live),
+                                               locale.formattedDataSize(usage.peak)));
+    }
+    m_memoryLabel->setToolTip(lines.join(QLatin1Char('\n')));
+}
+
+void MainWindow::updateHistoryActions()
+{
+    const EditHistory *history = m_document->history();
+    ui->actionUndo->setEnabled(history->canUndo());
+    ui->actionRedo->setEnabled(history->canRedo());
+}
+
+void MainWindow::updateIngestStatus()
+{
+    if (!m_ingestLabel) {
+        m_ingestLabel = new QLabel(this);
+        ui->statusbar->addPermanentWidget(m_ingestLabel);
+    }
+    const IngestClient::Stats stats = m_ingest->stats();
+    const QLocale locale;
+    m_ingestLabel->setText(tr("Stream: %1 rec/s, %2 rows, ring %3%, back-pressure %4, dropped %5")
+                           .arg(locale.toString(qRound64(stats.recordsPerSecond)),
+                                locale.toString(stats.delivered),
+                                QString::number(stats.ringFillPercent),
+                                locale.toString(stats.backPressureEvents),
+                                locale.toString(stats.dropped)));
+}
+
+void MainWindow::showDocument()
+{
+    const QSharedPointer<DataSource> source = m_document->source();
+    if (m_follower && m_follower->isFollowing()) {
+        const QSharedPointer<CsvSource> text = source.dynamicCast<CsvSource>();
+        if (!text || text->file() != m_follower->file())
+            ui->actionFollow->setChecked(false);
+    }
+    // Pending changes were to the previous source.
+    m_updates->discard();
+    tableView();
+    m_model->setSource(source);
+    if (m_findBar)
+        m_findBar->setSource(source);
+    if (!m_document->title().isEmpty())
+        setWindowTitle(m_document->title());
+    if (m_palette)
+        updatePaletteColumns();
+    updateMemoryStatus();
+}
+
+void MainWindow::showEditedCells(qint64 firstRow, qint64 lastRow, int firstColumn, int lastColumn)
+{
+    const QSharedPointer<DataSource> source = m_document->source();
+    if (m_follower && m_follower->isFollowing()) {
+        ui->actionFollow->setChecked(false);
+        ui->statusbar->showMessage(tr("Stopped following %1: it has been edited").arg(m_document->title()), 3000);
+    }
+    const int last = int(qMin<qint64>(lastRow, std::numeric_limits<int>::max()));
+    m_model->sourceCellsChanged(source, int(qMin<qint64>(firstRow, last)), last, firstColumn, lastColumn);
+    if (m_findBar && m_findBar->source() != source)
+        m_findBar->setSource(source);
+}
+
+CommandPalette *MainWindow::commandPalette()
+{
+    if (!m_palette) {
+        m_palette = new CommandPalette(m_tasks, this);
+        connect(m_palette, &CommandPalette::activated, this, &MainWindow::activatePaletteCandidate);
+        QVector<CommandIndex::Candidate> actions;
+        fillRareMenus();
+        collectActions(ui->menubar->actions(), QString(), ui->actionCommandPalette, &m_paletteActions, &actions);
+        m_palette->setCandidates(QStringLiteral("actions"), actions);
+        updatePaletteColumns();
+    }
+    return m_palette;
+}
+
+void MainWindow::fillRareMenus()
+{
+    if (!ui->menuPlot->isEmpty())
+        return;
+    TRACE_SCOPE("MainWindow::fillRareMenus");
+    ui->menuView->addSeparator();
+    ui->menuView->addActions({ ui->actionLatencyOverlay, ui->actionDumpLatency, ui->actionMemoryDiagnostics });
+    ui->menuData->addActions({ ui->actionLoadIntoMemory, ui->actionStatistics });
+    ui->menuPlot->addActions({ ui->actionPlotColumn, ui->actionTestSignal });
+}
+
+// Tables may have many thousands of columns, so these are indexed once per
+// source rather than each time the palette opens.
+void MainWindow::updatePaletteColumns()
+{
+    QVector<CommandIndex::Candidate> columns;
+    if (const QSharedPointer<DataSource> source = m_document->source()) {
+        columns.reserve(source->columnCount());
+        for (int c = 0; c < source->columnCount(); ++c) {
+            CommandIndex::Candidate candidate;
+            candidate.text = source->columnName(c);
+            candidate.detail = tr("Column %1").arg(c + 1);
+            candidate.kind = CommandIndex::Column;
+            candidate.id = c;
+            columns.append(candidate);
+        }
+    }
+    m_palette->setCandidates(QStringLiteral("columns"), columns);
+}
+
+void MainWindow::addRecentFile(const QString &fileName)
+{
+    QSettings settings;
+    QStringList files = settings.value(QStringLiteral("recentFiles")).toStringList();
+    const QString path = QFileInfo(fileName).absoluteFilePath();
+    files.removeAll(path);
+    files.prepend(path);
+    while (files.size() > MaxRecentFiles)
+        files.removeLast();
+    settings.setValue(QStringLiteral("recentFiles"), files);
+}
+
+DataTableView *MainWindow::tableView()
+{
+    if (!m_tableView) {
+        TRACE_SCOPE("MainWindow::tableView");
+        m_proxy = new SortFilterProxy(m_tasks, this);
+        m_proxy->setSourceModel(m_model);
+        m_tableView = new DataTableView(ui->viewTabs);
+        m_tableView->setModel(m_proxy);
+        // Unsorted until a header is clicked; a third click unsorts again.
+        m_tableView->horizontalHeader()->setSortIndicator(-1, Qt::AscendingOrder);
+        m_tableView->horizontalHeader()->setSortIndicatorClearable(true);
+        m_tableView->setSortingEnabled(true);
+        connect(m_proxy, &SortFilterProxy::sortReverted, this, [this](int column, Qt::SortOrder order) {
+            // The header would otherwise ask for the same sort again.
+            QHeaderView *header = m_tableView->horizontalHeader();
+            const QSignalBlocker blocker(header);
+            header->setSortIndicator(column, order);
+        });
+        ui->viewTabs->insertTab(0, m_tableView, tr("Table"));
+    }
+    return m_tableView;
+}
+
+PlotWidget *MainWindow::plotWidget()
+{
+    if (!m_plotWidget) {
+        m_plotWidget = new PlotWidget(m_tasks, ui->viewTabs);
+        ui->viewTabs->addTab(m_plotWidget, tr("Plot"));
+    }
+    return m_plotWidget;
+}
+
+ImageViewer *MainWindow::imageViewer()
+{
+    if (!m_imageViewer) {
+        m_imageViewer = new ImageViewer(m_tasks, ui->viewTabs);
+        m_imageViewer->setCacheBudget(m_imageCacheBudget);
+        ui->viewTabs->addTab(m_imageViewer, tr("Image"));
+    }
+    return m_imageViewer;
+}
+
+ThumbnailView *MainWindow::thumbnailView()
+{
+    if (!m_thumbnailView) {
+        m_thumbnailView = new ThumbnailView(ui->viewTabs);
+        ThumbnailModel *model = new ThumbnailModel(m_thumbnailView);
+        model->setCacheBudget(m_thumbnailCacheBudget);
+        m_thumbnailView->setThumbnailModel(model);
+        connect(model, &ThumbnailModel::directoryLoaded, this, [this, model] {
+            ui->statusbar->showMessage(tr("%1 images in %2").arg(QLocale().toString(model->rowCount()),
+                                                                 model->directory()), 5000);
+        });
+        connect(m_thumbnailView, &ThumbnailView::imageActivated, this, &MainWindow::openImage);
+        ui->viewTabs->addTab(m_thumbnailView, tr("Thumbnails"));
+    }
+    return m_thumbnailView;
+}
+
+FindBar *MainWindow::findBar()
+{
+    if (!m_findBar) {
+        m_findBar = new FindBar(m_tasks, ui->centralwidget);
+        m_findBar->setSource(m_document->source());
+        // Matches are shown in the table, so they are stepped in its order.
+        tableView();
+        m_findBar->setProxy(m_proxy);
+        ui->centralLayout->addWidget(m_findBar);
+        connect(m_findBar, &FindBar::matchActivated, this, &MainWindow::showRow);
+        connect(m_findBar, &FindBar::dismissed, this, [this] {
+            if (m_tableView)
+                m_tableView->setFocus();
+        });
+    }
+    return m_findBar;
+}
+
+QDockWidget *MainWindow::statisticsDock()
+{
+    if (!m_statisticsDock) {
+        StatisticsPanel *panel = new StatisticsPanel(m_document, m_tasks);
+        connect(panel, &StatisticsPanel::loadRequested, this, &MainWindow::on_actionLoadIntoMemory_triggered);
+        m_statisticsDock = new QDockWidget(tr("Statistics"), this);
+        m_statisticsDock->setObjectName(QStringLiteral("statisticsDock"));
+        m_statisticsDock->setWidget(panel);
+        addDockWidget(Qt::RightDockWidgetArea, m_statisticsDock);
+    }
+    return m_statisticsDock;
+}
+
+// Shows the new rows, and keeps the last one in view if it already was.
+void MainWindow::followedLinesAppended()
+{
+    const QScrollBar *scrollBar = tableView()->verticalScrollBar();
+    const bool atEnd = scrollBar->value() == scrollBar->maximum();
+    // A file that was empty when opened has only now got its header.
+    if (m_document->source()->columnCount() == 0)
+        reloadFollowedSource();
+    else
+        m_model->sourceRowsAppended();
+    if (atEnd)
+        m_tableView->scrollToBottom();
+}
+
+// A new source over the same file: it re-reads the header and forgets
+// fields split from the unfinished last line. Nothing is read from disk.
+void MainWindow::reloadFollowedSource()
+{
+    m_document->setSource(QSharedPointer<DataSource>(new CsvSource(m_follower->file())),
+                          m_document->title(), m_document->fileName());
+}
+
+void MainWindow::showRow(qint64 row)
+{
+    if (row >= m_model->rowCount())
+        m_model->sourceRowsAppended();
+    if (row >= m_model->rowCount())
+        return;
+    DataTableView *view = tableView();
+    ui->viewTabs->setCurrentWidget(view);
+    const int column = qMax(0, view->currentIndex().column());
+    const QModelIndex index = m_proxy->mapFromSource(m_model->index(int(row), column));
+    if (!index.isValid()) {
+        ui->statusbar->showMessage(tr("Row %1 is hidden by the filter").arg(row + 1), 3000);
+        return;
+    }
+    view->setCurrentIndex(index);
+    view->scrollTo(index, QAbstractItemView::PositionAtCenter);
+}
+
+void MainWindow::ensureTaskWidgets()
+{
+    if (m_progressBar)
+        return;
+    m_progressBar = new QProgressBar(this);
+    m_progressBar->setMaximumWidth(260);
+    m_cancelButton = new QToolButton(this);
+    m_cancelButton->setText(tr("Cancel"));
+    m_cancelButton->setAutoRaise(true);
+    ui->statusbar->addPermanentWidget(m_progressBar);
+    ui->statusbar->addPermanentWidget(m_cancelButton);
+    connect(m_cancelButton, &QToolButton::clicked, m_tasks, &TaskEngine::cancelAll);
+}
+
+QLabel *MainWindow::latencyLabel()
+{
+    if (!m_latencyLabel) {
+        m_latencyLabel = new QLabel(this);
+        ui->statusbar->addPermanentWidget(m_latencyLabel);
+    }
+    return m_latencyLabel;
+}
@@ -1,7 +1,35 @@
 #ifndef MAINWINDOW_H
 #define MAINWINDOW_H
 
+#include "commandindex.h"
+#include "eventprofiler.h"
+
 #include <QMainWindow>
+#include <QPointer>
+#include <QSharedPointer>
+#include <QTimer>
+
+class ColumnStore;
+class CommandPalette;
+class DataSource;
+class DataTableView;
+class Document;
+class FileFollower;
+class FindBar;
+class ImageViewer;
+class IngestClient;
+class LazyTableModel;
+class MemoryDialog;
+class ModelUpdateScheduler;
+class PlotWidget;
+class QDockWidget;
+class QLabel;
+class QProgressBar;
+class QToolButton;
+class SortFilterProxy;
+class StatisticsPanel;
+class TaskEngine;
+class ThumbnailView;
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
@@ -12,10 +40,98 @@ class MainWindow : public QMainWindow
     Q_OBJECT
 
 public:
+    static const int MaxRecentFiles = 20;
+
     MainWindow(QWidget *parent = nullptr);
     ~MainWindow();
 
+    void setDataSource(const QSharedPointer<DataSource> &source, const QString &title = QString());
+    void openFile(const QString &fileName);
+    void openImage(const QString &fileName);
+    void browseThumbnails(const QString &directory);
+    // Memory for decoded image tiles and for thumbnails.
+    void setImageCacheBudget(qint64 bytes);
+    void setThumbnailCacheBudget(qint64 bytes);
+    void connectToProducer(const QString &serverName);
+
+private slots:
+    void on_actionNewWindow_triggered();
+    void on_actionOpen_triggered();
+    void on_actionFollow_toggled(bool checked);
+    void on_actionOpenImage_triggered();
+    void on_actionBrowseThumbnails_triggered();
+    void on_actionConnectProducer_triggered();
+    void on_actionFind_triggered();
+    void on_actionFindNext_triggered();
+    void on_actionFindPrevious_triggered();
+    void on_actionUndo_triggered();
+    void on_actionRedo_triggered();
+    void on_actionFillColumn_triggered();
+    void on_actionCommandPalette_triggered();
+    void on_actionFilterRows_triggered();
+    void on_actionLatencyOverlay_toggled(bool checked);
+    void on_actionDumpLatency_triggered();
+    void on_actionMemoryDiagnostics_triggered();
+    void on_actionPlotColumn_triggered();
+    void on_actionTestSignal_triggered();
+    void on_actionLoadIntoMemory_triggered();
+    void on_actionStatistics_triggered();
+    void updateTaskProgress(qint64 done, qint64 total, const QString &label);
+    void updateLatencyOverlay();
+    void updateIngestStatus();
+    void updateMemoryStatus();
+    void updateHistoryActions();
+    void showDocument();
+    void showEditedCells(qint64 firstRow, qint64 lastRow, int firstColumn, int lastColumn);
+    void activatePaletteCandidate(const CommandIndex::Candidate &candidate);
+
 private:
+    // Widgets that are not needed for the first frame are built on first use.
+    DataTableView *tableView();
+    PlotWidget *plotWidget();
+    ImageViewer *imageViewer();
+    ThumbnailView *thumbnailView();
+    FindBar *findBar();
+    QDockWidget *statisticsDock();
+    CommandPalette *commandPalette();
+    void fillRareMenus();
+    void updatePaletteColumns();
+    void addRecentFile(const QString &fileName);
+    void showRow(qint64 row);
+    void followedLinesAppended();
+    void reloadFollowedSource();
+    void saveColumnCache(const QSharedPointer<ColumnStore> &store, const QString &fileName);
+    void ensureTaskWidgets();
+    QLabel *latencyLabel();
+
     Ui::MainWindow *ui;
+    Document *m_document;
+    LazyTableModel *m_model;
+    TaskEngine *m_tasks;
+    ModelUpdateScheduler *m_updates;
+    SortFilterProxy *m_proxy = nullptr;
+    DataTableView *m_tableView = nullptr;
+    PlotWidget *m_plotWidget = nullptr;
+    ImageViewer *m_imageViewer = nullptr;
+    qint64 m_imageCacheBudget;
+    ThumbnailView *m_thumbnailView = nullptr;
+    qint64 m_thumbnailCacheBudget;
+    FindBar *m_findBar = nullptr;
+    QDockWidget *m_statisticsDock = nullptr;
+    QProgressBar *m_progressBar = nullptr;
+    QToolButton *m_cancelButton = nullptr;
+    QLabel *m_latencyLabel = nullptr;
+    IngestClient *m_ingest = nullptr;
+    FileFollower *m_follower = nullptr;
+    QLabel *m_ingestLabel = nullptr;
+    QLabel *m_memoryLabel = nullptr;
+    MemoryDialog *m_memoryDialog = nullptr;
+    CommandPalette *m_palette = nullptr;
+    QVector<QPointer<QAction>> m_paletteActions;
+    // Identifies the window in palette candidates; never reused.
+    int m_serial;
+    QTimer m_latencyTimer;
+    QTimer m_memoryTimer;
+    EventProfiler::Snapshot m_latencyBaseline;
 };
 #endif // MAINWINDOW_H
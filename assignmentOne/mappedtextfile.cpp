@@ -0,0 +1,149 @@
+#include "mappedtextfile.h"
+
+#include "taskengine.h"
+#include "trace.h"
+
+#include <QCoreApplication>
+
+#include <cstring>
+
+MappedTextFile::MappedTextFile()
+{
+}
+
+MappedTextFile::~MappedTextFile()
+{
+    if (m_data)
+        m_file.unmap(reinterpret_cast<uchar *>(const_cast<char *>(m_data)));
+}
+
+bool MappedTextFile::open(const QString &fileName, QString *errorString, TaskContext *context)
+{
+    TRACE_SCOPE("MappedTextFile::open");
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        if (errorString)
+            *errorString = m_file.errorString();
+        return false;
+    }
+
+    m_size = m_file.size();
+    if (m_size > 0) {
+        m_data = reinterpret_cast<const char *>(m_file.map(0, m_size));
+        if (!m_data) {
+            if (errorString)
+                *errorString = m_file.errorString();
+            m_size = 0;
+            return false;
+        }
+    }
+
+    if (context)
+        context->setProgressRange(2 * m_size);
+    if (!m_index.build(m_data, m_size, context)) {
+        if (errorString)
+            *errorString = QCoreApplication::translate("MappedTextFile", "Canceled");
+        return false;
+    }
+    m_mappedLines = m_index.lineCount();
+    m_lines.store(m_mappedLines, std::memory_order_release);
+    m_readOffset = m_size;
+    m_lastLineOpen = m_size > 0 && m_data[m_size - 1] != '\n';
+    return true;
+}
+
+QString MappedTextFile::fileName() const
+{
+    return m_file.fileName();
+}
+
+const char *MappedTextFile::line(qint64 line, qint64 *length) const
+{
+    if (line >= m_mappedLines) {
+        const QByteArray *chunk;
+        {
+            QMutexLocker locker(&m_tailMutex);
+            chunk = m_tail[size_t((line - m_mappedLines) / TailChunkLines)].get();
+        }
+        const QByteArray &text = chunk[(line - m_mappedLines) % TailChunkLines];
+        *length = text.size();
+        return text.constData();
+    }
+    if (line == m_mappedLines - 1) {
+        if (const QByteArray *completed = m_lastLine.load(std::memory_order_acquire)) {
+            *length = completed->size();
+            return completed->constData();
+        }
+    }
+
+    const qint64 begin = m_index.lineStart(line);
+    qint64 end = line + 1 < m_index.lineCount() ? m_index.lineStart(line + 1) - 1 : m_size;
+    if (end > begin && m_data[end - 1] == '\n')
+        --end;
+    if (end > begin && m_data[end - 1] == '\r')
+        --end;
+    *length = end - begin;
+    return m_data + begin;
+}
+
+qint64 MappedTextFile::readAppended(bool *lastLineCompleted, QString *errorString)
+{
+    if (lastLineCompleted)
+        *lastLineCompleted = false;
+    const qint64 size = m_file.size();
+    if (size < m_readOffset) {
+        if (errorString)
+            *errorString = QCoreApplication::translate("MappedTextFile", "The file was truncated");
+        return -1;
+    }
+    if (size == m_readOffset)
+        return 0;
+    if (!m_file.seek(m_readOffset)) {
+        if (errorString)
+            *errorString = m_file.errorString();
+        return -1;
+    }
+    const QByteArray bytes = m_file.read(size - m_readOffset);
+    if (bytes.isEmpty()) {
+        if (errorString)
+            *errorString = m_file.errorString();
+        return -1;
+    }
+    m_readOffset += bytes.size();
+    m_pending += bytes;
+
+    qint64 added = 0;
+    qint64 lines = m_lines.load(std::memory_order_relaxed);
+    const char *data = m_pending.constData();
+    qint64 start = 0;
+    while (const void *hit = std::memchr(data + start, '\n', size_t(m_pending.size() - start))) {
+        const qint64 end = static_cast<const char *>(hit) - data;
+        const qint64 length = end > start && data[end - 1] == '\r' ? end - start - 1 : end - start;
+        QByteArray text(data + start, int(length));
+        start = end + 1;
+
+        if (m_lastLineOpen) {
+            qint64 mappedLength = 0;
+            const char *mapped = line(m_mappedLines - 1, &mappedLength);
+            m_completedLastLine = QByteArray(mapped, int(mappedLength)) + text;
+            m_lastLine.store(&m_completedLastLine, std::memory_order_release);
+            m_lastLineOpen = false;
+            if (lastLineCompleted)
+                *lastLineCompleted = true;
+            continue;
+        }
+
+        const qint64 tailLine = lines - m_mappedLines;
+        const size_t chunkIndex = size_t(tailLine / TailChunkLines);
+        if (chunkIndex == m_tail.size()) {
+            QMutexLocker locker(&m_tailMutex);
+            m_tail.emplace_back(new QByteArray[TailChunkLines]);
+        }
+        m_tail[chunkIndex][tailLine % TailChunkLines] = std::move(text);
+        ++lines;
+        ++added;
+    }
+    m_pending.remove(0, int(start));
+    m_lines.store(lines, std::memory_order_release);
+    return added;
+}
@@ -0,0 +1,76 @@
+#ifndef MAPPEDTEXTFILE_H
+#define MAPPEDTEXTFILE_H
+
+#include "lineindex.h"
+
+#include <QByteArray>
+#include <QFile>
+#include <QMutex>
+#include <QString>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+class TaskContext;
+
+// A read-only text file mapped into memory together with its line index.
+// Lines are handed out as pointers into the mapping; nothing is copied.
+// A file that is still being written can be followed: readAppended()
+// reads just the new bytes and adds their complete lines after the mapped
+// ones, so lines already handed out never move or change.
+class MappedTextFile
+{
+public:
+    MappedTextFile();
+    ~MappedTextFile();
+
+    // Maps the file and indexes it. Safe to call from a worker thread;
+    // reports progress to and can be canceled through context.
+    bool open(const QString &fileName, QString *errorString = nullptr,
+              TaskContext *context = nullptr);
+
+    QString fileName() const;
+    qint64 size() const { return m_size; }
+    const char *data() const { return m_data; }
+
+    // Safe to call while another thread appends.
+    qint64 lineCount() const { return m_lines.load(std::memory_order_acquire); }
+    // Returns line without its terminating "\n" or "\r\n".
+    const char *line(qint64 line, qint64 *length) const;
+    qint64 indexMemoryUsage() const { return m_index.memoryUsage(); }
+
+    // Reads what was appended to the file since it was opened or last
+    // read, and adds the lines that are now complete; a final line without
+    // its newline waits for the next call. Returns the number of lines
+    // added, or -1 if the file shrank or could not be read, in which case
+    // it has to be reopened. lastLineCompleted is set when the appended
+    // bytes finished a last line that was mapped without its newline; that
+    // line's text has changed. Call from one thread only.
+    qint64 readAppended(bool *lastLineCompleted = nullptr, QString *errorString = nullptr);
+    // Bytes read past the mapping so far.
+    qint64 appendedSize() const { return m_readOffset - m_size; }
+
+private:
+    Q_DISABLE_COPY(MappedTextFile)
+
+    QFile m_file;
+    const char *m_data = nullptr;
+    qint64 m_size = 0;
+    LineIndex m_index;
+    qint64 m_mappedLines = 0;
+    std::atomic<qint64> m_lines { 0 };
+
+    // Follow state, written by the reading thread only. Appended lines are
+    // kept in chunks that never move; the mutex guards the chunk table.
+    static const int TailChunkLines = 1 << 14;
+    mutable QMutex m_tailMutex;
+    std::vector<std::unique_ptr<QByteArray[]>> m_tail;
+    qint64 m_readOffset = 0;
+    QByteArray m_pending;
+    bool m_lastLineOpen = false;
+    QByteArray m_completedLastLine;
+    std::atomic<const QByteArray *> m_lastLine { nullptr };
+};
+
+#endif // MAPPEDTEXTFILE_H
@@ -0,0 +1,111 @@
+#include "memorydialog.h"
+
+#include "memorytracker.h"
+
+#include <QDialogButtonBox>
+#include <QFormLayout>
+#include <QHeaderView>
+#include <QLabel>
+#include <QLocale>
+#include <QPushButton>
+#include <QSpinBox>
+#include <QTableWidget>
+#include <QVBoxLayout>
+
+namespace {
+
+const int RefreshIntervalMs = 500;
+
+}
+
+MemoryDialog::MemoryDialog(QWidget *parent)
+    : QDialog(parent)
+    , m_table(new QTableWidget(MemoryTracker::SubsystemCount + 1, 4, this))
+    , m_summary(new QLabel(this))
+    , m_budgetBox(new QSpinBox(this))
+{
+    setWindowTitle(tr("Memory Diagnostics"));
+    m_table->setHorizontalHeaderLabels({ tr("Subsystem"), tr("Live"), tr("Peak"), tr("Share") });
+    m_table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    m_table->setSelectionMode(QAbstractItemView::NoSelection);
+    m_table->verticalHeader()->hide();
+    m_table->horizontalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
+    m_table->horizontalHeader()->setStretchLastSection(true);
+    for (int row = 0; row < m_table->rowCount(); ++row) {
+        for (int column = 0; column < m_table->columnCount(); ++column) {
+            QTableWidgetItem *item = new QTableWidgetItem;
+            if (column > 0)
+                item->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+            m_table->setItem(row, column, item);
+        }
+    }
+
+    m_budgetBox->setRange(0, 1 << 20);
+    m_budgetBox->setSuffix(tr(" MB"));
+    m_budgetBox->setSpecialValueText(tr("Unlimited"));
+    m_budgetBox->setValue(int(MemoryTracker::budget() >> 20));
+    connect(m_budgetBox, &QSpinBox::editingFinished, this, [this] {
+        MemoryTracker::setBudget(qint64(m_budgetBox->value()) << 20);
+        refresh();
+    });
+
+    QPushButton *resetButton = new QPushButton(tr("Reset Peaks"), this);
+    connect(resetButton, &QPushButton::clicked, this, [this] {
+        MemoryTracker::resetPeaks();
+        refresh();
+    });
+    QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Close, this);
+    buttons->addButton(resetButton, QDialogButtonBox::ActionRole);
+    connect(buttons, &QDialogButtonBox::rejected, this, &QDialog::reject);
+
+    QFormLayout *budgetLayout = new QFormLayout;
+    budgetLayout->addRow(tr("Budget:"), m_budgetBox);
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->addWidget(m_table, 1);
+    layout->addWidget(m_summary);
+    layout->addLayout(budgetLayout);
+    layout->addWidget(buttons);
+    resize(480, 320);
+
+    m_refreshTimer.setInterval(RefreshIntervalMs);
+    connect(&m_refreshTimer, &QTimer::timeout, this, &MemoryDialog::refresh);
+}
+
+void MemoryDialog::showEvent(QShowEvent *event)
+{
+    QDialog::showEvent(event);
+    m_budgetBox->setValue(int(MemoryTracker::budget() >> 20));
+    refresh();
+    m_refreshTimer.start();
+}
+
+void MemoryDialog::hideEvent(QHideEvent *event)
+{
+    m_refreshTimer.stop();
+    QDialog::hideEvent(event);
+}
+
+void MemoryDialog::refresh()
+{
+    const QLocale locale;
+    const MemoryTracker::Usage total = MemoryTracker::total();
+    const auto setRow = [this, &locale, &total](int row, const QString &name, const MemoryTracker::Usage &usage) {
+        m_table->item(row, 0)->setText(name);
+        m_table->item(row, 1)->setText(locale.formattedDataSize(usage.live));
+        m_table->item(row, 2)->setText(locale.formattedDataSize(usage.peak));
+        m_table->item(row, 3)->setText(total.live > 0 ? QStringLiteral("%1%").arg(100.0 * usage.live / total.live, 0, 'f', 1)
+                                                      : QString());
+    };
+    for (int s = 0; s < MemoryTracker::SubsystemCount; ++s) {
+        const MemoryTracker::Subsystem subsystem = MemoryTracker::Subsystem(s);
+        setRow(s, MemoryTracker::subsystemName(subsystem), MemoryTracker::usage(subsystem));
+    }
+    setRow(MemoryTracker::SubsystemCount, tr("Total"), total);
+
+    const qint64 budget = MemoryTracker::budget();
+    m_summary->setText(budget > 0 ? tr("%1 of the %2 budget in use; caches were asked to shrink %n time(s).", nullptr,
+                                       MemoryTracker::reclaimCount())
+                                    .arg(locale.formattedDataSize(total.live), locale.formattedDataSize(budget))
+                                  : tr("No budget; caches keep their own limits."));
+}
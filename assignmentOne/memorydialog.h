@@ -0,0 +1,33 @@
+#ifndef MEMORYDIALOG_H
+#define MEMORYDIALOG_H
+
+#include <QDialog>
+#include <QTimer>
+
+class QLabel;
+class QSpinBox;
+class QTableWidget;
+
+// Live and peak memory of every MemoryTracker subsystem, refreshed while
+// shown, with the global budget that makes caches shrink.
+class MemoryDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit MemoryDialog(QWidget *parent = nullptr);
+
+protected:
+    void showEvent(QShowEvent *event) override;
+    void hideEvent(QHideEvent *event) override;
+
+private:
+    void refresh();
+
+    QTableWidget *m_table;
+    QLabel *m_summary;
+    QSpinBox *m_budgetBox;
+    QTimer m_refreshTimer;
+};
+
+#endif // MEMORYDIALOG_H
@@ -0,0 +1,154 @@
+#include "memorytracker.h"
+
+#include <QCoreApplication>
+#include <QMutex>
+#include <QPointer>
+#include <QVector>
+
+#include <algorithm>
+#include <atomic>
+
+namespace {
+
+struct Counter
+{
+    std::atomic<qint64> live { 0 };
+    std::atomic<qint64> peak { 0 };
+
+    void add(qint64 bytes)
+    {
+        const qint64 now = live.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+        qint64 highest = peak.load(std::memory_order_relaxed);
+        while (now > highest && !peak.compare_exchange_weak(highest, now, std::memory_order_relaxed)) { }
+    }
+};
+
+struct Registration
+{
+    QPointer<QObject> owner;
+    MemoryTracker::Subsystem subsystem;
+    MemoryTracker::Reclaimer reclaim;
+};
+
+Counter counters[MemoryTracker::SubsystemCount];
+Counter totalCounter;
+std::atomic<qint64> budgetBytes { 0 };
+std::atomic<bool> reclaimPending { false };
+std::atomic<int> reclaims { 0 };
+
+QMutex registryMutex;
+QVector<Registration> registrations;
+
+}
+
+QString MemoryTracker::subsystemName(Subsystem subsystem)
+{
+    switch (subsystem) {
+    case Columns: return QCoreApplication::translate("MemoryTracker", "Columns in memory");
+    case LineIndex: return QCoreApplication::translate("MemoryTracker", "Line indexes");
+    case ImageTiles: return QCoreApplication::translate("MemoryTracker", "Image tile cache");
+    case Thumbnails: return QCoreApplication::translate("MemoryTracker", "Thumbnail cache");
+    case RenderTiles: return QCoreApplication::translate("MemoryTracker", "Rendered tiles");
+    case UndoHistory: return QCoreApplication::translate("MemoryTracker", "Undo history");
+    case SubsystemCount: break;
+    }
+    return QString();
+}
+
+void MemoryTracker::allocated(Subsystem subsystem, qint64 bytes)
+{
+    if (bytes == 0)
+        return;
+    counters[subsystem].add(bytes);
+    totalCounter.add(bytes);
+
+    const qint64 budget = budgetBytes.load(std::memory_order_relaxed);
+    if (budget <= 0 || totalCounter.live.load(std::memory_order_relaxed) <= budget)
+        return;
+    QCoreApplication *app = QCoreApplication::instance();
+    if (app && !reclaimPending.exchange(true))
+        QMetaObject::invokeMethod(app, [] { reclaim(); }, Qt::QueuedConnection);
+}
+
+void MemoryTracker::freed(Subsystem subsystem, qint64 bytes)
+{
+    counters[subsystem].live.fetch_sub(bytes, std::memory_order_relaxed);
+    totalCounter.live.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+MemoryTracker::Usage MemoryTracker::usage(Subsystem subsystem)
+{
+    Usage usage;
+    usage.live = counters[subsystem].live.load(std::memory_order_relaxed);
+    usage.peak = counters[subsystem].peak.load(std::memory_order_relaxed);
+    return usage;
+}
+
+MemoryTracker::Usage MemoryTracker::total()
+{
+    Usage usage;
+    usage.live = totalCounter.live.load(std::memory_order_relaxed);
+    usage.peak = totalCounter.peak.load(std::memory_order_relaxed);
+    return usage;
+}
+
+void MemoryTracker::resetPeaks()
+{
+    for (Counter &counter : counters)
+        counter.peak.store(counter.live.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    totalCounter.peak.store(totalCounter.live.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+void MemoryTracker::setBudget(qint64 bytes)
+{
+    budgetBytes.store(qMax<qint64>(0, bytes), std::memory_order_relaxed);
+    QCoreApplication *app = QCoreApplication::instance();
+    if (app && bytes > 0 && total().live > bytes && !reclaimPending.exchange(true))
+        QMetaObject::invokeMethod(app, [] { reclaim(); }, Qt::QueuedConnection);
+}
+
+qint64 MemoryTracker::budget()
+{
+    return budgetBytes.load(std::memory_order_relaxed);
+}
+
+int MemoryTracker::reclaimCount()
+{
+    return reclaims.load(std::memory_order_relaxed);
+}
+
+void MemoryTracker::addReclaimer(QObject *owner, Subsystem subsystem, const Reclaimer &reclaim)
+{
+    QMutexLocker locker(&registryMutex);
+    registrations.append({ owner, subsystem, reclaim });
+}
+
+void MemoryTracker::reclaim()
+{
+    reclaimPending.store(false);
+    const qint64 budget = budgetBytes.load(std::memory_order_relaxed);
+    const qint64 target = qint64(budget * ReclaimTarget);
+    if (budget <= 0 || total().live <= budget)
+        return;
+    reclaims.fetch_add(1, std::memory_order_relaxed);
+
+    QVector<Registration> candidates;
+    {
+        QMutexLocker locker(&registryMutex);
+        registrations.erase(std::remove_if(registrations.begin(), registrations.end(),
+                                           [](const Registration &r) { return r.owner.isNull(); }),
+                            registrations.end());
+        candidates = registrations;
+    }
+    std::stable_sort(candidates.begin(), candidates.end(), [](const Registration &a, const Registration &b) {
+        return usage(a.subsystem).live > usage(b.subsystem).live;
+    });
+    // A reclaimer may destroy another registration's owner.
+    for (const Registration &r : qAsConst(candidates)) {
+        const qint64 excess = total().live - target;
+        if (excess <= 0)
+            break;
+        if (r.owner)
+            r.reclaim(excess);
+    }
+}
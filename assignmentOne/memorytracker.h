@@ -0,0 +1,132 @@
+#ifndef MEMORYTRACKER_H
+#define MEMORYTRACKER_H
+
+#include <QString>
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+class QObject;
+
+// Live and peak bytes held by each part of the app, and a global budget.
+// Long-lived arrays allocate through TrackedAllocator; cached and rendered
+// images hold a MemoryAllocation for as long as they are kept. Counting is
+// a few relaxed atomics, so it is safe from any thread.
+//
+// Caches that can give memory back register a reclaimer. Once the total
+// exceeds the budget, the reclaimers are called on the GUI thread, those
+// of the largest subsystems first, until the total is back below
+// ReclaimTarget of the budget. Data itself is never dropped, so caches
+// shrink to make room for it.
+class MemoryTracker
+{
+public:
+    enum Subsystem { Columns, LineIndex, ImageTiles, Thumbnails, RenderTiles, UndoHistory, SubsystemCount };
+
+    struct Usage
+    {
+        qint64 live = 0;
+        qint64 peak = 0;
+    };
+
+    static constexpr double ReclaimTarget = 0.9;
+
+    static QString subsystemName(Subsystem subsystem);
+
+    static void allocated(Subsystem subsystem, qint64 bytes);
+    static void freed(Subsystem subsystem, qint64 bytes);
+
+    static Usage usage(Subsystem subsystem);
+    static Usage total();
+    // Peaks restart from the current live bytes.
+    static void resetPeaks();
+
+    // 0, the default, is unlimited.
+    static void setBudget(qint64 bytes);
+    static qint64 budget();
+    // Times the reclaimers were run because the budget was exceeded.
+    static int reclaimCount();
+
+    // Asked to free about the given number of bytes from subsystem. Called
+    // on the GUI thread, only while owner exists.
+    typedef std::function<void(qint64 bytes)> Reclaimer;
+    static void addReclaimer(QObject *owner, Subsystem subsystem, const Reclaimer &reclaim);
+    // Runs the reclaimers now if the total exceeds the budget. GUI thread.
+    static void reclaim();
+};
+
+// Counts bytes held by one object against a subsystem until it is
+// destroyed. A copy counts the same bytes again.
+class MemoryAllocation
+{
+public:
+    MemoryAllocation() = default;
+    MemoryAllocation(MemoryTracker::Subsystem subsystem, qint64 bytes)
+        : m_subsystem(subsystem)
+        , m_bytes(bytes)
+    {
+        MemoryTracker::allocated(m_subsystem, m_bytes);
+    }
+    MemoryAllocation(const MemoryAllocation &other)
+        : MemoryAllocation(other.m_subsystem, other.m_bytes)
+    {
+    }
+    ~MemoryAllocation() { MemoryTracker::freed(m_subsystem, m_bytes); }
+
+    MemoryAllocation &operator=(const MemoryAllocation &other)
+    {
+        MemoryTracker::allocated(other.m_subsystem, other.m_bytes);
+        MemoryTracker::freed(m_subsystem, m_bytes);
+        m_subsystem = other.m_subsystem;
+        m_bytes = other.m_bytes;
+        return *this;
+    }
+
+    qint64 bytes() const { return m_bytes; }
+
+private:
+    MemoryTracker::Subsystem m_subsystem = MemoryTracker::Columns;
+    qint64 m_bytes = 0;
+};
+
+// std::allocator that counts its allocations against subsystem S.
+template<typename T, MemoryTracker::Subsystem S>
+class TrackedAllocator
+{
+public:
+    typedef T value_type;
+
+    template<typename U>
+    struct rebind
+    {
+        typedef TrackedAllocator<U, S> other;
+    };
+
+    TrackedAllocator() = default;
+    template<typename U>
+    TrackedAllocator(const TrackedAllocator<U, S> &) { }
+
+    T *allocate(size_t count)
+    {
+        T *p = std::allocator<T>().allocate(count);
+        MemoryTracker::allocated(S, qint64(count * sizeof(T)));
+        return p;
+    }
+
+    void deallocate(T *p, size_t count)
+    {
+        MemoryTracker::freed(S, qint64(count * sizeof(T)));
+        std::allocator<T>().deallocate(p, count);
+    }
+
+    template<typename U>
+    bool operator==(const TrackedAllocator<U, S> &) const { return true; }
+    template<typename U>
+    bool operator!=(const TrackedAllocator<U, S> &) const { return false; }
+};
+
+template<typename T, MemoryTracker::Subsystem S>
+using TrackedVector = std::vector<T, TrackedAllocator<T, S>>;
+
+#endif // MEMORYTRACKER_H
@@ -0,0 +1,197 @@
+#include "minmaxpyramid.h"
+
+#include "taskengine.h"
+#include "trace.h"
+
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE__) || defined(_M_X64)
+#  include <xmmintrin.h>
+#  define MINMAXPYRAMID_SSE
+#endif
+
+namespace {
+
+const qint64 GrainBlocks = 1 << 14;
+
+// NaN compares false both ways, so missing samples are skipped.
+inline void widen(float value, float *lo, float *hi)
+{
+    if (value < *lo)
+        *lo = value;
+    if (value > *hi)
+        *hi = value;
+}
+
+// An all-NaN block summarizes to (+inf, -inf) and merges as a no-op.
+inline void merge(float min, float max, float *lo, float *hi)
+{
+    if (min < *lo)
+        *lo = min;
+    if (max > *hi)
+        *hi = max;
+}
+
+#ifdef MINMAXPYRAMID_SSE
+inline __m128 replaceNaN(__m128 v, __m128 fill)
+{
+    const __m128 ordered = _mm_cmpord_ps(v, v);
+    return _mm_or_ps(_mm_and_ps(ordered, v), _mm_andnot_ps(ordered, fill));
+}
+#endif
+
+// Level 1: min and max of each full block of BaseBlock raw samples.
+void reduceSamples(const float *samples, qint64 firstBlock, qint64 lastBlock, float *mins, float *maxs)
+{
+    const float inf = std::numeric_limits<float>::infinity();
+#ifdef MINMAXPYRAMID_SSE
+    const __m128 posInf = _mm_set1_ps(inf);
+    const __m128 negInf = _mm_set1_ps(-inf);
+#endif
+    for (qint64 block = firstBlock; block < lastBlock; ++block) {
+        const float *p = samples + block * MinMaxPyramid::BaseBlock;
+#ifdef MINMAXPYRAMID_SSE
+        const __m128 a = _mm_loadu_ps(p);
+        const __m128 b = _mm_loadu_ps(p + 4);
+        const __m128 c = _mm_loadu_ps(p + 8);
+        const __m128 d = _mm_loadu_ps(p + 12);
+        __m128 lo = _mm_min_ps(_mm_min_ps(replaceNaN(a, posInf), replaceNaN(b, posInf)),
+                               _mm_min_ps(replaceNaN(c, posInf), replaceNaN(d, posInf)));
+        __m128 hi = _mm_max_ps(_mm_max_ps(replaceNaN(a, negInf), replaceNaN(b, negInf)),
+                               _mm_max_ps(replaceNaN(c, negInf), replaceNaN(d, negInf)));
+        lo = _mm_min_ps(lo, _mm_movehl_ps(lo, lo));
+        hi = _mm_max_ps(hi, _mm_movehl_ps(hi, hi));
+        lo = _mm_min_ss(lo, _mm_shuffle_ps(lo, lo, 1));
+        hi = _mm_max_ss(hi, _mm_shuffle_ps(hi, hi, 1));
+        mins[block] = _mm_cvtss_f32(lo);
+        maxs[block] = _mm_cvtss_f32(hi);
+#else
+        float lo = inf;
+        float hi = -inf;
+        for (int i = 0; i < MinMaxPyramid::BaseBlock; ++i)
+            widen(p[i], &lo, &hi);
+        mins[block] = lo;
+        maxs[block] = hi;
+#endif
+    }
+}
+
+}
+
+bool MinMaxPyramid::build(const QSharedPointer<const SampleVector> &samples, TaskContext *context)
+{
+    TRACE_SCOPE("MinMaxPyramid::build");
+    m_samples = samples;
+    m_levels.clear();
+    if (!samples)
+        return true;
+
+    const qint64 count = qint64(samples->size());
+    qint64 entries = count / BaseBlock;
+    if (entries == 0)
+        return true;
+
+    if (context)
+        context->setProgressRange(entries);
+
+    Level first;
+    first.min.resize(size_t(entries));
+    first.max.resize(size_t(entries));
+    const float *raw = samples->data();
+    float *mins = first.min.data();
+    float *maxs = first.max.data();
+    TaskEngine::parallelFor(entries, GrainBlocks, [raw, mins, maxs, context](qint64 begin, qint64 end) {
+        reduceSamples(raw, begin, end, mins, maxs);
+        if (context)
+            context->addProgress(end - begin);
+    }, context);
+    if (context && context->isCanceled()) {
+        m_samples.reset();
+        return false;
+    }
+    m_levels.push_back(std::move(first));
+
+    // Upper levels are at most a quarter of level 1 in total; one pass each.
+    while ((entries = qint64(m_levels.back().min.size()) / Fanout) > 0) {
+        const Level &below = m_levels.back();
+        Level level;
+        level.min.resize(size_t(entries));
+        level.max.resize(size_t(entries));
+        for (qint64 i = 0; i < entries; ++i) {
+            float lo = std::numeric_limits<float>::infinity();
+            float hi = -std::numeric_limits<float>::infinity();
+            for (int j = 0; j < Fanout; ++j)
+                merge(below.min[size_t(i * Fanout + j)], below.max[size_t(i * Fanout + j)], &lo, &hi);
+            level.min[size_t(i)] = lo;
+            level.max[size_t(i)] = hi;
+        }
+        m_levels.push_back(std::move(level));
+    }
+    return true;
+}
+
+qint64 MinMaxPyramid::sampleCount() const
+{
+    return m_samples ? qint64(m_samples->size()) : 0;
+}
+
+bool MinMaxPyramid::range(qint64 begin, qint64 end, float *min, float *max) const
+{
+    begin = qMax<qint64>(begin, 0);
+    end = qMin(end, sampleCount());
+    if (begin >= end)
+        return false;
+
+    float lo = std::numeric_limits<float>::infinity();
+    float hi = -std::numeric_limits<float>::infinity();
+    const float *raw = m_samples->data();
+
+    // Unaligned ends come from the raw samples, the rest from the coarsest
+    // level whose blocks fit, peeling off partial blocks on the way up.
+    if (m_levels.empty() || end - begin < 2 * BaseBlock) {
+        for (qint64 i = begin; i < end; ++i)
+            widen(raw[i], &lo, &hi);
+    } else {
+        while (begin % BaseBlock)
+            widen(raw[begin++], &lo, &hi);
+        while (end % BaseBlock)
+            widen(raw[--end], &lo, &hi);
+
+        qint64 first = begin / BaseBlock;
+        qint64 last = end / BaseBlock;
+        for (size_t level = 0; first < last; ++level) {
+            const Level &l = m_levels[level];
+            const bool climb = level + 1 < m_levels.size();
+            while (first < last && (!climb || first % Fanout)) {
+                merge(l.min[size_t(first)], l.max[size_t(first)], &lo, &hi);
+                ++first;
+            }
+            while (last > first && last % Fanout) {
+                --last;
+                merge(l.min[size_t(last)], l.max[size_t(last)], &lo, &hi);
+            }
+            first /= Fanout;
+            last /= Fanout;
+        }
+    }
+
+    if (lo > hi)
+        return false; // all NaN
+    *min = lo;
+    *max = hi;
+    return true;
+}
+
+void MinMaxPyramid::envelope(double begin, double end, int buckets, float *mins, float *maxs) const
+{
+    const double step = (end - begin) / buckets;
+    for (int i = 0; i < buckets; ++i) {
+        const qint64 from = qint64(std::floor(begin + i * step));
+        const qint64 to = qMax(from + 1, qint64(std::floor(begin + (i + 1) * step)));
+        if (!range(from, to, &mins[i], &maxs[i])) {
+            mins[i] = std::numeric_limits<float>::quiet_NaN();
+            maxs[i] = std::numeric_limits<float>::quiet_NaN();
+        }
+    }
+}
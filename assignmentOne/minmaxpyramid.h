@@ -0,0 +1,48 @@
+#ifndef MINMAXPYRAMID_H
+#define MINMAXPYRAMID_H
+
+#include <QSharedPointer>
+
+#include <vector>
+
+class TaskContext;
+
+typedef std::vector<float> SampleVector;
+
+// Min/max decimation levels over a sample array. Level 1 summarizes blocks
+// of BaseBlock samples, each further level Fanout blocks of the one below,
+// so the min and max of any range come from O(log n) entries. Adds about
+// an eighth of the raw data in memory.
+class MinMaxPyramid
+{
+public:
+    static const int BaseBlock = 16;
+    static const int Fanout = 4;
+
+    // Builds all levels on every core. Returns false if context was
+    // canceled, leaving the pyramid empty.
+    bool build(const QSharedPointer<const SampleVector> &samples, TaskContext *context = nullptr);
+
+    QSharedPointer<const SampleVector> samples() const { return m_samples; }
+    qint64 sampleCount() const;
+
+    // Exact min and max over [begin, end). Returns false for an empty range.
+    bool range(qint64 begin, qint64 end, float *min, float *max) const;
+
+    // Splits [begin, end) into `buckets` equal parts and writes each part's
+    // min and max; empty parts get NaN.
+    void envelope(double begin, double end, int buckets, float *mins, float *maxs) const;
+
+private:
+    struct Level
+    {
+        std::vector<float> min;
+        std::vector<float> max;
+    };
+
+    QSharedPointer<const SampleVector> m_samples;
+    // m_levels[0] is level 1 (BaseBlock samples per entry).
+    std::vector<Level> m_levels;
+};
+
+#endif // MINMAXPYRAMID_H
@@ -0,0 +1,163 @@
+#include "modelupdatescheduler.h"
+
+#include "trace.h"
+
+#include <algorithm>
+
+namespace {
+
+typedef ModelUpdateScheduler::Span Span;
+
+bool touchRows(const Span &a, const Span &b)
+{
+    return b.firstRow <= a.lastRow + 1 && a.firstRow <= b.lastRow + 1;
+}
+
+bool touchColumns(const Span &a, const Span &b)
+{
+    return b.firstColumn <= a.lastColumn + 1 && a.firstColumn <= b.lastColumn + 1;
+}
+
+// Merges spans over the same columns whose rows touch, then spans over the
+// same rows whose columns touch.
+void mergeSpans(QVector<Span> &spans)
+{
+    std::sort(spans.begin(), spans.end(), [](const Span &a, const Span &b) {
+        if (a.firstColumn != b.firstColumn)
+            return a.firstColumn < b.firstColumn;
+        if (a.lastColumn != b.lastColumn)
+            return a.lastColumn < b.lastColumn;
+        return a.firstRow < b.firstRow;
+    });
+    int kept = 0;
+    for (int i = 1; i < spans.size(); ++i) {
+        Span &last = spans[kept];
+        const Span &span = spans.at(i);
+        if (span.firstColumn == last.firstColumn && span.lastColumn == last.lastColumn && touchRows(last, span))
+            last.lastRow = qMax(last.lastRow, span.lastRow);
+        else
+            spans[++kept] = span;
+    }
+    spans.resize(spans.isEmpty() ? 0 : kept + 1);
+
+    std::sort(spans.begin(), spans.end(), [](const Span &a, const Span &b) {
+        if (a.firstRow != b.firstRow)
+            return a.firstRow < b.firstRow;
+        if (a.lastRow != b.lastRow)
+            return a.lastRow < b.lastRow;
+        return a.firstColumn < b.firstColumn;
+    });
+    kept = 0;
+    for (int i = 1; i < spans.size(); ++i) {
+        Span &last = spans[kept];
+        const Span &span = spans.at(i);
+        if (span.firstRow == last.firstRow && span.lastRow == last.lastRow && touchColumns(last, span))
+            last.lastColumn = qMax(last.lastColumn, span.lastColumn);
+        else
+            spans[++kept] = span;
+    }
+    spans.resize(spans.isEmpty() ? 0 : kept + 1);
+}
+
+}
+
+ModelUpdateScheduler::ModelUpdateScheduler(QObject *parent)
+    : QObject(parent)
+{
+    m_timer.setSingleShot(true);
+    m_timer.setTimerType(Qt::PreciseTimer);
+    m_timer.setInterval(FrameIntervalMs);
+    connect(&m_timer, &QTimer::timeout, this, &ModelUpdateScheduler::flush);
+}
+
+bool ModelUpdateScheduler::isPending() const
+{
+    return m_rowsAppended || !m_spans.isEmpty();
+}
+
+ModelUpdateScheduler::Stats ModelUpdateScheduler::stats() const
+{
+    return m_stats;
+}
+
+void ModelUpdateScheduler::cellsChanged(qint64 firstRow, qint64 lastRow, int firstColumn, int lastColumn)
+{
+    ++m_stats.received;
+    const Span span { firstRow, lastRow, firstColumn, lastColumn };
+    // Runs of changes down a column or along a row extend the last span.
+    if (!m_spans.isEmpty()) {
+        Span &last = m_spans.last();
+        if (span.firstColumn == last.firstColumn && span.lastColumn == last.lastColumn && touchRows(last, span)) {
+            last.firstRow = qMin(last.firstRow, span.firstRow);
+            last.lastRow = qMax(last.lastRow, span.lastRow);
+            schedule();
+            return;
+        }
+        if (span.firstRow == last.firstRow && span.lastRow == last.lastRow && touchColumns(last, span)) {
+            last.firstColumn = qMin(last.firstColumn, span.firstColumn);
+            last.lastColumn = qMax(last.lastColumn, span.lastColumn);
+            schedule();
+            return;
+        }
+    }
+    m_spans.append(span);
+    if (m_spans.size() >= CompactThreshold)
+        compact();
+    schedule();
+}
+
+void ModelUpdateScheduler::rowsAppended()
+{
+    ++m_stats.received;
+    m_rowsAppended = true;
+    schedule();
+}
+
+void ModelUpdateScheduler::flush()
+{
+    m_timer.stop();
+    if (!isPending())
+        return;
+    TRACE_SCOPE("ModelUpdateScheduler::flush");
+    compact();
+    // Taken first: a receiver may change the data again.
+    const QVector<Span> spans = std::move(m_spans);
+    m_spans.clear();
+    const bool rowsAppended = m_rowsAppended;
+    m_rowsAppended = false;
+
+    ++m_stats.flushes;
+    m_stats.emitted += spans.size() + (rowsAppended ? 1 : 0);
+    if (rowsAppended)
+        emit rowsUpdated();
+    for (const Span &span : spans)
+        emit cellsUpdated(span.firstRow, span.lastRow, span.firstColumn, span.lastColumn);
+}
+
+void ModelUpdateScheduler::discard()
+{
+    m_timer.stop();
+    m_spans.clear();
+    m_rowsAppended = false;
+}
+
+void ModelUpdateScheduler::schedule()
+{
+    if (!m_timer.isActive())
+        m_timer.start();
+}
+
+void ModelUpdateScheduler::compact()
+{
+    mergeSpans(m_spans);
+    if (m_spans.size() <= MaxSpans)
+        return;
+    Span bounds = m_spans.constFirst();
+    for (const Span &span : qAsConst(m_spans)) {
+        bounds.firstRow = qMin(bounds.firstRow, span.firstRow);
+        bounds.lastRow = qMax(bounds.lastRow, span.lastRow);
+        bounds.firstColumn = qMin(bounds.firstColumn, span.firstColumn);
+        bounds.lastColumn = qMax(bounds.lastColumn, span.lastColumn);
+    }
+    m_spans = { bounds };
+}
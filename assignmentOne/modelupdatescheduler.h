@@ -0,0 +1,70 @@
+#ifndef MODELUPDATESCHEDULER_H
+#define MODELUPDATESCHEDULER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QVector>
+
+// Sits between the data and the models of a window and turns change
+// notifications that may come thousands of times per frame into a few
+// signals once per frame. Changed cells are kept as spans of rows and
+// columns; overlapping and adjacent ones are merged, and past MaxSpans
+// they are replaced by the one span covering them all, which a view
+// repaints as cheaply as any other. Appended rows are reported once.
+class ModelUpdateScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    static const int FrameIntervalMs = 16;
+    static const int MaxSpans = 32;
+    // Pending spans are merged early once there are this many.
+    static const int CompactThreshold = 1024;
+
+    struct Span
+    {
+        qint64 firstRow;
+        qint64 lastRow;
+        int firstColumn;
+        int lastColumn;
+    };
+
+    struct Stats
+    {
+        qint64 received = 0;
+        qint64 emitted = 0;
+        qint64 flushes = 0;
+
+        qint64 saved() const { return received - emitted; }
+    };
+
+    explicit ModelUpdateScheduler(QObject *parent = nullptr);
+
+    bool isPending() const;
+    Stats stats() const;
+
+public slots:
+    void cellsChanged(qint64 firstRow, qint64 lastRow, int firstColumn, int lastColumn);
+    void rowsAppended();
+    // Emits what is pending now instead of at the end of the frame.
+    void flush();
+    // Forgets what is pending, e.g. when the data was replaced.
+    void discard();
+
+signals:
+    // Emitted on flush: rows first, so that changed cells in appended rows
+    // are already part of the model.
+    void rowsUpdated();
+    void cellsUpdated(qint64 firstRow, qint64 lastRow, int firstColumn, int lastColumn);
+
+private:
+    void schedule();
+    void compact();
+
+    QVector<Span> m_spans;
+    bool m_rowsAppended = false;
+    QTimer m_timer;
+    Stats m_stats;
+};
+
+#endif // MODELUPDATESCHEDULER_H
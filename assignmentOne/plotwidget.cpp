@@ -0,0 +1,274 @@
+#include "plotwidget.h"
+
+#include "taskengine.h"
+#include "trace.h"
+
+#include <QMouseEvent>
+#include <QPainter>
+#include <QPolygonF>
+#include <QWheelEvent>
+
+#include <cmath>
+
+namespace {
+
+const int LeftMargin = 64;
+const int BottomMargin = 22;
+const int Margin = 8;
+
+quint64 hash(quint64 x)
+{
+    x = (x ^ (x >> 33)) * 0xff51afd7ed558ccdULL;
+    x = (x ^ (x >> 33)) * 0xc4ceb9fe1a85ec53ULL;
+    return x ^ (x >> 33);
+}
+
+}
+
+PlotWidget::PlotWidget(TaskEngine *tasks, QWidget *parent)
+    : TiledCanvas(parent)
+    , m_tasks(tasks)
+{
+    setMinimumSize(200, 120);
+}
+
+void PlotWidget::setSamples(const QSharedPointer<const SampleVector> &samples, const QString &title)
+{
+    if (m_build)
+        m_build->cancel();
+    m_pyramid.reset();
+    m_title = title;
+    invalidateAll();
+
+    const QSharedPointer<MinMaxPyramid> pyramid(new MinMaxPyramid);
+    Task *task = m_tasks->start(tr("Preparing plot of %1").arg(title), Task::NormalPriority,
+                                [pyramid, samples](TaskContext &context) {
+        pyramid->build(samples, &context);
+    });
+    m_build = task;
+    connect(task, &Task::finished, this, [this, task, pyramid] {
+        if (task != m_build || task->isCanceled())
+            return;
+        m_pyramid = pyramid;
+        resetView();
+        emit ready();
+    });
+}
+
+bool PlotWidget::isReady() const
+{
+    return !m_pyramid.isNull();
+}
+
+qint64 PlotWidget::sampleCount() const
+{
+    return m_pyramid ? m_pyramid->sampleCount() : 0;
+}
+
+void PlotWidget::setView(double begin, double span)
+{
+    const double count = double(sampleCount());
+    const int width = qMax(1, canvasRect().width());
+    span = qBound(qMin(minimumSpan(), count), span, count);
+    // World coordinates are ints; keep the widest zoomed-in world below 2^30.
+    const double samplesPerPixel = qMax(qMax(span, 1.0) / width, count / double(1 << 30));
+    m_viewBegin = qBound(0.0, begin, qMax(0.0, count - span));
+
+    if (!qFuzzyCompare(samplesPerPixel, m_samplesPerPixel)) {
+        m_samplesPerPixel = samplesPerPixel;
+        rescale();
+    }
+    setWorldOrigin(QPoint(qRound(m_viewBegin / m_samplesPerPixel), 0));
+    update();
+}
+
+void PlotWidget::resetView()
+{
+    setView(0, double(sampleCount()));
+}
+
+QSharedPointer<SampleVector> PlotWidget::generateTestSignal(qint64 count, TaskContext *context)
+{
+    QSharedPointer<SampleVector> samples(new SampleVector(size_t(count)));
+    float *out = samples->data();
+    if (context)
+        context->setProgressRange(count);
+    TaskEngine::parallelFor(count, 1 << 18, [out, context](qint64 begin, qint64 end) {
+        for (qint64 i = begin; i < end; ++i) {
+            const double t = double(i);
+            const quint64 h = hash(quint64(i));
+            double value = std::sin(t * 1e-6) * 50.0 + std::sin(t * 3e-4) * 10.0 + std::sin(t * 0.02) * 2.0;
+            value += (double(h & 0xffff) / 65535.0 - 0.5) * 4.0;
+            if ((h >> 20) % 1000003 == 0)
+                value += 80.0;
+            out[i] = float(value);
+        }
+        if (context)
+            context->addProgress(end - begin);
+    }, context);
+    return samples;
+}
+
+TiledCanvas::TileRenderer PlotWidget::createRenderer() const
+{
+    if (!m_pyramid)
+        return TileRenderer();
+
+    const QSharedPointer<const MinMaxPyramid> pyramid = m_pyramid;
+    const double samplesPerPixel = m_samplesPerPixel;
+    const double yTop = m_yTop;
+    const double yScale = m_yScale;
+    const QColor color = palette().color(QPalette::Highlight);
+    return [pyramid, samplesPerPixel, yTop, yScale, color](QPainter *painter, const QRect &world) {
+        const auto yOf = [yTop, yScale](float v) { return (yTop - v) * yScale; };
+        // One column of overlap on each side joins the line across tiles.
+        const int firstColumn = world.left() - 1;
+        const int columns = world.width() + 2;
+
+        QPolygonF line;
+        if (samplesPerPixel <= 2.0) {
+            // Close in: plain polyline through the raw samples.
+            const float *raw = pyramid->samples()->data();
+            const qint64 first = qMax<qint64>(0, qint64(std::floor(firstColumn * samplesPerPixel)));
+            const qint64 last = qMin(pyramid->sampleCount(),
+                                     qint64(std::ceil((firstColumn + columns) * samplesPerPixel)) + 1);
+            for (qint64 i = first; i < last; ++i) {
+                if (!std::isnan(raw[i]))
+                    line.append(QPointF(i / samplesPerPixel, yOf(raw[i])));
+            }
+        } else {
+            std::vector<float> mins(size_t(columns));
+            std::vector<float> maxs(size_t(columns));
+            pyramid->envelope(firstColumn * samplesPerPixel, (firstColumn + columns) * samplesPerPixel,
+                              columns, mins.data(), maxs.data());
+            line.reserve(2 * columns);
+            for (int x = 0; x < columns; ++x) {
+                if (std::isnan(mins[size_t(x)]))
+                    continue;
+                // Alternate the order so consecutive columns join without crossing.
+                const int column = firstColumn + x;
+                const float first = column % 2 ? mins[size_t(x)] : maxs[size_t(x)];
+                const float second = column % 2 ? maxs[size_t(x)] : mins[size_t(x)];
+                line.append(QPointF(column + 0.5, yOf(first)));
+                line.append(QPointF(column + 0.5, yOf(second)));
+            }
+        }
+        painter->setPen(QPen(color, 1));
+        painter->drawPolyline(line);
+    };
+}
+
+void PlotWidget::paintOverlay(QPainter *painter)
+{
+    painter->setPen(palette().color(QPalette::Text));
+    if (!m_pyramid) {
+        const QString text = m_build ? tr("Preparing %1...").arg(m_title) : tr("Nothing to plot");
+        painter->drawText(rect(), Qt::AlignCenter, text);
+        return;
+    }
+
+    const QRect area = canvasRect();
+    const double begin = m_viewBegin;
+    const double end = m_viewBegin + viewSpan();
+    painter->setPen(palette().color(QPalette::Mid));
+    painter->drawRect(area.adjusted(0, 0, -1, -1));
+    painter->setPen(palette().color(QPalette::Text));
+    const QRect leftLabels(0, area.top(), LeftMargin - 4, area.height());
+    painter->drawText(leftLabels, Qt::AlignRight | Qt::AlignTop, QString::number(m_yTop, 'g', 5));
+    painter->drawText(leftLabels, Qt::AlignRight | Qt::AlignBottom,
+                      QString::number(m_yTop - area.height() / m_yScale, 'g', 5));
+    const QRect bottomLabels(area.left(), area.bottom() + 2, area.width(), BottomMargin - 2);
+    painter->drawText(bottomLabels, Qt::AlignLeft | Qt::AlignTop, QString::number(qint64(begin)));
+    painter->drawText(bottomLabels, Qt::AlignHCenter | Qt::AlignTop, m_title);
+    painter->drawText(bottomLabels, Qt::AlignRight | Qt::AlignTop, QString::number(qint64(end)));
+}
+
+QRect PlotWidget::canvasRect() const
+{
+    return rect().adjusted(LeftMargin, Margin, -Margin, -BottomMargin);
+}
+
+void PlotWidget::resizeEvent(QResizeEvent *event)
+{
+    TiledCanvas::resizeEvent(event);
+    if (m_pyramid)
+        setView(m_viewBegin, viewSpan());
+    rescale();
+}
+
+void PlotWidget::wheelEvent(QWheelEvent *event)
+{
+    if (!m_pyramid)
+        return;
+    const QRect area = canvasRect();
+    const double fraction = qBound(0.0, (event->position().x() - area.left()) / qMax(1, area.width()), 1.0);
+    const double anchor = m_viewBegin + fraction * viewSpan();
+    const double span = viewSpan() * std::pow(1.25, -event->angleDelta().y() / 120.0);
+    const double count = double(sampleCount());
+    const double clamped = qBound(qMin(minimumSpan(), count), span, count);
+    setView(anchor - fraction * clamped, clamped);
+    event->accept();
+}
+
+void PlotWidget::mousePressEvent(QMouseEvent *event)
+{
+    if (event->button() != Qt::LeftButton)
+        return;
+    m_dragging = true;
+    m_dragOriginX = qRound(event->position().x());
+    m_dragOriginBegin = m_viewBegin;
+    setCursor(Qt::ClosedHandCursor);
+}
+
+void PlotWidget::mouseMoveEvent(QMouseEvent *event)
+{
+    if (!m_dragging)
+        return;
+    setView(m_dragOriginBegin - (event->position().x() - m_dragOriginX) * m_samplesPerPixel, viewSpan());
+}
+
+void PlotWidget::mouseReleaseEvent(QMouseEvent *event)
+{
+    if (event->button() == Qt::LeftButton && m_dragging) {
+        m_dragging = false;
+        unsetCursor();
+    }
+}
+
+void PlotWidget::mouseDoubleClickEvent(QMouseEvent *)
+{
+    resetView();
+}
+
+// Zooming in stops at a few pixels per sample.
+double PlotWidget::minimumSpan() const
+{
+    return qMax(2.0, canvasRect().width() / 8.0);
+}
+
+double PlotWidget::viewSpan() const
+{
+    return m_samplesPerPixel * canvasRect().width();
+}
+
+// Fits the value axis to the visible range and starts over with new tiles.
+void PlotWidget::rescale()
+{
+    float lo = -1;
+    float hi = 1;
+    if (m_pyramid) {
+        const double end = m_viewBegin + viewSpan();
+        if (!m_pyramid->range(qint64(std::floor(m_viewBegin)), qint64(std::ceil(end)), &lo, &hi)) {
+            lo = -1;
+            hi = 1;
+        }
+    }
+    if (lo == hi) {
+        lo -= 1;
+        hi += 1;
+    }
+    const double pad = (double(hi) - lo) * 0.05;
+    m_yTop = hi + pad;
+    m_yScale = qMax(1, canvasRect().height()) / (double(hi) - lo + 2 * pad);
+    invalidateAll();
+}
@@ -0,0 +1,73 @@
+#ifndef PLOTWIDGET_H
+#define PLOTWIDGET_H
+
+#include "minmaxpyramid.h"
+#include "tiledcanvas.h"
+
+#include <QPointer>
+
+class Task;
+class TaskContext;
+class TaskEngine;
+
+// Line plot for very long signals. Tiles are drawn off the GUI thread from
+// the min/max envelope of their range at two points per pixel column,
+// looked up in a MinMaxPyramid that is built in the background, so cost
+// depends on the widget size rather than the number of samples. Wheel
+// zooms around the cursor (and rescales the value axis), dragging pans,
+// double-click shows everything.
+class PlotWidget : public TiledCanvas
+{
+    Q_OBJECT
+
+public:
+    explicit PlotWidget(TaskEngine *tasks, QWidget *parent = nullptr);
+
+    void setSamples(const QSharedPointer<const SampleVector> &samples, const QString &title);
+    bool isReady() const;
+
+    qint64 sampleCount() const;
+    void setView(double begin, double span);
+    void resetView();
+
+    // Sum of sines with noise and rare spikes, generated on every core.
+    static QSharedPointer<SampleVector> generateTestSignal(qint64 count, TaskContext *context = nullptr);
+
+signals:
+    void ready();
+
+protected:
+    TileRenderer createRenderer() const override;
+    void paintOverlay(QPainter *painter) override;
+    QRect canvasRect() const override;
+
+    void resizeEvent(QResizeEvent *event) override;
+    void wheelEvent(QWheelEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    void mouseReleaseEvent(QMouseEvent *event) override;
+    void mouseDoubleClickEvent(QMouseEvent *event) override;
+
+private:
+    double minimumSpan() const;
+    double viewSpan() const;
+    void rescale();
+
+    TaskEngine *m_tasks;
+    QPointer<Task> m_build;
+    QSharedPointer<const MinMaxPyramid> m_pyramid;
+    QString m_title;
+
+    // World x of a column is sample / m_samplesPerPixel; world y is pixels
+    // below the top of the plot area.
+    double m_viewBegin = 0;
+    double m_samplesPerPixel = 1;
+    double m_yTop = 1;
+    double m_yScale = 1;
+
+    bool m_dragging = false;
+    int m_dragOriginX = 0;
+    double m_dragOriginBegin = 0;
+};
+
+#endif // PLOTWIDGET_H
@@ -0,0 +1,480 @@
+#include "rowsearch.h"
+
+#include "columnstore.h"
+#include "datasource.h"
+#include "taskengine.h"
+#include "trace.h"
+
+#include <QMutex>
+#include <QRegularExpression>
+#include <QScopedPointer>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <map>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#  include <emmintrin.h>
+#  define ROWSEARCH_SSE2
+#endif
+
+namespace {
+
+const int PollIntervalMs = 16;
+
+inline int lowestBit(quint32 v)
+{
+#if defined(__GNUC__)
+    return __builtin_ctz(v);
+#else
+    int n = 0;
+    while (!(v & 1u)) {
+        v >>= 1;
+        ++n;
+    }
+    return n;
+#endif
+}
+
+// Byte-level substring test. With folding, bit 5 of every byte is set on
+// both sides before comparing; that merges ASCII case pairs (and a few
+// unrelated pairs), which is fine for a prefilter whose hits are verified.
+class LiteralFinder
+{
+public:
+    LiteralFinder(const QByteArray &needle, bool fold)
+        : m_fold(fold ? 0x20 : 0)
+    {
+        m_needle = needle;
+        for (char &c : m_needle)
+            c = char(c | m_fold);
+    }
+
+    bool isEmpty() const { return m_needle.isEmpty(); }
+
+    bool occursIn(const char *data, qint64 length) const
+    {
+        const qint64 m = m_needle.size();
+        if (length < m)
+            return false;
+        const char first = m_needle.at(0);
+        const char last = m_needle.at(m - 1);
+        qint64 i = 0;
+#ifdef ROWSEARCH_SSE2
+        // Compare the first and last needle byte at 16 positions at once
+        // and only look closer where both agree.
+        const __m128i firsts = _mm_set1_epi8(first);
+        const __m128i lasts = _mm_set1_epi8(last);
+        const __m128i fold = _mm_set1_epi8(char(m_fold));
+        for (; i + m - 1 + 16 <= length; i += 16) {
+            const __m128i a = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i)), fold);
+            const __m128i b = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + m - 1)), fold);
+            quint32 mask = quint32(_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, firsts), _mm_cmpeq_epi8(b, lasts))));
+            while (mask) {
+                if (equalsAt(data + i + lowestBit(mask)))
+                    return true;
+                mask &= mask - 1;
+            }
+        }
+#endif
+        for (; i + m <= length; ++i) {
+            if (char(data[i] | m_fold) == first && equalsAt(data + i))
+                return true;
+        }
+        return false;
+    }
+
+private:
+    bool equalsAt(const char *data) const
+    {
+        if (!m_fold)
+            return std::memcmp(data, m_needle.constData(), size_t(m_needle.size())) == 0;
+        for (int i = 0; i < m_needle.size(); ++i) {
+            if (char(data[i] | m_fold) != m_needle.at(i))
+                return false;
+        }
+        return true;
+    }
+
+    QByteArray m_needle;
+    char m_fold;
+};
+
+// Per-chunk matcher; owns its own regular expression so chunks running on
+// different threads share nothing.
+class RowMatcher
+{
+public:
+    RowMatcher(const SearchQuery &query, const QByteArray &literal)
+        : m_query(query)
+        , m_finder(literal, query.caseSensitivity == Qt::CaseInsensitive)
+    {
+        if (query.regularExpression) {
+            m_regex.setPattern(query.text);
+            if (query.caseSensitivity == Qt::CaseInsensitive)
+                m_regex.setPatternOptions(QRegularExpression::CaseInsensitiveOption);
+        }
+    }
+
+    bool matchesText(const QString &text) const
+    {
+        return m_query.regularExpression ? m_regex.match(text).hasMatch()
+                                         : text.contains(m_query.text, m_query.caseSensitivity);
+    }
+
+    bool matches(const DataSource &source, qint64 row) const
+    {
+        if (!m_finder.isEmpty()) {
+            qint64 length = 0;
+            const char *data = source.rowData(row, &length);
+            if (data && !m_finder.occursIn(data, length))
+                return false;
+        }
+        for (int column = 0; column < source.columnCount(); ++column) {
+            if (matchesText(source.cellText(row, column)))
+                return true;
+        }
+        return false;
+    }
+
+private:
+    SearchQuery m_query;
+    LiteralFinder m_finder;
+    QRegularExpression m_regex;
+};
+
+// The columns of a ColumnStore, matched without formatting every cell:
+// text columns are matched once per dictionary entry, and numbers are
+// only formatted when the query could be part of one.
+class StoreMatcher
+{
+public:
+    StoreMatcher(const ColumnStore &store, const SearchQuery &query, TaskContext &context)
+        : m_store(store)
+        , m_columns(size_t(store.columnCount()))
+    {
+        // Characters QString::number() writes for integers and doubles,
+        // "inf" and "nan" included.
+        static const QString NumberCharacters = QStringLiteral("0123456789+-.efinat");
+        bool numbers = query.regularExpression;
+        if (!numbers) {
+            numbers = true;
+            for (const QChar c : query.text.toLower())
+                numbers = numbers && NumberCharacters.contains(c);
+        }
+        const bool nullMatches = RowMatcher(query, QByteArray()).matchesText(QString());
+
+        for (int c = 0; c < store.columnCount(); ++c) {
+            Column &column = m_columns[size_t(c)];
+            column.validity = store.validity(c);
+            column.codes = store.stringCodes(c);
+            column.nullMatches = nullMatches;
+            if (!column.codes) {
+                column.formatted = numbers;
+                continue;
+            }
+            const QVector<QString> &dictionary = store.dictionary(c);
+            column.codeMatches.resize(size_t(dictionary.size()));
+            TaskEngine::parallelFor(dictionary.size(), RowSearch::ChunkRows,
+                                    [&dictionary, &column, &query](qint64 begin, qint64 end) {
+                const RowMatcher matcher(query, QByteArray());
+                for (qint64 code = begin; code < end; ++code)
+                    column.codeMatches[size_t(code)] = matcher.matchesText(dictionary.at(code));
+            }, &context);
+        }
+    }
+
+    bool matches(const RowMatcher &matcher, qint64 row) const
+    {
+        for (int c = 0; c < int(m_columns.size()); ++c) {
+            const Column &column = m_columns[size_t(c)];
+            if (!((column.validity[row / 64] >> (row % 64)) & 1)) {
+                if (column.nullMatches)
+                    return true;
+            } else if (column.codes) {
+                if (column.codeMatches[column.codes[row]])
+                    return true;
+            } else if (column.formatted && matcher.matchesText(m_store.cellText(row, c))) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    struct Column
+    {
+        const quint64 *validity = nullptr;
+        const quint32 *codes = nullptr;
+        // Per dictionary code.
+        std::vector<char> codeMatches;
+        bool nullMatches = false;
+        // Numbers are formatted and matched.
+        bool formatted = false;
+    };
+
+    const ColumnStore &m_store;
+    std::vector<Column> m_columns;
+};
+
+// Longest run of plain characters a regular expression always matches
+// literally. Anything not understood ends the run; alternation and inline
+// options give up, since they can make every run optional.
+QString regexLiteral(const QString &pattern)
+{
+    if (pattern.contains(QLatin1Char('|')) || pattern.contains(QLatin1String("(?"))
+            || pattern.contains(QLatin1String("\\Q")))
+        return QString();
+
+    QString best;
+    QString current;
+    const auto flush = [&best, &current] {
+        if (current.size() > best.size())
+            best = current;
+        current.clear();
+    };
+
+    int depth = 0;
+    for (int i = 0; i < pattern.size(); ++i) {
+        const QChar c = pattern.at(i);
+        if (c == QLatin1Char('\\')) {
+            const QChar next = i + 1 < pattern.size() ? pattern.at(i + 1) : QChar();
+            ++i;
+            if (depth == 0 && !next.isNull() && !next.isLetterOrNumber())
+                current.append(next);
+            else
+                flush();
+        } else if (depth > 0) {
+            depth += c == QLatin1Char('(');
+            depth -= c == QLatin1Char(')');
+        } else if (c == QLatin1Char('(')) {
+            flush();
+            depth = 1;
+        } else if (c == QLatin1Char('[')) {
+            flush();
+            // Skip the class; a leading ']' is a member, not the end.
+            int j = i + 1;
+            if (j < pattern.size() && pattern.at(j) == QLatin1Char('^'))
+                ++j;
+            if (j < pattern.size() && pattern.at(j) == QLatin1Char(']'))
+                ++j;
+            while (j < pattern.size() && pattern.at(j) != QLatin1Char(']'))
+                j += pattern.at(j) == QLatin1Char('\\') ? 2 : 1;
+            i = j;
+        } else if (c == QLatin1Char('*') || c == QLatin1Char('?') || c == QLatin1Char('{')) {
+            // The previous character may be absent.
+            current.chop(1);
+            flush();
+            if (c == QLatin1Char('{')) {
+                while (i < pattern.size() && pattern.at(i) != QLatin1Char('}'))
+                    ++i;
+            }
+        } else if (c == QLatin1Char('+')) {
+            flush();
+        } else if (c == QLatin1Char('.') || c == QLatin1Char('^') || c == QLatin1Char('$')) {
+            flush();
+        } else {
+            current.append(c);
+        }
+    }
+    flush();
+    return best;
+}
+
+}
+
+struct RowSearch::Results
+{
+    // Matches per chunk, keyed by the chunk's first row.
+    mutable QMutex mutex;
+    std::map<qint64, std::vector<qint64>> chunks;
+    std::atomic<qint64> matches { 0 };
+    std::atomic<qint64> scanned { 0 };
+    qint64 total = 0;
+};
+
+RowSearch::RowSearch(TaskEngine *tasks, QObject *parent)
+    : QObject(parent)
+    , m_tasks(tasks)
+{
+    m_pollTimer.setInterval(PollIntervalMs);
+    connect(&m_pollTimer, &QTimer::timeout, this, &RowSearch::matchesChanged);
+}
+
+RowSearch::~RowSearch()
+{
+    cancel();
+}
+
+void RowSearch::start(const QSharedPointer<DataSource> &source, const SearchQuery &query)
+{
+    cancel();
+    m_query = query;
+    m_errorString.clear();
+    m_results.reset(new Results);
+
+    if (query.regularExpression) {
+        const QRegularExpression regex(query.text);
+        if (!regex.isValid())
+            m_errorString = regex.errorString();
+    }
+    if (!source || query.text.isEmpty() || !m_errorString.isEmpty()) {
+        emit matchesChanged();
+        emit finished();
+        return;
+    }
+
+    // Rows appended while the search runs are not part of it.
+    const QSharedPointer<DataSource> snapshot = source->clone();
+    const QSharedPointer<Results> results = m_results;
+    results->total = snapshot->rowCount();
+    const QByteArray literal = requiredLiteral(query);
+    Task *task = m_tasks->start(tr("Searching for \"%1\"").arg(query.text), Task::HighPriority,
+                                [snapshot, results, query, literal](TaskContext &context) {
+        context.setProgressRange(results->total);
+        const QSharedPointer<ColumnStore> store = snapshot.dynamicCast<ColumnStore>();
+        QScopedPointer<StoreMatcher> storeMatcher(store ? new StoreMatcher(*store, query, context) : nullptr);
+        TaskEngine::parallelFor(results->total, ChunkRows,
+                                [&snapshot, &results, &query, &literal, &context, &storeMatcher](qint64 begin, qint64 end) {
+            TRACE_SCOPE("RowSearch::scanChunk");
+            const QSharedPointer<DataSource> reader = snapshot->clone();
+            const RowMatcher matcher(query, literal);
+            std::vector<qint64> hits;
+            for (qint64 row = begin; row < end; ++row) {
+                if (storeMatcher ? storeMatcher->matches(matcher, row) : matcher.matches(*reader, row))
+                    hits.push_back(row);
+            }
+            if (!hits.empty()) {
+                const qint64 count = qint64(hits.size());
+                QMutexLocker locker(&results->mutex);
+                results->chunks.emplace(begin, std::move(hits));
+                results->matches.fetch_add(count, std::memory_order_relaxed);
+            }
+            results->scanned.fetch_add(end - begin, std::memory_order_relaxed);
+            context.addProgress(end - begin);
+        }, &context);
+    });
+    m_task = task;
+    connect(task, &Task::finished, this, [this, task] {
+        if (task != m_task)
+            return;
+        m_pollTimer.stop();
+        emit matchesChanged();
+        emit finished();
+    });
+    m_pollTimer.start();
+}
+
+void RowSearch::cancel()
+{
+    if (m_task) {
+        m_task->cancel();
+        m_task = nullptr;
+    }
+    m_pollTimer.stop();
+}
+
+bool RowSearch::isRunning() const
+{
+    return !m_task.isNull();
+}
+
+SearchQuery RowSearch::query() const
+{
+    return m_query;
+}
+
+QString RowSearch::errorString() const
+{
+    return m_errorString;
+}
+
+qint64 RowSearch::matchCount() const
+{
+    return m_results ? m_results->matches.load(std::memory_order_relaxed) : 0;
+}
+
+qint64 RowSearch::scannedRows() const
+{
+    return m_results ? m_results->scanned.load(std::memory_order_relaxed) : 0;
+}
+
+qint64 RowSearch::totalRows() const
+{
+    return m_results ? m_results->total : 0;
+}
+
+qint64 RowSearch::nextMatch(qint64 row) const
+{
+    if (!m_results)
+        return -1;
+    QMutexLocker locker(&m_results->mutex);
+    const auto &chunks = m_results->chunks;
+    // Start with the chunk that could hold row itself.
+    auto it = chunks.upper_bound(row);
+    if (it != chunks.begin())
+        --it;
+    for (; it != chunks.end(); ++it) {
+        const std::vector<qint64> &hits = it->second;
+        const auto hit = std::upper_bound(hits.begin(), hits.end(), row);
+        if (hit != hits.end())
+            return *hit;
+    }
+    return -1;
+}
+
+qint64 RowSearch::previousMatch(qint64 row) const
+{
+    if (!m_results)
+        return -1;
+    QMutexLocker locker(&m_results->mutex);
+    const auto &chunks = m_results->chunks;
+    for (auto it = chunks.lower_bound(row); it != chunks.begin();) {
+        --it;
+        const std::vector<qint64> &hits = it->second;
+        const auto hit = std::lower_bound(hits.begin(), hits.end(), row);
+        if (hit != hits.begin())
+            return *(hit - 1);
+    }
+    return -1;
+}
+
+bool RowSearch::isMatch(qint64 row) const
+{
+    if (!m_results)
+        return false;
+    QMutexLocker locker(&m_results->mutex);
+    const auto &chunks = m_results->chunks;
+    auto it = chunks.upper_bound(row);
+    if (it == chunks.begin())
+        return false;
+    --it;
+    return std::binary_search(it->second.begin(), it->second.end(), row);
+}
+
+QByteArray RowSearch::requiredLiteral(const SearchQuery &query)
+{
+    const QString literal = query.regularExpression ? regexLiteral(query.text) : query.text;
+    // Any part of the literal is required too; the longest is kept that the
+    // raw bytes must contain as is. CSV doubles quotes inside quoted
+    // fields, and case folding on bytes only works for ASCII. Ignoring
+    // case, 'k' and 's' also match U+212A KELVIN SIGN and U+017F LATIN
+    // SMALL LETTER LONG S, which are not ASCII.
+    const bool fold = query.caseSensitivity == Qt::CaseInsensitive;
+    QString best;
+    int start = 0;
+    for (int i = 0; i <= literal.size(); ++i) {
+        const QChar c = i < literal.size() ? literal.at(i) : QChar();
+        const bool usable = i < literal.size() && c != QLatin1Char('"')
+                && !(fold && (c.unicode() > 0x7f || c.toLower() == QLatin1Char('k')
+                              || c.toLower() == QLatin1Char('s')));
+        if (usable)
+            continue;
+        if (i - start > best.size())
+            best = literal.mid(start, i - start);
+        start = i + 1;
+    }
+    return best.toUtf8();
+}
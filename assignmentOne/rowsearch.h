@@ -0,0 +1,76 @@
+#ifndef ROWSEARCH_H
+#define ROWSEARCH_H
+
+#include <QObject>
+#include <QPointer>
+#include <QSharedPointer>
+#include <QTimer>
+
+class DataSource;
+class Task;
+class TaskEngine;
+
+struct SearchQuery
+{
+    QString text;
+    bool regularExpression = false;
+    Qt::CaseSensitivity caseSensitivity = Qt::CaseInsensitive;
+};
+
+// Finds the rows of a DataSource with a cell matching a query. Rows are
+// scanned in chunks on every core. Sources that expose rowData() are
+// first filtered on their raw bytes with a SIMD scan for a literal the
+// query requires, so only candidate rows have their cells decoded. A
+// ColumnStore's text columns are matched once per dictionary entry.
+// Matches become visible chunk by chunk while the scan runs; the lowest
+// chunks are handed out first, so hits near the top arrive first.
+class RowSearch : public QObject
+{
+    Q_OBJECT
+
+public:
+    static const int ChunkRows = 1 << 14;
+
+    explicit RowSearch(TaskEngine *tasks, QObject *parent = nullptr);
+    ~RowSearch() override;
+
+    // Cancels any running search. An empty query clears the results.
+    void start(const QSharedPointer<DataSource> &source, const SearchQuery &query);
+    void cancel();
+
+    bool isRunning() const;
+    SearchQuery query() const;
+    // Set when the query is an invalid regular expression.
+    QString errorString() const;
+
+    qint64 matchCount() const;
+    qint64 scannedRows() const;
+    qint64 totalRows() const;
+    // First match after row / last match before row among those found so
+    // far; -1 if there is none.
+    qint64 nextMatch(qint64 row) const;
+    qint64 previousMatch(qint64 row) const;
+    // Whether row is among the matches found so far.
+    bool isMatch(qint64 row) const;
+
+    // Bytes every match must contain, or empty when the query cannot be
+    // reduced to such a literal.
+    static QByteArray requiredLiteral(const SearchQuery &query);
+
+signals:
+    // Sent once per frame while scanning, and once more at the end.
+    void matchesChanged();
+    void finished();
+
+private:
+    struct Results;
+
+    TaskEngine *m_tasks;
+    QPointer<Task> m_task;
+    QSharedPointer<Results> m_results;
+    SearchQuery m_query;
+    QString m_errorString;
+    QTimer m_pollTimer;
+};
+
+#endif // ROWSEARCH_H
@@ -0,0 +1,848 @@
+#include "sortfilterproxy.h"
+
+#include "columnstore.h"
+#include "datasource.h"
+#include "lazytablemodel.h"
+#include "taskengine.h"
+#include "trace.h"
+
+#include <QRegularExpression>
+#include <QThread>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#  include <emmintrin.h>
+#  define SORTFILTERPROXY_SSE2
+#endif
+
+namespace {
+
+// A multiple of 64, so chunks never share a mask word.
+const qint64 ChunkRows = 1 << 16;
+const qint64 MinSortRun = 1 << 15;
+const int NumericSampleRows = 1000;
+const int DefaultAppendDelayMs = 100;
+
+typedef SortFilterProxy::Clause Clause;
+
+double numberOf(const QString &cell)
+{
+    bool ok = false;
+    const double value = cell.toDouble(&ok);
+    return ok ? value : std::numeric_limits<double>::quiet_NaN();
+}
+
+// Unsigned keys that order like the doubles; NaN (not a number) sorts last.
+quint64 numericKey(double value)
+{
+    if (std::isnan(value))
+        return ~quint64(0);
+    quint64 bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return (bits >> 63) ? ~bits : bits | (quint64(1) << 63);
+}
+
+// Unsigned keys that order like the integers.
+quint64 int64Key(qint64 value)
+{
+    return quint64(value) ^ (quint64(1) << 63);
+}
+
+// First four UTF-16 code units, so keys order like QString::compare()
+// and only equal prefixes need the full strings.
+quint64 textKey(const QString &text)
+{
+    quint64 key = 0;
+    for (int i = 0; i < 4; ++i)
+        key = (key << 16) | (i < text.size() ? text.at(i).unicode() : 0);
+    return key;
+}
+
+inline bool compare(double a, double b, Clause::Operator op)
+{
+    switch (op) {
+    case Clause::Less: return a < b;
+    case Clause::LessEqual: return a <= b;
+    case Clause::Greater: return a > b;
+    case Clause::GreaterEqual: return a >= b;
+    case Clause::Equal: return a == b;
+    case Clause::NotEqual: return a != b;
+    case Clause::Contains: break;
+    }
+    return false;
+}
+
+#ifdef SORTFILTERPROXY_SSE2
+inline int compare2(__m128d a, __m128d b, Clause::Operator op)
+{
+    switch (op) {
+    case Clause::Less: return _mm_movemask_pd(_mm_cmplt_pd(a, b));
+    case Clause::LessEqual: return _mm_movemask_pd(_mm_cmple_pd(a, b));
+    case Clause::Greater: return _mm_movemask_pd(_mm_cmpgt_pd(a, b));
+    case Clause::GreaterEqual: return _mm_movemask_pd(_mm_cmpge_pd(a, b));
+    case Clause::Equal: return _mm_movemask_pd(_mm_cmpeq_pd(a, b));
+    case Clause::NotEqual: return _mm_movemask_pd(_mm_cmpneq_pd(a, b));
+    case Clause::Contains: break;
+    }
+    return 0;
+}
+#endif
+
+// Clears the bits of words whose value fails "value op number"; values[0]
+// belongs to bit 0 of words[0].
+void maskCompare(const double *values, qint64 count, Clause::Operator op, double number, quint64 *words)
+{
+    for (qint64 base = 0; base < count; base += 64) {
+        const qint64 n = qMin<qint64>(64, count - base);
+        quint64 word = 0;
+        qint64 i = 0;
+#ifdef SORTFILTERPROXY_SSE2
+        const __m128d rhs = _mm_set1_pd(number);
+        for (; i + 2 <= n; i += 2)
+            word |= quint64(compare2(_mm_loadu_pd(values + base + i), rhs, op)) << i;
+#endif
+        for (; i < n; ++i)
+            word |= quint64(compare(values[base + i], number, op)) << i;
+        words[base / 64] &= word;
+    }
+}
+
+inline int lowestBit(quint64 v)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(v);
+#else
+    int n = 0;
+    while (!(v & 1u)) {
+        v >>= 1;
+        ++n;
+    }
+    return n;
+#endif
+}
+
+struct SortEntry
+{
+    quint64 key;
+    quint32 row;
+};
+
+// Sorts runs of items on every core, then merges pairs of runs level by
+// level; the merges of one level also run in parallel.
+template<typename T, typename Less>
+void parallelSort(std::vector<T> &items, Less less, const TaskContext *context)
+{
+    const qint64 count = qint64(items.size());
+    qint64 runs = 1;
+    while (runs < QThread::idealThreadCount() && count / (runs * 2) >= MinSortRun)
+        runs *= 2;
+    const auto bound = [count, runs](qint64 run) { return count * qMin(run, runs) / runs; };
+
+    TaskEngine::parallelFor(runs, 1, [&items, &less, &bound](qint64 begin, qint64 end) {
+        for (qint64 run = begin; run < end; ++run)
+            std::sort(items.begin() + bound(run), items.begin() + bound(run + 1), less);
+    }, context);
+
+    std::vector<T> merged(items.size());
+    for (qint64 width = 1; width < runs; width *= 2) {
+        TaskEngine::parallelFor(runs / (2 * width), 1,
+                                [&items, &merged, &less, &bound, width](qint64 begin, qint64 end) {
+            for (qint64 pair = begin; pair < end; ++pair) {
+                const qint64 first = bound(pair * 2 * width);
+                const qint64 middle = bound(pair * 2 * width + width);
+                const qint64 last = bound((pair + 1) * 2 * width);
+                std::merge(items.begin() + first, items.begin() + middle,
+                           items.begin() + middle, items.begin() + last,
+                           merged.begin() + first, less);
+            }
+        }, context);
+        items.swap(merged);
+    }
+}
+
+// A filtered or sorted column of a ColumnStore, read from its arrays
+// instead of its cell texts. Text clauses are decided once per dictionary
+// entry and numbers parsed once per entry of a text column.
+struct StoreColumn
+{
+    const quint64 *validity = nullptr;
+    const qint64 *ints = nullptr;
+    const double *doubles = nullptr;
+    const quint32 *codes = nullptr;
+    // Per dictionary code.
+    std::vector<double> codeNumbers;
+    std::vector<char> codePasses;
+    bool nullPasses = false;
+
+    StoreColumn(const ColumnStore &store, int column)
+        : validity(store.validity(column))
+        , ints(store.int64Values(column))
+        , doubles(store.doubleValues(column))
+        , codes(store.stringCodes(column))
+    {
+    }
+
+    bool isValid(qint64 row) const { return (validity[row / 64] >> (row % 64)) & 1; }
+
+    double number(qint64 row) const
+    {
+        if (!isValid(row))
+            return std::numeric_limits<double>::quiet_NaN();
+        if (ints)
+            return double(ints[row]);
+        return doubles ? doubles[row] : codeNumbers[codes[row]];
+    }
+
+    bool passes(qint64 row) const { return isValid(row) ? codePasses[codes[row]] != 0 : nullPasses; }
+};
+
+// Puts runs of entries with equal keys in text order, reading the cells of
+// those rows only; keys hold just a prefix of the text.
+void sortTies(std::vector<SortEntry> &entries, const DataSource &source, int column, bool descending,
+              const TaskContext *context)
+{
+    std::vector<std::pair<size_t, size_t>> runs;
+    for (size_t first = 0; first < entries.size();) {
+        size_t last = first + 1;
+        while (last < entries.size() && entries[last].key == entries[first].key)
+            ++last;
+        if (last - first > 1)
+            runs.emplace_back(first, last);
+        first = last;
+    }
+
+    TaskEngine::parallelFor(qint64(runs.size()), 64, [&entries, &runs, &source, column, descending](qint64 begin, qint64 end) {
+        const QSharedPointer<DataSource> reader = source.clone();
+        std::vector<std::pair<QString, quint32>> texts;
+        for (qint64 r = begin; r < end; ++r) {
+            const size_t first = runs[size_t(r)].first;
+            const size_t last = runs[size_t(r)].second;
+            texts.clear();
+            for (size_t i = first; i < last; ++i)
+                texts.emplace_back(reader->cellText(entries[i].row, column), entries[i].row);
+            std::sort(texts.begin(), texts.end(), [descending](const std::pair<QString, quint32> &a,
+                                                              const std::pair<QString, quint32> &b) {
+                const int order = a.first.compare(b.first);
+                if (order != 0)
+                    return descending ? order > 0 : order < 0;
+                return a.second < b.second;
+            });
+            for (size_t i = first; i < last; ++i)
+                entries[i].row = texts[i - first].second;
+        }
+    }, context);
+}
+
+}
+
+struct SortFilterProxy::Order
+{
+    int sortColumn = -1;
+    bool descending = false;
+    bool numericSort = false;
+    // Keys hold a prefix of the text, so equal keys compare the cells.
+    bool textTies = false;
+    QVector<Clause> clauses;
+    // Source rows this order covers.
+    qint64 sourceRows = 0;
+    // Per source row while sorted.
+    std::vector<quint64> keys;
+    // Where ties are read once the order is shown; the GUI thread's.
+    QSharedPointer<DataSource> source;
+    // Visible source rows in display order; unused while identity.
+    std::vector<quint32> rows;
+
+    bool isIdentity() const { return sortColumn < 0 && clauses.isEmpty(); }
+
+    void setKey(qint64 row, const QString &cell)
+    {
+        keys[size_t(row)] = numericSort ? numericKey(numberOf(cell)) : textKey(cell);
+    }
+
+    // Display order of two source rows; ties keep source order.
+    bool less(quint32 a, quint32 b) const
+    {
+        if (sortColumn >= 0) {
+            if (keys[a] != keys[b])
+                return descending ? keys[a] > keys[b] : keys[a] < keys[b];
+            if (textTies) {
+                const int order = source->cellText(a, sortColumn).compare(source->cellText(b, sortColumn));
+                if (order != 0)
+                    return descending ? order > 0 : order < 0;
+            }
+        }
+        return a < b;
+    }
+
+    // Proxy row of a source row, or -1 when it is filtered out.
+    int find(quint32 sourceRow) const
+    {
+        const auto it = std::lower_bound(rows.begin(), rows.end(), sourceRow,
+                                         [this](quint32 a, quint32 b) { return less(a, b); });
+        return it != rows.end() && *it == sourceRow ? int(it - rows.begin()) : -1;
+    }
+};
+
+bool SortFilterProxy::Clause::test(const QString &cell) const
+{
+    if (numeric)
+        return compare(numberOf(cell), number, op);
+    if (op == Contains)
+        return cell.contains(text, Qt::CaseInsensitive);
+    const bool equal = cell.compare(text, Qt::CaseInsensitive) == 0;
+    return op == Equal ? equal : !equal;
+}
+
+SortFilterProxy::SortFilterProxy(TaskEngine *tasks, QObject *parent)
+    : QAbstractProxyModel(parent)
+    , m_tasks(tasks)
+    , m_order(new Order)
+{
+    m_appendTimer.setSingleShot(true);
+    m_appendTimer.setInterval(DefaultAppendDelayMs);
+    connect(&m_appendTimer, &QTimer::timeout, this, &SortFilterProxy::appendRows);
+}
+
+SortFilterProxy::~SortFilterProxy()
+{
+    if (m_rebuild)
+        m_rebuild->cancel();
+}
+
+void SortFilterProxy::setSourceModel(QAbstractItemModel *model)
+{
+    Q_ASSERT(!model || qobject_cast<LazyTableModel *>(model));
+    beginResetModel();
+    if (m_model)
+        disconnect(m_model, nullptr, this, nullptr);
+    m_model = qobject_cast<LazyTableModel *>(model);
+    QAbstractProxyModel::setSourceModel(model);
+    if (m_model) {
+        connect(m_model, &QAbstractItemModel::modelReset, this, &SortFilterProxy::sourceReset);
+        connect(m_model, &QAbstractItemModel::rowsInserted, this, &SortFilterProxy::sourceRowsInserted);
+        connect(m_model, &QAbstractItemModel::dataChanged, this, &SortFilterProxy::sourceDataChanged);
+    }
+    m_order.reset(new Order);
+    endResetModel();
+    rebuild();
+}
+
+bool SortFilterProxy::setFilter(const QString &expression, QString *errorString)
+{
+    QStringList columnNames;
+    for (int column = 0; column < columnCount(); ++column)
+        columnNames.append(headerData(column, Qt::Horizontal).toString());
+    QVector<Clause> clauses;
+    if (!parseFilter(expression, columnNames, &clauses, errorString))
+        return false;
+
+    m_filter = expression.trimmed();
+    m_clauses = clauses;
+    rebuild();
+    return true;
+}
+
+QString SortFilterProxy::filter() const
+{
+    return m_filter;
+}
+
+bool SortFilterProxy::parseFilter(const QString &expression, const QStringList &columnNames,
+                                  QVector<Clause> *clauses, QString *errorString)
+{
+    static const QRegularExpression separator(QStringLiteral("\\s+and\\s+"),
+                                              QRegularExpression::CaseInsensitiveOption);
+    static const QRegularExpression clausePattern(QStringLiteral("^(.+?)\\s*(<=|>=|!=|=|<|>|~)\\s*(.*)$"));
+
+    const auto fail = [errorString](const QString &message) {
+        if (errorString)
+            *errorString = message;
+        return false;
+    };
+
+    clauses->clear();
+    const QString trimmed = expression.trimmed();
+    const QStringList parts = trimmed.isEmpty() ? QStringList() : trimmed.split(separator);
+    for (const QString &part : parts) {
+        const QRegularExpressionMatch match = clausePattern.match(part.trimmed());
+        if (!match.hasMatch())
+            return fail(tr("Expected <column> <operator> <value>: %1").arg(part));
+
+        Clause clause;
+        clause.column = -1;
+        const QString name = match.captured(1);
+        for (int column = 0; column < columnNames.size(); ++column) {
+            if (columnNames.at(column).compare(name, Qt::CaseInsensitive) == 0) {
+                clause.column = column;
+                break;
+            }
+        }
+        if (clause.column < 0)
+            return fail(tr("Unknown column: %1").arg(name));
+
+        clause.text = match.captured(3).trimmed();
+        if (clause.text.size() >= 2 && clause.text.startsWith(QLatin1Char('"')) && clause.text.endsWith(QLatin1Char('"')))
+            clause.text = clause.text.mid(1, clause.text.size() - 2);
+        bool isNumber = false;
+        clause.number = clause.text.toDouble(&isNumber);
+
+        static const char *const Operators[] = { "<", "<=", ">", ">=", "=", "!=", "~" };
+        const QString op = match.captured(2);
+        for (int i = 0; i < int(sizeof(Operators) / sizeof(Operators[0])); ++i) {
+            if (op == QLatin1String(Operators[i]))
+                clause.op = Clause::Operator(i);
+        }
+        switch (clause.op) {
+        case Clause::Equal:
+        case Clause::NotEqual:
+            clause.numeric = isNumber;
+            break;
+        case Clause::Contains:
+            clause.numeric = false;
+            break;
+        default:
+            if (!isNumber)
+                return fail(tr("%1 %2 needs a number").arg(name, op));
+            clause.numeric = true;
+            break;
+        }
+        clauses->append(clause);
+    }
+    return true;
+}
+
+std::vector<quint32> SortFilterProxy::filterRows(const DataSource &source, const QVector<Clause> &clauses,
+                                                 TaskContext &context)
+{
+    Order order;
+    order.clauses = clauses;
+    order.sourceRows = source.rowCount();
+    buildOrder(order, source, context);
+    return std::move(order.rows);
+}
+
+bool SortFilterProxy::isBusy() const
+{
+    return !m_rebuild.isNull();
+}
+
+bool SortFilterProxy::isSorted() const
+{
+    return m_order->sortColumn >= 0;
+}
+
+void SortFilterProxy::setAppendDelay(int msecs)
+{
+    m_appendTimer.setInterval(msecs);
+}
+
+void SortFilterProxy::sort(int column, Qt::SortOrder order)
+{
+    m_sortColumn = column;
+    m_sortOrder = order;
+    rebuild();
+}
+
+int SortFilterProxy::sortColumn() const
+{
+    return m_sortColumn;
+}
+
+Qt::SortOrder SortFilterProxy::sortOrder() const
+{
+    return m_sortOrder;
+}
+
+QModelIndex SortFilterProxy::index(int row, int column, const QModelIndex &parent) const
+{
+    if (parent.isValid() || row < 0 || column < 0 || row >= rowCount() || column >= columnCount())
+        return QModelIndex();
+    return createIndex(row, column);
+}
+
+QModelIndex SortFilterProxy::parent(const QModelIndex &) const
+{
+    return QModelIndex();
+}
+
+int SortFilterProxy::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid())
+        return 0;
+    return m_order->isIdentity() ? int(m_order->sourceRows) : int(m_order->rows.size());
+}
+
+int SortFilterProxy::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() || !m_model ? 0 : m_model->columnCount();
+}
+
+QVariant SortFilterProxy::data(const QModelIndex &index, int role) const
+{
+    if ((role != Qt::DisplayRole && role != Qt::EditRole) || !index.isValid())
+        return QVariant();
+    // Permuted rows would defeat the source model's page cache, so cells
+    // are read straight from the source.
+    if (m_order->isIdentity())
+        return m_model->data(mapToSource(index), role);
+    return m_model->source()->cellText(m_order->rows[size_t(index.row())], index.column());
+}
+
+QVariant SortFilterProxy::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    // Row headers keep showing the source row numbers.
+    if (orientation == Qt::Vertical && role == Qt::DisplayRole && !m_order->isIdentity()) {
+        if (section < 0 || size_t(section) >= m_order->rows.size())
+            return QVariant();
+        return qint64(m_order->rows[size_t(section)]) + 1;
+    }
+    return m_model ? m_model->headerData(section, orientation, role) : QVariant();
+}
+
+QModelIndex SortFilterProxy::mapToSource(const QModelIndex &proxyIndex) const
+{
+    if (!proxyIndex.isValid() || !m_model)
+        return QModelIndex();
+    const int row = m_order->isIdentity() ? proxyIndex.row() : int(m_order->rows[size_t(proxyIndex.row())]);
+    return m_model->index(row, proxyIndex.column());
+}
+
+QModelIndex SortFilterProxy::mapFromSource(const QModelIndex &sourceIndex) const
+{
+    if (!sourceIndex.isValid() || sourceIndex.row() >= m_order->sourceRows)
+        return QModelIndex();
+    const int row = m_order->isIdentity() ? sourceIndex.row() : m_order->find(quint32(sourceIndex.row()));
+    return row < 0 ? QModelIndex() : index(row, sourceIndex.column());
+}
+
+void SortFilterProxy::buildOrder(Order &order, const DataSource &source, TaskContext &context)
+{
+    TRACE_SCOPE("SortFilterProxy::buildOrder");
+    const qint64 rows = order.sourceRows;
+    const int sortColumn = order.sortColumn;
+    const QVector<Clause> &clauses = order.clauses;
+    context.setProgressRange(rows);
+
+    // A ColumnStore is read from its arrays; per clause, null where the
+    // cell texts are compared (text clauses on numeric columns).
+    const ColumnStore *store = dynamic_cast<const ColumnStore *>(&source);
+    std::vector<std::unique_ptr<StoreColumn>> typed(size_t(clauses.size()));
+    for (int c = 0; store && c < clauses.size(); ++c) {
+        const Clause &clause = clauses.at(c);
+        const bool text = store->columnType(clause.column) == ColumnStore::StringColumn;
+        if (!clause.numeric && !text)
+            continue;
+        StoreColumn *column = new StoreColumn(*store, clause.column);
+        typed[size_t(c)].reset(column);
+        if (!text)
+            continue;
+        const QVector<QString> &dictionary = store->dictionary(clause.column);
+        if (clause.numeric)
+            column->codeNumbers.resize(size_t(dictionary.size()));
+        else
+            column->codePasses.resize(size_t(dictionary.size()));
+        TaskEngine::parallelFor(dictionary.size(), ChunkRows, [&dictionary, &clause, column](qint64 begin, qint64 end) {
+            for (qint64 code = begin; code < end; ++code) {
+                if (clause.numeric)
+                    column->codeNumbers[size_t(code)] = numberOf(dictionary.at(code));
+                else
+                    column->codePasses[size_t(code)] = clause.test(dictionary.at(code));
+            }
+        }, &context);
+        column->nullPasses = clause.test(QString());
+    }
+
+    std::unique_ptr<StoreColumn> sortValues;
+    if (sortColumn >= 0 && store && store->columnType(sortColumn) != ColumnStore::StringColumn) {
+        sortValues.reset(new StoreColumn(*store, sortColumn));
+        order.numericSort = true;
+    } else if (sortColumn >= 0) {
+        // Numeric when every non-empty cell of a sample parses as a number.
+        const QSharedPointer<DataSource> reader = source.clone();
+        int numbers = 0;
+        bool numeric = true;
+        for (qint64 row = 0; row < qMin<qint64>(rows, NumericSampleRows) && numeric; ++row) {
+            const QString cell = reader->cellText(row, sortColumn);
+            if (!cell.isEmpty()) {
+                cell.toDouble(&numeric);
+                ++numbers;
+            }
+        }
+        order.numericSort = numeric && numbers > 0;
+    }
+    if (sortColumn >= 0) {
+        order.textTies = !order.numericSort;
+        order.keys.resize(size_t(rows));
+    }
+
+    // Text held as dictionary codes sorts by the rank of each code's text,
+    // which is exact, so ties need no cells.
+    std::vector<quint64> ranks;
+    const quint32 *codes = nullptr;
+    if (sortColumn >= 0 && !order.numericSort && store && store->columnType(sortColumn) == ColumnStore::StringColumn) {
+        const QVector<QString> &dictionary = store->dictionary(sortColumn);
+        std::vector<int> byText(size_t(dictionary.size()));
+        for (size_t i = 0; i < byText.size(); ++i)
+            byText[i] = int(i);
+        std::sort(byText.begin(), byText.end(), [&dictionary](int a, int b) {
+            return dictionary.at(a).compare(dictionary.at(b)) < 0;
+        });
+        // Empty text ranks 0 like null cells; equal texts share a rank.
+        ranks.resize(byText.size());
+        quint64 rank = 0;
+        for (size_t i = 0; i < byText.size(); ++i) {
+            const QString &text = dictionary.at(byText[i]);
+            if (i == 0 ? !text.isEmpty() : text.compare(dictionary.at(byText[i - 1])) != 0)
+                ++rank;
+            ranks[size_t(byText[i])] = rank;
+        }
+        codes = store->stringCodes(sortColumn);
+        order.textTies = false;
+    }
+
+    std::vector<quint64> mask(size_t((rows + 63) / 64), ~quint64(0));
+    if (rows % 64)
+        mask.back() = (quint64(1) << (rows % 64)) - 1;
+
+    // One pass over the rows reads every cell that is needed, so each row
+    // is split only once; numeric clauses are then applied to whole runs.
+    TaskEngine::parallelFor(rows, ChunkRows, [&order, &source, &clauses, &mask, &context, &typed, &sortValues,
+                                              &ranks, store, codes, sortColumn](qint64 begin, qint64 end) {
+        const QSharedPointer<DataSource> reader = source.clone();
+        const qint64 count = end - begin;
+        quint64 *words = mask.data() + begin / 64;
+        std::vector<std::vector<double>> values(size_t(clauses.size()));
+        for (int c = 0; c < clauses.size(); ++c) {
+            if (clauses.at(c).numeric)
+                values[size_t(c)].resize(size_t(count));
+        }
+
+        for (qint64 row = begin; row < end; ++row) {
+            for (int c = 0; c < clauses.size(); ++c) {
+                const Clause &clause = clauses.at(c);
+                if (const StoreColumn *column = typed[size_t(c)].get()) {
+                    if (clause.numeric)
+                        values[size_t(c)][size_t(row - begin)] = column->number(row);
+                    else if (!column->passes(row))
+                        words[(row - begin) / 64] &= ~(quint64(1) << ((row - begin) % 64));
+                    continue;
+                }
+                const QString cell = reader->cellText(row, clause.column);
+                if (clause.numeric)
+                    values[size_t(c)][size_t(row - begin)] = numberOf(cell);
+                else if (!clause.test(cell))
+                    words[(row - begin) / 64] &= ~(quint64(1) << ((row - begin) % 64));
+            }
+            if (sortColumn < 0)
+                continue;
+            if (codes) {
+                order.keys[size_t(row)] = store->isNull(row, sortColumn) ? 0 : ranks[codes[row]];
+            } else if (sortValues) {
+                // Null cells sort last, like text that is not a number.
+                order.keys[size_t(row)] = !sortValues->ints ? numericKey(sortValues->number(row))
+                        : sortValues->isValid(row) ? int64Key(sortValues->ints[row]) : ~quint64(0);
+            } else {
+                order.setKey(row, reader->cellText(row, sortColumn));
+            }
+        }
+        for (int c = 0; c < clauses.size(); ++c) {
+            if (clauses.at(c).numeric)
+                maskCompare(values[size_t(c)].data(), count, clauses.at(c).op, clauses.at(c).number, words);
+        }
+        context.addProgress(count);
+    }, &context);
+    if (context.isCanceled())
+        return;
+
+    if (sortColumn < 0) {
+        for (size_t w = 0; w < mask.size(); ++w) {
+            for (quint64 bits = mask[w]; bits; bits &= bits - 1)
+                order.rows.push_back(quint32(w * 64 + size_t(lowestBit(bits))));
+        }
+        return;
+    }
+
+    std::vector<SortEntry> entries;
+    for (size_t w = 0; w < mask.size(); ++w) {
+        for (quint64 bits = mask[w]; bits; bits &= bits - 1) {
+            const quint32 row = quint32(w * 64 + size_t(lowestBit(bits)));
+            // Inverted keys sort descending with the same comparison.
+            const SortEntry entry = { order.descending ? ~order.keys[row] : order.keys[row], row };
+            entries.push_back(entry);
+        }
+    }
+    parallelSort(entries, [](const SortEntry &a, const SortEntry &b) {
+        return a.key != b.key ? a.key < b.key : a.row < b.row;
+    }, &context);
+    if (order.textTies)
+        sortTies(entries, source, sortColumn, order.descending, &context);
+    if (context.isCanceled())
+        return;
+
+    order.rows.resize(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i)
+        order.rows[i] = entries[i].row;
+}
+
+void SortFilterProxy::rebuild()
+{
+    ++m_generation;
+    if (m_rebuild) {
+        m_rebuild->cancel();
+        m_rebuild = nullptr;
+    }
+    m_appendTimer.stop();
+
+    const QSharedPointer<Order> order(new Order);
+    order->sortColumn = m_sortColumn;
+    order->descending = m_sortOrder == Qt::DescendingOrder;
+    order->clauses = m_clauses;
+    const QSharedPointer<DataSource> source = m_model ? m_model->source() : QSharedPointer<DataSource>();
+    order->source = source;
+    order->sourceRows = source ? m_model->rowCount() : 0;
+    if (order->isIdentity() || !source) {
+        beginResetModel();
+        order->sortColumn = -1;
+        order->clauses.clear();
+        m_order = order;
+        endResetModel();
+        emit orderChanged();
+        return;
+    }
+
+    const QSharedPointer<DataSource> snapshot = source->clone();
+    const quint64 generation = m_generation;
+    Task *task = m_tasks->start(m_clauses.isEmpty() ? tr("Sorting") : tr("Filtering"), Task::HighPriority,
+                                [order, snapshot](TaskContext &context) {
+        buildOrder(*order, *snapshot, context);
+    });
+    m_rebuild = task;
+    connect(task, &Task::finished, this, [this, task, order, generation] {
+        if (generation != m_generation)
+            return;
+        m_rebuild = nullptr;
+        if (task->isCanceled()) {
+            // The rows shown keep their sort; the filter stays pending
+            // until the next rebuild.
+            m_sortColumn = m_order->sortColumn;
+            m_sortOrder = m_order->descending ? Qt::DescendingOrder : Qt::AscendingOrder;
+            emit sortReverted(m_sortColumn, m_sortOrder);
+            appendRows();
+            return;
+        }
+        beginResetModel();
+        m_order = order;
+        endResetModel();
+        emit orderChanged();
+        // Rows the source gained during the rebuild.
+        appendRows();
+    });
+}
+
+void SortFilterProxy::sourceReset()
+{
+    // The current rows refer to the previous source.
+    beginResetModel();
+    m_order.reset(new Order);
+    endResetModel();
+    rebuild();
+}
+
+// Edited rows keep their place until the next rebuild.
+void SortFilterProxy::sourceDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight)
+{
+    if (m_order->isIdentity()) {
+        const int last = qMin(bottomRight.row(), rowCount() - 1);
+        if (topLeft.row() <= last)
+            emit dataChanged(index(topLeft.row(), topLeft.column()), index(last, bottomRight.column()));
+    } else if (rowCount() > 0) {
+        // Changed rows are scattered in display order.
+        emit dataChanged(index(0, topLeft.column()), index(rowCount() - 1, bottomRight.column()));
+    }
+}
+
+void SortFilterProxy::sourceRowsInserted()
+{
+    if (m_order->isIdentity())
+        appendRows();
+    else if (!m_appendTimer.isActive())
+        m_appendTimer.start();
+}
+
+// Filters and sorts only the rows added since the last update, then merges
+// them into the visible order in one linear pass.
+void SortFilterProxy::appendRows()
+{
+    if (!m_model || m_rebuild)
+        return;
+    Order &order = *m_order;
+    const qint64 first = order.sourceRows;
+    const qint64 last = m_model->rowCount();
+    if (last <= first)
+        return;
+    TRACE_SCOPE("SortFilterProxy::appendRows");
+
+    if (order.isIdentity()) {
+        beginInsertRows(QModelIndex(), int(first), int(last - 1));
+        order.sourceRows = last;
+        endInsertRows();
+        return;
+    }
+
+    const QSharedPointer<DataSource> source = m_model->source();
+    if (order.sortColumn >= 0)
+        order.keys.resize(size_t(last));
+    std::vector<quint32> added;
+    for (qint64 row = first; row < last; ++row) {
+        bool visible = true;
+        for (const Clause &clause : qAsConst(order.clauses)) {
+            if (!clause.test(source->cellText(row, clause.column))) {
+                visible = false;
+                break;
+            }
+        }
+        if (order.sortColumn >= 0)
+            order.setKey(row, source->cellText(row, order.sortColumn));
+        if (visible)
+            added.push_back(quint32(row));
+    }
+    order.sourceRows = last;
+    if (added.empty())
+        return;
+
+    if (order.sortColumn < 0) {
+        const int at = int(order.rows.size());
+        beginInsertRows(QModelIndex(), at, at + int(added.size()) - 1);
+        order.rows.insert(order.rows.end(), added.begin(), added.end());
+        endInsertRows();
+        emit orderChanged();
+        return;
+    }
+
+    const auto less = [&order](quint32 a, quint32 b) { return order.less(a, b); };
+    std::sort(added.begin(), added.end(), less);
+
+    emit layoutAboutToBeChanged();
+    const QModelIndexList before = persistentIndexList();
+    std::vector<quint32> persistentRows;
+    for (const QModelIndex &index : before)
+        persistentRows.push_back(order.rows[size_t(index.row())]);
+
+    std::vector<quint32> merged(order.rows.size() + added.size());
+    std::merge(order.rows.begin(), order.rows.end(), added.begin(), added.end(), merged.begin(), less);
+    order.rows.swap(merged);
+
+    QModelIndexList after;
+    for (int i = 0; i < before.size(); ++i)
+        after.append(index(order.find(persistentRows[size_t(i)]), before.at(i).column()));
+    changePersistentIndexList(before, after);
+    emit layoutChanged();
+    emit orderChanged();
+}
@@ -0,0 +1,120 @@
+#ifndef SORTFILTERPROXY_H
+#define SORTFILTERPROXY_H
+
+#include <QAbstractProxyModel>
+#include <QPointer>
+#include <QSharedPointer>
+#include <QTimer>
+#include <QVector>
+
+#include <vector>
+
+class DataSource;
+class LazyTableModel;
+class Task;
+class TaskContext;
+class TaskEngine;
+
+// Sorted and filtered view of a LazyTableModel, built for row counts where
+// QSortFilterProxyModel's per-row bookkeeping and single-threaded sorting
+// fall over. The visible rows are one vector of source row numbers.
+//
+// Changing the sort or filter rebuilds that vector in a background task:
+// cells are read in parallel chunks, filter clauses are evaluated into row
+// bitmasks (numeric comparisons 2 rows per SSE2 instruction), and the
+// survivors are ordered by a parallel merge sort on 64-bit keys. Rows the
+// source appends later are filtered, sorted among themselves and merged
+// in, without re-sorting what is already there. A ColumnStore is read
+// from its typed arrays rather than its cell texts.
+class SortFilterProxy : public QAbstractProxyModel
+{
+    Q_OBJECT
+
+public:
+    // One "<column> <operator> <value>" part of a filter.
+    struct Clause
+    {
+        enum Operator { Less, LessEqual, Greater, GreaterEqual, Equal, NotEqual, Contains };
+
+        int column;
+        Operator op;
+        bool numeric;
+        double number;
+        QString text;
+
+        bool test(const QString &cell) const;
+    };
+
+    explicit SortFilterProxy(TaskEngine *tasks, QObject *parent = nullptr);
+    ~SortFilterProxy() override;
+
+    // Must be a LazyTableModel.
+    void setSourceModel(QAbstractItemModel *model) override;
+
+    // Keeps rows matching every clause of expression, for example
+    // "Value > 10 and Status = FAULT". < <= > >= compare numbers; = and !=
+    // compare numbers, or text ignoring case; ~ matches a substring
+    // ignoring case. An empty expression shows all rows.
+    bool setFilter(const QString &expression, QString *errorString = nullptr);
+    QString filter() const;
+
+    // The parsing and evaluation behind setFilter(), for use without a
+    // model. columnNames are matched ignoring case. filterRows() returns
+    // the rows of source that pass every clause, in source order; it runs
+    // on all cores and returns early once context is canceled.
+    static bool parseFilter(const QString &expression, const QStringList &columnNames,
+                            QVector<Clause> *clauses, QString *errorString = nullptr);
+    static std::vector<quint32> filterRows(const DataSource &source, const QVector<Clause> &clauses,
+                                           TaskContext &context);
+
+    // True while a rebuild runs; the previous order stays visible meanwhile.
+    bool isBusy() const;
+    // Whether the visible rows are sorted rather than in source order.
+    bool isSorted() const;
+    // How long appended rows are collected before they are merged in.
+    void setAppendDelay(int msecs);
+
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override;
+    int sortColumn() const;
+    Qt::SortOrder sortOrder() const;
+
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex &child) const override;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation,
+                        int role = Qt::DisplayRole) const override;
+    QModelIndex mapToSource(const QModelIndex &proxyIndex) const override;
+    QModelIndex mapFromSource(const QModelIndex &sourceIndex) const override;
+
+signals:
+    // A rebuild or a merge of appended rows was applied.
+    void orderChanged();
+    // A rebuild was canceled, so the sort went back to that of the rows
+    // still shown.
+    void sortReverted(int column, Qt::SortOrder order);
+
+private:
+    struct Order;
+
+    static void buildOrder(Order &order, const DataSource &source, TaskContext &context);
+    void rebuild();
+    void sourceReset();
+    void sourceRowsInserted();
+    void sourceDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight);
+    void appendRows();
+
+    TaskEngine *m_tasks;
+    LazyTableModel *m_model = nullptr;
+    QSharedPointer<Order> m_order;
+    QPointer<Task> m_rebuild;
+    quint64 m_generation = 0;
+    int m_sortColumn = -1;
+    Qt::SortOrder m_sortOrder = Qt::AscendingOrder;
+    QString m_filter;
+    QVector<Clause> m_clauses;
+    QTimer m_appendTimer;
+};
+
+#endif // SORTFILTERPROXY_H
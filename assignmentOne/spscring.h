@@ -0,0 +1,78 @@
+#ifndef SPSCRING_H
+#define SPSCRING_H
+
+#include <QtGlobal>
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Bounded lock-free queue for exactly one producer thread and one consumer
+// thread. The capacity is rounded up to a power of two. Each side keeps a
+// private copy of the other side's index and only reloads the shared one
+// when that copy says the ring is full (or empty), so the two cache lines
+// bounce as little as possible.
+template <typename T>
+class SpscRing
+{
+public:
+    explicit SpscRing(size_t capacity)
+    {
+        size_t size = 2;
+        while (size < capacity)
+            size *= 2;
+        m_slots.resize(size);
+        m_mask = size - 1;
+    }
+
+    SpscRing(const SpscRing &) = delete;
+    SpscRing &operator=(const SpscRing &) = delete;
+
+    size_t capacity() const { return m_slots.size(); }
+
+    // Approximate when called while the other side is running.
+    size_t size() const
+    {
+        return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+    }
+
+    // Producer side. Leaves value untouched and returns false when full.
+    bool tryPush(T &&value)
+    {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_producerHead == m_slots.size()) {
+            m_producerHead = m_head.load(std::memory_order_acquire);
+            if (tail - m_producerHead == m_slots.size())
+                return false;
+        }
+        m_slots[tail & m_mask] = std::move(value);
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side.
+    bool tryPop(T *value)
+    {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_consumerTail) {
+            m_consumerTail = m_tail.load(std::memory_order_acquire);
+            if (head == m_consumerTail)
+                return false;
+        }
+        *value = std::move(m_slots[head & m_mask]);
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::vector<T> m_slots;
+    size_t m_mask = 0;
+
+    alignas(64) std::atomic<size_t> m_head { 0 };
+    size_t m_consumerTail = 0;
+    alignas(64) std::atomic<size_t> m_tail { 0 };
+    size_t m_producerHead = 0;
+};
+
+#endif // SPSCRING_H
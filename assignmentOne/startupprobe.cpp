@@ -0,0 +1,58 @@
+#include "startupprobe.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QEvent>
+#include <QTextStream>
+#include <QTimer>
+#include <QWidget>
+
+namespace {
+
+QElapsedTimer startupClock;
+
+class FirstPaintProbe : public QObject
+{
+public:
+    FirstPaintProbe(QWidget *window, double budgetMs)
+        : QObject(window)
+        , m_budgetMs(budgetMs)
+    {
+        window->installEventFilter(this);
+    }
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) override
+    {
+        if (event->type() == QEvent::Paint) {
+            watched->removeEventFilter(this);
+            // Report once the paint has been delivered, not before it.
+            QTimer::singleShot(0, this, [this] { finish(); });
+        }
+        return false;
+    }
+
+private:
+    void finish()
+    {
+        const double elapsedMs = startupClock.nsecsElapsed() / 1e6;
+        const bool pass = elapsedMs <= m_budgetMs;
+        QTextStream(stdout) << "startup time-to-first-paint: " << QString::number(elapsedMs, 'f', 1) << " ms "
+                            << (pass ? "PASS" : "FAIL") << " (budget " << m_budgetMs << " ms)" << Qt::endl;
+        QCoreApplication::exit(pass ? 0 : 1);
+    }
+
+    double m_budgetMs;
+};
+
+}
+
+void startStartupClock()
+{
+    startupClock.start();
+}
+
+void measureFirstPaint(QWidget *window, double budgetMs)
+{
+    new FirstPaintProbe(window, budgetMs);
+}
@@ -0,0 +1,12 @@
+#ifndef STARTUPPROBE_H
+#define STARTUPPROBE_H
+
+class QWidget;
+
+// Time-to-first-paint check behind --startup-bench. The clock should be
+// started first thing in main(). Once window has painted, the event loop
+// exits with status 1 if that took longer than budgetMs.
+void startStartupClock();
+void measureFirstPaint(QWidget *window, double budgetMs);
+
+#endif // STARTUPPROBE_H
@@ -0,0 +1,195 @@
+#include "statisticspanel.h"
+
+#include "columnstats.h"
+#include "columnstore.h"
+#include "document.h"
+
+#include <QComboBox>
+#include <QFormLayout>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QLabel>
+#include <QLocale>
+#include <QPushButton>
+#include <QTableWidget>
+#include <QVBoxLayout>
+
+#include <cmath>
+
+namespace {
+
+QString numberText(double value)
+{
+    return std::isfinite(value) ? QLocale().toString(value, 'g', 6) : QString();
+}
+
+QTableWidget *createTable(const QStringList &headers, QWidget *parent)
+{
+    QTableWidget *table = new QTableWidget(0, headers.size(), parent);
+    table->setHorizontalHeaderLabels(headers);
+    table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    table->setSelectionBehavior(QAbstractItemView::SelectRows);
+    table->verticalHeader()->hide();
+    table->horizontalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
+    return table;
+}
+
+void setRow(QTableWidget *table, int row, const QStringList &cells)
+{
+    for (int column = 0; column < cells.size(); ++column) {
+        QTableWidgetItem *item = table->item(row, column);
+        if (!item) {
+            item = new QTableWidgetItem;
+            // Names and keys on the left, numbers on the right.
+            if (column > 0)
+                item->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+            table->setItem(row, column, item);
+        }
+        item->setText(cells.at(column));
+    }
+}
+
+}
+
+StatisticsPanel::StatisticsPanel(Document *document, TaskEngine *tasks, QWidget *parent)
+    : QWidget(parent)
+    , m_document(document)
+    , m_statistics(new ColumnStatistics(tasks, this))
+    , m_status(new QLabel(this))
+    , m_loadButton(new QPushButton(tr("Load into Memory"), this))
+    , m_groupBox(new QComboBox(this))
+    , m_valueBox(new QComboBox(this))
+{
+    m_columnsTable = createTable({ tr("Column"), tr("Type"), tr("Count"), tr("Empty"), tr("Min"), tr("Max"),
+                                   tr("Mean"), tr("Std dev"), tr("p50"), tr("p90"), tr("p99"),
+                                   tr("Distinct"), tr("Most frequent") }, this);
+    m_groupsTable = createTable({ tr("Group"), tr("Rows"), tr("Count"), tr("Sum"), tr("Mean"),
+                                  tr("Min"), tr("Max") }, this);
+    m_status->setWordWrap(true);
+
+    QHBoxLayout *statusLayout = new QHBoxLayout;
+    statusLayout->addWidget(m_status, 1);
+    statusLayout->addWidget(m_loadButton);
+    QFormLayout *groupLayout = new QFormLayout;
+    groupLayout->addRow(tr("Group by:"), m_groupBox);
+    groupLayout->addRow(tr("Aggregate:"), m_valueBox);
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->setContentsMargins(4, 4, 4, 4);
+    layout->addLayout(statusLayout);
+    layout->addWidget(m_columnsTable, 1);
+    layout->addLayout(groupLayout);
+    layout->addWidget(m_groupsTable, 1);
+
+    connect(m_loadButton, &QPushButton::clicked, this, &StatisticsPanel::loadRequested);
+    connect(m_groupBox, QOverload<int>::of(&QComboBox::activated), this, &StatisticsPanel::recompute);
+    connect(m_valueBox, QOverload<int>::of(&QComboBox::activated), this, &StatisticsPanel::recompute);
+    connect(m_statistics, &ColumnStatistics::resultsChanged, this, &StatisticsPanel::updateTables);
+    connect(m_document, &Document::sourceChanged, this, &StatisticsPanel::sourceChanged);
+    // Results for the columns as they were loaded no longer describe the
+    // edited data.
+    connect(m_document, &Document::columnStoreChanged, this, &StatisticsPanel::sourceChanged);
+    sourceChanged();
+}
+
+void StatisticsPanel::recompute()
+{
+    m_stale = false;
+    const QSharedPointer<ColumnStore> store = m_document->columnStore();
+    m_loadButton->setVisible(!store && m_document->source());
+    m_statistics->start(store, m_groupBox->currentData().toInt(), m_valueBox->currentData().toInt());
+}
+
+void StatisticsPanel::showEvent(QShowEvent *event)
+{
+    QWidget::showEvent(event);
+    if (m_stale)
+        recompute();
+}
+
+void StatisticsPanel::sourceChanged()
+{
+    m_groupBox->clear();
+    m_valueBox->clear();
+    m_groupBox->addItem(tr("(none)"), -1);
+    m_valueBox->addItem(tr("(rows only)"), -1);
+    if (const QSharedPointer<ColumnStore> store = m_document->columnStore()) {
+        for (int c = 0; c < store->columnCount(); ++c) {
+            m_groupBox->addItem(store->columnName(c), c);
+            if (store->columnType(c) != ColumnStore::StringColumn)
+                m_valueBox->addItem(store->columnName(c), c);
+        }
+    }
+
+    m_stale = true;
+    if (isVisible())
+        recompute();
+    else
+        m_statistics->cancel();
+}
+
+void StatisticsPanel::updateTables()
+{
+    const QSharedPointer<ColumnStore> store = m_document->columnStore();
+    const QLocale locale;
+    if (!store) {
+        m_status->setText(m_document->source() ? tr("Statistics are computed on data held in memory.")
+                                               : tr("Nothing loaded."));
+        m_columnsTable->setRowCount(0);
+        m_groupsTable->setRowCount(0);
+        return;
+    }
+    if (m_statistics->isRunning() && m_statistics->totalRows() > 0) {
+        m_status->setText(tr("Computing... %1 of %2 rows")
+                          .arg(locale.toString(m_statistics->scannedRows()),
+                               locale.toString(m_statistics->totalRows())));
+    } else {
+        m_status->setText(tr("%1 rows").arg(locale.toString(m_statistics->totalRows())));
+    }
+
+    const QVector<ColumnSummary> summaries = m_statistics->summaries();
+    m_columnsTable->setRowCount(int(summaries.size()));
+    for (int c = 0; c < summaries.size() && c < store->columnCount(); ++c) {
+        const ColumnSummary &s = summaries.at(c);
+        if (store->columnType(c) == ColumnStore::StringColumn) {
+            setRow(m_columnsTable, c, { store->columnName(c), tr("text"),
+                                        locale.toString(s.rows - s.nulls),
+                                        locale.toString(s.nulls),
+                                        QString(), QString(), QString(), QString(), QString(), QString(), QString(),
+                                        locale.toString(s.distinct),
+                                        s.mostFrequentCount > 0 ? tr("%1 (%2)").arg(s.mostFrequent,
+                                                                                  locale.toString(s.mostFrequentCount))
+                                                                : QString() });
+            continue;
+        }
+        const Moments &m = s.moments;
+        // Sketch estimates are clamped to the exact extremes.
+        const auto quantileText = [&s, &m](double q) {
+            return m.count > 0 ? numberText(qBound(m.min, s.quantiles.quantile(q), m.max)) : QString();
+        };
+        setRow(m_columnsTable, c, { store->columnName(c),
+                                    store->columnType(c) == ColumnStore::Int64Column ? tr("integer") : tr("number"),
+                                    locale.toString(m.count), locale.toString(s.nulls),
+                                    numberText(m.min), numberText(m.max), numberText(m.mean),
+                                    numberText(m.standardDeviation()),
+                                    quantileText(0.5), quantileText(0.9), quantileText(0.99),
+                                    QString(), QString() });
+    }
+
+    const QVector<GroupSummary> groups = m_statistics->groups();
+    const int shown = groups.size() < MaxShownGroups ? int(groups.size()) : MaxShownGroups;
+    m_groupsTable->setRowCount(shown);
+    for (int i = 0; i < shown; ++i) {
+        const GroupSummary &g = groups.at(i);
+        const bool aggregated = g.values.count > 0;
+        setRow(m_groupsTable, i, { g.key, locale.toString(g.rows),
+                                   locale.toString(g.values.count),
+                                   aggregated ? numberText(g.values.sum()) : QString(),
+                                   aggregated ? numberText(g.values.mean) : QString(),
+                                   aggregated ? numberText(g.values.min) : QString(),
+                                   aggregated ? numberText(g.values.max) : QString() });
+    }
+    if (groups.size() > shown)
+        m_status->setText(m_status->text() + tr(", showing the %1 largest of %2 groups")
+                          .arg(locale.toString(shown), locale.toString(groups.size())));
+}
@@ -0,0 +1,52 @@
+#ifndef STATISTICSPANEL_H
+#define STATISTICSPANEL_H
+
+#include <QWidget>
+
+class ColumnStatistics;
+class Document;
+class QComboBox;
+class QLabel;
+class QPushButton;
+class QTableWidget;
+class TaskEngine;
+
+// Per-column summary statistics and a group-by table for the document's
+// data. Works on the in-memory columns; for other sources it offers to
+// load them first. Recomputes whenever the document changes while shown,
+// filling the tables in as chunks are merged.
+class StatisticsPanel : public QWidget
+{
+    Q_OBJECT
+
+public:
+    // Groups beyond this are counted but not listed.
+    static const int MaxShownGroups = 1000;
+
+    StatisticsPanel(Document *document, TaskEngine *tasks, QWidget *parent = nullptr);
+
+public slots:
+    void recompute();
+
+signals:
+    void loadRequested();
+
+protected:
+    void showEvent(QShowEvent *event) override;
+
+private:
+    void sourceChanged();
+    void updateTables();
+
+    Document *m_document;
+    ColumnStatistics *m_statistics;
+    QLabel *m_status;
+    QPushButton *m_loadButton;
+    QTableWidget *m_columnsTable;
+    QComboBox *m_groupBox;
+    QComboBox *m_valueBox;
+    QTableWidget *m_groupsTable;
+    bool m_stale = true;
+};
+
+#endif // STATISTICSPANEL_H
@@ -0,0 +1,104 @@
+#include "streamsource.h"
+
+#include <QMutex>
+
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+struct StreamSource::Store
+{
+    QStringList columnNames;
+
+    // Guards the chunk table only; records inside a chunk are written once
+    // before rows is advanced past them and never change afterwards.
+    mutable QMutex mutex;
+    std::vector<std::unique_ptr<QByteArray[]>> chunks;
+    std::atomic<qint64> rows { 0 };
+    qint64 bytes = 0;
+};
+
+StreamSource::StreamSource(const QStringList &columnNames)
+    : m_store(new Store)
+{
+    m_store->columnNames = columnNames;
+}
+
+StreamSource::StreamSource(const QSharedPointer<Store> &store, qint64 rows)
+    : m_store(store)
+    , m_snapshotRows(rows)
+{
+}
+
+void StreamSource::append(QByteArray &&record)
+{
+    Q_ASSERT(m_snapshotRows < 0);
+    Store &store = *m_store;
+    const qint64 row = store.rows.load(std::memory_order_relaxed);
+    const size_t chunkIndex = size_t(row / ChunkRows);
+    if (chunkIndex == store.chunks.size()) {
+        QMutexLocker locker(&store.mutex);
+        store.chunks.emplace_back(new QByteArray[ChunkRows]);
+    }
+    store.bytes += record.size();
+    store.chunks[chunkIndex][row % ChunkRows] = std::move(record);
+    store.rows.store(row + 1, std::memory_order_release);
+}
+
+qint64 StreamSource::rowCount() const
+{
+    return m_snapshotRows >= 0 ? m_snapshotRows : m_store->rows.load(std::memory_order_acquire);
+}
+
+int StreamSource::columnCount() const
+{
+    return m_store->columnNames.size();
+}
+
+QString StreamSource::columnName(int column) const
+{
+    return m_store->columnNames.value(column);
+}
+
+QString StreamSource::cellText(qint64 row, int column) const
+{
+    const QByteArray &data = record(row);
+    const char *begin = data.constData();
+    const char *end = begin + data.size();
+    for (int i = 0; i < column && begin < end; ++i) {
+        const void *separator = std::memchr(begin, FieldSeparator, size_t(end - begin));
+        begin = separator ? static_cast<const char *>(separator) + 1 : end;
+    }
+    const void *separator = std::memchr(begin, FieldSeparator, size_t(end - begin));
+    const char *fieldEnd = separator ? static_cast<const char *>(separator) : end;
+    return QString::fromUtf8(begin, int(fieldEnd - begin));
+}
+
+const char *StreamSource::rowData(qint64 row, qint64 *length) const
+{
+    const QByteArray &data = record(row);
+    *length = data.size();
+    return data.constData();
+}
+
+QSharedPointer<DataSource> StreamSource::clone() const
+{
+    return QSharedPointer<DataSource>(new StreamSource(m_store, rowCount()));
+}
+
+qint64 StreamSource::memoryUsage() const
+{
+    return m_store->bytes + qint64(m_store->chunks.size()) * ChunkRows * qint64(sizeof(QByteArray));
+}
+
+const QByteArray &StreamSource::record(qint64 row) const
+{
+    const qint64 chunkIndex = row / ChunkRows;
+    if (chunkIndex != m_cachedChunkIndex) {
+        QMutexLocker locker(&m_store->mutex);
+        m_cachedChunk = m_store->chunks[size_t(chunkIndex)].get();
+        m_cachedChunkIndex = chunkIndex;
+    }
+    return m_cachedChunk[row % ChunkRows];
+}
@@ -0,0 +1,49 @@
+#ifndef STREAMSOURCE_H
+#define STREAMSOURCE_H
+
+#include "datasource.h"
+
+#include <QByteArray>
+#include <QStringList>
+
+// Rows that arrive while the application runs. Each record is kept as
+// one UTF-8 byte array with its fields separated by FieldSeparator, in
+// fixed-size chunks that never move once allocated. Records are appended
+// by a single writer; clones taken on other threads read the rows that
+// existed when they were made.
+class StreamSource : public DataSource
+{
+public:
+    static const char FieldSeparator = '\x1f';
+    static const int ChunkRows = 1 << 16;
+
+    explicit StreamSource(const QStringList &columnNames);
+
+    // Writer side; the source must not be a clone.
+    void append(QByteArray &&record);
+
+    qint64 rowCount() const override;
+    int columnCount() const override;
+    QString columnName(int column) const override;
+    QString cellText(qint64 row, int column) const override;
+    const char *rowData(qint64 row, qint64 *length) const override;
+    QSharedPointer<DataSource> clone() const override;
+
+    // Record bytes plus chunk tables. Writer side only.
+    qint64 memoryUsage() const;
+
+private:
+    struct Store;
+
+    StreamSource(const QSharedPointer<Store> &store, qint64 rows);
+    const QByteArray &record(qint64 row) const;
+
+    QSharedPointer<Store> m_store;
+    // Row count of a clone; -1 for the live source.
+    qint64 m_snapshotRows = -1;
+
+    mutable qint64 m_cachedChunkIndex = -1;
+    mutable const QByteArray *m_cachedChunk = nullptr;
+};
+
+#endif // STREAMSOURCE_H
@@ -0,0 +1,72 @@
+#include "syntheticsource.h"
+
+#include <QDateTime>
+#include <QLocale>
+
+namespace {
+
+enum Column { IdColumn, TimestampColumn, SensorColumn, ValueColumn, StatusColumn, ColumnCount };
+
+quint64 mix(quint64 x)
+{
+    // splitmix64 finalizer: cheap and well distributed.
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+const qint64 BaseTimestampMs = 1577836800000LL; // 2020-01-01T00:00:00Z
+
+}
+
+SyntheticSource::SyntheticSource(qint64 rows)
+    : m_rows(rows)
+{
+}
+
+qint64 SyntheticSource::rowCount() const
+{
+    return m_rows;
+}
+
+int SyntheticSource::columnCount() const
+{
+    return ColumnCount;
+}
+
+QString SyntheticSource::columnName(int column) const
+{
+    switch (column) {
+    case IdColumn: return QStringLiteral("Id");
+    case TimestampColumn: return QStringLiteral("Timestamp");
+    case SensorColumn: return QStringLiteral("Sensor");
+    case ValueColumn: return QStringLiteral("Value");
+    case StatusColumn: return QStringLiteral("Status");
+    }
+    return QString();
+}
+
+QString SyntheticSource::cellText(qint64 row, int column) const
+{
+    const quint64 h = mix(quint64(row));
+    switch (column) {
+    case IdColumn:
+        return QString::number(row);
+    case TimestampColumn:
+        return QDateTime::fromMSecsSinceEpoch(BaseTimestampMs + row * 100, Qt::UTC)
+                .toString(Qt::ISODateWithMs);
+    case SensorColumn:
+        return QStringLiteral("sensor-%1").arg(h % 64, 2, 10, QLatin1Char('0'));
+    case ValueColumn:
+        return QString::number(double(h % 2000000) / 1000.0 - 1000.0, 'g', QLocale::FloatingPointShortest);
+    case StatusColumn:
+        return (h >> 32) % 97 == 0 ? QStringLiteral("FAULT") : QStringLiteral("OK");
+    }
+    return QString();
+}
+
+QSharedPointer<DataSource> SyntheticSource::clone() const
+{
+    return QSharedPointer<DataSource>(new SyntheticSource(m_rows));
+}
@@ -0,0 +1,23 @@
+#ifndef SYNTHETICSOURCE_H
+#define SYNTHETICSOURCE_H
+
+#include "datasource.h"
+
+// Generates deterministic sensor-style rows from the row number, so any
+// row count costs no memory. Used for demos and benchmarks.
+class SyntheticSource : public DataSource
+{
+public:
+    explicit SyntheticSource(qint64 rows);
+
+    qint64 rowCount() const override;
+    int columnCount() const override;
+    QString columnName(int column) const override;
+    QString cellText(qint64 row, int column) const override;
+    QSharedPointer<DataSource> clone() const override;
+
+private:
+    qint64 m_rows;
+};
+
+#endif // SYNTHETICSOURCE_H
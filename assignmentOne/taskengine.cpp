@@ -0,0 +1,182 @@
+#include "taskengine.h"
+
+#include "trace.h"
+
+#include <QThreadPool>
+
+#include <memory>
+
+namespace {
+
+const int ProgressIntervalMs = 16;
+
+int poolPriority(Task::Priority priority)
+{
+    switch (priority) {
+    case Task::LowPriority: return -1;
+    case Task::NormalPriority: return 0;
+    case Task::HighPriority: return 1;
+    }
+    return 0;
+}
+
+}
+
+Task::Task(const QString &name, Priority priority, QObject *parent)
+    : QObject(parent)
+    , m_name(name)
+    , m_priority(priority)
+    , m_context(new TaskContext)
+{
+}
+
+void Task::cancel()
+{
+    m_context->m_canceled.store(true, std::memory_order_relaxed);
+}
+
+void Task::finish()
+{
+    static_cast<TaskEngine *>(parent())->taskFinished(this);
+}
+
+TaskEngine::TaskEngine(QObject *parent)
+    : QObject(parent)
+{
+    m_progressTimer.setInterval(ProgressIntervalMs);
+    connect(&m_progressTimer, &QTimer::timeout, this, &TaskEngine::sampleProgress);
+}
+
+TaskEngine::~TaskEngine()
+{
+    cancelAll();
+    waitForDone();
+}
+
+Task *TaskEngine::start(const QString &name, Task::Priority priority,
+                        const std::function<void(TaskContext &)> &work)
+{
+    Task *task = new Task(name, priority, this);
+    m_active.append(task);
+    if (!m_progressTimer.isActive())
+        m_progressTimer.start();
+
+    {
+        QMutexLocker locker(&m_runningMutex);
+        ++m_running;
+    }
+
+    const QSharedPointer<TaskContext> context = task->m_context;
+    const char *traceName = Trace::isEnabled() ? Trace::intern(name) : nullptr;
+    QThreadPool::globalInstance()->start([this, task, context, work, traceName] {
+        if (!context->isCanceled()) {
+            TraceScope scope(traceName);
+            work(*context);
+        }
+        QMetaObject::invokeMethod(task, "finish", Qt::QueuedConnection);
+
+        QMutexLocker locker(&m_runningMutex);
+        if (--m_running == 0)
+            m_runningDone.wakeAll();
+    }, poolPriority(priority));
+    return task;
+}
+
+int TaskEngine::activeTaskCount() const
+{
+    return m_active.size();
+}
+
+void TaskEngine::cancelAll()
+{
+    for (Task *task : qAsConst(m_active))
+        task->cancel();
+}
+
+void TaskEngine::waitForDone()
+{
+    QMutexLocker locker(&m_runningMutex);
+    while (m_running > 0)
+        m_runningDone.wait(&m_runningMutex);
+}
+
+void TaskEngine::parallelFor(qint64 count, qint64 grain,
+                             const std::function<void(qint64, qint64)> &body,
+                             const TaskContext *context)
+{
+    if (count <= 0)
+        return;
+    grain = qMax<qint64>(1, grain);
+    const qint64 chunks = (count + grain - 1) / grain;
+
+    struct Shared
+    {
+        std::atomic<qint64> next { 0 };
+        std::atomic<int> inFlight { 0 };
+        QMutex mutex;
+        QWaitCondition done;
+    };
+    const auto shared = std::make_shared<Shared>();
+
+    // Helpers that only get scheduled after every chunk was claimed find
+    // nothing to do and never touch body or context.
+    const auto drain = [shared, chunks, count, grain, &body, context] {
+        for (;;) {
+            shared->inFlight.fetch_add(1);
+            const qint64 chunk = shared->next.fetch_add(1);
+            const bool run = chunk < chunks && !(context && context->isCanceled());
+            if (run) {
+                const qint64 begin = chunk * grain;
+                body(begin, qMin(begin + grain, count));
+            }
+            if (shared->inFlight.fetch_sub(1) == 1) {
+                QMutexLocker locker(&shared->mutex);
+                shared->done.wakeAll();
+            }
+            if (!run)
+                return;
+        }
+    };
+
+    QThreadPool *pool = QThreadPool::globalInstance();
+    const qint64 helpers = qMin<qint64>(chunks - 1, pool->maxThreadCount());
+    for (qint64 i = 0; i < helpers; ++i)
+        pool->start(drain, poolPriority(Task::HighPriority));
+    drain();
+
+    // Cancellation can leave chunks unclaimed; claim them so late helpers exit.
+    shared->next.store(chunks);
+    QMutexLocker locker(&shared->mutex);
+    while (shared->inFlight.load() > 0)
+        shared->done.wait(&shared->mutex);
+}
+
+void TaskEngine::sampleProgress()
+{
+    qint64 done = 0;
+    qint64 total = 0;
+    for (const Task *task : qAsConst(m_active)) {
+        done += task->context().progress();
+        total += task->context().progressRange();
+    }
+    if (done == m_lastDone && total == m_lastTotal)
+        return;
+    m_lastDone = done;
+    m_lastTotal = total;
+    emit progressChanged(done, total, m_active.isEmpty() ? QString() : m_active.constFirst()->name());
+}
+
+void TaskEngine::taskFinished(Task *task)
+{
+    m_active.removeOne(task);
+    emit task->finished();
+    task->deleteLater();
+
+    if (m_active.isEmpty()) {
+        m_progressTimer.stop();
+        m_lastDone = -1;
+        m_lastTotal = -1;
+        emit progressChanged(0, 0, QString());
+        emit idle();
+    }
+}
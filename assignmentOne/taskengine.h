@@ -0,0 +1,112 @@
+#ifndef TASKENGINE_H
+#define TASKENGINE_H
+
+#include <QMutex>
+#include <QObject>
+#include <QSharedPointer>
+#include <QTimer>
+#include <QWaitCondition>
+
+#include <atomic>
+#include <functional>
+
+// Handed to a task's work function. Progress is plain atomics, so it can be
+// reported from any number of threads at any rate; the engine samples it.
+class TaskContext
+{
+public:
+    bool isCanceled() const { return m_canceled.load(std::memory_order_relaxed); }
+
+    void setProgressRange(qint64 total) { m_total.store(total, std::memory_order_relaxed); }
+    void setProgress(qint64 done) { m_done.store(done, std::memory_order_relaxed); }
+    void addProgress(qint64 delta) { m_done.fetch_add(delta, std::memory_order_relaxed); }
+
+    qint64 progress() const { return m_done.load(std::memory_order_relaxed); }
+    qint64 progressRange() const { return m_total.load(std::memory_order_relaxed); }
+
+private:
+    friend class Task;
+
+    std::atomic<bool> m_canceled { false };
+    std::atomic<qint64> m_done { 0 };
+    std::atomic<qint64> m_total { 0 };
+};
+
+// A unit of background work started by TaskEngine. Lives on the GUI
+// thread; finished() is always delivered there, after the work function
+// has returned. The object deletes itself once finished() was emitted.
+class Task : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Priority { LowPriority, NormalPriority, HighPriority };
+
+    QString name() const { return m_name; }
+    Priority priority() const { return m_priority; }
+    const TaskContext &context() const { return *m_context; }
+    bool isCanceled() const { return m_context->isCanceled(); }
+
+public slots:
+    void cancel();
+
+signals:
+    void finished();
+
+private:
+    friend class TaskEngine;
+
+    Task(const QString &name, Priority priority, QObject *parent);
+    Q_INVOKABLE void finish();
+
+    QString m_name;
+    Priority m_priority;
+    QSharedPointer<TaskContext> m_context;
+};
+
+// Background work on the global QThreadPool. Tasks are queued by priority;
+// parallelFor() lets any task fan out over all cores, with idle workers
+// claiming chunks until the range is exhausted. Progress of running tasks
+// is sampled on a frame timer and reported at most ~60 times a second.
+class TaskEngine : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit TaskEngine(QObject *parent = nullptr);
+    ~TaskEngine();
+
+    Task *start(const QString &name, Task::Priority priority,
+                const std::function<void(TaskContext &)> &work);
+
+    int activeTaskCount() const;
+    void cancelAll();
+    void waitForDone();
+
+    // Runs body over [0, count) in chunks of grain. The calling thread takes
+    // part, so this is safe to nest inside tasks. Stops handing out chunks
+    // once context is canceled.
+    static void parallelFor(qint64 count, qint64 grain,
+                            const std::function<void(qint64 begin, qint64 end)> &body,
+                            const TaskContext *context = nullptr);
+
+signals:
+    // Summed over all running tasks. label names the oldest running task.
+    void progressChanged(qint64 done, qint64 total, const QString &label);
+    void idle();
+
+private:
+    void sampleProgress();
+    void taskFinished(Task *task);
+
+    QList<Task *> m_active;
+    QTimer m_progressTimer;
+    qint64 m_lastDone = -1;
+    qint64 m_lastTotal = -1;
+
+    QMutex m_runningMutex;
+    QWaitCondition m_runningDone;
+    int m_running = 0;
+};
+
+#endif // TASKENGINE_H
@@ -0,0 +1,6 @@
+TARGET = tst_columns
+
+include(../tests.pri)
+
+SOURCES += \
+    tst_columns.cpp
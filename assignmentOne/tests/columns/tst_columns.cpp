@@ -0,0 +1,250 @@
+#include "batch.h"
+#include "columnstats.h"
+#include "columnstore.h"
+#include "imagepyramid.h"
+#include "memorytracker.h"
+#include "streamsource.h"
+#include "syntheticsource.h"
+#include "taskengine.h"
+#include "testsupport.h"
+
+#include <QApplication>
+#include <QEventLoop>
+#include <QFile>
+#include <QImage>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTemporaryDir>
+#include <QVariant>
+#include <QtTest>
+
+// Rows held as typed columns: memory, the global budget, statistics and
+// the headless batch pipeline.
+class tst_Columns : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void memory();
+    void budget();
+    void statistics();
+    void infinities();
+    void batch();
+};
+
+// 2M generated rows held as typed columns versus the usual row of
+// QVariants: resident memory added by each and a scan of one column.
+void tst_Columns::memory()
+{
+    const qint64 Rows = 2000000;
+    const int ValueColumn = 3;
+
+    const SyntheticSource source(Rows);
+    // The store is built first and kept alive, so the baseline cannot reuse
+    // pages the store's build freed.
+    qint64 before = residentBytes();
+    const QSharedPointer<ColumnStore> store = ColumnStore::build(source);
+    const qint64 storeResident = residentBytes() - before;
+
+    before = residentBytes();
+    QVector<QVector<QVariant>> rows;
+    rows.reserve(int(Rows));
+    for (qint64 r = 0; r < Rows; ++r) {
+        QVector<QVariant> row;
+        row.reserve(source.columnCount());
+        for (int c = 0; c < source.columnCount(); ++c) {
+            const QString text = source.cellText(r, c);
+            bool ok = false;
+            const qint64 integer = text.toLongLong(&ok);
+            if (ok) {
+                row.append(integer);
+                continue;
+            }
+            const double real = text.toDouble(&ok);
+            row.append(ok ? QVariant(real) : QVariant(text));
+        }
+        rows.append(row);
+    }
+    const qint64 variantResident = residentBytes() - before;
+
+    double variantSum = 0;
+    for (const QVector<QVariant> &row : qAsConst(rows))
+        variantSum += row.at(ValueColumn).toDouble();
+
+    QElapsedTimer timer;
+    timer.start();
+    double columnSum = 0;
+    const double *values = store->doubleValues(ValueColumn);
+    const quint64 *validity = store->validity(ValueColumn);
+    QVERIFY(values);
+    for (qint64 r = 0; r < Rows; ++r) {
+        if (validity[r / 64] >> (r % 64) & 1)
+            columnSum += values[r];
+    }
+    QTest::setBenchmarkResult(timer.nsecsElapsed() / 1e6, QTest::WalltimeMilliseconds);
+
+    qInfo("columns %.1f MB resident (%.1f MB reported), QVariant rows %.1f MB", storeResident / 1e6,
+          store->memoryUsage() / 1e6, variantResident / 1e6);
+    QVERIFY(qAbs(columnSum - variantSum) <= 1e-6 * qMax(1.0, qAbs(variantSum)));
+    if (storeResident > 0)
+        QVERIFY2(storeResident < variantResident, "typed columns take more memory than QVariant rows");
+}
+
+// Memory accounting and the global budget: column arrays are counted as
+// they are built, and once the budget drops below what is held the tile
+// cache gives memory back on the next turn of the event loop.
+void tst_Columns::budget()
+{
+    const qint64 Rows = 2000000;
+    const int Size = 4096;
+    const qint64 Squeeze = qint64(32) << 20;
+    const double ReclaimBudgetMs = 50.0;
+
+    const qint64 columnsBefore = MemoryTracker::usage(MemoryTracker::Columns).live;
+    const QSharedPointer<ColumnStore> store = ColumnStore::build(SyntheticSource(Rows));
+    const qint64 columns = MemoryTracker::usage(MemoryTracker::Columns).live - columnsBefore;
+    QVERIFY(columns > 0);
+    QVERIFY(columns <= store->memoryUsage());
+
+    QImage image(Size, Size, QImage::Format_RGB32);
+    image.fill(Qt::darkCyan);
+    QTemporaryDir dir;
+    const QString sourceFile = dir.filePath(QStringLiteral("budget.src"));
+    const QString pyramidFile = dir.filePath(QStringLiteral("budget.tiles"));
+    QFile source(sourceFile);
+    QVERIFY(source.open(QIODevice::WriteOnly));
+    QCOMPARE(source.write("image", 5), qint64(5));
+    source.close();
+    QString errorString;
+    QVERIFY2(ImagePyramid::build(std::move(image), sourceFile, pyramidFile, &errorString), qPrintable(errorString));
+    const QSharedPointer<ImagePyramid> pyramid = ImagePyramid::open(sourceFile, pyramidFile, &errorString);
+    QVERIFY2(pyramid, qPrintable(errorString));
+    for (int row = 0; row < pyramid->rowCount(0); ++row) {
+        for (int column = 0; column < pyramid->columnCount(0); ++column)
+            pyramid->tile(0, column, row);
+    }
+    QVERIFY(MemoryTracker::usage(MemoryTracker::ImageTiles).live > 0);
+
+    QObject owner;
+    MemoryTracker::addReclaimer(&owner, MemoryTracker::ImageTiles, [&pyramid](qint64 bytes) {
+        pyramid->trimCache(bytes);
+    });
+    const qint64 previousBudget = MemoryTracker::budget();
+    const qint64 budget = MemoryTracker::total().live - Squeeze;
+    QElapsedTimer timer;
+    timer.start();
+    MemoryTracker::setBudget(budget);
+    while (MemoryTracker::total().live > budget && timer.elapsed() < 1000)
+        QCoreApplication::processEvents();
+    const double reclaimMs = timer.nsecsElapsed() / 1e6;
+    const qint64 total = MemoryTracker::total().live;
+    MemoryTracker::setBudget(previousBudget);
+
+    QTest::setBenchmarkResult(reclaimMs, QTest::WalltimeMilliseconds);
+    QVERIFY(total <= budget);
+    QVERIFY2(reclaimMs < ReclaimBudgetMs, "memory came back too slowly");
+}
+
+// Summary statistics of every column of 50M in-memory rows, then the same
+// with a group-by of the reading per sensor.
+void tst_Columns::statistics()
+{
+    const qint64 Rows = 50000000;
+    const double BudgetMs = 2000.0;
+
+    const QSharedPointer<ColumnStore> store = ColumnStore::build(ReadingsSource(Rows));
+    TaskEngine engine;
+    ColumnStatistics statistics(&engine);
+    QEventLoop loop;
+    connect(&statistics, &ColumnStatistics::finished, &loop, &QEventLoop::quit);
+
+    QElapsedTimer timer;
+    timer.start();
+    statistics.start(store);
+    if (statistics.isRunning())
+        loop.exec();
+    const double summaryMs = timer.nsecsElapsed() / 1e6;
+    const ColumnSummary reading = statistics.summaries().value(1);
+
+    timer.restart();
+    statistics.start(store, 0, 1);
+    if (statistics.isRunning())
+        loop.exec();
+    const double groupMs = timer.nsecsElapsed() / 1e6;
+
+    qInfo("summaries %.3f ms, group-by %.3f ms, %.1f Mrows/s; reading mean %g, p50 %g", summaryMs, groupMs,
+          Rows / 1e6 / (summaryMs / 1e3), reading.moments.mean, reading.quantiles.quantile(0.5));
+    QTest::setBenchmarkResult(summaryMs, QTest::WalltimeMilliseconds);
+    QVERIFY(reading.moments.count > 0);
+    QCOMPARE(int(statistics.groups().size()), 64);
+    QVERIFY2(summaryMs < BudgetMs, "summaries over budget");
+    QVERIFY2(groupMs < BudgetMs, "group-by over budget");
+}
+
+// "inf" reads back as a double, so a numeric column can hold it; the
+// quantiles have to skip it rather than size buckets from it.
+void tst_Columns::infinities()
+{
+    StreamSource source(QStringList() << QStringLiteral("Value"));
+    for (const char *text : { "1", "inf", "2", "-inf", "3" })
+        source.append(QByteArray(text));
+    const QSharedPointer<ColumnStore> store = ColumnStore::build(source);
+    QVERIFY(store->doubleValues(0));
+
+    TaskEngine engine;
+    ColumnStatistics statistics(&engine);
+    QEventLoop loop;
+    connect(&statistics, &ColumnStatistics::finished, &loop, &QEventLoop::quit);
+    statistics.start(store);
+    if (statistics.isRunning())
+        loop.exec();
+    const ColumnSummary value = statistics.summaries().value(0);
+    QCOMPARE(value.quantiles.count(), qint64(3));
+    QVERIFY(qAbs(value.quantiles.quantile(0.5) - 2) < 2 * QuantileSketch::RelativeAccuracy);
+}
+
+// The headless --batch pipeline over several CSV files: filter, group-by
+// and the JSON result, end to end.
+void tst_Columns::batch()
+{
+    const int Files = 4;
+    const qint64 Rows = 1000000;
+    const double BudgetMs = 5000.0;
+
+    QTemporaryDir dir;
+    BatchOptions options;
+    for (int i = 0; i < Files; ++i) {
+        const QString fileName = dir.filePath(QStringLiteral("batch%1.csv").arg(i));
+        QVERIFY(writeSyntheticCsv(fileName, Rows));
+        options.files.append(fileName);
+    }
+    options.filter = QStringLiteral("Value > 0 and Status = OK");
+    options.groupBy = QStringLiteral("Sensor");
+    options.aggregate = QStringLiteral("Value");
+    options.format = QStringLiteral("json");
+    options.outputFile = dir.filePath(QStringLiteral("batch.json"));
+
+    QElapsedTimer timer;
+    timer.start();
+    QCOMPARE(runBatch(options), 0);
+    const double elapsedMs = timer.nsecsElapsed() / 1e6;
+
+    QFile output(options.outputFile);
+    QVERIFY(output.open(QIODevice::ReadOnly));
+    const QJsonArray files = QJsonDocument::fromJson(output.readAll()).object().value(QStringLiteral("files")).toArray();
+    QCOMPARE(int(files.size()), Files);
+    qint64 matched = 0;
+    for (const QJsonValue &file : files) {
+        matched += file.toObject().value(QStringLiteral("matched")).toVariant().toLongLong();
+        QCOMPARE(int(file.toObject().value(QStringLiteral("groups")).toArray().size()), 64);
+    }
+    QVERIFY(matched > 0);
+
+    QTest::setBenchmarkResult(elapsedMs, QTest::WalltimeMilliseconds);
+    QVERIFY2(elapsedMs < BudgetMs, "batch over budget");
+}
+
+OFFSCREEN_TEST_MAIN(tst_Columns)
+
+#include "tst_columns.moc"
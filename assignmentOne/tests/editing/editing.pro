@@ -0,0 +1,6 @@
+TARGET = tst_editing
+
+include(../tests.pri)
+
+SOURCES += \
+    tst_editing.cpp
@@ -0,0 +1,153 @@
+#include "columnstore.h"
+#include "document.h"
+#include "edithistory.h"
+#include "memorytracker.h"
+#include "syntheticsource.h"
+#include "testsupport.h"
+
+#include <QtTest>
+
+// Edits and their undo history.
+class tst_Editing : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void fillUndoRedo();
+    void mergeSingleEdits();
+    void capacity();
+    void shrinkWithRedo();
+    void editColumnStore();
+
+private:
+    static const qint64 Rows = 1000000;
+    static const int Column = 1;
+
+    QScopedPointer<Document> m_document;
+};
+
+void tst_Editing::init()
+{
+    m_document.reset(new Document);
+    m_document->setSource(QSharedPointer<DataSource>(new SyntheticSource(Rows)), QStringLiteral("undo"));
+}
+
+// Fills a column of 1M rows twice and undoes and redoes both fills, each
+// of which has to take milliseconds and a few records of history.
+void tst_Editing::fillUndoRedo()
+{
+    const double BudgetMs = 50.0;
+
+    Document &document = *m_document;
+    const QString original = document.source()->cellText(Rows / 2, Column);
+    document.fillCells(Column, 0, Rows - 1, QStringLiteral("first"));
+    document.fillCells(Column, 0, Rows - 1, QStringLiteral("second"));
+    qInfo("history %lld bytes, %lld tracked", document.history()->bytes(),
+          MemoryTracker::usage(MemoryTracker::UndoHistory).live);
+
+    Timings steps;
+    QElapsedTimer timer;
+    timer.start();
+    document.undo();
+    steps.add(timer.nsecsElapsed());
+    timer.restart();
+    document.undo();
+    steps.add(timer.nsecsElapsed());
+    QCOMPARE(document.source()->cellText(Rows / 2, Column), original);
+    QVERIFY(!document.isModified());
+
+    timer.restart();
+    document.redo();
+    steps.add(timer.nsecsElapsed());
+    timer.restart();
+    document.redo();
+    steps.add(timer.nsecsElapsed());
+    QCOMPARE(document.source()->cellText(Rows / 2, Column), QStringLiteral("second"));
+
+    qInfo("undo/redo %s", qPrintable(steps.summary()));
+    const double slowest = steps.quantile(1.0);
+    QTest::setBenchmarkResult(slowest, QTest::WalltimeMilliseconds);
+    QVERIFY2(slowest < BudgetMs, "a 1M-cell undo or redo is over budget");
+}
+
+// Neighbouring single-cell edits merge into one step.
+void tst_Editing::mergeSingleEdits()
+{
+    const int SingleEdits = 1000;
+
+    EditHistory *history = m_document->history();
+    const int stepsBefore = history->undoCount();
+    for (int i = 0; i < SingleEdits; ++i)
+        m_document->setCellText(i, 0, QString::number(i));
+    QCOMPARE(history->undoCount(), stepsBefore + 1);
+}
+
+// The history stays within its capacity by forgetting the oldest steps.
+void tst_Editing::capacity()
+{
+    const int LargeEdits = 2000;
+    const qint64 Capacity = EditHistory::BlockSize * 4;
+
+    Document &document = *m_document;
+    EditHistory *history = document.history();
+    history->setCapacity(Capacity);
+    const QString large(1000, QLatin1Char('x'));
+    for (int i = 0; i < LargeEdits; ++i)
+        document.setCellText(qint64(i) * 100, 2, large);
+    qInfo("%d steps kept", history->undoCount());
+    QVERIFY(history->bytes() <= Capacity);
+    QVERIFY(history->undoCount() < LargeEdits);
+    QVERIFY(document.undo());
+    QVERIFY(document.source()->cellText(qint64(LargeEdits - 1) * 100, 2) != large);
+}
+
+// Shrinking a history with steps to redo has to forget those steps, not
+// the oldest ones they build on.
+void tst_Editing::shrinkWithRedo()
+{
+    const int PendingEdits = 16;
+    const int PendingUndos = 4;
+    const qint64 Capacity = EditHistory::BlockSize * 2;
+
+    Document &document = *m_document;
+    EditHistory *history = document.history();
+    const QString wide(EditHistory::BlockSize / 4, QLatin1Char('y'));
+    QVector<QString> before;
+    for (int i = 0; i < PendingEdits; ++i) {
+        before.append(document.source()->cellText(qint64(i) * 10, 2));
+        document.setCellText(qint64(i) * 10, 2, wide);
+    }
+    for (int i = 0; i < PendingUndos; ++i)
+        document.undo();
+    history->setCapacity(Capacity);
+
+    QVERIFY(!history->canRedo());
+    QVERIFY(!document.redo());
+    QVERIFY(history->bytes() <= Capacity);
+    QVERIFY(history->undoCount() > 0);
+    for (int i = 0; i < PendingEdits; ++i) {
+        const QString expected = i < PendingEdits - PendingUndos ? wide : before.at(i);
+        QCOMPARE(document.source()->cellText(qint64(i) * 10, 2), expected);
+    }
+}
+
+// The first edit of in-memory columns takes them out of use, and says so,
+// so results computed on them can be dropped.
+void tst_Editing::editColumnStore()
+{
+    Document document;
+    document.setSource(ColumnStore::build(SyntheticSource(1000)), QStringLiteral("columns"));
+    QVERIFY(document.columnStore());
+    QSignalSpy changed(&document, &Document::columnStoreChanged);
+
+    QVERIFY(document.setCellText(0, Column, QStringLiteral("edited")));
+    QCOMPARE(changed.count(), 1);
+    QVERIFY(!document.columnStore());
+    QVERIFY(document.setCellText(1, Column, QStringLiteral("edited")));
+    QCOMPARE(changed.count(), 1);
+}
+
+QTEST_GUILESS_MAIN(tst_Editing)
+
+#include "tst_editing.moc"
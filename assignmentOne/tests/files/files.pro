@@ -0,0 +1,6 @@
+TARGET = tst_files
+
+include(../tests.pri)
+
+SOURCES += \
+    tst_files.cpp
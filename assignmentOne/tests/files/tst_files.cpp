@@ -0,0 +1,240 @@
+#include "columncache.h"
+#include "columnstore.h"
+#include "csvsource.h"
+#include "document.h"
+#include "documentcache.h"
+#include "mappedtextfile.h"
+#include "memorytracker.h"
+#include "streamsource.h"
+#include "syntheticsource.h"
+#include "testsupport.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QRandomGenerator>
+#include <QTemporaryDir>
+#include <QtTest>
+
+#include <cstring>
+
+// Opening, following, caching and sharing data files.
+class tst_Files : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void load();
+    void follow();
+    void cache();
+    void damagedCache();
+    void numbersReadBack();
+    void sharing();
+
+private:
+    static const qint64 Rows = 2000000;
+
+    QTemporaryDir m_dir;
+    QString m_csvFileName;
+};
+
+void tst_Files::initTestCase()
+{
+    QVERIFY(m_dir.isValid());
+    m_csvFileName = m_dir.filePath(QStringLiteral("rows.csv"));
+    QVERIFY(writeSyntheticCsv(m_csvFileName, Rows));
+}
+
+void tst_Files::load()
+{
+    QBENCHMARK {
+        MappedTextFile file;
+        QVERIFY(file.open(m_csvFileName));
+        QVERIFY(file.size() > 0);
+    }
+}
+
+// Follows a 2M-row file while another 200 batches of 1000 lines are
+// appended, the last line of each batch split across two writes. Each
+// catch-up read has to cost far less than the full reopen it replaces.
+void tst_Files::follow()
+{
+    const int Batches = 200;
+    const int BatchLines = 1000;
+
+    const QString fileName = m_dir.filePath(QStringLiteral("follow.csv"));
+    QVERIFY(QFile::copy(m_csvFileName, fileName));
+    QElapsedTimer timer;
+    timer.start();
+    QSharedPointer<MappedTextFile> file(new MappedTextFile);
+    QVERIFY(file->open(fileName));
+    const double reopenMs = timer.nsecsElapsed() / 1e6;
+
+    QFile writer(fileName);
+    QVERIFY(writer.open(QIODevice::WriteOnly | QIODevice::Append));
+    const qint64 firstLine = file->lineCount();
+    qint64 written = 0;
+    Timings reads;
+    for (int b = 0; b < Batches; ++b) {
+        QByteArray batch;
+        for (int i = 0; i < BatchLines; ++i)
+            batch += QByteArray::number(written++) + ",appended,line\n";
+        // Ends mid-line; the rest of that line arrives with the next batch.
+        const int split = batch.size() - 4;
+        writer.write(batch.constData(), split);
+        writer.flush();
+        timer.restart();
+        const qint64 added = file->readAppended();
+        reads.add(timer.nsecsElapsed());
+        writer.write(batch.constData() + split, batch.size() - split);
+        writer.flush();
+        QCOMPARE(added, qint64(BatchLines - 1));
+        QCOMPARE(file->readAppended(), qint64(1));
+    }
+
+    QRandomGenerator rng(13);
+    for (int i = 0; i < 1000; ++i) {
+        const qint64 n = rng.bounded(int(written));
+        qint64 length = 0;
+        const char *line = file->line(firstLine + n, &length);
+        QCOMPARE(QByteArray(line, int(length)), QByteArray::number(n) + ",appended,line");
+    }
+    QCOMPARE(file->lineCount(), firstLine + written);
+
+    qInfo("reopen %.3f ms; read_appended %s", reopenMs, qPrintable(reads.summary()));
+    const double p99 = reads.quantile(0.99);
+    QTest::setBenchmarkResult(p99, QTest::WalltimeMilliseconds);
+    QVERIFY2(p99 * 10 < reopenMs, "a catch-up read costs more than a tenth of a reopen");
+}
+
+// Reopening the parsed file: parsing the text into columns versus loading
+// the columns back from the binary cache. Both have to show every cell
+// exactly as the file has it.
+void tst_Files::cache()
+{
+    const int Checks = 1000;
+
+    const QString cacheFile = m_dir.filePath(QStringLiteral("rows.cols"));
+    QElapsedTimer timer;
+    timer.start();
+    QSharedPointer<MappedTextFile> file(new MappedTextFile);
+    QVERIFY(file->open(m_csvFileName));
+    const QSharedPointer<ColumnStore> parsed = ColumnStore::build(CsvSource(file));
+    const double parseMs = timer.nsecsElapsed() / 1e6;
+
+    QString errorString;
+    QVERIFY2(ColumnCache::save(*parsed, m_csvFileName, cacheFile, &errorString), qPrintable(errorString));
+
+    timer.restart();
+    const QSharedPointer<ColumnStore> loaded = ColumnCache::load(m_csvFileName, cacheFile, &errorString);
+    const double loadMs = timer.nsecsElapsed() / 1e6;
+    QVERIFY2(loaded, qPrintable(errorString));
+    qInfo("parse %.3f ms, load %.3f ms; text %.1f MB, cache %.1f MB", parseMs, loadMs, file->size() / 1e6,
+          QFileInfo(cacheFile).size() / 1e6);
+
+    QCOMPARE(loaded->rowCount(), parsed->rowCount());
+    QCOMPARE(loaded->columnCount(), parsed->columnCount());
+    const CsvSource text(file);
+    QRandomGenerator rng(11);
+    for (int i = 0; i < Checks; ++i) {
+        const qint64 row = rng.bounded(int(Rows));
+        for (int c = 0; c < parsed->columnCount(); ++c) {
+            QCOMPARE(loaded->cellText(row, c), parsed->cellText(row, c));
+            QCOMPARE(parsed->cellText(row, c), text.cellText(row, c));
+        }
+    }
+    QTest::setBenchmarkResult(loadMs, QTest::WalltimeMilliseconds);
+    QVERIFY2(loadMs < parseMs, "loading the cache is not faster than parsing the text");
+}
+
+// A damaged header or a truncated file has to be reported and removed,
+// not sized into arrays.
+void tst_Files::damagedCache()
+{
+    const QString cacheFile = m_dir.filePath(QStringLiteral("small.cols"));
+    const QString csvFile = m_dir.filePath(QStringLiteral("small.csv"));
+    QVERIFY(writeSyntheticCsv(csvFile, 100000));
+    QSharedPointer<MappedTextFile> file(new MappedTextFile);
+    QVERIFY(file->open(csvFile));
+    QVERIFY(ColumnCache::save(*ColumnStore::build(CsvSource(file)), csvFile, cacheFile));
+
+    QFile cache(cacheFile);
+    QVERIFY(cache.open(QIODevice::ReadOnly));
+    const QByteArray head = cache.read(4096);
+    cache.close();
+    QByteArray huge = head;
+    const qint64 hugeRows = qint64(1) << 60;
+    QVERIFY(huge.size() >= 24);
+    std::memcpy(huge.data() + 16, &hugeRows, sizeof(hugeRows));
+    for (const QByteArray &bytes : { huge, head }) {
+        const QString damagedFile = m_dir.filePath(QStringLiteral("damaged.cols"));
+        QFile damaged(damagedFile);
+        QVERIFY(damaged.open(QIODevice::WriteOnly));
+        QCOMPARE(damaged.write(bytes), qint64(bytes.size()));
+        damaged.close();
+        QString reason;
+        QVERIFY(!ColumnCache::load(csvFile, damagedFile, &reason));
+        QVERIFY(!QFile::exists(damagedFile));
+    }
+}
+
+// Numbers that would not read back as written stay text.
+void tst_Files::numbersReadBack()
+{
+    static const char *const Texts[] = { "1", "00123", "+5", "1.50", "1e3", "0.25", "-7" };
+    StreamSource odd(QStringList() << QStringLiteral("Text"));
+    for (const char *text : Texts)
+        odd.append(QByteArray(text));
+    const QSharedPointer<ColumnStore> store = ColumnStore::build(odd);
+    for (int i = 0; i < int(sizeof(Texts) / sizeof(Texts[0])); ++i)
+        QCOMPARE(store->cellText(i, 0), QString::fromLatin1(Texts[i]));
+}
+
+// Opens the file a second time through the document cache, which has to
+// hand out the same source without indexing the file again. Then forks a
+// document holding 100k edits: the copy shares them, and its first edit
+// copies one chunk, not the edits made before.
+void tst_Files::sharing()
+{
+    const qint64 SharedRows = 1000000;
+    const int Edits = 100000;
+
+    const QString fileName = m_dir.filePath(QStringLiteral("sharing.csv"));
+    QVERIFY(writeSyntheticCsv(fileName, SharedRows));
+    QSharedPointer<MappedTextFile> file(new MappedTextFile);
+    QVERIFY(file->open(fileName));
+    const QSharedPointer<DataSource> source(new CsvSource(file));
+    DocumentCache::insert(fileName, source);
+
+    const qint64 indexBytes = MemoryTracker::usage(MemoryTracker::LineIndex).live;
+    const QSharedPointer<DataSource> shared = DocumentCache::find(fileName);
+    QVERIFY(shared == source);
+    QCOMPARE(MemoryTracker::usage(MemoryTracker::LineIndex).live, indexBytes);
+
+    Document first;
+    first.setSource(shared, QStringLiteral("sharing.csv"), fileName);
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < Edits; ++i)
+        first.setCellText(qint64(i) * (SharedRows / Edits), 1, QString::number(i));
+    const double editsMs = timer.nsecsElapsed() / 1e6;
+
+    Document second;
+    second.assign(first);
+    timer.restart();
+    second.setCellText(0, 1, QStringLiteral("changed"));
+    const double forkEditMs = timer.nsecsElapsed() / 1e6;
+    qInfo("%d edits %.3f ms, first edit after the fork %.3f ms", Edits, editsMs, forkEditMs);
+
+    const qint64 lastEdited = qint64(Edits - 1) * (SharedRows / Edits);
+    QCOMPARE(first.source()->cellText(0, 1), QStringLiteral("0"));
+    QCOMPARE(second.source()->cellText(0, 1), QStringLiteral("changed"));
+    QCOMPARE(second.source()->cellText(lastEdited, 1), QString::number(Edits - 1));
+    QVERIFY(first.originalSource() == second.originalSource());
+    QTest::setBenchmarkResult(forkEditMs, QTest::WalltimeMilliseconds);
+    QVERIFY2(forkEditMs < editsMs / 10, "the first edit after a fork copied more than one chunk");
+}
+
+QTEST_GUILESS_MAIN(tst_Files)
+
+#include "tst_files.moc"
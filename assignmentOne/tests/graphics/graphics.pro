@@ -0,0 +1,6 @@
+TARGET = tst_graphics
+
+include(../tests.pri)
+
+SOURCES += \
+    tst_graphics.cpp
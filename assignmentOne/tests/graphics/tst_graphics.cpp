@@ -0,0 +1,281 @@
+#include "imagepyramid.h"
+#include "imageviewer.h"
+#include "minmaxpyramid.h"
+#include "plotwidget.h"
+#include "taskengine.h"
+#include "testsupport.h"
+#include "thumbnailmodel.h"
+#include "thumbnailview.h"
+
+#include <QApplication>
+#include <QBuffer>
+#include <QEventLoop>
+#include <QFile>
+#include <QImage>
+#include <QRandomGenerator>
+#include <QScrollBar>
+#include <QTemporaryDir>
+#include <QtTest>
+
+// Plots, large images and thumbnails: frames have to stay cheap while
+// tiles are rendered and decoded elsewhere.
+class tst_Graphics : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void plot();
+    void imageFromStrips();
+    void image();
+    void thumbnails();
+
+private:
+    static const int ImageSize = 8192;
+
+    static QImage testImage();
+};
+
+QImage tst_Graphics::testImage()
+{
+    QImage image(ImageSize, ImageSize, QImage::Format_RGB32);
+    uchar *bits = image.bits();
+    const qsizetype stride = image.bytesPerLine();
+    TaskEngine::parallelFor(ImageSize, 64, [bits, stride](qint64 begin, qint64 end) {
+        for (qint64 y = begin; y < end; ++y) {
+            quint32 *line = reinterpret_cast<quint32 *>(bits + y * stride);
+            for (int x = 0; x < ImageSize; ++x)
+                line[x] = 0xff000000u | quint32((x ^ int(y)) & 0xff) << 16 | quint32(x >> 5) << 8 | quint32(y >> 5);
+        }
+    });
+    return image;
+}
+
+// 100M-sample signal: frame time at zoom levels from the whole signal
+// down to raw samples.
+void tst_Graphics::plot()
+{
+    const qint64 Samples = 100000000;
+    const double FrameBudgetMs = 8.0;
+    const int FramesPerZoom = 50;
+
+    const QSharedPointer<const SampleVector> samples = PlotWidget::generateTestSignal(Samples);
+    QElapsedTimer timer;
+    timer.start();
+    MinMaxPyramid pyramid;
+    pyramid.build(samples);
+    const double buildMs = timer.nsecsElapsed() / 1e6;
+
+    TaskEngine engine;
+    PlotWidget plot(&engine);
+    plot.resize(1600, 500);
+    plot.show();
+    QEventLoop loop;
+    const QMetaObject::Connection ready = connect(&plot, &PlotWidget::ready, &loop, &QEventLoop::quit);
+    plot.setSamples(samples, QStringLiteral("test"));
+    if (!plot.isReady())
+        loop.exec();
+    disconnect(ready);
+
+    // Each zoom level starts over with fresh tiles rendered by the pool;
+    // the pans that follow must only blit tiles on the GUI thread.
+    Timings tiles;
+    Timings frames;
+    QRandomGenerator rng(7);
+    connect(&plot, &PlotWidget::tilesReady, &loop, &QEventLoop::quit);
+    for (double span = double(Samples); span >= 400; span /= 10) {
+        double begin = rng.bounded(1.0) * (Samples - span);
+        timer.restart();
+        plot.setView(begin, span);
+        plot.repaint();
+        if (!plot.isComplete())
+            loop.exec();
+        tiles.add(timer.nsecsElapsed());
+
+        for (int i = 0; i < FramesPerZoom; ++i) {
+            begin += span * (rng.bounded(0.02) - 0.01);
+            plot.setView(begin, span);
+            timer.restart();
+            plot.repaint();
+            frames.add(timer.nsecsElapsed());
+        }
+    }
+    qInfo("pyramid build %.3f ms; tiles ready %s; frame %s", buildMs, qPrintable(tiles.summary()),
+          qPrintable(frames.summary()));
+    const double p99 = frames.quantile(0.99);
+    QTest::setBenchmarkResult(p99, QTest::WalltimeMilliseconds);
+    QVERIFY2(p99 < FrameBudgetMs, "p99 frame over budget");
+}
+
+// From a file whose format decodes clips, the image is read in strips.
+void tst_Graphics::imageFromStrips()
+{
+    const QImage image = testImage();
+    QTemporaryDir dir;
+    const QString jpegFile = dir.filePath(QStringLiteral("image.jpg"));
+    if (!image.save(jpegFile, "JPEG", 90))
+        QSKIP("no JPEG encoder");
+
+    const QString pyramidFile = dir.filePath(QStringLiteral("strips.tiles"));
+    QString errorString;
+    QElapsedTimer timer;
+    timer.start();
+    QVERIFY2(ImagePyramid::build(jpegFile, pyramidFile, &errorString), qPrintable(errorString));
+    QTest::setBenchmarkResult(timer.nsecsElapsed() / 1e6, QTest::WalltimeMilliseconds);
+
+    const QSharedPointer<ImagePyramid> strips = ImagePyramid::open(jpegFile, pyramidFile, &errorString);
+    QVERIFY2(strips, qPrintable(errorString));
+    QCOMPARE(strips->imageSize(), image.size());
+    QVERIFY(!strips->tile(strips->levelCount() - 1, 0, 0).isNull());
+    QVERIFY(!strips->tile(0, strips->columnCount(0) - 1, strips->rowCount(0) - 1).isNull());
+}
+
+// A generated 8192 x 8192 image: tiling it, decoding tiles under a small
+// cache budget, then zooming and panning the viewer in 64-pixel steps.
+// Frames must stay cheap and the cache within its budget.
+void tst_Graphics::image()
+{
+    const qint64 Budget = qint64(64) << 20;
+    const double FrameBudgetMs = 8.0;
+    const int Steps = 100;
+
+    QTemporaryDir dir;
+    // The pyramid is tied to a source file; this one only has to exist.
+    const QString sourceFile = dir.filePath(QStringLiteral("image.src"));
+    const QString pyramidFile = dir.filePath(QStringLiteral("image.tiles"));
+    QFile source(sourceFile);
+    QVERIFY(source.open(QIODevice::WriteOnly));
+    QCOMPARE(source.write("image", 5), qint64(5));
+    source.close();
+
+    QString errorString;
+    QVERIFY2(ImagePyramid::build(testImage(), sourceFile, pyramidFile, &errorString), qPrintable(errorString));
+    const QSharedPointer<ImagePyramid> pyramid = ImagePyramid::open(sourceFile, pyramidFile, &errorString);
+    QVERIFY2(pyramid, qPrintable(errorString));
+
+    // More tiles than the budget holds, each decoded once.
+    pyramid->setCacheBudget(Budget);
+    const int columns = pyramid->columnCount(0);
+    for (int i = 0; i < 2 * Budget / (ImagePyramid::TileSize * ImagePyramid::TileSize * 4); ++i)
+        QVERIFY(!pyramid->tile(0, i % columns, i / columns).isNull());
+    QVERIFY(pyramid->cachedBytes() <= Budget);
+
+    TaskEngine engine;
+    ImageViewer viewer(&engine);
+    viewer.setCacheBudget(Budget);
+    viewer.resize(1600, 900);
+    viewer.show();
+    viewer.setPyramid(pyramid, QStringLiteral("test"));
+    QEventLoop loop;
+    connect(&viewer, &ImageViewer::tilesReady, &loop, &QEventLoop::quit);
+
+    Timings frames;
+    int ready = 0;
+    int panned = 0;
+    QElapsedTimer timer;
+    for (double scale = viewer.scale(); scale <= 4.0; scale *= 4) {
+        QPointF topLeft(ImageSize / 4.0, ImageSize / 4.0);
+        viewer.setView(topLeft, scale);
+        viewer.repaint();
+        if (!viewer.isComplete())
+            loop.exec();
+
+        for (int i = 0; i < Steps; ++i) {
+            topLeft += QPointF(64 / scale, 16 / scale);
+            viewer.setView(topLeft, scale);
+            timer.start();
+            viewer.repaint();
+            frames.add(timer.nsecsElapsed());
+            ++panned;
+            if (viewer.isComplete())
+                ++ready;
+            else
+                loop.exec();
+        }
+    }
+    qInfo("frame %s; %.1f%% ready after a pan, %.1f MB cached", qPrintable(frames.summary()),
+          100.0 * ready / qMax(1, panned), pyramid->cachedBytes() / 1e6);
+    const double p99 = frames.quantile(0.99);
+    QTest::setBenchmarkResult(p99, QTest::WalltimeMilliseconds);
+    QVERIFY(pyramid->cachedBytes() <= Budget);
+    QVERIFY2(p99 < FrameBudgetMs, "p99 frame over budget");
+}
+
+// A folder of 20k photos (one 640x480 JPEG written under many names),
+// scrolled a page per frame from top to bottom while thumbnails arrive.
+// Frames only lay out and paint; queued work must stay near the view and
+// the cache within its budget.
+void tst_Graphics::thumbnails()
+{
+    const int Files = 20000;
+    const qint64 Budget = qint64(32) << 20;
+    const double FrameBudgetMs = 16.0;
+
+    QImage photo(640, 480, QImage::Format_RGB32);
+    for (int y = 0; y < photo.height(); ++y) {
+        quint32 *line = reinterpret_cast<quint32 *>(photo.scanLine(y));
+        for (int x = 0; x < photo.width(); ++x)
+            line[x] = 0xff000000u | quint32(x * 255 / 640) << 16 | quint32(y * 255 / 480) << 8 | quint32((x ^ y) & 0xff);
+    }
+    QByteArray encoded;
+    QBuffer buffer(&encoded);
+    buffer.open(QIODevice::WriteOnly);
+    if (!photo.save(&buffer, "JPG", 85))
+        QSKIP("no JPEG encoder");
+    QTemporaryDir dir;
+    for (int i = 0; i < Files; ++i) {
+        QFile file(dir.filePath(QStringLiteral("photo%1.jpg").arg(i, 5, 10, QLatin1Char('0'))));
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        QCOMPARE(file.write(encoded), qint64(encoded.size()));
+    }
+
+    ThumbnailModel model;
+    ThumbnailView view;
+    model.setCacheBudget(Budget);
+    view.setThumbnailModel(&model);
+    view.resize(1200, 800);
+    view.show();
+
+    QEventLoop loop;
+    const QMetaObject::Connection listed = connect(&model, &ThumbnailModel::directoryLoaded,
+                                                   &loop, &QEventLoop::quit);
+    model.setDirectory(dir.path());
+    loop.exec();
+    disconnect(listed);
+    QCOMPARE(model.rowCount(), Files);
+
+    connect(&model, &ThumbnailModel::thumbnailsReady, &loop, &QEventLoop::quit);
+    view.viewport()->repaint();
+    if (model.pendingCount() > 0)
+        loop.exec();
+
+    // Cells on screen, for judging how much work piles up.
+    const QSize cell = view.gridSize();
+    const int screen = qMax(1, view.viewport()->width() / cell.width())
+            * (view.viewport()->height() / cell.height() + 2);
+    QScrollBar *scrollBar = view.verticalScrollBar();
+    Timings frames;
+    int maxPending = 0;
+    QElapsedTimer timer;
+    for (int value = 0; value <= scrollBar->maximum(); value += scrollBar->pageStep()) {
+        timer.start();
+        scrollBar->setValue(value);
+        QCoreApplication::processEvents();
+        view.viewport()->repaint();
+        frames.add(timer.nsecsElapsed());
+        maxPending = qMax(maxPending, model.pendingCount());
+    }
+    if (model.pendingCount() > 0)
+        loop.exec();
+
+    qInfo("scroll frame %s; at most %d queued, %.1f MB cached", qPrintable(frames.summary()), maxPending,
+          model.cachedBytes() / 1e6);
+    const double p99 = frames.quantile(0.99);
+    QTest::setBenchmarkResult(p99, QTest::WalltimeMilliseconds);
+    QVERIFY(maxPending <= 4 * screen);
+    QVERIFY(model.cachedBytes() <= Budget);
+    QVERIFY2(p99 < FrameBudgetMs, "p99 scroll frame over budget");
+}
+
+OFFSCREEN_TEST_MAIN(tst_Graphics)
+
+#include "tst_graphics.moc"
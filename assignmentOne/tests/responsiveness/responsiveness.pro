@@ -0,0 +1,6 @@
+TARGET = tst_responsiveness
+
+include(../tests.pri)
+
+SOURCES += \
+    tst_responsiveness.cpp
@@ -0,0 +1,198 @@
+#include "datatableview.h"
+#include "document.h"
+#include "eventprofiler.h"
+#include "ingest.h"
+#include "lazytablemodel.h"
+#include "modelupdatescheduler.h"
+#include "sortfilterproxy.h"
+#include "streamsource.h"
+#include "syntheticsource.h"
+#include "taskengine.h"
+#include "testsupport.h"
+
+#include <QApplication>
+#include <QEventLoop>
+#include <QRandomGenerator>
+#include <QThread>
+#include <QtTest>
+
+#include <atomic>
+
+// The GUI thread has to keep turning its event loop within a frame while
+// work runs on other threads or data pours in.
+class tst_Responsiveness : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void parallelJob();
+    void ingest();
+    void updates();
+
+private:
+    static constexpr double FrameBudgetMs = 16.0;
+};
+
+// Runs a CPU-bound job on every core.
+void tst_Responsiveness::parallelJob()
+{
+    const qint64 Work = qint64(1) << 31;
+
+    TaskEngine engine;
+    std::atomic<quint64> sink { 0 };
+    Task *task = engine.start(QStringLiteral("cpu"), Task::NormalPriority, [&sink](TaskContext &context) {
+        context.setProgressRange(Work);
+        TaskEngine::parallelFor(Work, 1 << 20, [&sink, &context](qint64 begin, qint64 end) {
+            quint64 x = quint64(begin);
+            for (qint64 i = begin; i < end; ++i)
+                x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+            sink.fetch_xor(x, std::memory_order_relaxed);
+            context.addProgress(end - begin);
+        }, &context);
+    });
+
+    QEventLoop loop;
+    connect(task, &Task::finished, &loop, &QEventLoop::quit);
+    LoopIterations iterations;
+    iterations.start();
+    loop.exec();
+    iterations.stop();
+
+    qInfo("event loop %s", qPrintable(iterations.timings().summary()));
+    const double p99 = iterations.timings().quantile(0.99);
+    QTest::setBenchmarkResult(p99, QTest::WalltimeMilliseconds);
+    QVERIFY2(p99 < FrameBudgetMs, "p99 event loop iteration over a frame");
+}
+
+// Stand-in producer on a second thread streaming as fast as it can into a
+// visible table: every record has to arrive.
+void tst_Responsiveness::ingest()
+{
+    const qint64 Records = 2000000;
+
+    const QString serverName = QStringLiteral("post-narnia-test-%1").arg(QCoreApplication::applicationPid());
+    QString producerError;
+    QScopedPointer<QThread> producer(QThread::create([&serverName, &producerError] {
+        runIngestProducer(serverName, Records, 0, &producerError);
+    }));
+    producer->start();
+
+    LazyTableModel model;
+    DataTableView view;
+    view.setModel(&model);
+    view.resize(1200, 800);
+    view.show();
+
+    IngestClient client;
+    connect(&client, &IngestClient::sourceReady, &model, [&model](const QSharedPointer<StreamSource> &source) {
+        model.setSource(source);
+    });
+    connect(&client, &IngestClient::rowsAppended, &model, &LazyTableModel::sourceRowsAppended);
+
+    QEventLoop loop;
+    QElapsedTimer elapsed;
+    const auto checkDone = [&client, &loop] {
+        const IngestClient::Stats stats = client.stats();
+        if (!client.isRunning() && stats.delivered + stats.dropped >= stats.received)
+            loop.quit();
+    };
+    connect(&client, &IngestClient::rowsAppended, &loop, checkDone);
+    connect(&client, &IngestClient::finished, &loop, checkDone);
+    connect(&client, &IngestClient::sourceReady, &loop, [&elapsed] { elapsed.start(); });
+    connect(producer.data(), &QThread::finished, &loop, [&producerError, &loop] {
+        if (!producerError.isEmpty())
+            loop.quit();
+    });
+
+    LoopIterations iterations;
+    client.connectToProducer(serverName);
+    iterations.start();
+    loop.exec();
+    iterations.stop();
+    const double seconds = qMax<qint64>(elapsed.nsecsElapsed(), 1) / 1e9;
+    producer->wait();
+
+    QVERIFY2(producerError.isEmpty(), qPrintable(producerError));
+    const IngestClient::Stats stats = client.stats();
+    qInfo("%.0f records/s, %lld dropped, %lld back pressure events; event loop %s", stats.delivered / seconds,
+          qint64(stats.dropped), qint64(stats.backPressureEvents), qPrintable(iterations.timings().summary()));
+    QTest::setBenchmarkResult(stats.delivered / seconds, QTest::Events);
+    QCOMPARE(qint64(stats.delivered), Records);
+    QVERIFY2(iterations.timings().quantile(0.99) < FrameBudgetMs, "p99 event loop iteration over a frame");
+}
+
+// Edits a shown 1M-row table at 1M cells per second for a few seconds,
+// mostly in the visible rows and some anywhere. The scheduler has to turn
+// them into a few signals per frame, so the event loop and the paints
+// stay within a frame while every update is applied.
+void tst_Responsiveness::updates()
+{
+    const qint64 Rows = 1000000;
+    const double UpdatesPerSecond = 1e6;
+    const int DurationMs = 3000;
+    const int VisibleRows = 40;
+
+    TaskEngine engine;
+    Document document;
+    LazyTableModel model;
+    SortFilterProxy proxy(&engine);
+    proxy.setSourceModel(&model);
+    DataTableView view;
+    view.setModel(&proxy);
+    view.resize(1200, 800);
+    view.show();
+    document.setSource(QSharedPointer<DataSource>(new SyntheticSource(Rows)), QStringLiteral("updates"));
+    model.setSource(document.source());
+    QCoreApplication::processEvents();
+
+    ModelUpdateScheduler scheduler;
+    connect(&document, &Document::cellsChanged, &scheduler, &ModelUpdateScheduler::cellsChanged);
+    connect(&scheduler, &ModelUpdateScheduler::cellsUpdated, &model,
+            [&document, &model](qint64 firstRow, qint64 lastRow, int firstColumn, int lastColumn) {
+        model.sourceCellsChanged(document.source(), int(firstRow), int(lastRow), firstColumn, lastColumn);
+    });
+
+    // Applies whatever the rate asks for since the last tick.
+    const int columns = model.columnCount();
+    QRandomGenerator rng(17);
+    qint64 applied = 0;
+    QElapsedTimer elapsed;
+    QTimer producer;
+    producer.setTimerType(Qt::PreciseTimer);
+    connect(&producer, &QTimer::timeout, this, [&] {
+        const qint64 due = qint64(elapsed.nsecsElapsed() / 1e9 * UpdatesPerSecond);
+        for (; applied < due; ++applied) {
+            const qint64 row = applied % 10 == 0 ? rng.bounded(int(Rows)) : rng.bounded(VisibleRows);
+            document.setCellText(row, rng.bounded(columns), QString::number(applied));
+        }
+    });
+
+    QEventLoop loop;
+    LoopIterations iterations;
+    QTimer::singleShot(DurationMs, &loop, &QEventLoop::quit);
+    const EventProfiler::Snapshot before = EventProfiler::snapshot();
+    elapsed.start();
+    producer.start(1);
+    iterations.start();
+    loop.exec();
+    producer.stop();
+    iterations.stop();
+    scheduler.flush();
+    const double seconds = elapsed.nsecsElapsed() / 1e9;
+    const LatencyStats paint = EventProfiler::snapshot().categories[EventProfiler::Paint]
+            - before.categories[EventProfiler::Paint];
+
+    const ModelUpdateScheduler::Stats stats = scheduler.stats();
+    qInfo("%.0f updates/s, %lld signals (%lld saved), %.1f flushes/s, %.1f frames/s, frame p99 %.3f ms; "
+          "event loop %s", applied / seconds, qint64(stats.emitted), qint64(stats.saved()), stats.flushes / seconds,
+          paint.count() / seconds, paint.quantileMs(0.99), qPrintable(iterations.timings().summary()));
+    QTest::setBenchmarkResult(applied / seconds, QTest::Events);
+    QVERIFY2(applied >= qint64(UpdatesPerSecond * DurationMs / 1000 * 0.9), "update rate not sustained");
+    QCOMPARE(qint64(stats.received), applied);
+    QVERIFY2(iterations.timings().quantile(0.99) < FrameBudgetMs, "p99 event loop iteration over a frame");
+    QVERIFY2(paint.quantileMs(0.99) < FrameBudgetMs, "p99 frame paint over the frame budget");
+}
+
+OFFSCREEN_TEST_MAIN(tst_Responsiveness)
+
+#include "tst_responsiveness.moc"
@@ -0,0 +1,6 @@
+TARGET = tst_search
+
+include(../tests.pri)
+
+SOURCES += \
+    tst_search.cpp
@@ -0,0 +1,462 @@
+#include "columnstore.h"
+#include "commandindex.h"
+#include "csvsource.h"
+#include "lazytablemodel.h"
+#include "mappedtextfile.h"
+#include "rowsearch.h"
+#include "sortfilterproxy.h"
+#include "streamsource.h"
+#include "syntheticsource.h"
+#include "taskengine.h"
+#include "testsupport.h"
+
+#include <QApplication>
+#include <QEventLoop>
+#include <QRandomGenerator>
+#include <QTemporaryDir>
+#include <QtTest>
+
+#include <algorithm>
+
+// Finding rows, sorting and filtering them, and the command palette index.
+class tst_Search : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void search_data();
+    void search();
+    void foldedLetters();
+    void sortFilter_data();
+    void sortFilter();
+    void columnStore_data();
+    void columnStore();
+    void textSort_data();
+    void textSort();
+    void cancelSort();
+    void appendToSorted();
+    void palette();
+
+private:
+    static const qint64 SearchRows = 4000000;
+    static const qint64 SortRows = 5000000;
+
+    QTemporaryDir m_dir;
+    QSharedPointer<MappedTextFile> m_file;
+};
+
+void tst_Search::initTestCase()
+{
+    QVERIFY(m_dir.isValid());
+    const QString fileName = m_dir.filePath(QStringLiteral("search.csv"));
+    QVERIFY(writeSyntheticCsv(fileName, SearchRows));
+    m_file.reset(new MappedTextFile);
+    QVERIFY(m_file->open(fileName));
+}
+
+void tst_Search::search_data()
+{
+    QTest::addColumn<QString>("text");
+    QTest::addColumn<bool>("regularExpression");
+    QTest::addColumn<double>("firstHitBudgetMs");
+    QTest::newRow("frequent") << QStringLiteral("fault") << false << 50.0;
+    QTest::newRow("rare") << QStringLiteral("3999999") << false << 0.0;
+    QTest::newRow("regex") << QStringLiteral("^sensor-0[0-3]$") << true << 0.0;
+}
+
+// Searches the mapped CSV file: time to the first hit and to the end of
+// the scan. A frequent literal has to show its first hit within a frame
+// or so.
+void tst_Search::search()
+{
+    QFETCH(QString, text);
+    QFETCH(bool, regularExpression);
+    QFETCH(double, firstHitBudgetMs);
+
+    const QSharedPointer<DataSource> source(new CsvSource(m_file));
+    TaskEngine engine;
+    RowSearch search(&engine);
+    SearchQuery query;
+    query.text = text;
+    query.regularExpression = regularExpression;
+
+    QEventLoop loop;
+    QElapsedTimer timer;
+    double firstHitMs = -1;
+    connect(&search, &RowSearch::matchesChanged, this, [&] {
+        if (firstHitMs < 0 && search.matchCount() > 0)
+            firstHitMs = timer.nsecsElapsed() / 1e6;
+    });
+    connect(&search, &RowSearch::finished, &loop, &QEventLoop::quit);
+    timer.start();
+    search.start(source, query);
+    if (search.isRunning())
+        loop.exec();
+    const double scanMs = timer.nsecsElapsed() / 1e6;
+
+    qInfo("%lld matches, first hit %.3f ms, scan %.3f ms, %.1f MB/s", search.matchCount(), firstHitMs, scanMs,
+          m_file->size() / 1e6 / (scanMs / 1e3));
+    QTest::setBenchmarkResult(scanMs, QTest::WalltimeMilliseconds);
+    QVERIFY(search.matchCount() > 0);
+    if (firstHitBudgetMs > 0)
+        QVERIFY2(firstHitMs >= 0 && firstHitMs < firstHitBudgetMs, "the first hit came too late");
+}
+
+// Ignoring case, k and s also match the Kelvin sign and the long s, which
+// the byte prefilter cannot fold.
+void tst_Search::foldedLetters()
+{
+    SearchQuery query;
+    query.text = QStringLiteral("Sensor-Kelvin");
+    QCOMPARE(RowSearch::requiredLiteral(query), QByteArray("elvin"));
+    query.caseSensitivity = Qt::CaseSensitive;
+    QCOMPARE(RowSearch::requiredLiteral(query), QByteArray("Sensor-Kelvin"));
+
+    const QString fileName = m_dir.filePath(QStringLiteral("folded.csv"));
+    QFile file(fileName);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write(QStringLiteral("Name\nKELVIN\n\u212Aelvin\n\u017Fensor\nother\n").toUtf8());
+    file.close();
+    const QSharedPointer<MappedTextFile> mapped(new MappedTextFile);
+    QVERIFY(mapped->open(fileName));
+    const QSharedPointer<DataSource> source(new CsvSource(mapped));
+
+    TaskEngine engine;
+    RowSearch search(&engine);
+    QSignalSpy finished(&search, &RowSearch::finished);
+    query.caseSensitivity = Qt::CaseInsensitive;
+    query.text = QStringLiteral("kelvin");
+    search.start(source, query);
+    QVERIFY(!finished.isEmpty() || finished.wait());
+    QCOMPARE(search.matchCount(), qint64(2));
+
+    finished.clear();
+    query.text = QStringLiteral("sensor");
+    search.start(source, query);
+    QVERIFY(!finished.isEmpty() || finished.wait());
+    QCOMPARE(search.matchCount(), qint64(1));
+}
+
+void tst_Search::sortFilter_data()
+{
+    QTest::addColumn<int>("sortColumn");
+    QTest::addColumn<Qt::SortOrder>("order");
+    QTest::addColumn<QString>("filter");
+    QTest::newRow("sort_numeric") << 3 << Qt::AscendingOrder << QString();
+    QTest::newRow("sort_numeric_descending") << 3 << Qt::DescendingOrder << QString();
+    QTest::newRow("sort_text") << 2 << Qt::AscendingOrder << QString();
+    QTest::newRow("filter_numeric") << -1 << Qt::AscendingOrder << QStringLiteral("Value > 500");
+    QTest::newRow("filter_text") << -1 << Qt::AscendingOrder << QStringLiteral("Status = FAULT");
+    QTest::newRow("filter_and_sort") << 3 << Qt::AscendingOrder << QStringLiteral("Value > 0 and Sensor ~ sensor-1");
+}
+
+// Sorting and filtering 5M generated rows through the table proxy.
+void tst_Search::sortFilter()
+{
+    QFETCH(int, sortColumn);
+    QFETCH(Qt::SortOrder, order);
+    QFETCH(QString, filter);
+
+    TaskEngine engine;
+    LazyTableModel model;
+    SortFilterProxy proxy(&engine);
+    proxy.setSourceModel(&model);
+    QEventLoop loop;
+    connect(&proxy, &SortFilterProxy::orderChanged, &loop, &QEventLoop::quit);
+    const auto wait = [&proxy, &loop] {
+        if (proxy.isBusy())
+            loop.exec();
+    };
+    model.setSource(QSharedPointer<DataSource>(new SyntheticSource(SortRows)));
+    wait();
+
+    QElapsedTimer timer;
+    timer.start();
+    QVERIFY(proxy.setFilter(filter));
+    wait();
+    proxy.sort(sortColumn, order);
+    wait();
+    QTest::setBenchmarkResult(timer.nsecsElapsed() / 1e6, QTest::WalltimeMilliseconds);
+    QVERIFY(proxy.rowCount() > 0);
+    QVERIFY(proxy.rowCount() <= SortRows);
+    if (filter.isEmpty())
+        QCOMPARE(proxy.rowCount(), int(SortRows));
+
+    if (sortColumn >= 0) {
+        bool ok = false;
+        const QModelIndex first = proxy.index(0, sortColumn);
+        const QModelIndex last = proxy.index(proxy.rowCount() - 1, sortColumn);
+        const QString a = first.data().toString();
+        const QString b = last.data().toString();
+        const double x = a.toDouble(&ok);
+        if (ok) {
+            const double y = b.toDouble();
+            QVERIFY(order == Qt::AscendingOrder ? x <= y : x >= y);
+        } else {
+            QVERIFY(order == Qt::AscendingOrder ? a <= b : a >= b);
+        }
+    }
+}
+
+// Merging 10K appended rows into a sorted 1M-row stream, against a full
+// resort of the same rows.
+void tst_Search::columnStore_data()
+{
+    QTest::addColumn<int>("sortColumn");
+    QTest::addColumn<QString>("filter");
+    QTest::addColumn<QString>("search");
+    QTest::addColumn<bool>("regularExpression");
+    QTest::newRow("integers") << 0 << QStringLiteral("Id >= 5000") << QStringLiteral("777") << false;
+    QTest::newRow("doubles") << 3 << QStringLiteral("Value < -500 and Status != OK")
+                             << QStringLiteral("^-99") << true;
+    QTest::newRow("text") << 2 << QStringLiteral("Sensor ~ sensor-1 and Status = ok")
+                          << QStringLiteral("Sensor-07") << false;
+    QTest::newRow("no numbers") << 4 << QStringLiteral("Status = FAULT") << QStringLiteral("fault") << false;
+}
+
+// Sorting, filtering and searching a ColumnStore reads its arrays; the
+// results are those of the source it was built from.
+void tst_Search::columnStore()
+{
+    QFETCH(int, sortColumn);
+    QFETCH(QString, filter);
+    QFETCH(QString, search);
+    QFETCH(bool, regularExpression);
+    const qint64 Rows = 100000;
+
+    const QSharedPointer<DataSource> synthetic(new SyntheticSource(Rows));
+    const QSharedPointer<DataSource> store = ColumnStore::build(*synthetic);
+    QVERIFY(store);
+
+    TaskEngine engine;
+    const auto order = [&engine, sortColumn, &filter](const QSharedPointer<DataSource> &source) {
+        LazyTableModel model;
+        SortFilterProxy proxy(&engine);
+        proxy.setSourceModel(&model);
+        model.setSource(source);
+        proxy.setFilter(filter);
+        proxy.sort(sortColumn, Qt::DescendingOrder);
+        std::vector<int> rows;
+        if (!QTest::qWaitFor([&proxy] { return !proxy.isBusy(); }, 30000))
+            return rows;
+        for (int row = 0; row < proxy.rowCount(); ++row)
+            rows.push_back(proxy.mapToSource(proxy.index(row, 0)).row());
+        return rows;
+    };
+    const std::vector<int> expected = order(synthetic);
+    QVERIFY(!expected.empty());
+    QVERIFY(order(store) == expected);
+
+    SearchQuery query;
+    query.text = search;
+    query.regularExpression = regularExpression;
+    const auto matches = [&engine, &query](const QSharedPointer<DataSource> &source) {
+        RowSearch rowSearch(&engine);
+        QSignalSpy finished(&rowSearch, &RowSearch::finished);
+        rowSearch.start(source, query);
+        std::vector<qint64> rows;
+        if (finished.isEmpty() && !finished.wait(30000))
+            return rows;
+        for (qint64 row = rowSearch.nextMatch(-1); row >= 0; row = rowSearch.nextMatch(row))
+            rows.push_back(row);
+        return rows;
+    };
+    const std::vector<qint64> found = matches(synthetic);
+    QVERIFY(!found.empty());
+    QVERIFY(matches(store) == found);
+}
+
+void tst_Search::textSort_data()
+{
+    QTest::addColumn<bool>("columnStore");
+    QTest::addColumn<Qt::SortOrder>("order");
+    QTest::newRow("stream ascending") << false << Qt::AscendingOrder;
+    QTest::newRow("stream descending") << false << Qt::DescendingOrder;
+    QTest::newRow("column store ascending") << true << Qt::AscendingOrder;
+    QTest::newRow("column store descending") << true << Qt::DescendingOrder;
+}
+
+// Texts sharing their first characters, and repeated ones, come out in
+// QString::compare() order with ties in source order.
+void tst_Search::textSort()
+{
+    QFETCH(bool, columnStore);
+    QFETCH(Qt::SortOrder, order);
+    const int Rows = 20000;
+
+    const QSharedPointer<StreamSource> stream(new StreamSource({ QStringLiteral("Name") }));
+    QStringList texts;
+    QRandomGenerator random(7);
+    for (int row = 0; row < Rows; ++row) {
+        const int n = random.bounded(300);
+        const QString text = n == 0 ? QString() : QStringLiteral("item%1").arg(n % 3 ? n : n * 1000);
+        texts.append(text);
+        stream->append(text.toUtf8());
+    }
+    QSharedPointer<DataSource> source = stream;
+    if (columnStore)
+        source = ColumnStore::build(*stream);
+    QVERIFY(source);
+
+    TaskEngine engine;
+    LazyTableModel model;
+    SortFilterProxy proxy(&engine);
+    proxy.setSourceModel(&model);
+    model.setSource(source);
+    proxy.sort(0, order);
+    QTRY_VERIFY(!proxy.isBusy());
+
+    std::vector<int> expected(size_t(Rows));
+    for (int row = 0; row < Rows; ++row)
+        expected[size_t(row)] = row;
+    std::stable_sort(expected.begin(), expected.end(), [&texts, order](int a, int b) {
+        const int c = texts.at(a).compare(texts.at(b));
+        return order == Qt::AscendingOrder ? c < 0 : c > 0;
+    });
+    QCOMPARE(proxy.rowCount(), Rows);
+    for (int row = 0; row < Rows; ++row)
+        QCOMPARE(proxy.mapToSource(proxy.index(row, 0)).row(), expected[size_t(row)]);
+}
+
+// A canceled sort leaves the rows, the sort and the header as they were.
+void tst_Search::cancelSort()
+{
+    TaskEngine engine;
+    LazyTableModel model;
+    SortFilterProxy proxy(&engine);
+    proxy.setSourceModel(&model);
+    model.setSource(QSharedPointer<DataSource>(new SyntheticSource(SortRows)));
+    QTRY_VERIFY(!proxy.isBusy());
+
+    QSignalSpy reverted(&proxy, &SortFilterProxy::sortReverted);
+    proxy.sort(3, Qt::DescendingOrder);
+    QVERIFY(proxy.isBusy());
+    QCOMPARE(proxy.sortColumn(), 3);
+    engine.cancelAll();
+    QVERIFY(reverted.wait());
+    QCOMPARE(reverted.first().at(0).toInt(), -1);
+    QCOMPARE(proxy.sortColumn(), -1);
+    QCOMPARE(proxy.sortOrder(), Qt::AscendingOrder);
+    QVERIFY(!proxy.isBusy());
+    QVERIFY(!proxy.isSorted());
+    QCOMPARE(proxy.rowCount(), int(SortRows));
+}
+
+void tst_Search::appendToSorted()
+{
+    const qint64 StreamRows = 1000000;
+    const qint64 AppendedRows = 10000;
+
+    TaskEngine engine;
+    LazyTableModel model;
+    SortFilterProxy proxy(&engine);
+    proxy.setSourceModel(&model);
+    proxy.setAppendDelay(0);
+    QEventLoop loop;
+    connect(&proxy, &SortFilterProxy::orderChanged, &loop, &QEventLoop::quit);
+    const auto wait = [&proxy, &loop] {
+        if (proxy.isBusy())
+            loop.exec();
+    };
+
+    const SyntheticSource rows(StreamRows + AppendedRows);
+    QStringList names;
+    for (int c = 0; c < rows.columnCount(); ++c)
+        names.append(rows.columnName(c));
+    const QSharedPointer<StreamSource> stream(new StreamSource(names));
+    const auto appendRecords = [&rows, &stream](qint64 begin, qint64 end) {
+        for (qint64 r = begin; r < end; ++r) {
+            QByteArray record;
+            for (int c = 0; c < rows.columnCount(); ++c) {
+                if (c > 0)
+                    record.append(StreamSource::FieldSeparator);
+                record.append(rows.cellText(r, c).toUtf8());
+            }
+            stream->append(std::move(record));
+        }
+    };
+    appendRecords(0, StreamRows);
+    model.setSource(stream);
+    proxy.sort(3, Qt::AscendingOrder);
+    wait();
+
+    appendRecords(StreamRows, StreamRows + AppendedRows);
+    QElapsedTimer timer;
+    timer.start();
+    model.sourceRowsAppended();
+    loop.exec();
+    const double mergeMs = timer.nsecsElapsed() / 1e6;
+    QCOMPARE(proxy.rowCount(), int(StreamRows + AppendedRows));
+
+    timer.start();
+    proxy.sort(3, Qt::AscendingOrder);
+    wait();
+    const double resortMs = timer.nsecsElapsed() / 1e6;
+    qInfo("merge %.3f ms, full resort %.3f ms", mergeMs, resortMs);
+    QTest::setBenchmarkResult(mergeMs, QTest::WalltimeMilliseconds);
+    QCOMPARE(proxy.rowCount(), int(StreamRows + AppendedRows));
+}
+
+// Types 50 of 100k candidate names one key at a time against the command
+// index. Every keystroke has to rank its matches within 5 ms, the typed
+// name has to come first, and with one letter wrong it still has to be
+// among the matches shown.
+void tst_Search::palette()
+{
+    const int Candidates = 100000;
+    const int Targets = 50;
+    const double KeystrokeBudgetMs = 5.0;
+    static const char *const Words[] = {
+        "sensor", "temperature", "pressure", "voltage", "current", "status", "fault", "load", "memory",
+        "window", "filter", "column", "export", "import", "value", "average", "maximum", "minimum",
+        "signal", "channel", "device", "station", "north", "south", "pump", "valve", "motor", "speed",
+    };
+    const int WordCount = int(sizeof(Words) / sizeof(Words[0]));
+
+    QRandomGenerator rng(23);
+    QVector<CommandIndex::Candidate> candidates(Candidates);
+    for (int i = 0; i < Candidates; ++i) {
+        QString &text = candidates[i].text;
+        const int words = 2 + rng.bounded(3);
+        for (int w = 0; w < words; ++w)
+            text += QLatin1String(Words[rng.bounded(WordCount)]) + QLatin1Char(w + 1 < words ? ' ' : '_');
+        text += QString::number(i);
+        candidates[i].kind = CommandIndex::Column;
+        candidates[i].id = i;
+    }
+
+    CommandIndex index;
+    index.setSegment(QStringLiteral("columns"), CommandIndex::buildSegment(candidates));
+
+    Timings keystrokes;
+    QElapsedTimer timer;
+    for (int t = 0; t < Targets; ++t) {
+        const CommandIndex::Candidate &target = candidates.at(rng.bounded(Candidates));
+        QVector<CommandIndex::Match> matches;
+        for (int length = 1; length <= target.text.size(); ++length) {
+            timer.start();
+            matches = index.match(target.text.left(length));
+            keystrokes.add(timer.nsecsElapsed());
+        }
+        QVERIFY(!matches.isEmpty());
+        QCOMPARE(matches.constFirst().candidate.id, target.id);
+
+        QString typo = target.text;
+        typo[typo.size() / 2] = QLatin1Char('q');
+        const QVector<CommandIndex::Match> typoMatches = index.match(typo);
+        const bool found = std::any_of(typoMatches.cbegin(), typoMatches.cend(), [&target](const CommandIndex::Match &m) {
+            return m.candidate.id == target.id;
+        });
+        QVERIFY2(found, qPrintable(QStringLiteral("%1 not found as %2").arg(target.text, typo)));
+    }
+
+    qInfo("keystroke %s", qPrintable(keystrokes.summary()));
+    const double p99 = keystrokes.quantile(0.99);
+    QTest::setBenchmarkResult(p99, QTest::WalltimeMilliseconds);
+    QVERIFY2(p99 < KeystrokeBudgetMs, "p99 keystroke over budget");
+}
+
+OFFSCREEN_TEST_MAIN(tst_Search)
+
+#include "tst_search.moc"
@@ -0,0 +1,132 @@
+#include "testsupport.h"
+
+#include "syntheticsource.h"
+
+#include <QFile>
+
+#include <algorithm>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#elif defined(Q_OS_LINUX)
+#include <unistd.h>
+#endif
+
+double Timings::quantile(double q)
+{
+    if (samples.isEmpty())
+        return 0.0;
+    std::sort(samples.begin(), samples.end());
+    return samples.at(int(q * (samples.size() - 1)));
+}
+
+double Timings::mean() const
+{
+    double sum = 0;
+    for (double s : samples)
+        sum += s;
+    return samples.isEmpty() ? 0.0 : sum / samples.size();
+}
+
+QString Timings::summary()
+{
+    return QStringLiteral("%1 samples, mean %2 ms, p50 %3 ms, p99 %4 ms, max %5 ms")
+            .arg(samples.size())
+            .arg(mean(), 0, 'f', 3)
+            .arg(quantile(0.5), 0, 'f', 3)
+            .arg(quantile(0.99), 0, 'f', 3)
+            .arg(quantile(1.0), 0, 'f', 3);
+}
+
+LoopIterations::LoopIterations()
+{
+    QObject::connect(&m_tick, &QTimer::timeout, [this] {
+        m_timings.add(m_iteration.nsecsElapsed());
+        m_iteration.restart();
+    });
+}
+
+void LoopIterations::start()
+{
+    m_iteration.start();
+    m_tick.start(0);
+}
+
+void LoopIterations::stop()
+{
+    m_tick.stop();
+}
+
+ReadingsSource::ReadingsSource(qint64 rows)
+    : m_rows(rows)
+{
+    for (int i = 0; i < 64; ++i)
+        m_sensors.append(QStringLiteral("sensor-%1").arg(i, 2, 10, QLatin1Char('0')));
+}
+
+QString ReadingsSource::columnName(int column) const
+{
+    static const char *const names[] = { "Sensor", "Reading", "Counter" };
+    return QLatin1String(names[column]);
+}
+
+QString ReadingsSource::cellText(qint64 row, int column) const
+{
+    quint64 h = quint64(row) * 0x9e3779b97f4a7c15ULL;
+    h ^= h >> 29;
+    switch (column) {
+    case 0:
+        return m_sensors.at(int(h % 64));
+    case 1:
+        return h % 100 == 0 ? QString() : QString::number(double(h % 2000000) / 1000.0 - 1000.0);
+    case 2:
+        return QString::number(row % 100000);
+    }
+    return QString();
+}
+
+QSharedPointer<DataSource> ReadingsSource::clone() const
+{
+    return QSharedPointer<DataSource>(new ReadingsSource(m_rows));
+}
+
+bool writeSyntheticCsv(const QString &fileName, qint64 rows)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+    SyntheticSource source(rows);
+    QByteArray chunk;
+    for (int c = 0; c < source.columnCount(); ++c)
+        chunk += (c ? "," : "") + source.columnName(c).toUtf8();
+    chunk += '\n';
+    for (qint64 r = 0; r < rows; ++r) {
+        for (int c = 0; c < source.columnCount(); ++c)
+            chunk += (c ? "," : "") + source.cellText(r, c).toUtf8();
+        chunk += '\n';
+        if (chunk.size() > (1 << 20)) {
+            file.write(chunk);
+            chunk.clear();
+        }
+    }
+    return file.write(chunk) == chunk.size();
+}
+
+qint64 residentBytes()
+{
+#if defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return qint64(counters.WorkingSetSize);
+    return 0;
+#elif defined(Q_OS_LINUX)
+    QFile statm(QStringLiteral("/proc/self/statm"));
+    if (!statm.open(QIODevice::ReadOnly))
+        return 0;
+    const QList<QByteArray> fields = statm.readAll().split(' ');
+    return fields.size() > 1 ? fields.at(1).toLongLong() * sysconf(_SC_PAGESIZE) : 0;
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,80 @@
+#ifndef TESTSUPPORT_H
+#define TESTSUPPORT_H
+
+#include "application.h"
+#include "datasource.h"
+
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QTimer>
+#include <QVector>
+
+// QTEST_MAIN on the offscreen platform unless another one is asked for;
+// widgets never need a real display here, and the platform has to be
+// chosen before QApplication exists. Application times events and frames
+// for EventProfiler as in the program.
+#define OFFSCREEN_TEST_MAIN(TestObject) \
+int main(int argc, char *argv[]) \
+{ \
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) \
+        qputenv("QT_QPA_PLATFORM", "offscreen"); \
+    Application app(argc, argv); \
+    TestObject test; \
+    QTEST_SET_MAIN_SOURCE_PATH \
+    return QTest::qExec(&test, argc, argv); \
+}
+
+// Samples in milliseconds.
+struct Timings
+{
+    QVector<double> samples;
+
+    void add(qint64 nsecs) { samples.append(nsecs / 1e6); }
+    double quantile(double q);
+    double mean() const;
+    // Mean, median, p99 and maximum, for the test log.
+    QString summary();
+};
+
+// Times every turn of the event loop between start() and stop().
+class LoopIterations
+{
+public:
+    LoopIterations();
+
+    void start();
+    void stop();
+    Timings &timings() { return m_timings; }
+
+private:
+    QTimer m_tick;
+    QElapsedTimer m_iteration;
+    Timings m_timings;
+};
+
+// Three cheap columns, so tens of millions of rows can be loaded into a
+// ColumnStore in reasonable time and memory: a sensor name out of 64, a
+// reading and an integer counter, about 1% of readings missing.
+class ReadingsSource : public DataSource
+{
+public:
+    explicit ReadingsSource(qint64 rows);
+
+    qint64 rowCount() const override { return m_rows; }
+    int columnCount() const override { return 3; }
+    QString columnName(int column) const override;
+    QString cellText(qint64 row, int column) const override;
+    QSharedPointer<DataSource> clone() const override;
+
+private:
+    qint64 m_rows;
+    QStringList m_sensors;
+};
+
+// SyntheticSource rows as a CSV file with a header line.
+bool writeSyntheticCsv(const QString &fileName, qint64 rows);
+
+// Resident set size of this process, or 0 where it cannot be read.
+qint64 residentBytes();
+
+#endif // TESTSUPPORT_H
@@ -0,0 +1,16 @@
+# Included by every test: the core library, QtTest and the shared fixtures.
+QT += testlib
+CONFIG += testcase
+
+include(../core.pri)
+
+INCLUDEPATH += $$PWD/shared
+
+SOURCES += \
+    $$PWD/shared/testsupport.cpp
+
+HEADERS += \
+    $$PWD/shared/testsupport.h
+
+# GetProcessMemoryInfo() for residentBytes().
+win32: LIBS += -lpsapi
@@ -0,0 +1,12 @@
+TEMPLATE = subdirs
+
+# Each test logs its measurements; "make check TESTARGS=\"-o results.csv,csv\""
+# also writes them as CSV into each test's build directory.
+SUBDIRS += \
+    columns \
+    editing \
+    files \
+    graphics \
+    responsiveness \
+    search \
+    window
@@ -0,0 +1,119 @@
+#include "datatableview.h"
+#include "lazytablemodel.h"
+#include "mainwindow.h"
+#include "syntheticsource.h"
+#include "testsupport.h"
+
+#include <QApplication>
+#include <QRandomGenerator>
+#include <QtTest>
+
+// The main window, the table and its model over generated rows.
+class tst_Window : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void mainWindow();
+    void repaint();
+    void setSource();
+    void pageMaterialize();
+    void cachedLookup();
+    void scrollTable_data();
+    void scrollTable();
+
+private:
+    static const qint64 ModelRows = 10000000;
+};
+
+void tst_Window::mainWindow()
+{
+    QBENCHMARK {
+        MainWindow *window = new MainWindow;
+        window->show();
+        QCoreApplication::processEvents();
+        delete window;
+        QCoreApplication::processEvents();
+    }
+}
+
+void tst_Window::repaint()
+{
+    MainWindow window;
+    window.resize(800, 600);
+    window.setDataSource(QSharedPointer<DataSource>(new SyntheticSource(ModelRows)));
+    window.show();
+    QVERIFY(QTest::qWaitForWindowExposed(&window));
+    QCoreApplication::processEvents();
+
+    QBENCHMARK {
+        window.centralWidget()->repaint();
+    }
+}
+
+void tst_Window::setSource()
+{
+    LazyTableModel model;
+    QBENCHMARK {
+        model.setSource(QSharedPointer<DataSource>(new SyntheticSource(ModelRows)));
+    }
+    QCOMPARE(model.rowCount(), int(ModelRows));
+}
+
+void tst_Window::pageMaterialize()
+{
+    LazyTableModel model;
+    model.setSource(QSharedPointer<DataSource>(new SyntheticSource(ModelRows)));
+    // Cold: every lookup lands on a page that has to be materialized.
+    qint64 i = 0;
+    QBENCHMARK {
+        model.data(model.index(int(i++ * 49999 % model.rowCount()), 0));
+    }
+}
+
+void tst_Window::cachedLookup()
+{
+    LazyTableModel model;
+    model.setSource(QSharedPointer<DataSource>(new SyntheticSource(ModelRows)));
+    const int columns = model.columnCount();
+    QVERIFY(model.data(model.index(0, 0)).isValid());
+
+    int i = 0;
+    QBENCHMARK {
+        model.data(model.index(i % LazyTableModel::PageRows, i % columns));
+        ++i;
+    }
+}
+
+void tst_Window::scrollTable_data()
+{
+    QTest::addColumn<qint64>("rows");
+    QTest::newRow("1M") << qint64(1000000);
+    QTest::newRow("10M") << qint64(10000000);
+}
+
+// Jumps to random rows of a shown table and paints each.
+void tst_Window::scrollTable()
+{
+    QFETCH(qint64, rows);
+
+    DataTableView view;
+    view.resize(800, 600);
+    LazyTableModel model;
+    view.setModel(&model);
+    view.show();
+    QCoreApplication::processEvents();
+    model.setSource(QSharedPointer<DataSource>(new SyntheticSource(rows)));
+    QCOMPARE(model.rowCount(), int(rows));
+
+    QRandomGenerator rng(42);
+    QBENCHMARK {
+        view.scrollTo(model.index(rng.bounded(model.rowCount()), 0), QAbstractItemView::PositionAtCenter);
+        view.viewport()->repaint();
+    }
+    QVERIFY(model.cachedPageCount() <= LazyTableModel::MaxCachedPages);
+}
+
+OFFSCREEN_TEST_MAIN(tst_Window)
+
+#include "tst_window.moc"
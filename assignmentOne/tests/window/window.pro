@@ -0,0 +1,6 @@
+TARGET = tst_window
+
+include(../tests.pri)
+
+SOURCES += \
+    tst_window.cpp
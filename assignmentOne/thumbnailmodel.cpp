@@ -0,0 +1,238 @@
+#include "thumbnailmodel.h"
+
+#include "trace.h"
+
+#include <QDir>
+#include <QImageReader>
+#include <QMutex>
+#include <QThread>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+// Shared with the workers. A result is only used if the generation it was
+// requested in is still current.
+struct ThumbnailModel::Queue
+{
+    QMutex mutex;
+    // Newest last; workers take from the back.
+    std::vector<std::pair<int, QString>> requests;
+    quint64 generation = 0;
+    int workers = 0;
+};
+
+ThumbnailModel::ThumbnailModel(QObject *parent)
+    : QAbstractListModel(parent)
+    , m_queue(new Queue)
+{
+    m_pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount()));
+    m_cache.setMaxCost(DefaultCacheBudget);
+    MemoryTracker::addReclaimer(this, MemoryTracker::Thumbnails, [this](qint64 bytes) {
+        const qint64 budget = m_cache.maxCost();
+        m_cache.setMaxCost(qMax<qint64>(0, m_cache.totalCost() - bytes));
+        m_cache.setMaxCost(budget);
+    });
+}
+
+ThumbnailModel::~ThumbnailModel()
+{
+    {
+        QMutexLocker locker(&m_queue->mutex);
+        m_queue->requests.clear();
+    }
+    m_pool.waitForDone();
+}
+
+void ThumbnailModel::setDirectory(const QString &path)
+{
+    const quint64 generation = ++m_generation;
+    {
+        QMutexLocker locker(&m_queue->mutex);
+        m_queue->requests.clear();
+        m_queue->generation = generation;
+    }
+    beginResetModel();
+    m_directory = path;
+    m_files.clear();
+    m_pending.clear();
+    m_cache.clear();
+    endResetModel();
+
+    m_pool.start([this, path, generation] {
+        TRACE_SCOPE("ThumbnailModel::listDirectory");
+        QStringList filters;
+        for (const QByteArray &format : QImageReader::supportedImageFormats())
+            filters.append(QStringLiteral("*.") + QString::fromLatin1(format));
+        const QStringList files = QDir(path).entryList(filters, QDir::Files, QDir::Name | QDir::IgnoreCase);
+        QMetaObject::invokeMethod(this, [this, generation, files] {
+            filesListed(generation, files);
+        }, Qt::QueuedConnection);
+    });
+}
+
+QString ThumbnailModel::directory() const
+{
+    return m_directory;
+}
+
+QString ThumbnailModel::filePath(int row) const
+{
+    return m_directory + QLatin1Char('/') + m_files.at(row);
+}
+
+void ThumbnailModel::setCacheBudget(qint64 bytes)
+{
+    m_cache.setMaxCost(bytes);
+}
+
+qint64 ThumbnailModel::cacheBudget() const
+{
+    return m_cache.maxCost();
+}
+
+qint64 ThumbnailModel::cachedBytes() const
+{
+    return m_cache.totalCost();
+}
+
+int ThumbnailModel::pendingCount() const
+{
+    return int(m_pending.size());
+}
+
+void ThumbnailModel::setVisibleRows(int first, int last)
+{
+    const int margin = qMax(0, last - first) + 1;
+    std::vector<int> dropped;
+    {
+        QMutexLocker locker(&m_queue->mutex);
+        auto &requests = m_queue->requests;
+        const auto far = std::remove_if(requests.begin(), requests.end(), [&](const std::pair<int, QString> &r) {
+            if (r.first >= first - margin && r.first <= last + margin)
+                return false;
+            dropped.push_back(r.first);
+            return true;
+        });
+        requests.erase(far, requests.end());
+    }
+    for (int row : dropped)
+        m_pending.remove(row);
+    if (!dropped.empty() && m_pending.isEmpty())
+        emit thumbnailsReady();
+}
+
+int ThumbnailModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : int(m_files.size());
+}
+
+QVariant ThumbnailModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_files.size())
+        return QVariant();
+    const int row = index.row();
+    switch (role) {
+    case Qt::DisplayRole:
+        return m_files.at(row);
+    case Qt::ToolTipRole:
+        return filePath(row);
+    case Qt::DecorationRole:
+        if (const Thumbnail *thumbnail = m_cache.object(row))
+            return thumbnail->pixmap.isNull() ? QVariant() : QVariant(thumbnail->pixmap);
+        request(row);
+        return QVariant();
+    default:
+        return QVariant();
+    }
+}
+
+QImage ThumbnailModel::loadThumbnail(const QString &fileName, int size)
+{
+    TRACE_SCOPE("ThumbnailModel::loadThumbnail");
+    QImageReader reader(fileName);
+    reader.setAutoTransform(true);
+    const QSize full = reader.size();
+    const bool large = full.width() > size || full.height() > size;
+    // JPEG and a few others decode straight to a fraction of their size.
+    if (large && reader.supportsOption(QImageIOHandler::ScaledSize))
+        reader.setScaledSize(full.scaled(size, size, Qt::KeepAspectRatio));
+    QImage image = reader.read();
+    if (image.isNull())
+        return image;
+    if (image.width() > size || image.height() > size)
+        image = image.scaled(size, size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    // In the format pixmaps use, so converting on the GUI thread is a copy.
+    return image.convertToFormat(image.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied
+                                                         : QImage::Format_RGB32);
+}
+
+void ThumbnailModel::request(int row) const
+{
+    if (m_pending.contains(row))
+        return;
+    m_pending.insert(row);
+    bool startWorker = false;
+    {
+        QMutexLocker locker(&m_queue->mutex);
+        m_queue->requests.emplace_back(row, filePath(row));
+        if (m_queue->workers < m_pool.maxThreadCount()) {
+            ++m_queue->workers;
+            startWorker = true;
+        }
+    }
+    if (!startWorker)
+        return;
+
+    // Requests are made from data(); the results change the model.
+    ThumbnailModel *model = const_cast<ThumbnailModel *>(this);
+    const QSharedPointer<Queue> queue = m_queue;
+    model->m_pool.start([model, queue] {
+        for (;;) {
+            int row;
+            QString fileName;
+            quint64 generation;
+            {
+                QMutexLocker locker(&queue->mutex);
+                if (queue->requests.empty()) {
+                    --queue->workers;
+                    return;
+                }
+                row = queue->requests.back().first;
+                fileName = queue->requests.back().second;
+                generation = queue->generation;
+                queue->requests.pop_back();
+            }
+            const QImage image = loadThumbnail(fileName, ThumbnailSize);
+            QMetaObject::invokeMethod(model, [model, generation, row, image] {
+                model->thumbnailReady(generation, row, image);
+            }, Qt::QueuedConnection);
+        }
+    });
+}
+
+void ThumbnailModel::filesListed(quint64 generation, const QStringList &files)
+{
+    if (generation != m_generation)
+        return;
+    beginResetModel();
+    m_files = files;
+    endResetModel();
+    emit directoryLoaded();
+}
+
+void ThumbnailModel::thumbnailReady(quint64 generation, int row, const QImage &image)
+{
+    if (generation != m_generation)
+        return;
+    m_pending.remove(row);
+    // Kept even if the row was dropped meanwhile; the work is done.
+    const qint64 bytes = qMax<qint64>(1, image.sizeInBytes());
+    m_cache.insert(row, new Thumbnail { image.isNull() ? QPixmap() : QPixmap::fromImage(image),
+                                        MemoryAllocation(MemoryTracker::Thumbnails, bytes) },
+                   bytes);
+    const QModelIndex changed = index(row);
+    emit dataChanged(changed, changed, { Qt::DecorationRole });
+    if (m_pending.isEmpty())
+        emit thumbnailsReady();
+}
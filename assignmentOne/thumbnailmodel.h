@@ -0,0 +1,83 @@
+#ifndef THUMBNAILMODEL_H
+#define THUMBNAILMODEL_H
+
+#include "memorytracker.h"
+
+#include <QAbstractListModel>
+#include <QCache>
+#include <QPixmap>
+#include <QSet>
+#include <QSharedPointer>
+#include <QStringList>
+#include <QThreadPool>
+
+// The images in a directory, with thumbnails decoded and scaled down on
+// worker threads as a view asks for them. Requests are served newest
+// first, which is whatever was just scrolled into view, and queued
+// requests for rows far from the view are dropped. Finished thumbnails are
+// kept in a cache with a byte budget of its own, which also gives way when
+// the app exceeds its memory budget; the GUI thread only turns them into
+// pixmaps.
+class ThumbnailModel : public QAbstractListModel
+{
+    Q_OBJECT
+
+public:
+    static const int ThumbnailSize = 128;
+    static const qint64 DefaultCacheBudget = qint64(64) << 20;
+
+    explicit ThumbnailModel(QObject *parent = nullptr);
+    ~ThumbnailModel() override;
+
+    // Lists the directory in the background; the model is reset when done.
+    void setDirectory(const QString &path);
+    QString directory() const;
+    QString filePath(int row) const;
+
+    void setCacheBudget(qint64 bytes);
+    qint64 cacheBudget() const;
+    qint64 cachedBytes() const;
+    // Thumbnails queued or being decoded.
+    int pendingCount() const;
+
+    // Rows the view shows. Queued requests more than a screenful away are
+    // dropped; they are made again if the rows come back into view.
+    void setVisibleRows(int first, int last);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+    // Reads fileName scaled to fit size x size, letting the decoder scale
+    // where it can. Safe on any thread; null if it cannot be read.
+    static QImage loadThumbnail(const QString &fileName, int size);
+
+signals:
+    void directoryLoaded();
+    // Nothing is queued or being decoded any more.
+    void thumbnailsReady();
+
+private:
+    struct Queue;
+
+    struct Thumbnail
+    {
+        QPixmap pixmap;
+        MemoryAllocation allocation;
+    };
+
+    void request(int row) const;
+    void filesListed(quint64 generation, const QStringList &files);
+    void thumbnailReady(quint64 generation, int row, const QImage &image);
+
+    QString m_directory;
+    QStringList m_files;
+    quint64 m_generation = 0;
+    QSharedPointer<Queue> m_queue;
+    QThreadPool m_pool;
+    // Rows queued or being decoded.
+    mutable QSet<int> m_pending;
+    // A null pixmap marks a file that could not be read.
+    mutable QCache<int, Thumbnail> m_cache;
+};
+
+#endif // THUMBNAILMODEL_H
@@ -0,0 +1,68 @@
+#include "thumbnailview.h"
+
+#include "thumbnailmodel.h"
+
+ThumbnailView::ThumbnailView(QWidget *parent)
+    : QListView(parent)
+{
+    const int size = ThumbnailModel::ThumbnailSize;
+    setViewMode(QListView::ListMode);
+    setFlow(QListView::LeftToRight);
+    setWrapping(true);
+    setResizeMode(QListView::Adjust);
+    setMovement(QListView::Static);
+    setUniformItemSizes(true);
+    setIconSize(QSize(size, size));
+    setGridSize(QSize(size + 24, size + fontMetrics().height() + 16));
+    setTextElideMode(Qt::ElideMiddle);
+    setVerticalScrollMode(QAbstractItemView::ScrollPerPixel);
+    setSelectionMode(QAbstractItemView::ExtendedSelection);
+
+    connect(this, &QListView::activated, this, [this](const QModelIndex &index) {
+        if (m_model && index.isValid())
+            emit imageActivated(m_model->filePath(index.row()));
+    });
+}
+
+ThumbnailModel *ThumbnailView::thumbnailModel() const
+{
+    return m_model;
+}
+
+void ThumbnailView::setThumbnailModel(ThumbnailModel *model)
+{
+    if (m_model)
+        disconnect(m_model, nullptr, this, nullptr);
+    m_model = model;
+    setModel(model);
+    if (m_model)
+        connect(m_model, &QAbstractItemModel::modelReset, this, &ThumbnailView::updateVisibleRows,
+                Qt::QueuedConnection);
+}
+
+void ThumbnailView::resizeEvent(QResizeEvent *event)
+{
+    QListView::resizeEvent(event);
+    updateVisibleRows();
+}
+
+void ThumbnailView::scrollContentsBy(int dx, int dy)
+{
+    QListView::scrollContentsBy(dx, dy);
+    updateVisibleRows();
+}
+
+void ThumbnailView::updateVisibleRows()
+{
+    if (!m_model || m_model->rowCount() == 0)
+        return;
+    // Cells are uniform, so the top-left one and the size of the grid
+    // give the rest.
+    const QSize cell = gridSize();
+    const QRect area = viewport()->rect();
+    const QModelIndex first = indexAt(QPoint(cell.width() / 2, 1));
+    const int columns = qMax(1, area.width() / cell.width());
+    const int rows = area.height() / cell.height() + 2;
+    const int firstRow = first.isValid() ? first.row() : 0;
+    m_model->setVisibleRows(firstRow, qMin(m_model->rowCount() - 1, firstRow + columns * rows - 1));
+}
@@ -0,0 +1,35 @@
+#ifndef THUMBNAILVIEW_H
+#define THUMBNAILVIEW_H
+
+#include <QListView>
+
+class ThumbnailModel;
+
+// Grid of a ThumbnailModel's images. Uses the list layout with wrapping
+// and uniform cells rather than icon mode, so laying out tens of thousands
+// of items is a division instead of a pass over all of them. Tells the
+// model which rows are on screen whenever that changes.
+class ThumbnailView : public QListView
+{
+    Q_OBJECT
+
+public:
+    explicit ThumbnailView(QWidget *parent = nullptr);
+
+    ThumbnailModel *thumbnailModel() const;
+    void setThumbnailModel(ThumbnailModel *model);
+
+signals:
+    void imageActivated(const QString &fileName);
+
+protected:
+    void resizeEvent(QResizeEvent *event) override;
+    void scrollContentsBy(int dx, int dy) override;
+
+private:
+    void updateVisibleRows();
+
+    ThumbnailModel *m_model = nullptr;
+};
+
+#endif // THUMBNAILVIEW_H
@@ -0,0 +1,282 @@
+#include "tiledcanvas.h"
+
+#include "trace.h"
+
+#include <QPaintEvent>
+#include <QPainter>
+#include <QThreadPool>
+
+#include <algorithm>
+
+namespace {
+
+// Tiles kept around the visible ones so short pans show finished content.
+const int PrefetchMargin = 1;
+// Further tiles rendered ahead in the direction of the last pan.
+const int PanPrefetch = 2;
+const int EvictMargin = 3;
+
+// Tiles render on threads of their own: the global pool also runs the
+// helpers of TaskEngine::parallelFor(), which can hold every thread for
+// as long as a long job lasts.
+QThreadPool *renderPool()
+{
+    static QThreadPool pool;
+    return &pool;
+}
+
+// Tile row or column holding a world coordinate; rounds toward -infinity.
+int tileIndex(int world)
+{
+    return world >= 0 ? world / TiledCanvas::TileSize : -((-world - 1) / TiledCanvas::TileSize) - 1;
+}
+
+}
+
+TiledCanvas::TiledCanvas(QWidget *parent)
+    : QWidget(parent)
+{
+    setAttribute(Qt::WA_OpaquePaintEvent);
+    MemoryTracker::addReclaimer(this, MemoryTracker::RenderTiles, [this](qint64) {
+        evictTiles(visibleTiles(0));
+    });
+}
+
+TiledCanvas::~TiledCanvas()
+{
+    // Jobs still queued return without rendering.
+    ++m_generation;
+    QMutexLocker locker(&m_runningMutex);
+    while (m_running > 0)
+        m_runningDone.wait(&m_runningMutex);
+}
+
+bool TiledCanvas::isComplete() const
+{
+    if (!m_renderer)
+        return false;
+    const QRect tiles = visibleTiles(0);
+    for (int row = tiles.top(); row <= tiles.bottom(); ++row) {
+        for (int column = tiles.left(); column <= tiles.right(); ++column) {
+            const auto it = m_tiles.constFind(keyOf(column, row));
+            if (it == m_tiles.constEnd() || it->dirty)
+                return false;
+        }
+    }
+    return true;
+}
+
+void TiledCanvas::paintOverlay(QPainter *)
+{
+}
+
+QRect TiledCanvas::canvasRect() const
+{
+    return rect();
+}
+
+QPoint TiledCanvas::worldOrigin() const
+{
+    return m_origin;
+}
+
+void TiledCanvas::setWorldOrigin(const QPoint &origin)
+{
+    if (origin == m_origin)
+        return;
+    // A jump across more than the view is not a pan.
+    const QPoint step = origin - m_origin;
+    const QSize view = canvasRect().size();
+    if (qAbs(step.x()) < view.width() && qAbs(step.y()) < view.height())
+        m_panDirection = QPoint((step.x() > 0) - (step.x() < 0), (step.y() > 0) - (step.y() < 0));
+    else
+        m_panDirection = QPoint();
+    m_origin = origin;
+    update();
+}
+
+void TiledCanvas::invalidateAll()
+{
+    ++m_generation;
+    m_tiles.clear();
+    m_inFlight.clear();
+    m_renderer = createRenderer();
+    update();
+}
+
+void TiledCanvas::invalidate(const QRect &worldRect)
+{
+    for (int row = tileIndex(worldRect.top()); row <= tileIndex(worldRect.bottom()); ++row) {
+        for (int column = tileIndex(worldRect.left()); column <= tileIndex(worldRect.right()); ++column) {
+            const quint64 key = keyOf(column, row);
+            const auto tile = m_tiles.find(key);
+            if (tile != m_tiles.end())
+                tile->dirty = true;
+            const auto job = m_inFlight.find(key);
+            if (job != m_inFlight.end())
+                *job = 0;
+        }
+    }
+    update();
+}
+
+void TiledCanvas::paintEvent(QPaintEvent *event)
+{
+    TRACE_SCOPE("TiledCanvas::paintEvent");
+    QPainter painter(this);
+    const QRect canvas = canvasRect();
+    painter.fillRect(event->rect(), palette().base());
+
+    if (m_renderer) {
+        painter.save();
+        painter.setClipRect(canvas);
+        const QRect tiles = visibleTiles(0);
+        const QPoint offset = canvas.topLeft() - m_origin;
+        for (int row = tiles.top(); row <= tiles.bottom(); ++row) {
+            for (int column = tiles.left(); column <= tiles.right(); ++column) {
+                const auto it = m_tiles.constFind(keyOf(column, row));
+                if (it != m_tiles.constEnd())
+                    painter.drawImage(offset + QPoint(column * TileSize, row * TileSize), it->image);
+            }
+        }
+        painter.restore();
+        schedule();
+    }
+
+    paintOverlay(&painter);
+}
+
+void TiledCanvas::resizeEvent(QResizeEvent *event)
+{
+    QWidget::resizeEvent(event);
+    update();
+}
+
+quint64 TiledCanvas::keyOf(int column, int row)
+{
+    return (quint64(quint32(column)) << 32) | quint32(row);
+}
+
+QRect TiledCanvas::visibleTiles(int margin) const
+{
+    const QRect world(m_origin, canvasRect().size());
+    return QRect(QPoint(tileIndex(world.left()) - margin, tileIndex(world.top()) - margin),
+                 QPoint(tileIndex(world.right()) + margin, tileIndex(world.bottom()) + margin));
+}
+
+void TiledCanvas::schedule()
+{
+    if (!m_renderer || canvasRect().isEmpty())
+        return;
+
+    // Nearest to the middle of the view first; prefetch ring and the tiles
+    // ahead of a pan last.
+    QRect wanted = visibleTiles(PrefetchMargin);
+    if (!m_panDirection.isNull())
+        wanted |= visibleTiles(0).translated(m_panDirection * (PrefetchMargin + PanPrefetch));
+    const QPointF center = QRectF(visibleTiles(0)).center();
+    QVector<QPoint> missing;
+    for (int row = wanted.top(); row <= wanted.bottom(); ++row) {
+        for (int column = wanted.left(); column <= wanted.right(); ++column) {
+            const quint64 key = keyOf(column, row);
+            const auto tile = m_tiles.constFind(key);
+            const bool current = tile != m_tiles.constEnd() && !tile->dirty;
+            const auto job = m_inFlight.constFind(key);
+            const bool pending = job != m_inFlight.constEnd() && *job != 0;
+            if (!current && !pending)
+                missing.append(QPoint(column, row));
+        }
+    }
+    std::sort(missing.begin(), missing.end(), [&center](const QPoint &a, const QPoint &b) {
+        return QLineF(center, a).length() < QLineF(center, b).length();
+    });
+
+    // Jobs of an older generation still count until they come back, so
+    // zooming repeatedly cannot pile up renders.
+    const int maxInFlight = 2 * qMax(1, renderPool()->maxThreadCount());
+    for (const QPoint &tile : qAsConst(missing)) {
+        if (m_queued >= maxInFlight)
+            break;
+        const quint64 key = keyOf(tile.x(), tile.y());
+        const quint64 ticket = m_nextTicket++;
+        m_inFlight.insert(key, ticket);
+        ++m_queued;
+
+        {
+            QMutexLocker locker(&m_runningMutex);
+            ++m_running;
+        }
+        const QRect worldRect(tile.x() * TileSize, tile.y() * TileSize, TileSize, TileSize);
+        const qreal dpr = devicePixelRatioF();
+        const QColor background = palette().color(QPalette::Base);
+        const TileRenderer renderer = m_renderer;
+        const quint64 generation = m_generation;
+        renderPool()->start([this, renderer, worldRect, dpr, background, key, generation, ticket] {
+            QImage image;
+            if (m_generation.load(std::memory_order_relaxed) == generation) {
+                TRACE_SCOPE("TiledCanvas::renderTile");
+                image = QImage(worldRect.size() * dpr, QImage::Format_ARGB32_Premultiplied);
+                image.setDevicePixelRatio(dpr);
+                image.fill(background);
+                QPainter painter(&image);
+                painter.translate(-worldRect.topLeft());
+                renderer(&painter, worldRect);
+            }
+            QMetaObject::invokeMethod(this, [this, key, generation, ticket, image] {
+                tileFinished(key, generation, ticket, image);
+            }, Qt::QueuedConnection);
+
+            QMutexLocker locker(&m_runningMutex);
+            if (--m_running == 0)
+                m_runningDone.wakeAll();
+        }, 1);
+    }
+
+    // Forget tiles that drifted far out of view.
+    const QRect keep = visibleTiles(EvictMargin);
+    if (m_tiles.size() > 2 * keep.width() * keep.height())
+        evictTiles(keep);
+}
+
+void TiledCanvas::evictTiles(const QRect &keep)
+{
+    for (auto it = m_tiles.begin(); it != m_tiles.end();) {
+        const int column = int(qint32(it.key() >> 32));
+        const int row = int(qint32(quint32(it.key())));
+        if (!keep.contains(column, row))
+            it = m_tiles.erase(it);
+        else
+            ++it;
+    }
+}
+
+void TiledCanvas::tileFinished(quint64 key, quint64 generation, quint64 ticket, const QImage &image)
+{
+    --m_queued;
+    if (generation != m_generation) {
+        // Made room for a job of the current generation.
+        schedule();
+        return;
+    }
+    const auto job = m_inFlight.find(key);
+    const bool stale = job == m_inFlight.end() || *job != ticket;
+    if (job != m_inFlight.end() && (*job == ticket || *job == 0))
+        m_inFlight.erase(job);
+
+    Tile &tile = m_tiles[key];
+    tile.image = image;
+    tile.allocation = MemoryAllocation(MemoryTracker::RenderTiles, image.sizeInBytes());
+    tile.dirty = stale;
+
+    const int column = int(qint32(key >> 32));
+    const int row = int(qint32(quint32(key)));
+    const QRect world(column * TileSize, row * TileSize, TileSize, TileSize);
+    const QRect dirty = world.translated(canvasRect().topLeft() - m_origin).intersected(canvasRect());
+    // An off-screen tile causes no paint, so the next prefetch starts here.
+    if (dirty.isEmpty())
+        schedule();
+    else
+        update(dirty);
+    if (isComplete())
+        emit tilesReady();
+}
@@ -0,0 +1,96 @@
+#ifndef TILEDCANVAS_H
+#define TILEDCANVAS_H
+
+#include "memorytracker.h"
+
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QWidget>
+
+#include <atomic>
+#include <functional>
+
+// Widget whose content is rasterized into TileSize x TileSize images on
+// worker threads. Tiles are addressed in world pixels, so scrolling only
+// renders the tiles that come into view. Finished tiles replace the
+// previous image in one step on the GUI thread; paintEvent() never
+// renders content, it only blits whatever tiles are current. While
+// panning, tiles ahead of the movement are rendered before they show.
+// Tiles count as MemoryTracker::RenderTiles; over the memory budget, all
+// but the visible ones are dropped.
+class TiledCanvas : public QWidget
+{
+    Q_OBJECT
+
+public:
+    static const int TileSize = 256;
+
+    explicit TiledCanvas(QWidget *parent = nullptr);
+    ~TiledCanvas() override;
+
+    // True once every visible tile holds current content.
+    bool isComplete() const;
+
+signals:
+    void tilesReady();
+
+protected:
+    // Draws the part of the world in worldRect; the painter is translated
+    // so world coordinates can be used directly. Runs on several worker
+    // threads at once and must only use state it captured.
+    typedef std::function<void(QPainter *painter, const QRect &worldRect)> TileRenderer;
+
+    // Called on the GUI thread after invalidateAll() to snapshot the scene.
+    virtual TileRenderer createRenderer() const = 0;
+    // Drawn on the GUI thread over the tiles; keep it cheap.
+    virtual void paintOverlay(QPainter *painter);
+    // Part of the widget covered by tiles; defaults to the whole widget.
+    virtual QRect canvasRect() const;
+
+    QPoint worldOrigin() const;
+    // World pixel shown at the top-left of canvasRect().
+    void setWorldOrigin(const QPoint &origin);
+    // Drops every tile; used when the world itself changes (zoom, resize).
+    void invalidateAll();
+    // Re-renders tiles over worldRect, showing the old images meanwhile.
+    void invalidate(const QRect &worldRect);
+
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+
+private:
+    struct Tile
+    {
+        QImage image;
+        MemoryAllocation allocation;
+        bool dirty = false;
+    };
+
+    static quint64 keyOf(int column, int row);
+    QRect visibleTiles(int margin) const;
+    void schedule();
+    // Forgets the tiles outside keep.
+    void evictTiles(const QRect &keep);
+    void tileFinished(quint64 key, quint64 generation, quint64 ticket, const QImage &image);
+
+    TileRenderer m_renderer;
+    // Read by queued jobs, which skip rendering for an older generation.
+    std::atomic<quint64> m_generation { 0 };
+    quint64 m_nextTicket = 1;
+    QPoint m_origin;
+    // Sign of the last pan step on each axis.
+    QPoint m_panDirection;
+    QHash<quint64, Tile> m_tiles;
+    // Tile key -> ticket of the job rendering it; 0 once the job is stale.
+    QHash<quint64, quint64> m_inFlight;
+    // Jobs whose result has not come back yet, older generations included.
+    int m_queued = 0;
+
+    QMutex m_runningMutex;
+    QWaitCondition m_runningDone;
+    int m_running = 0;
+};
+
+#endif // TILEDCANVAS_H
@@ -0,0 +1,154 @@
+#include "trace.h"
+
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QThread>
+#include <QVector>
+
+#include <chrono>
+#include <memory>
+
+std::atomic<bool> Trace::s_enabled { false };
+
+namespace {
+
+struct Span
+{
+    const char *name;
+    quint64 startNs;
+    quint64 endNs;
+};
+
+struct ThreadRing
+{
+    int tid = 0;
+    QString threadName;
+    std::unique_ptr<Span[]> spans { new Span[Trace::EventsPerThread] };
+    std::atomic<quint64> written { 0 };
+};
+
+QMutex registryMutex;
+QVector<ThreadRing *> rings;
+// QByteArray keeps its buffer when the hash rehashes, so pointers into
+// the values stay valid.
+QHash<QString, QByteArray> internedNames;
+thread_local ThreadRing *localRing = nullptr;
+
+const quint64 processStartNs = quint64(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                               std::chrono::steady_clock::now().time_since_epoch()).count());
+
+ThreadRing *ring()
+{
+    if (!localRing) {
+        localRing = new ThreadRing;
+        QThread *thread = QThread::currentThread();
+        QMutexLocker locker(&registryMutex);
+        localRing->tid = rings.size() + 1;
+        localRing->threadName = !thread->objectName().isEmpty()
+                ? thread->objectName()
+                : localRing->tid == 1 ? QStringLiteral("GUI") : QStringLiteral("Worker %1").arg(localRing->tid - 1);
+        rings.append(localRing);
+    }
+    return localRing;
+}
+
+void appendEscaped(QByteArray *out, const QByteArray &text)
+{
+    for (char c : text) {
+        if (c == '"' || c == '\\')
+            out->append('\\');
+        if (uchar(c) < 0x20)
+            out->append(' ');
+        else
+            out->append(c);
+    }
+}
+
+}
+
+void Trace::setEnabled(bool enabled)
+{
+    if (enabled)
+        ring(); // the thread that turns tracing on is listed first
+    s_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+quint64 Trace::now()
+{
+    return quint64(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::steady_clock::now().time_since_epoch()).count()) - processStartNs;
+}
+
+void Trace::record(const char *name, quint64 startNs, quint64 endNs)
+{
+    ThreadRing *r = ring();
+    const quint64 index = r->written.load(std::memory_order_relaxed);
+    Span &span = r->spans[index % EventsPerThread];
+    span.name = name;
+    span.startNs = startNs;
+    span.endNs = endNs;
+    r->written.store(index + 1, std::memory_order_release);
+}
+
+const char *Trace::intern(const QString &name)
+{
+    QMutexLocker locker(&registryMutex);
+    auto it = internedNames.find(name);
+    if (it == internedNames.end())
+        it = internedNames.insert(name, name.toUtf8());
+    return it->constData();
+}
+
+bool Trace::writeChromeJson(const QString &fileName, QString *errorString)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        if (errorString)
+            *errorString = file.errorString();
+        return false;
+    }
+
+    QByteArray out;
+    out.reserve(1 << 20);
+    out.append("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    const auto separator = [&out, &first] {
+        if (!first)
+            out.append(",\n");
+        first = false;
+    };
+
+    QMutexLocker locker(&registryMutex);
+    for (const ThreadRing *r : qAsConst(rings)) {
+        separator();
+        out.append("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":");
+        out.append(QByteArray::number(r->tid));
+        out.append(",\"args\":{\"name\":\"");
+        appendEscaped(&out, r->threadName.toUtf8());
+        out.append("\"}}");
+
+        const quint64 written = r->written.load(std::memory_order_acquire);
+        const quint64 begin = written > quint64(EventsPerThread) ? written - EventsPerThread : 0;
+        for (quint64 i = begin; i < written; ++i) {
+            const Span &span = r->spans[i % EventsPerThread];
+            separator();
+            out.append("{\"name\":\"");
+            appendEscaped(&out, QByteArray(span.name));
+            out.append("\",\"ph\":\"X\",\"pid\":1,\"tid\":");
+            out.append(QByteArray::number(r->tid));
+            out.append(",\"ts\":");
+            out.append(QByteArray::number(span.startNs / 1e3, 'f', 3));
+            out.append(",\"dur\":");
+            out.append(QByteArray::number((span.endNs - span.startNs) / 1e3, 'f', 3));
+            out.append('}');
+            if (out.size() > (1 << 20)) {
+                file.write(out);
+                out.clear();
+            }
+        }
+    }
+    out.append("\n]}\n");
+    file.write(out);
+    return true;
+}
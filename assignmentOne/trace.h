@@ -0,0 +1,64 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QString>
+
+#include <atomic>
+
+// Scoped spans recorded into per-thread ring buffers and exported in the
+// Chrome trace-event format (chrome://tracing, ui.perfetto.dev). While
+// tracing is off a TRACE_SCOPE costs one relaxed atomic load. Define
+// NO_TRACING to compile the macros out entirely.
+class Trace
+{
+public:
+    static const int EventsPerThread = 1 << 16;
+
+    static bool isEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+    static void setEnabled(bool enabled);
+
+    static quint64 now();
+    static void record(const char *name, quint64 startNs, quint64 endNs);
+    // Returns a pointer that stays valid for the life of the process, for
+    // spans named at run time (task names and the like).
+    static const char *intern(const QString &name);
+
+    // Call once worker threads are idle; spans still being written may be
+    // garbled otherwise.
+    static bool writeChromeJson(const QString &fileName, QString *errorString = nullptr);
+
+private:
+    static std::atomic<bool> s_enabled;
+};
+
+class TraceScope
+{
+public:
+    explicit TraceScope(const char *name)
+        : m_name(name && Trace::isEnabled() ? name : nullptr)
+        , m_start(m_name ? Trace::now() : 0)
+    {
+    }
+
+    ~TraceScope()
+    {
+        if (m_name)
+            Trace::record(m_name, m_start, Trace::now());
+    }
+
+private:
+    Q_DISABLE_COPY(TraceScope)
+
+    const char *m_name;
+    quint64 m_start;
+};
+
+#ifdef NO_TRACING
+#  define TRACE_SCOPE(name) do { } while (false)
+#else
+#  define TRACE_CONCAT_INNER(a, b) a##b
+#  define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#  define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#endif
+
+#endif // TRACE_H